@@ -139,11 +139,15 @@ extern "C" {
  *   2.1.5:  new freelist; version is 3
  *   2.1.9:  changes in btree node format; version is 4
  *   2.1.13: changes in btree node format; version is 5
+ *   2.2.0:  CRC32C checksums (@ref UPS_PARAM_CHECKSUM), AES-XTS
+ *           encryption and tiered storage (@ref UPS_PARAM_COLD_STORAGE_PATH);
+ *           version is 6. Files without these features are still created
+ *           as version 5 and remain compatible
  */
 #define UPS_VERSION_MAJ     2
 #define UPS_VERSION_MIN     2
 #define UPS_VERSION_REV     0
-#define UPS_FILE_VERSION    5
+#define UPS_FILE_VERSION    6
 
 /**
  * The upscaledb Database structure
@@ -444,6 +448,20 @@ typedef struct {
  */
 typedef void UPS_CALLCONV (*ups_error_handler_fun)(int level, const char *message);
 
+/**
+ * A typedef for a callback which reports the progress of the recovery
+ *
+ * The callback is set with @ref UPS_PARAM_RECOVERY_PROGRESS_CALLBACK
+ * in @ref ups_env_open. It is called when the recovery starts, after
+ * every few hundred replayed operations and when the replay is complete.
+ *
+ * @param context The value of @ref UPS_PARAM_RECOVERY_PROGRESS_CONTEXT
+ * @param replayed The number of operations which were already replayed
+ * @param total The total number of operations which are replayed
+ */
+typedef void UPS_CALLCONV (*ups_recovery_progress_fun)(void *context,
+                uint64_t replayed, uint64_t total);
+
 /** A debug message */
 #define UPS_DEBUG_LEVEL_DEBUG     0
 
@@ -492,6 +510,20 @@ UPS_EXPORT void UPS_CALLCONV
 ups_get_version(uint32_t *major, uint32_t *minor,
             uint32_t *revision);
 
+/**
+ * Sets a process-wide memory budget for the caches of all Environments
+ *
+ * If the pages cached by all Environments of this process exceed the
+ * budget then each Environment evicts pages in proportion to its share of
+ * the cached memory, even if its own cache is not yet full. Environments
+ * created with @ref UPS_CACHE_UNLIMITED and In-Memory Environments are
+ * counted, but never evict pages.
+ *
+ * @param size The budget in bytes, or 0 to disable the budget (the default)
+ */
+UPS_EXPORT void UPS_CALLCONV
+ups_set_cache_budget(uint64_t size);
+
 /**
  * @}
  */
@@ -537,7 +569,11 @@ ups_get_version(uint32_t *major, uint32_t *minor,
  * persisted.
  *
  * Upscaledb can transparently encrypt the generated file using
- * 128bit AES in CBC mode. The transactional journal is not encrypted.
+ * 128bit AES in XTS mode; every page is encrypted separately, with its
+ * address as the tweak. Encrypted files have file version 6. Files which
+ * were encrypted with AES in CBC mode (by older releases) can still be
+ * opened; their pages are read and written in CBC mode. The
+ * transactional journal is not encrypted.
  * Encryption can be enabled by specifying @ref UPS_PARAM_ENCRYPTION_KEY
  * (see below). The identical key has to be provided in @ref ups_env_open
  * as well. Ignored for remote Environments.
@@ -611,6 +647,93 @@ ups_get_version(uint32_t *major, uint32_t *minor,
  *    <li>@ref UPS_PARAM_ENCRYPTION_KEY</li> The 16 byte long AES
  *      encryption key; enables AES encryption for the Environment file. Not
  *      allowed for In-Memory Environments. Ignored for remote Environments.
+ *    <li>@ref UPS_PARAM_WORKER_THREADS</li> The number of background
+ *      threads which flush dirty pages to disk. Default is 1; 0 is not
+ *      allowed. Ignored for remote Environments.
+ *    <li>@ref UPS_PARAM_CACHE_POLICY</li> The page replacement policy
+ *      of the cache; either @ref UPS_CACHE_POLICY_LRU (the default) or
+ *      @ref UPS_CACHE_POLICY_2Q, which protects frequently used pages
+ *      from being evicted by long scans. Ignored for remote Environments.
+ *    <li>@ref UPS_PARAM_HUGE_PAGES</li> If set to 1 then the page buffers
+ *      are allocated from memory which is backed by huge pages (if the
+ *      operating system supports this). Default is 0. Ignored for
+ *      in-memory and remote Environments.
+ *    <li>@ref UPS_PARAM_IO_QUEUE_DEPTH</li> If set to a value > 1 then
+ *      pages are read and written in batches with io_uring, with up to
+ *      this many requests in flight (Linux only; if io_uring is not
+ *      available then synchronous I/O is used). Default is 0 (synchronous
+ *      I/O). Ignored for in-memory and remote Environments.
+ *    <li>@ref UPS_PARAM_DIRECT_IO</li> If set to 1 then the database file
+ *      is accessed with direct I/O (O_DIRECT), bypassing the page cache of
+ *      the operating system; implies @ref UPS_DISABLE_MMAP. Requires a
+ *      page size which is a multiple of 4 KB. Not available on Win32
+ *      and for in-memory Environments. Default is 0.
+ *    <li>@ref UPS_PARAM_READ_AHEAD</li> The number of btree leaf pages
+ *      which are loaded asynchronously in advance if a cursor scans the
+ *      database sequentially. Set to 0 to disable the read-ahead.
+ *      Default is 8. Ignored for in-memory and remote Environments.
+ *    <li>@ref UPS_PARAM_CHECKSUM</li> The algorithm of the checksums
+ *      which are stored if @ref UPS_ENABLE_CRC32 is set; either
+ *      @ref UPS_CHECKSUM_CRC32C (the default) or @ref UPS_CHECKSUM_MURMUR3.
+ *      The algorithm is persisted. As soon as CRC32C checksums are
+ *      stored, the file has file version 6 and cannot be opened by older
+ *      releases.
+ *    <li>@ref UPS_PARAM_COLD_STORAGE_PATH</li> Enables tiered storage:
+ *      pages which were not accessed for a while are moved from the
+ *      database file to this (secondary) file, and back to the database
+ *      file when they are read frequently. The file name plus ".map"
+ *      stores the location of the moved pages. The database file should
+ *      be on fast storage, the secondary file can be on slow storage.
+ *      The pages are moved in the background; implies
+ *      @ref UPS_DISABLE_MMAP. The path has to be specified again when
+ *      the Environment is opened. Tiered Environments have file version
+ *      6. Not available for in-memory Environments.
+ *    <li>@ref UPS_PARAM_FAST_TIER_SIZE</li> With tiered storage: the
+ *      capacity of the database file (in bytes). Cold pages are only
+ *      moved to the secondary file if the database file stores more data
+ *      than this. Default is 0 (all cold pages are moved).
+ *    <li>@ref UPS_PARAM_FILE_GROWTH_BYTES</li> The database file grows
+ *      in steps of this size (in bytes; rounded to a multiple of the page
+ *      size). The storage is reserved with fallocate(), and the next step
+ *      is reserved in the background before it is required. The unused
+ *      space is released when the Environment is closed. Default is 0
+ *      (the file grows in proportion to its size).
+ *    <li>@ref UPS_PARAM_COMPACTION_RATE</li> Enables the online
+ *      compaction: a background thread moves btree nodes from the end of
+ *      the file to free pages, and truncates the file. The value is the
+ *      maximum number of pages which are moved per second. The compaction
+ *      locks the Environment exclusively (pending operations wait till it
+ *      finished a round), and therefore must not be combined with
+ *      @ref UPS_DONT_LOCK. Known limitation: blob pages (i.e. large
+ *      records, extended keys and duplicate tables) are never moved; the
+ *      file only shrinks down to the last blob page. Default is 0
+ *      (disabled).
+ *    <li>@ref UPS_PARAM_JOURNAL_GROUP_COMMIT_WINDOW</li> With
+ *      @ref UPS_ENABLE_FSYNC, the journal is written by a background
+ *      thread, and the commits of concurrent Transactions are written
+ *      and synced together (group commit). The thread waits up to this
+ *      many microseconds for further commits before it writes them.
+ *      Default is 0 (only the commits which arrive during the previous
+ *      sync are grouped).
+ *    <li>@ref UPS_PARAM_JOURNAL_GROUP_COMMIT_BYTES</li> Ends the group
+ *      commit window as soon as this many bytes are waiting to be written.
+ *      Default is 0 (no limit).
+ *    <li>@ref UPS_PARAM_JOURNAL_SEGMENTS</li> The number of segment files
+ *      of the journal (between 2 and 16). A segment is recycled as soon
+ *      as all of its Transactions were flushed to the database file.
+ *      Default is 2.
+ *    <li>@ref UPS_PARAM_JOURNAL_SEGMENT_SIZE</li> The size of a journal
+ *      segment, in bytes. The storage of each segment is preallocated, and
+ *      the journal switches to the next segment when the current segment
+ *      exceeds this size. Default is 0 (segments are only switched after
+ *      @ref UPS_PARAM_JOURNAL_SWITCH_THRESHOLD Transactions).
+ *    <li>@ref UPS_PARAM_JOURNAL_CHECKPOINT_INTERVAL</li> The interval (in
+ *      milliseconds) of the journal checkpoints. A checkpoint flushes the
+ *      committed Transactions in the background and logs the lsn from which
+ *      the recovery starts. Default is 0 (no timed checkpoints).
+ *    <li>@ref UPS_PARAM_JOURNAL_CHECKPOINT_BYTES</li> Runs a checkpoint
+ *      whenever this many bytes were appended to the journal since the
+ *      previous checkpoint. Default is 0.
  *    </ul>
  *
  * @return @ref UPS_SUCCESS upon success
@@ -695,7 +818,9 @@ ups_env_create(ups_env_t **env, const char *filename,
  *     <li>@ref UPS_DISABLE_RECOVERY</li> Disables logging/recovery for this
  *      Environment.
  *     <li>@ref UPS_AUTO_RECOVERY </li> Automatically recover the Environment,
- *      if necessary.
+ *      if necessary. The recovery is partitioned by Database: the journal
+ *      entries of the Databases are decoded and sorted in parallel, then
+ *      they are replayed in key order, one Database after the other.
  *     <li>@ref UPS_ENABLE_CRC32</li> Stores (and verifies) CRC32
  *      checksums.
  *    </ul>
@@ -722,6 +847,65 @@ ups_env_create(ups_env_t **env, const char *filename,
  *    <li>@ref UPS_PARAM_ENCRYPTION_KEY</li> The 16 byte long AES
  *      encryption key; enables AES encryption for the Environment file. Not
  *      allowed for In-Memory Environments. Ignored for remote Environments.
+ *    <li>@ref UPS_PARAM_WORKER_THREADS</li> The number of background
+ *      threads which flush dirty pages to disk. Default is 1; 0 is not
+ *      allowed. Ignored for remote Environments.
+ *    <li>@ref UPS_PARAM_CACHE_POLICY</li> The page replacement policy
+ *      of the cache; either @ref UPS_CACHE_POLICY_LRU (the default) or
+ *      @ref UPS_CACHE_POLICY_2Q, which protects frequently used pages
+ *      from being evicted by long scans. Ignored for remote Environments.
+ *    <li>@ref UPS_PARAM_HUGE_PAGES</li> If set to 1 then the page buffers
+ *      are allocated from memory which is backed by huge pages (if the
+ *      operating system supports this). Default is 0. Ignored for
+ *      in-memory and remote Environments.
+ *    <li>@ref UPS_PARAM_IO_QUEUE_DEPTH</li> If set to a value > 1 then
+ *      pages are read and written in batches with io_uring, with up to
+ *      this many requests in flight (Linux only; if io_uring is not
+ *      available then synchronous I/O is used). Default is 0 (synchronous
+ *      I/O). Ignored for in-memory and remote Environments.
+ *    <li>@ref UPS_PARAM_DIRECT_IO</li> If set to 1 then the database file
+ *      is accessed with direct I/O (O_DIRECT), bypassing the page cache of
+ *      the operating system; implies @ref UPS_DISABLE_MMAP. Requires a
+ *      page size which is a multiple of 4 KB. Not available on Win32
+ *      and for in-memory Environments. Default is 0.
+ *    <li>@ref UPS_PARAM_READ_AHEAD</li> The number of btree leaf pages
+ *      which are loaded asynchronously in advance if a cursor scans the
+ *      database sequentially. Set to 0 to disable the read-ahead.
+ *      Default is 8. Ignored for in-memory and remote Environments.
+ *    <li>@ref UPS_PARAM_COLD_STORAGE_PATH</li> The secondary file for
+ *      tiered storage; required if the Environment was created with
+ *      this parameter.
+ *    <li>@ref UPS_PARAM_FAST_TIER_SIZE</li> With tiered storage: the
+ *      capacity of the database file (in bytes). Default is 0 (all cold
+ *      pages are moved to the secondary file).
+ *    <li>@ref UPS_PARAM_FILE_GROWTH_BYTES</li> The step size (in bytes)
+ *      by which the database file grows; see @ref ups_env_create.
+ *      Default is 0 (the file grows in proportion to its size).
+ *    <li>@ref UPS_PARAM_COMPACTION_RATE</li> The maximum number of pages
+ *      per second which are moved by the online compaction; see
+ *      @ref ups_env_create. Default is 0 (disabled).
+ *    <li>@ref UPS_PARAM_JOURNAL_GROUP_COMMIT_WINDOW</li> The time (in
+ *      microseconds) which the journal waits for further commits; see
+ *      @ref ups_env_create. Default is 0.
+ *    <li>@ref UPS_PARAM_JOURNAL_GROUP_COMMIT_BYTES</li> Ends the group
+ *      commit window when this many bytes are waiting. Default is 0
+ *      (no limit).
+ *    <li>@ref UPS_PARAM_JOURNAL_SEGMENTS</li> The number of segment files
+ *      of the journal; see @ref ups_env_create. Existing segments are
+ *      always used. Default is 2.
+ *    <li>@ref UPS_PARAM_JOURNAL_SEGMENT_SIZE</li> The preallocated size of
+ *      a journal segment; see @ref ups_env_create. Default is 0.
+ *    <li>@ref UPS_PARAM_JOURNAL_CHECKPOINT_INTERVAL</li> The interval (in
+ *      milliseconds) of the journal checkpoints; see @ref ups_env_create.
+ *      Default is 0.
+ *    <li>@ref UPS_PARAM_JOURNAL_CHECKPOINT_BYTES</li> Runs a checkpoint
+ *      after this many journal bytes; see @ref ups_env_create.
+ *      Default is 0.
+ *    <li>@ref UPS_PARAM_RECOVERY_PROGRESS_CALLBACK</li> A function of type
+ *      @ref ups_recovery_progress_fun which reports the progress of
+ *      the recovery (with @ref UPS_AUTO_RECOVERY). Default is 0.
+ *    <li>@ref UPS_PARAM_RECOVERY_PROGRESS_CONTEXT</li> A pointer which is
+ *      passed to the recovery progress callback. Default is 0.
  *    </ul>
  *
  * @return @ref UPS_SUCCESS upon success.
@@ -765,6 +949,42 @@ ups_env_open(ups_env_t **env, const char *filename,
  *    <li>@ref UPS_PARAM_JOURNAL_COMPRESSION</li> Returns the
  *        selected algorithm for journal compression, or 0 if compression
  *        is disabled
+ *    <li>@ref UPS_PARAM_WORKER_THREADS</li> Returns the number of
+ *        background threads
+ *    <li>@ref UPS_PARAM_CACHE_POLICY</li> Returns the page replacement
+ *        policy of the cache
+ *    <li>@ref UPS_PARAM_HUGE_PAGES</li> Returns 1 if the page buffers
+ *        are backed by huge pages, otherwise 0
+ *    <li>@ref UPS_PARAM_IO_QUEUE_DEPTH</li> Returns the queue depth
+ *        of the io_uring backend, or 0 if synchronous I/O is used
+ *    <li>@ref UPS_PARAM_DIRECT_IO</li> Returns 1 if direct I/O is
+ *        enabled, otherwise 0
+ *    <li>@ref UPS_PARAM_READ_AHEAD</li> Returns the number of leaf pages
+ *        which are loaded in advance during sequential scans
+ *    <li>@ref UPS_PARAM_CHECKSUM</li> Returns the algorithm of the
+ *        page checksums (@ref UPS_CHECKSUM_CRC32C or
+ *        @ref UPS_CHECKSUM_MURMUR3)
+ *    <li>@ref UPS_PARAM_COLD_STORAGE_PATH</li> Returns the path of the
+ *        secondary file for tiered storage (a const char * pointer casted
+ *        to a uint64_t variable), or 0 if tiered storage is disabled
+ *    <li>@ref UPS_PARAM_FAST_TIER_SIZE</li> Returns the capacity of the
+ *        database file with tiered storage
+ *    <li>@ref UPS_PARAM_FILE_GROWTH_BYTES</li> Returns the step size by
+ *        which the database file grows, or 0
+ *    <li>@ref UPS_PARAM_COMPACTION_RATE</li> Returns the maximum number
+ *        of pages per second which are moved by the online compaction, or 0
+ *    <li>@ref UPS_PARAM_JOURNAL_GROUP_COMMIT_WINDOW</li> Returns the group
+ *        commit window of the journal (in microseconds)
+ *    <li>@ref UPS_PARAM_JOURNAL_GROUP_COMMIT_BYTES</li> Returns the number
+ *        of bytes which ends the group commit window, or 0
+ *    <li>@ref UPS_PARAM_JOURNAL_SEGMENTS</li> Returns the number of
+ *        segment files of the journal
+ *    <li>@ref UPS_PARAM_JOURNAL_SEGMENT_SIZE</li> Returns the size of a
+ *        journal segment, or 0
+ *    <li>@ref UPS_PARAM_JOURNAL_CHECKPOINT_INTERVAL</li> Returns the
+ *        interval of the journal checkpoints (in milliseconds), or 0
+ *    <li>@ref UPS_PARAM_JOURNAL_CHECKPOINT_BYTES</li> Returns the number
+ *        of journal bytes between two checkpoints, or 0
  *    </ul>
  *
  * @param env A valid Environment handle
@@ -777,6 +997,28 @@ ups_env_open(ups_env_t **env, const char *filename,
 UPS_EXPORT ups_status_t UPS_CALLCONV
 ups_env_get_parameters(ups_env_t *env, ups_parameter_t *param);
 
+/**
+ * Changes Environment settings at runtime
+ *
+ * The following parameters are supported:
+ *    <ul>
+ *    <li>UPS_PARAM_CACHE_SIZE</li> Resizes the cache. If the cache
+ *        shrinks then pages are evicted incrementally during the next
+ *        operations. Not allowed for In-Memory Environments or if the
+ *        Environment was created with @ref UPS_CACHE_UNLIMITED.
+ *    </ul>
+ *
+ * @param env A valid Environment handle
+ * @param param An array of ups_parameter_t structures
+ *
+ * @return @ref UPS_SUCCESS upon success
+ * @return @ref UPS_INV_PARAMETER if the @a env pointer is NULL,
+ *        @a param is NULL or contains an unsupported parameter
+ * @return @ref UPS_NOT_IMPLEMENTED if @a env is a remote Environment
+ */
+UPS_EXPORT ups_status_t UPS_CALLCONV
+ups_env_set_parameters(ups_env_t *env, const ups_parameter_t *param);
+
 /**
  * Creates a new Database in a Database Environment
  *
@@ -1755,12 +1997,103 @@ ups_db_get_parameters(ups_db_t *db, ups_parameter_t *param);
 /** Parameter name for @ref ups_env_create_db; sets the record type */
 #define UPS_PARAM_RECORD_TYPE           0x00000112
 
+/** Parameter name for @ref ups_env_create, @ref ups_env_open; sets the
+ * number of worker threads which flush pages in the background */
+#define UPS_PARAM_WORKER_THREADS        0x00000113
+
+/** Parameter name for @ref ups_env_create, @ref ups_env_open; sets the
+ * page replacement policy of the cache */
+#define UPS_PARAM_CACHE_POLICY          0x00000114
+
+/** Parameter name for @ref ups_env_create, @ref ups_env_open; backs the
+ * page buffers with huge pages */
+#define UPS_PARAM_HUGE_PAGES            0x00000115
+
+/** Parameter name for @ref ups_env_create, @ref ups_env_open; sets the
+ * queue depth of the io_uring backend */
+#define UPS_PARAM_IO_QUEUE_DEPTH        0x00000116
+
+/** Parameter name for @ref ups_env_create, @ref ups_env_open; enables
+ * direct I/O */
+#define UPS_PARAM_DIRECT_IO             0x00000117
+
+/** Parameter name for @ref ups_env_create, @ref ups_env_open; sets the
+ * number of leaf pages which are loaded in advance */
+#define UPS_PARAM_READ_AHEAD            0x00000118
+
+/** Parameter name for @ref ups_env_create; selects the algorithm of the
+ * page checksums */
+#define UPS_PARAM_CHECKSUM              0x00000119
+
+/** Parameter name for @ref ups_env_create, @ref ups_env_open; enables
+ * tiered storage with a secondary file for cold pages */
+#define UPS_PARAM_COLD_STORAGE_PATH     0x0000011A
+
+/** Parameter name for @ref ups_env_create, @ref ups_env_open; sets the
+ * capacity of the database file with tiered storage */
+#define UPS_PARAM_FAST_TIER_SIZE        0x0000011B
+
+/** Parameter name for @ref ups_env_create, @ref ups_env_open; sets the
+ * step size by which the database file grows */
+#define UPS_PARAM_FILE_GROWTH_BYTES     0x0000011C
+
+/** Parameter name for @ref ups_env_create, @ref ups_env_open; enables
+ * the online compaction and limits the pages which are moved per second */
+#define UPS_PARAM_COMPACTION_RATE       0x0000011D
+
+/** Parameter name for @ref ups_env_create, @ref ups_env_open; sets the
+ * time (in microseconds) which the journal waits for further commits
+ * before it writes and syncs them together */
+#define UPS_PARAM_JOURNAL_GROUP_COMMIT_WINDOW 0x0000011E
+
+/** Parameter name for @ref ups_env_create, @ref ups_env_open; ends the
+ * group commit window as soon as this many bytes are waiting */
+#define UPS_PARAM_JOURNAL_GROUP_COMMIT_BYTES 0x0000011F
+
+/** Parameter name for @ref ups_env_create, @ref ups_env_open; sets the
+ * number of segment files of the journal */
+#define UPS_PARAM_JOURNAL_SEGMENTS          0x00000120
+
+/** Parameter name for @ref ups_env_create, @ref ups_env_open; sets the
+ * preallocated size of a journal segment */
+#define UPS_PARAM_JOURNAL_SEGMENT_SIZE      0x00000121
+
+/** Parameter name for @ref ups_env_open; sets a callback of type
+ * @ref ups_recovery_progress_fun which reports the progress of the
+ * recovery */
+#define UPS_PARAM_RECOVERY_PROGRESS_CALLBACK 0x00000122
+
+/** Parameter name for @ref ups_env_open; sets the context pointer of the
+ * recovery progress callback */
+#define UPS_PARAM_RECOVERY_PROGRESS_CONTEXT 0x00000123
+
+/** Parameter name for @ref ups_env_create, @ref ups_env_open; sets the
+ * interval (in milliseconds) of the journal checkpoints */
+#define UPS_PARAM_JOURNAL_CHECKPOINT_INTERVAL 0x00000124
+
+/** Parameter name for @ref ups_env_create, @ref ups_env_open; runs a
+ * journal checkpoint after this many bytes were logged */
+#define UPS_PARAM_JOURNAL_CHECKPOINT_BYTES  0x00000125
+
 /** Value for @ref UPS_PARAM_POSIX_FADVISE */
 #define UPS_POSIX_FADVICE_NORMAL                 0
 
 /** Value for @ref UPS_PARAM_POSIX_FADVISE */
 #define UPS_POSIX_FADVICE_RANDOM                 1
 
+/** Value for @ref UPS_PARAM_CACHE_POLICY: least recently used (default) */
+#define UPS_CACHE_POLICY_LRU                     0
+
+/** Value for @ref UPS_PARAM_CACHE_POLICY: scan-resistant 2Q */
+#define UPS_CACHE_POLICY_2Q                      1
+
+/** Value for @ref UPS_PARAM_CHECKSUM: MurmurHash3 (file version 5) */
+#define UPS_CHECKSUM_MURMUR3                     0
+
+/** Value for @ref UPS_PARAM_CHECKSUM: CRC32C, calculated in hardware
+ * if supported by the CPU (default) */
+#define UPS_CHECKSUM_CRC32C                      1
+
 /** Value for unlimited record sizes */
 #define UPS_RECORD_SIZE_UNLIMITED       ((uint32_t)-1)
 
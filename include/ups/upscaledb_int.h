@@ -207,7 +207,10 @@ typedef struct btree_metrics_t {
  * Metrics marked "global" are stored globally and shared between multiple
  * Environments.
  */
-#define UPS_METRICS_VERSION         9
+#define UPS_METRICS_VERSION         18
+
+/* the maximum number of cache shards reported in ups_env_metrics_t */
+#define UPS_MAX_CACHE_SHARDS        16
 
 typedef struct ups_env_metrics_t {
   /* the version indicator - must be UPS_METRICS_VERSION */
@@ -308,6 +311,102 @@ typedef struct ups_env_metrics_t {
   // PRO: set to true if AVX is enabled
   ups_bool_t is_avx_enabled;
 
+  /* number of background threads */
+  uint32_t worker_threads;
+
+  /* number of pending work items of the background threads */
+  uint64_t worker_queue_depth;
+
+  /* maximum number of pending work items of the background threads */
+  uint64_t worker_max_queue_depth;
+
+  /* number of cache shards */
+  uint32_t cache_shards;
+
+  /* number of successful cache hits per shard */
+  uint64_t cache_shard_hits[UPS_MAX_CACHE_SHARDS];
+
+  /* number of cache misses per shard */
+  uint64_t cache_shard_misses[UPS_MAX_CACHE_SHARDS];
+
+  /* number of cache hits for index pages */
+  uint64_t cache_hits_index;
+
+  /* number of index pages fetched from disk */
+  uint64_t cache_misses_index;
+
+  /* number of cache hits for blob pages */
+  uint64_t cache_hits_blob;
+
+  /* number of blob pages fetched from disk */
+  uint64_t cache_misses_blob;
+
+  /* number of cache hits for page-manager pages */
+  uint64_t cache_hits_page_manager;
+
+  /* number of page-manager pages fetched from disk */
+  uint64_t cache_misses_page_manager;
+
+  /* number of clean pages which were evicted from the cache */
+  uint64_t cache_evictions_clean;
+
+  /* number of dirty pages which were flushed for eviction */
+  uint64_t cache_evictions_dirty;
+
+  /* average age of the evicted pages, in cache accesses (approximated) */
+  uint64_t cache_eviction_avg_age;
+
+  /* estimated hit ratio (0.0 - 1.0) if the cache was twice as large */
+  double cache_hit_ratio_double;
+
+  /* estimated hit ratio (0.0 - 1.0) if the cache was half as large */
+  double cache_hit_ratio_half;
+
+  /* number of write operations for flushing pages; adjacent pages are
+   * merged into a single write */
+  uint64_t page_flush_writes;
+
+  /* average number of pages per write operation (page_count_flushed /
+   * page_flush_writes) */
+  double page_flush_merge_ratio;
+
+  /* number of pages which were loaded by the read-ahead */
+  uint64_t page_count_prefetched;
+
+  /* tiered storage: number of pages in the secondary file */
+  uint64_t tiered_cold_pages;
+
+  /* tiered storage: number of pages moved to the secondary file */
+  uint64_t tiered_pages_demoted;
+
+  /* tiered storage: number of pages moved back to the database file */
+  uint64_t tiered_pages_promoted;
+
+  /* number of btree nodes which were moved by the online compaction */
+  uint64_t page_count_relocated;
+
+  /* number of group commits (writes and syncs) of the journal */
+  uint64_t journal_group_commits;
+
+  /* number of segment files of the journal */
+  uint32_t journal_segments;
+
+  /* number of journal segments which were recycled */
+  uint64_t journal_segments_recycled;
+
+  /* number of journal segment switches which were deferred because no
+   * segment could be recycled */
+  uint64_t journal_segment_overflows;
+
+  /* number of completed journal checkpoints */
+  uint64_t journal_checkpoints;
+
+  /* number of page bytes in journal changesets before the delta encoding */
+  uint64_t journal_page_bytes_before_delta;
+
+  /* number of page bytes in journal changesets after the delta encoding */
+  uint64_t journal_page_bytes_after_delta;
+
 } ups_env_metrics_t;
 
 /**
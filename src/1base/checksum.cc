@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2005-2016 Christoph Rupp (chris@crupp.de).
+ * All Rights Reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the file COPYING for License information.
+ */
+
+#include "0root/root.h"
+
+#include "3rdparty/murmurhash3/MurmurHash3.h"
+
+#include "ups/upscaledb.h"
+
+// Always verify that a file of level N does not include headers > N!
+#include "1base/checksum.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#  include <nmmintrin.h>
+#  define UPS_CRC32C_HARDWARE
+#  define UPS_CRC32C_TARGET __attribute__((target("sse4.2")))
+#elif defined(__GNUC__) && defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#  include <arm_acle.h>
+#  define UPS_CRC32C_HARDWARE
+#  define UPS_CRC32C_TARGET
+#endif
+
+#ifndef UPS_ROOT_H
+#  error "root.h was not included"
+#endif
+
+namespace upscaledb {
+
+// The CRC32C polynomial (bit-reflected)
+static const uint32_t kPolynomial = 0x82f63b78;
+
+// The number of bytes which each of the three interleaved streams
+// processes in one round
+static const size_t kStreamSize = 256;
+
+// Returns a * b modulo the polynomial (both bit-reflected)
+static uint32_t
+multmodp(uint32_t a, uint32_t b)
+{
+  uint32_t m = (uint32_t)1 << 31;
+  uint32_t p = 0;
+  for (;;) {
+    if (a & m) {
+      p ^= b;
+      if ((a & (m - 1)) == 0)
+        break;
+    }
+    m >>= 1;
+    b = b & 1 ? (b >> 1) ^ kPolynomial : b >> 1;
+  }
+  return p;
+}
+
+// Returns x^(8 * len) modulo the polynomial; multiplying a checksum with
+// this value appends |len| zero bytes
+static uint32_t
+zeroes_operator(size_t len)
+{
+  uint32_t result = (uint32_t)1 << 31; // x^0
+  uint32_t square = (uint32_t)1 << 23; // x^8
+  for (; len > 0; len >>= 1) {
+    if (len & 1)
+      result = multmodp(square, result);
+    square = multmodp(square, square);
+  }
+  return result;
+}
+
+// Lookup tables, initialized when the library is loaded
+static struct Crc32cTables {
+  Crc32cTables()
+    : accelerated(false) {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++)
+        c = c & 1 ? (c >> 1) ^ kPolynomial : c >> 1;
+      bytes[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++)
+      for (int k = 1; k < 8; k++)
+        bytes[k][i] = (bytes[k - 1][i] >> 8)
+                        ^ bytes[0][bytes[k - 1][i] & 0xff];
+
+    uint32_t op1 = zeroes_operator(kStreamSize);
+    uint32_t op2 = zeroes_operator(2 * kStreamSize);
+    for (int k = 0; k < 4; k++) {
+      for (uint32_t i = 0; i < 256; i++) {
+        shift1[k][i] = multmodp(op1, i << (8 * k));
+        shift2[k][i] = multmodp(op2, i << (8 * k));
+      }
+    }
+
+#if defined(__x86_64__) && defined(UPS_CRC32C_HARDWARE)
+    __builtin_cpu_init();
+    accelerated = __builtin_cpu_supports("sse4.2") != 0;
+#elif defined(UPS_CRC32C_HARDWARE)
+    accelerated = true;
+#endif
+  }
+
+  // slicing-by-8: the checksum of byte i followed by k zero bytes
+  uint32_t bytes[8][256];
+
+  // appends |kStreamSize| zero bytes to a checksum, byte by byte
+  uint32_t shift1[4][256];
+
+  // appends 2 * |kStreamSize| zero bytes to a checksum, byte by byte
+  uint32_t shift2[4][256];
+
+  // true if the CPU has a crc32 instruction
+  bool accelerated;
+} tables;
+
+// Appends zero bytes to |crc|; |table| is one of the shift tables
+static inline uint32_t
+shift(const uint32_t table[4][256], uint32_t crc)
+{
+  return table[0][crc & 0xff] ^ table[1][(crc >> 8) & 0xff]
+          ^ table[2][(crc >> 16) & 0xff] ^ table[3][crc >> 24];
+}
+
+static uint32_t
+crc32c_software(uint32_t crc, const uint8_t *p, size_t len)
+{
+  for (; len >= 8; p += 8, len -= 8) {
+    crc ^= (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16)
+              | ((uint32_t)p[3] << 24);
+    crc = tables.bytes[7][crc & 0xff] ^ tables.bytes[6][(crc >> 8) & 0xff]
+          ^ tables.bytes[5][(crc >> 16) & 0xff] ^ tables.bytes[4][crc >> 24]
+          ^ tables.bytes[3][p[4]] ^ tables.bytes[2][p[5]]
+          ^ tables.bytes[1][p[6]] ^ tables.bytes[0][p[7]];
+  }
+  for (; len > 0; p++, len--)
+    crc = (crc >> 8) ^ tables.bytes[0][(crc ^ *p) & 0xff];
+  return crc;
+}
+
+#ifdef UPS_CRC32C_HARDWARE
+
+#ifdef __x86_64__
+static inline UPS_CRC32C_TARGET uint32_t
+crc_u8(uint32_t crc, uint8_t v)
+{
+  return _mm_crc32_u8(crc, v);
+}
+
+static inline UPS_CRC32C_TARGET uint64_t
+crc_u64(uint64_t crc, uint64_t v)
+{
+  return _mm_crc32_u64(crc, v);
+}
+#else
+static inline uint32_t
+crc_u8(uint32_t crc, uint8_t v)
+{
+  return __crc32cb(crc, v);
+}
+
+static inline uint64_t
+crc_u64(uint64_t crc, uint64_t v)
+{
+  return __crc32cd((uint32_t)crc, v);
+}
+#endif
+
+static UPS_CRC32C_TARGET uint32_t
+crc32c_hardware(uint32_t crc, const uint8_t *p, size_t len)
+{
+  for (; len > 0 && ((uintptr_t)p & 7) != 0; p++, len--)
+    crc = crc_u8(crc, *p);
+
+  // three independent streams keep the crc32 unit busy; afterwards the
+  // first two checksums are moved to the end of the round and combined
+  const size_t words = kStreamSize / 8;
+  for (; len >= 3 * kStreamSize; p += 3 * kStreamSize,
+                  len -= 3 * kStreamSize) {
+    const uint64_t *w = (const uint64_t *)p;
+    uint64_t crc0 = crc, crc1 = 0, crc2 = 0;
+    for (size_t i = 0; i < words; i++) {
+      crc0 = crc_u64(crc0, w[i]);
+      crc1 = crc_u64(crc1, w[words + i]);
+      crc2 = crc_u64(crc2, w[2 * words + i]);
+    }
+    crc = shift(tables.shift2, (uint32_t)crc0)
+            ^ shift(tables.shift1, (uint32_t)crc1) ^ (uint32_t)crc2;
+  }
+
+  uint64_t crc64 = crc;
+  for (; len >= 8; p += 8, len -= 8)
+    crc64 = crc_u64(crc64, *(const uint64_t *)p);
+  crc = (uint32_t)crc64;
+  for (; len > 0; p++, len--)
+    crc = crc_u8(crc, *p);
+  return crc;
+}
+
+#endif // UPS_CRC32C_HARDWARE
+
+uint32_t
+Checksum::calculate(int algorithm, const void *data, size_t len,
+                uint32_t seed)
+{
+  if (algorithm == UPS_CHECKSUM_CRC32C)
+    return crc32c(seed, data, len);
+
+  uint32_t hash;
+  MurmurHash3_x86_32(data, (int)len, seed, &hash);
+  return hash;
+}
+
+uint32_t
+Checksum::crc32c(uint32_t crc, const void *data, size_t len)
+{
+  const uint8_t *p = (const uint8_t *)data;
+#ifdef UPS_CRC32C_HARDWARE
+  if (tables.accelerated)
+    return ~crc32c_hardware(~crc, p, len);
+#endif
+  return ~crc32c_software(~crc, p, len);
+}
+
+bool
+Checksum::is_crc32c_accelerated()
+{
+  return tables.accelerated;
+}
+
+} // namespace upscaledb
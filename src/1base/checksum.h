@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2005-2016 Christoph Rupp (chris@crupp.de).
+ * All Rights Reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the file COPYING for License information.
+ */
+
+/*
+ * Checksums of pages and blobs (see UPS_ENABLE_CRC32)
+ *
+ * CRC32C (Castagnoli) is calculated with the crc32 instruction of SSE4.2
+ * (x86-64) or ARMv8 if the CPU supports it, otherwise with a table-driven
+ * software implementation. Large buffers are split into three streams
+ * which are processed in an interleaved fashion, because the crc32
+ * instruction has a latency of three cycles but a throughput of one
+ * cycle. The partial checksums are combined afterwards.
+ *
+ * @exception_safe: nothrow
+ * @thread_safe: yes
+ */
+
+#ifndef UPS_CHECKSUM_H
+#define UPS_CHECKSUM_H
+
+#include "0root/root.h"
+
+#include "ups/types.h"
+
+// Always verify that a file of level N does not include headers > N!
+
+#ifndef UPS_ROOT_H
+#  error "root.h was not included"
+#endif
+
+namespace upscaledb {
+
+struct Checksum {
+  // Returns the checksum of |len| bytes, calculated with |algorithm|
+  // (one of UPS_CHECKSUM_*) and initialized with |seed|
+  static uint32_t calculate(int algorithm, const void *data, size_t len,
+                  uint32_t seed);
+
+  // Returns the CRC32C of |len| bytes; |crc| is the checksum of the
+  // preceding data (or a seed)
+  static uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+
+  // Returns true if the CRC32C is calculated in hardware
+  static bool is_crc32c_accelerated();
+};
+
+} // namespace upscaledb
+
+#endif // UPS_CHECKSUM_H
@@ -28,6 +28,8 @@
 #include <boost/version.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/recursive_mutex.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/thread/locks.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/thread/tss.hpp>
 #include <boost/thread/condition.hpp>
@@ -45,6 +47,12 @@ typedef boost::thread Thread;
 typedef boost::condition Condition;
 typedef boost::recursive_mutex RecursiveMutex;
 
+// A reader/writer mutex; multiple readers can hold the lock at the same
+// time, but writers are exclusive
+typedef boost::shared_mutex RwMutex;
+typedef boost::shared_lock<boost::shared_mutex> ScopedReadLock;
+typedef boost::unique_lock<boost::shared_mutex> ScopedWriteLock;
+
 struct Mutex : public boost::mutex 
 {
   void acquire_ownership() {
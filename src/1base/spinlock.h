@@ -138,6 +138,126 @@ class Spinlock {
 };
 #endif // UPS_ENABLE_HELGRIND
 
+#ifdef UPS_ENABLE_HELGRIND
+struct ReadWriteSpinlock : public boost::shared_mutex
+{
+  ReadWriteSpinlock() {
+  }
+
+  // boost::shared_mutex is not copyable; initializes an *unlocked* mutex
+  ReadWriteSpinlock(const ReadWriteSpinlock &) {
+  }
+
+  void acquire_ownership() {
+  }
+
+  void safe_unlock() {
+    try_lock();
+    unlock();
+  }
+};
+#else
+
+//
+// A spinlock which can either be locked exclusively by a single writer
+// (lock/try_lock/unlock) or shared by multiple readers
+// (lock_shared/try_lock_shared/unlock_shared). Used for the Page objects,
+// which are shared by concurrent read-only operations.
+//
+class ReadWriteSpinlock {
+    enum {
+      kUnlocked      = 0,
+      kLocked        = -1
+    };
+
+  public:
+    ReadWriteSpinlock()
+      : m_state(kUnlocked) {
+    }
+
+    // Need user-defined copy constructor because boost::atomic<> is not
+    // copyable. Initializes an *unlocked* ReadWriteSpinlock.
+    ReadWriteSpinlock(const ReadWriteSpinlock &other)
+      : m_state(kUnlocked) {
+    }
+
+    ~ReadWriteSpinlock() {
+      assert(m_state == kUnlocked);
+    }
+
+    // Only for test verification: lets the current thread acquire ownership
+    // of a locked mutex
+    void acquire_ownership() {
+#ifdef UPS_DEBUG
+      assert(m_state != kUnlocked);
+      m_owner = boost::this_thread::get_id();
+#endif
+    }
+
+    // For debugging and verification; unlocks the mutex, even if it was
+    // locked by a different thread (or by readers)
+    void safe_unlock() {
+#ifdef UPS_DEBUG
+      m_owner = boost::this_thread::get_id();
+#endif
+      m_state.store(kUnlocked, boost::memory_order_release);
+    }
+
+    bool try_lock() {
+      int expected = kUnlocked;
+      if (m_state.compare_exchange_strong(expected, (int)kLocked,
+                              boost::memory_order_acquire)) {
+#ifdef UPS_DEBUG
+        m_owner = boost::this_thread::get_id();
+#endif
+        return true;
+      }
+      return false;
+    }
+
+    void lock() {
+      int k = 0;
+      while (!try_lock())
+        Spinlock::spin(k++);
+    }
+
+    void unlock() {
+      assert(m_state == kLocked);
+#ifdef UPS_DEBUG
+      assert(m_owner == boost::this_thread::get_id());
+#endif
+      m_state.store(kUnlocked, boost::memory_order_release);
+    }
+
+    bool try_lock_shared() {
+      int state = m_state.load(boost::memory_order_relaxed);
+      while (state >= kUnlocked) {
+        if (m_state.compare_exchange_weak(state, state + 1,
+                              boost::memory_order_acquire))
+          return true;
+      }
+      return false;
+    }
+
+    void lock_shared() {
+      int k = 0;
+      while (!try_lock_shared())
+        Spinlock::spin(k++);
+    }
+
+    void unlock_shared() {
+      assert(m_state > kUnlocked);
+      m_state.fetch_sub(1, boost::memory_order_release);
+    }
+
+  private:
+    boost::atomic<int> m_state;
+#ifdef UPS_DEBUG
+    boost::thread::id m_owner;
+#endif
+};
+#endif // UPS_ENABLE_HELGRIND
+
 class ScopedSpinlock {
   public:
     ScopedSpinlock(Spinlock &lock)
@@ -63,5 +63,9 @@ uint64_t Globals::ms_btree_smo_merge;
 
 uint64_t Globals::ms_btree_smo_shift;
 
+boost::atomic<uint64_t> Globals::ms_cache_budget(0);
+
+boost::atomic<uint64_t> Globals::ms_cache_usage(0);
+
 } // namespace upscaledb
 
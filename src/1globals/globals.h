@@ -27,6 +27,8 @@
 
 #include "0root/root.h"
 
+#include <boost/atomic.hpp>
+
 #include "ups/types.h"
 
 // Always verify that a file of level N does not include headers > N!
@@ -92,6 +94,12 @@ struct Globals {
 
   // usage metrics - number of page shifts
   static uint64_t ms_btree_smo_shift;
+
+  // the process-wide budget for all caches (in bytes); 0 if disabled
+  static boost::atomic<uint64_t> ms_cache_budget;
+
+  // the bytes currently cached by all Environments
+  static boost::atomic<uint64_t> ms_cache_usage;
 };
 
 } // namespace upscaledb
@@ -0,0 +1,270 @@
+/*
+ * Copyright (C) 2005-2016 Christoph Rupp (chris@crupp.de).
+ * All Rights Reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the file COPYING for License information.
+ */
+
+/*
+ * A slab allocator for page buffers
+ *
+ * Page buffers are carved from large "arenas" (2 MB or more, aligned to
+ * 2 MB), which can be backed by transparent huge pages. Released buffers
+ * are recycled. One empty arena is kept as a spare; any other arena is
+ * returned to the operating system as soon as all of its buffers were
+ * released.
+ *
+ * New buffers are always taken from the arena with the lowest address,
+ * which keeps the buffers compact and allows the other arenas to drain.
+ * Arenas are allocated and freed without holding the lock.
+ *
+ * @exception_safe: strong
+ * @thread_safe: yes
+ */
+
+#ifndef UPS_PAGE_BUFFER_POOL_H
+#define UPS_PAGE_BUFFER_POOL_H
+
+#include "0root/root.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "ups/types.h"
+
+// Always verify that a file of level N does not include headers > N!
+#include "1base/error.h"
+#include "1base/spinlock.h"
+#include "1base/uncopyable.h"
+#include "1os/os.h"
+
+#ifndef UPS_ROOT_H
+#  error "root.h was not included"
+#endif
+
+namespace upscaledb {
+
+class PageBufferPool : public Uncopyable {
+    // A contiguous chunk of memory, split into buffers
+    struct Arena {
+      Arena(uint8_t *data_, size_t capacity_)
+        : data(data_), capacity(capacity_), carved(0), used(0) {
+      }
+
+      // the memory of this arena
+      uint8_t *data;
+
+      // the number of buffers in this arena
+      size_t capacity;
+
+      // the number of buffers which were carved from |data|
+      size_t carved;
+
+      // the number of buffers which are currently in use
+      size_t used;
+
+      // released buffers which can be recycled
+      std::vector<uint8_t *> free_list;
+    };
+
+    typedef std::map<uint8_t *, Arena *> ArenaMap;
+
+  public:
+    enum {
+      // The alignment (and minimum size) of an arena; this is the size of
+      // a huge page on x86-64
+      kArenaSize = 2 * 1024 * 1024,
+
+      // An arena stores at least this many buffers
+      kMinBuffersPerArena = 8
+    };
+
+    // Constructor
+    PageBufferPool(size_t buffer_size, bool use_huge_pages)
+      : buffer_size_(buffer_size), use_huge_pages_(use_huge_pages),
+        arena_size_(kArenaSize), buffers_in_use_(0), spare_(0) {
+      assert(buffer_size > 0);
+      size_t minimum = buffer_size * kMinBuffersPerArena;
+      if (minimum > arena_size_)
+        arena_size_ = ((minimum + kArenaSize - 1) / kArenaSize) * kArenaSize;
+    }
+
+    // Destructor; releases all arenas, including those with buffers which
+    // are still in use
+    ~PageBufferPool() {
+      for (ArenaMap::iterator it = arenas_.begin(); it != arenas_.end(); ++it) {
+        os_free_aligned(it->second->data);
+        delete it->second;
+      }
+    }
+
+    // Returns a buffer of |buffer_size()| bytes
+    uint8_t *allocate() {
+      {
+        ScopedSpinlock lock(mutex_);
+        if (!available_.empty())
+          return take_buffer();
+      }
+
+      // the arena is allocated without holding the lock; if another thread
+      // added an arena in the meantime then this one becomes the spare
+      // (or is freed if there already is one)
+      Arena *arena = new_arena();
+      Arena *unused = 0;
+      uint8_t *p;
+
+      {
+        ScopedSpinlock lock(mutex_);
+        if (!available_.empty()) {
+          if (spare_)
+            unused = arena;
+          else
+            spare_ = arena;
+        }
+        if (!unused) {
+          arenas_[arena->data] = arena;
+          available_.insert(arena->data);
+        }
+        p = take_buffer();
+      }
+
+      if (unused) {
+        os_free_aligned(unused->data);
+        delete unused;
+      }
+      return p;
+    }
+
+    // Returns a buffer to the pool
+    void release(void *ptr) {
+      Arena *unused = 0;
+
+      {
+        ScopedSpinlock lock(mutex_);
+        uint8_t *p = (uint8_t *)ptr;
+
+        // the arena is the one with the highest address which is <= |p|
+        ArenaMap::iterator it = arenas_.upper_bound(p);
+        assert(it != arenas_.begin());
+        --it;
+        Arena *arena = it->second;
+        assert(p < arena->data + arena_size_);
+
+        arena->free_list.push_back(p);
+        arena->used--;
+        buffers_in_use_--;
+        available_.insert(arena->data);
+
+        // keep one empty arena as a spare to avoid thrashing; if there
+        // already is one then the arena with the higher address is
+        // returned to the operating system
+        if (arena->used == 0) {
+          if (!spare_)
+            spare_ = arena;
+          else {
+            unused = arena;
+            if (spare_->data > arena->data)
+              std::swap(spare_, unused);
+            available_.erase(unused->data);
+            arenas_.erase(unused->data);
+          }
+        }
+      }
+
+      if (unused) {
+        os_free_aligned(unused->data);
+        delete unused;
+      }
+    }
+
+    // Returns the size of a single buffer
+    size_t buffer_size() const {
+      return buffer_size_;
+    }
+
+    // Returns the number of allocated arenas
+    size_t arena_count() {
+      ScopedSpinlock lock(mutex_);
+      return arenas_.size();
+    }
+
+    // Returns the number of buffers which are currently in use
+    size_t buffers_in_use() {
+      ScopedSpinlock lock(mutex_);
+      return buffers_in_use_;
+    }
+
+  private:
+    // Allocates a new arena; the caller must not hold the lock
+    Arena *new_arena() {
+      uint8_t *data = (uint8_t *)os_alloc_aligned(arena_size_, kArenaSize,
+                            use_huge_pages_);
+      try {
+        return new Arena(data, arena_size_ / buffer_size_);
+      }
+      catch (...) {
+        os_free_aligned(data);
+        throw;
+      }
+    }
+
+    // Returns a buffer from the available arena with the lowest address;
+    // the caller must hold the lock
+    uint8_t *take_buffer() {
+      Arena *arena = arenas_[*available_.begin()];
+      uint8_t *p;
+      if (!arena->free_list.empty()) {
+        p = arena->free_list.back();
+        arena->free_list.pop_back();
+      }
+      else
+        p = arena->data + buffer_size_ * arena->carved++;
+
+      if (arena == spare_)
+        spare_ = 0;
+      if (++arena->used == arena->capacity)
+        available_.erase(arena->data);
+      buffers_in_use_++;
+      return p;
+    }
+
+    // Protects all members
+    Spinlock mutex_;
+
+    // The size of each buffer
+    size_t buffer_size_;
+
+    // True if the arenas should be backed by huge pages
+    bool use_huge_pages_;
+
+    // The size of each arena
+    size_t arena_size_;
+
+    // The number of buffers in use
+    size_t buffers_in_use_;
+
+    // All arenas, indexed by their address
+    ArenaMap arenas_;
+
+    // The addresses of all arenas which have unused buffers
+    std::set<uint8_t *> available_;
+
+    // An empty arena which is kept for the next allocation, or null
+    Arena *spare_;
+};
+
+} // namespace upscaledb
+
+#endif /* UPS_PAGE_BUFFER_POOL_H */
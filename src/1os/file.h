@@ -51,13 +51,23 @@ class File
       kSeekSet = SEEK_SET,
       kSeekEnd = SEEK_END,
       kSeekCur = SEEK_CUR,
-      kMaxPath = PATH_MAX
+      kMaxPath = PATH_MAX,
 #else
       kSeekSet = FILE_BEGIN,
       kSeekEnd = FILE_END,
       kSeekCur = FILE_CURRENT,
-      kMaxPath = MAX_PATH
+      kMaxPath = MAX_PATH,
 #endif
+
+      // With direct I/O, file offsets, lengths and buffers must be aligned
+      // to this boundary
+      kDirectIoAlignment = 4096
+    };
+
+    // A single buffer of a vectored write
+    struct IoVector {
+      const void *data;
+      size_t size;
     };
 
     // Constructor: creates an empty File handle
@@ -96,12 +106,37 @@ class File
       return m_fd != UPS_INVALID_FD;
     }
 
+    // Returns the file handle
+    ups_fd_t fd() const {
+      return m_fd;
+    }
+
     // Flushes a file
     void flush();
 
     // Sets the parameter for posix_fadvise()
     void set_posix_advice(int parameter);
 
+    // Asks the operating system to read a range of the file in advance
+    // (posix_fadvise(POSIX_FADV_WILLNEED)); failures are ignored
+    void prefetch(uint64_t addr, size_t len);
+
+    // Enables or disables direct I/O, which bypasses the operating
+    // system's page cache (O_DIRECT)
+    void set_direct_io(bool enable);
+
+    // Releases the storage of a range of the file without changing the
+    // file size; the range then reads as zeroes. Returns false if this
+    // is not supported by the platform or the file system
+    bool punch_hole(uint64_t addr, size_t len);
+
+    // Reserves storage for a range of the file (fallocate()). If
+    // |keep_size| is true then the file size does not change, even if the
+    // range is beyond the end of the file; otherwise the file is extended.
+    // Returns false if this is not supported by the platform or the file
+    // system
+    bool preallocate(uint64_t addr, uint64_t len, bool keep_size);
+
     // Maps a file in memory
     //
     // mmap is called with MAP_PRIVATE - the allocated buffer
@@ -119,6 +154,10 @@ class File
     // Positional write to a file
     void pwrite(uint64_t addr, const void *buffer, size_t len);
 
+    // Positional write of |count| buffers, which are stored contiguously
+    // in the file (pwritev())
+    void pwritev(uint64_t addr, const IoVector *vec, size_t count);
+
     // Write data to a file; uses the current file position
     void write(const void *buffer, size_t len);
 
@@ -0,0 +1,415 @@
+/*
+ * Copyright (C) 2005-2016 Christoph Rupp (chris@crupp.de).
+ * All Rights Reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the file COPYING for License information.
+ */
+
+#include "0root/root.h"
+
+#include <errno.h>
+#include <string.h>
+#include <vector>
+
+#ifdef HAVE_LINUX_IO_URING_H
+#  include <linux/io_uring.h>
+#  include <sys/mman.h>
+#  include <sys/syscall.h>
+#  include <sys/uio.h>
+#  include <unistd.h>
+#endif
+
+// Always verify that a file of level N does not include headers > N!
+#include "1base/error.h"
+#include "1os/io_uring.h"
+
+#ifndef UPS_ROOT_H
+#  error "root.h was not included"
+#endif
+
+// IORING_OP_READ and IORING_OP_WRITE require linux 5.6, which also
+// introduced IORING_FEAT_RW_CUR_POS
+#if defined(HAVE_LINUX_IO_URING_H) && defined(IORING_FEAT_RW_CUR_POS) \
+      && defined(__NR_io_uring_setup)
+#  define UPS_HAVE_IO_URING 1
+#endif
+
+namespace upscaledb {
+
+#ifdef UPS_HAVE_IO_URING
+
+struct IoUringState {
+  // the file descriptor of the ring
+  int fd;
+
+  // the maximum number of operations in flight
+  uint32_t queue_depth;
+
+  // the mapped submission queue ring
+  void *sq_ptr;
+  size_t sq_size;
+
+  // the mapped completion queue ring (can be identical to |sq_ptr|)
+  void *cq_ptr;
+  size_t cq_size;
+
+  // the mapped submission queue entries
+  io_uring_sqe *sqes;
+  size_t sqes_size;
+
+  // pointers into the submission queue ring
+  unsigned *sq_tail;
+  unsigned *sq_mask;
+  unsigned *sq_array;
+
+  // pointers into the completion queue ring
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned *cq_mask;
+  io_uring_cqe *cqes;
+
+  // the number of queued, but not yet submitted operations
+  uint32_t queued;
+
+  // the number of submitted, but not yet completed operations
+  uint32_t in_flight;
+
+  // the errno of the first failed operation
+  int error;
+
+  // the iovec arrays of all queued vectored writes; released in |wait()|
+  std::vector<struct iovec *> iovecs;
+};
+
+// Releases the iovec arrays of completed vectored writes
+static void
+release_iovecs(IoUringState *s)
+{
+  for (std::vector<struct iovec *>::iterator it = s->iovecs.begin();
+          it != s->iovecs.end(); it++)
+    delete [] *it;
+  s->iovecs.clear();
+}
+
+static void
+unmap_state(IoUringState *s)
+{
+  if (s->sqes)
+    ::munmap(s->sqes, s->sqes_size);
+  if (s->cq_ptr && s->cq_ptr != s->sq_ptr)
+    ::munmap(s->cq_ptr, s->cq_size);
+  if (s->sq_ptr)
+    ::munmap(s->sq_ptr, s->sq_size);
+  if (s->fd >= 0)
+    ::close(s->fd);
+}
+
+// Submits |to_submit| operations and waits for at least |min_complete|
+// completions
+static void
+enter(IoUringState *s, uint32_t to_submit, uint32_t min_complete)
+{
+  while (true) {
+    int r = (int)::syscall(__NR_io_uring_enter, s->fd, to_submit,
+                    min_complete,
+                    min_complete ? IORING_ENTER_GETEVENTS : 0, 0, 0);
+    if (r < 0) {
+      if (errno == EINTR)
+        continue;
+      ups_log(("io_uring_enter failed with status %u (%s)", errno,
+                              strerror(errno)));
+      throw Exception(UPS_IO_ERROR);
+    }
+    s->queued -= r;
+    s->in_flight += r;
+    return;
+  }
+}
+
+// Consumes all available completions
+static void
+reap(IoUringState *s)
+{
+  unsigned head = *s->cq_head;
+  unsigned tail = __atomic_load_n(s->cq_tail, __ATOMIC_ACQUIRE);
+
+  for (; head != tail; head++) {
+    io_uring_cqe *cqe = &s->cqes[head & *s->cq_mask];
+    // |user_data| stores the expected number of bytes (0 for fsync)
+    if (cqe->res < 0) {
+      if (!s->error)
+        s->error = -cqe->res;
+    }
+    else if (cqe->user_data != 0 && (uint64_t)cqe->res != cqe->user_data) {
+      if (!s->error)
+        s->error = EIO;
+    }
+    s->in_flight--;
+  }
+
+  __atomic_store_n(s->cq_head, head, __ATOMIC_RELEASE);
+}
+
+// Returns an empty submission queue entry; makes room if the queue is full
+static io_uring_sqe *
+next_sqe(IoUringState *s)
+{
+  while (s->queued + s->in_flight >= s->queue_depth) {
+    enter(s, s->queued, 1);
+    reap(s);
+  }
+
+  unsigned tail = *s->sq_tail;
+  unsigned index = tail & *s->sq_mask;
+  io_uring_sqe *sqe = &s->sqes[index];
+  ::memset(sqe, 0, sizeof(*sqe));
+  s->sq_array[index] = index;
+  return sqe;
+}
+
+// Publishes the entry which was returned by |next_sqe|
+static void
+push_sqe(IoUringState *s)
+{
+  __atomic_store_n(s->sq_tail, *s->sq_tail + 1, __ATOMIC_RELEASE);
+  s->queued++;
+}
+
+bool
+IoUring::open(uint32_t queue_depth)
+{
+  assert(m_state == 0);
+
+  io_uring_params params;
+  ::memset(&params, 0, sizeof(params));
+
+  int fd = (int)::syscall(__NR_io_uring_setup, queue_depth, &params);
+  if (fd < 0) {
+    ups_trace(("io_uring_setup failed with status %u (%s)", errno,
+                            strerror(errno)));
+    return false;
+  }
+
+  IoUringState *s = new IoUringState;
+  s->fd = fd;
+  s->sq_ptr = s->cq_ptr = 0;
+  s->sqes = 0;
+  s->queued = s->in_flight = 0;
+  s->error = 0;
+  s->queue_depth = params.sq_entries;
+
+  if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+    ups_trace(("io_uring does not support IORING_OP_READ/WRITE"));
+    unmap_state(s);
+    delete s;
+    return false;
+  }
+
+  s->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  s->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single_mmap) {
+    if (s->cq_size > s->sq_size)
+      s->sq_size = s->cq_size;
+    s->cq_size = s->sq_size;
+  }
+
+  void *p = ::mmap(0, s->sq_size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (p == MAP_FAILED)
+    goto fail;
+  s->sq_ptr = p;
+
+  if (single_mmap)
+    s->cq_ptr = s->sq_ptr;
+  else {
+    p = ::mmap(0, s->cq_size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (p == MAP_FAILED)
+      goto fail;
+    s->cq_ptr = p;
+  }
+
+  s->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+  p = ::mmap(0, s->sqes_size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (p == MAP_FAILED)
+    goto fail;
+  s->sqes = (io_uring_sqe *)p;
+
+  s->sq_tail = (unsigned *)((uint8_t *)s->sq_ptr + params.sq_off.tail);
+  s->sq_mask = (unsigned *)((uint8_t *)s->sq_ptr + params.sq_off.ring_mask);
+  s->sq_array = (unsigned *)((uint8_t *)s->sq_ptr + params.sq_off.array);
+  s->cq_head = (unsigned *)((uint8_t *)s->cq_ptr + params.cq_off.head);
+  s->cq_tail = (unsigned *)((uint8_t *)s->cq_ptr + params.cq_off.tail);
+  s->cq_mask = (unsigned *)((uint8_t *)s->cq_ptr + params.cq_off.ring_mask);
+  s->cqes = (io_uring_cqe *)((uint8_t *)s->cq_ptr + params.cq_off.cqes);
+
+  m_state = s;
+  return true;
+
+fail:
+  ups_trace(("mmap of io_uring failed with status %u (%s)", errno,
+                          strerror(errno)));
+  unmap_state(s);
+  delete s;
+  return false;
+}
+
+void
+IoUring::read(ups_fd_t fd, void *buffer, size_t len, uint64_t offset)
+{
+  assert(m_state != 0);
+  io_uring_sqe *sqe = next_sqe(m_state);
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = fd;
+  sqe->addr = (uint64_t)(uintptr_t)buffer;
+  sqe->len = (uint32_t)len;
+  sqe->off = offset;
+  sqe->user_data = len;
+  push_sqe(m_state);
+}
+
+void
+IoUring::write(ups_fd_t fd, const void *buffer, size_t len, uint64_t offset)
+{
+  assert(m_state != 0);
+  io_uring_sqe *sqe = next_sqe(m_state);
+  sqe->opcode = IORING_OP_WRITE;
+  sqe->fd = fd;
+  sqe->addr = (uint64_t)(uintptr_t)buffer;
+  sqe->len = (uint32_t)len;
+  sqe->off = offset;
+  sqe->user_data = len;
+  push_sqe(m_state);
+}
+
+void
+IoUring::writev(ups_fd_t fd, const File::IoVector *vec, size_t count,
+                uint64_t offset)
+{
+  assert(m_state != 0);
+  struct iovec *iov = new struct iovec[count];
+  m_state->iovecs.push_back(iov);
+
+  size_t len = 0;
+  for (size_t i = 0; i < count; i++) {
+    iov[i].iov_base = (void *)vec[i].data;
+    iov[i].iov_len = vec[i].size;
+    len += vec[i].size;
+  }
+
+  io_uring_sqe *sqe = next_sqe(m_state);
+  sqe->opcode = IORING_OP_WRITEV;
+  sqe->fd = fd;
+  sqe->addr = (uint64_t)(uintptr_t)iov;
+  sqe->len = (uint32_t)count;
+  sqe->off = offset;
+  sqe->user_data = len;
+  push_sqe(m_state);
+}
+
+void
+IoUring::fsync(ups_fd_t fd)
+{
+  assert(m_state != 0);
+  io_uring_sqe *sqe = next_sqe(m_state);
+  sqe->opcode = IORING_OP_FSYNC;
+  sqe->flags = IOSQE_IO_DRAIN;
+  sqe->fd = fd;
+  sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+  sqe->user_data = 0;
+  push_sqe(m_state);
+}
+
+void
+IoUring::wait()
+{
+  assert(m_state != 0);
+  IoUringState *s = m_state;
+
+  while (s->queued + s->in_flight > 0) {
+    enter(s, s->queued, 1);
+    reap(s);
+  }
+
+  release_iovecs(s);
+
+  if (s->error) {
+    int error = s->error;
+    s->error = 0;
+    ups_log(("io_uring operation failed with status %u (%s)", error,
+                            strerror(error)));
+    throw Exception(UPS_IO_ERROR);
+  }
+}
+
+void
+IoUring::close()
+{
+  if (m_state) {
+    release_iovecs(m_state);
+    unmap_state(m_state);
+    delete m_state;
+    m_state = 0;
+  }
+}
+
+#else // !UPS_HAVE_IO_URING
+
+struct IoUringState {
+};
+
+bool
+IoUring::open(uint32_t)
+{
+  return false;
+}
+
+void
+IoUring::read(ups_fd_t, void *, size_t, uint64_t)
+{
+  throw Exception(UPS_NOT_IMPLEMENTED);
+}
+
+void
+IoUring::write(ups_fd_t, const void *, size_t, uint64_t)
+{
+  throw Exception(UPS_NOT_IMPLEMENTED);
+}
+
+void
+IoUring::writev(ups_fd_t, const File::IoVector *, size_t, uint64_t)
+{
+  throw Exception(UPS_NOT_IMPLEMENTED);
+}
+
+void
+IoUring::fsync(ups_fd_t)
+{
+  throw Exception(UPS_NOT_IMPLEMENTED);
+}
+
+void
+IoUring::wait()
+{
+}
+
+void
+IoUring::close()
+{
+}
+
+#endif // UPS_HAVE_IO_URING
+
+} // namespace upscaledb
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2005-2016 Christoph Rupp (chris@crupp.de).
+ * All Rights Reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the file COPYING for License information.
+ */
+
+/*
+ * A thin wrapper around a Linux io_uring submission/completion queue.
+ *
+ * Reads, writes and fsyncs are queued and submitted in batches; up to
+ * |queue_depth| operations are in flight at the same time. |wait()|
+ * submits all queued operations and blocks till they are completed.
+ * Errors (including short reads/writes) are reported by |wait()|.
+ *
+ * On platforms without io_uring, |open()| returns false and the caller
+ * has to fall back to synchronous I/O.
+ *
+ * @exception_safe: basic
+ * @thread_safe: no
+ */
+
+#ifndef UPS_IO_URING_H
+#define UPS_IO_URING_H
+
+#include "0root/root.h"
+
+#include "ups/types.h"
+
+// Always verify that a file of level N does not include headers > N!
+#include "1base/uncopyable.h"
+#include "1os/os.h"
+#include "1os/file.h"
+
+#ifndef UPS_ROOT_H
+#  error "root.h was not included"
+#endif
+
+namespace upscaledb {
+
+struct IoUringState;
+
+class IoUring : public Uncopyable {
+  public:
+    // Constructor; the queue is not yet opened
+    IoUring()
+      : m_state(0) {
+    }
+
+    // Destructor; closes the queue
+    ~IoUring() {
+      close();
+    }
+
+    // Creates the queue with |queue_depth| entries. Returns false if
+    // io_uring is not available (i.e. not supported by the kernel or
+    // blocked by a security policy)
+    bool open(uint32_t queue_depth);
+
+    // Returns true if the queue was opened
+    bool is_open() const {
+      return m_state != 0;
+    }
+
+    // Queues a positional read of |len| bytes into |buffer|
+    void read(ups_fd_t fd, void *buffer, size_t len, uint64_t offset);
+
+    // Queues a positional write of |len| bytes from |buffer|
+    void write(ups_fd_t fd, const void *buffer, size_t len, uint64_t offset);
+
+    // Queues a positional write of |count| buffers, which are stored
+    // contiguously in the file. The buffers (but not |vec|) have to stay
+    // valid till |wait()| returns
+    void writev(ups_fd_t fd, const File::IoVector *vec, size_t count,
+                    uint64_t offset);
+
+    // Queues an fdatasync(); it is started after all previously queued
+    // operations were completed
+    void fsync(ups_fd_t fd);
+
+    // Submits all queued operations and waits till they are completed.
+    // Throws UPS_IO_ERROR if any of the operations failed
+    void wait();
+
+    // Closes the queue
+    void close();
+
+  private:
+    // The platform dependent state; null if the queue is not open
+    IoUringState *m_state;
+};
+
+} // namespace upscaledb
+
+#endif /* UPS_IO_URING_H */
@@ -74,6 +74,21 @@ os_has_avx();
 extern int
 os_get_simd_lane_width();
 
+// Allocates |size| bytes aligned to |alignment| (a power of two). If
+// |use_huge_pages| is true then the kernel is advised to back the memory
+// with transparent huge pages (if supported).
+// Throws UPS_OUT_OF_MEMORY on failure.
+extern void *
+os_alloc_aligned(size_t size, size_t alignment, bool use_huge_pages);
+
+// Releases memory which was allocated with os_alloc_aligned()
+extern void
+os_free_aligned(void *p);
+
+// Returns true if the file |path| exists
+extern bool
+os_file_exists(const char *path);
+
 } // namespace upscaledb
 
 #endif /* UPS_OS_H */
@@ -21,12 +21,14 @@
 #include "0root/root.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
 #include <errno.h>
 #include <string.h>
 #if HAVE_MMAP
 #  include <sys/mman.h>
 #endif
-#if HAVE_WRITEV
+#if HAVE_WRITEV || HAVE_PWRITEV
 #  include <sys/uio.h>
 #endif
 #include <sys/types.h>
@@ -41,6 +43,7 @@
 // Always verify that a file of level N does not include headers > N!
 #include "1base/error.h"
 #include "1errorinducer/errorinducer.h"
+#include "1os/os.h"
 #include "1os/file.h"
 #include "1os/socket.h"
 
@@ -144,6 +147,38 @@ os_write(ups_fd_t fd, const void *buffer, size_t len)
   }
 }
 
+void *
+os_alloc_aligned(size_t size, size_t alignment, bool use_huge_pages)
+{
+  void *p = 0;
+  int r = ::posix_memalign(&p, alignment, size);
+  if (r != 0) {
+    ups_log(("posix_memalign failed with status %d (%s)", r, strerror(r)));
+    throw Exception(UPS_OUT_OF_MEMORY);
+  }
+
+#if HAVE_MMAP && defined(MADV_HUGEPAGE)
+  // not fatal; the memory is then backed with regular pages
+  if (use_huge_pages && ::madvise(p, size, MADV_HUGEPAGE) != 0)
+    ups_trace(("madvise(MADV_HUGEPAGE) failed with status %u (%s)",
+                            errno, strerror(errno)));
+#endif
+  return p;
+}
+
+void
+os_free_aligned(void *p)
+{
+  ::free(p);
+}
+
+bool
+os_file_exists(const char *path)
+{
+  struct stat buf;
+  return ::stat(path, &buf) == 0;
+}
+
 size_t
 File::granularity()
 {
@@ -168,6 +203,72 @@ File::set_posix_advice(int advice)
 #endif
 }
 
+void
+File::prefetch(uint64_t addr, size_t len)
+{
+  assert(m_fd != UPS_INVALID_FD);
+
+#if HAVE_POSIX_FADVISE
+  (void)::posix_fadvise(m_fd, addr, len, POSIX_FADV_WILLNEED);
+#endif
+}
+
+void
+File::set_direct_io(bool enable)
+{
+  assert(m_fd != UPS_INVALID_FD);
+
+#if defined(O_DIRECT)
+  int flags = ::fcntl(m_fd, F_GETFL);
+  if (flags >= 0)
+    flags = ::fcntl(m_fd, F_SETFL, enable ? flags | O_DIRECT : flags & ~O_DIRECT);
+  if (flags < 0) {
+    ups_log(("fcntl(O_DIRECT) failed with status %d (%s)",
+                            errno, strerror(errno)));
+    throw Exception(UPS_IO_ERROR);
+  }
+#elif defined(F_NOCACHE)
+  if (::fcntl(m_fd, F_NOCACHE, enable ? 1 : 0) < 0) {
+    ups_log(("fcntl(F_NOCACHE) failed with status %d (%s)",
+                            errno, strerror(errno)));
+    throw Exception(UPS_IO_ERROR);
+  }
+#else
+  if (enable) {
+    ups_log(("direct I/O is not supported on this platform"));
+    throw Exception(UPS_NOT_IMPLEMENTED);
+  }
+#endif
+}
+
+bool
+File::punch_hole(uint64_t addr, size_t len)
+{
+  assert(m_fd != UPS_INVALID_FD);
+
+#if defined(FALLOC_FL_PUNCH_HOLE) && defined(FALLOC_FL_KEEP_SIZE)
+  if (::fallocate(m_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                          addr, len) == 0)
+    return true;
+  os_log(("fallocate(FALLOC_FL_PUNCH_HOLE) failed with status %d (%s)",
+                          errno, strerror(errno)));
+#endif
+  return false;
+}
+
+bool
+File::preallocate(uint64_t addr, uint64_t len, bool keep_size)
+{
+  assert(m_fd != UPS_INVALID_FD);
+
+#if defined(FALLOC_FL_KEEP_SIZE)
+  if (::fallocate(m_fd, keep_size ? FALLOC_FL_KEEP_SIZE : 0, addr, len) == 0)
+    return true;
+  os_log(("fallocate failed with status %d (%s)", errno, strerror(errno)));
+#endif
+  return false;
+}
+
 void
 File::mmap(uint64_t position, size_t size, bool readonly, uint8_t **buffer)
 {
@@ -259,7 +360,8 @@ File::pwrite(uint64_t addr, const void *buffer, size_t len)
   size_t total = 0;
 
   while (total < len) {
-    s = ::pwrite(m_fd, buffer, len, addr + total);
+    s = ::pwrite(m_fd, (const uint8_t *)buffer + total, len - total,
+                    addr + total);
     if (s < 0) {
       ups_log(("pwrite() failed with status %u (%s)", errno, strerror(errno)));
       throw Exception(UPS_IO_ERROR);
@@ -279,6 +381,67 @@ File::pwrite(uint64_t addr, const void *buffer, size_t len)
 #endif
 }
 
+void
+File::pwritev(uint64_t addr, const IoVector *vec, size_t count)
+{
+  os_log(("File::pwritev: fd=%d, address=%lld, count=%d", m_fd, addr,
+                          (int)count));
+
+#if HAVE_PWRITEV
+  // split the buffers into batches; the kernel accepts at most IOV_MAX
+  // buffers per call
+  const size_t kMaxVectors = 64;
+  struct iovec iov[kMaxVectors];
+
+  while (count > 0) {
+    size_t n = std::min(count, kMaxVectors);
+    size_t len = 0;
+    for (size_t i = 0; i < n; i++) {
+      iov[i].iov_base = (void *)vec[i].data;
+      iov[i].iov_len = vec[i].size;
+      len += vec[i].size;
+    }
+
+    struct iovec *p = &iov[0];
+    size_t remaining = n;
+    size_t total = 0;
+    while (total < len) {
+      ssize_t s = ::pwritev(m_fd, p, (int)remaining, addr + total);
+      if (s < 0) {
+        ups_log(("pwritev() failed with status %u (%s)", errno,
+                                strerror(errno)));
+        throw Exception(UPS_IO_ERROR);
+      }
+      if (s == 0) {
+        ups_log(("pwritev() failed with short write (%s)", strerror(errno)));
+        throw Exception(UPS_IO_ERROR);
+      }
+      total += s;
+
+      // skip the buffers which were completely written
+      while (remaining > 0 && (size_t)s >= p->iov_len) {
+        s -= p->iov_len;
+        p++;
+        remaining--;
+      }
+      if (s > 0) {
+        p->iov_base = (uint8_t *)p->iov_base + s;
+        p->iov_len -= s;
+      }
+    }
+
+    addr += len;
+    vec += n;
+    count -= n;
+  }
+#else
+  for (size_t i = 0; i < count; i++) {
+    pwrite(addr, vec[i].data, vec[i].size);
+    addr += vec[i].size;
+  }
+#endif
+}
+
 void
 File::write(const void *buffer, size_t len)
 {
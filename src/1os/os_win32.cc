@@ -19,6 +19,7 @@
 #include <windows.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <malloc.h>
 #include <string.h>
 #include <ctype.h>
 #include <assert.h>
@@ -27,6 +28,7 @@
 
 // Always verify that a file of level N does not include headers > N!
 #include "1base/error.h"
+#include "1os/os.h"
 #include "1os/file.h"
 #include "1os/socket.h"
 
@@ -90,6 +92,29 @@ calc_wlen4str(const char *str)
   return (int)(strlen(str) + 1);
 }
 
+void *
+os_alloc_aligned(size_t size, size_t alignment, bool use_huge_pages)
+{
+  // large pages require special privileges on Windows; |use_huge_pages|
+  // is therefore ignored
+  void *p = ::_aligned_malloc(size, alignment);
+  if (!p)
+    throw Exception(UPS_OUT_OF_MEMORY);
+  return p;
+}
+
+void
+os_free_aligned(void *p)
+{
+  ::_aligned_free(p);
+}
+
+bool
+os_file_exists(const char *path)
+{
+  return ::GetFileAttributesA(path) != INVALID_FILE_ATTRIBUTES;
+}
+
 size_t
 File::granularity()
 {
@@ -104,6 +129,36 @@ File::set_posix_advice(int advice)
   // Only available for posix platforms
 }
 
+void
+File::prefetch(uint64_t addr, size_t len)
+{
+  // Only available for posix platforms
+}
+
+void
+File::set_direct_io(bool enable)
+{
+  // FILE_FLAG_NO_BUFFERING can only be set when the file is opened
+  if (enable) {
+    ups_log(("direct I/O is not supported on this platform"));
+    throw Exception(UPS_NOT_IMPLEMENTED);
+  }
+}
+
+bool
+File::punch_hole(uint64_t addr, size_t len)
+{
+  // not supported; the storage is not released
+  return false;
+}
+
+bool
+File::preallocate(uint64_t addr, uint64_t len, bool keep_size)
+{
+  // not supported; the file is extended with SetEndOfFile()
+  return false;
+}
+
 void
 File::mmap(uint64_t position, size_t size, bool readonly, uint8_t **buffer)
 {
@@ -139,6 +194,11 @@ File::mmap(uint64_t position, size_t size, bool readonly, uint8_t **buffer)
       throw Exception(UPS_LIMITS_REACHED);
     throw Exception(UPS_IO_ERROR);
   }
+
+  /* the view keeps a reference to the mapping object; closing the handle
+   * right away allows several views (one per mapped segment) */
+  (void)CloseHandle(m_mmaph);
+  m_mmaph = UPS_INVALID_FD;
 }
 
 void
@@ -230,6 +290,15 @@ File::pwrite(uint64_t addr, const void *buffer, size_t len)
     throw Exception(UPS_IO_ERROR);
 }
 
+void
+File::pwritev(uint64_t addr, const IoVector *vec, size_t count)
+{
+  for (size_t i = 0; i < count; i++) {
+    pwrite(addr, vec[i].data, vec[i].size);
+    addr += vec[i].size;
+  }
+}
+
 void
 File::write(const void *buffer, size_t len)
 {
@@ -16,22 +16,46 @@
  */
 
 /*
-* Based on code from Saju Pillai (saju.pillai@gmail.com)
-*      http://saju.net.in/code/misc/openssl_aes.c.txt
-*
-* @exception_safe: nothrow
-* @thread_safe: no
-*/
+ * Page encryption with AES-128 in XTS mode
+ *
+ * Every page is an XTS data unit, and its address is the tweak. Pages can
+ * therefore be encrypted and decrypted independently (and in parallel),
+ * and identical pages at different addresses result in different
+ * ciphertext. A prefix of a page (i.e. the first bytes of the header
+ * page) can be decrypted on its own.
+ *
+ * XTS requires a second key for the tweak; it is derived from the user's
+ * key by encrypting a constant block.
+ *
+ * Earlier releases encrypted pages in CBC mode, with the page address as
+ * the initialization vector. Such files are still read and written in
+ * CBC mode; only new files use XTS.
+ *
+ * The OpenSSL contexts (and the expanded keys) are created once and reused
+ * for all pages; OpenSSL uses AES-NI if the CPU supports it. Since a
+ * cipher must not be shared by several threads, the ciphers are recycled
+ * in an AesCipherPool.
+ *
+ * @exception_safe: nothrow
+ * @thread_safe: no (AesCipher), yes (AesCipherPool)
+ */
 
 #ifndef UPS_AES_H
 #define UPS_AES_H
 
 #include "0root/root.h"
 
-#include <algorithm>
+#include <string.h>
+#include <vector>
 #include <openssl/evp.h>
 
+#include "ups/types.h"
+
 // Always verify that a file of level N does not include headers > N!
+#include "1base/spinlock.h"
+#include "1base/uncopyable.h"
+#include "1os/file.h"
+#include "1os/os.h"
 
 #ifndef UPS_ROOT_H
 #  error "root.h was not included"
@@ -39,66 +63,207 @@
 
 namespace upscaledb {
 
-class AesCipher {
-  enum {
-    kAesBlockSize = 16
-  };
-
+class AesCipher : public Uncopyable {
   public:
-    AesCipher(const uint8_t key[kAesBlockSize], uint64_t salt = 0) {
-      uint64_t iv[2] = {salt, 0};
-
-	    EVP_CIPHER_CTX_init(&m_encrypt_ctx);
-	    EVP_EncryptInit_ex(&m_encrypt_ctx, EVP_aes_128_cbc(), NULL, key,
-			  			(uint8_t *)&iv[0]);
-	    EVP_CIPHER_CTX_init(&m_decrypt_ctx);
-	    EVP_DecryptInit_ex(&m_decrypt_ctx, EVP_aes_128_cbc(), NULL, key,
-			  			(uint8_t *)&iv[0]);
-	    EVP_CIPHER_CTX_set_padding(&m_encrypt_ctx, 0);
-	    EVP_CIPHER_CTX_set_padding(&m_decrypt_ctx, 0);
+    enum {
+      kAesBlockSize = 16
+    };
+
+    // Constructor; uses CBC mode instead of XTS if |cbc| is true
+    AesCipher(const uint8_t key[kAesBlockSize], bool cbc = false)
+      : m_cbc(cbc), m_scratch(0), m_scratch_size(0) {
+      m_encrypt_ctx = EVP_CIPHER_CTX_new();
+      m_decrypt_ctx = EVP_CIPHER_CTX_new();
+      if (m_cbc) {
+        EVP_EncryptInit_ex(m_encrypt_ctx, EVP_aes_128_cbc(), 0, key, 0);
+        EVP_DecryptInit_ex(m_decrypt_ctx, EVP_aes_128_cbc(), 0, key, 0);
+        return;
+      }
+
+      uint8_t xts_key[2 * kAesBlockSize];
+      ::memcpy(&xts_key[0], key, kAesBlockSize);
+      derive_tweak_key(key, &xts_key[kAesBlockSize]);
+
+      EVP_EncryptInit_ex(m_encrypt_ctx, EVP_aes_128_xts(), 0, xts_key, 0);
+      EVP_DecryptInit_ex(m_decrypt_ctx, EVP_aes_128_xts(), 0, xts_key, 0);
+      ::memset(xts_key, 0, sizeof(xts_key));
     }
 
     ~AesCipher() {
-      EVP_CIPHER_CTX_cleanup(&m_encrypt_ctx);
-  	  EVP_CIPHER_CTX_cleanup(&m_decrypt_ctx);
+      EVP_CIPHER_CTX_free(m_encrypt_ctx);
+      EVP_CIPHER_CTX_free(m_decrypt_ctx);
+      if (m_scratch)
+        os_free_aligned(m_scratch);
     }
 
     /*
-     * Encrypt |len| bytes of binary data in |plaintext|, stores the
-     * encrypted data in |ciphertext|.
+     * Encrypts |len| bytes of the page at |address| in |plaintext|, stores
+     * the encrypted data in |ciphertext|. Both buffers can be identical.
      *
-     * The input data length must be aligned to the aes block size (16 bytes)!
+     * The length must be aligned to the aes block size (16 bytes)!
      */
-    void encrypt(const uint8_t *plaintext, uint8_t *ciphertext, size_t len) {
-	    assert(len % kAesBlockSize == 0);
-
-	    /* update ciphertext, c_len is filled with the length of ciphertext
-	     * generated, len is the size of plaintext in bytes */
-	    int clen = (int)len;
-	    EVP_EncryptUpdate(&m_encrypt_ctx, ciphertext, &clen, plaintext, (int)len);
+    void encrypt(uint64_t address, const uint8_t *plaintext,
+                    uint8_t *ciphertext, size_t len) {
+      assert(len % kAesBlockSize == 0);
 
-	    /* update ciphertext with the final remaining bytes */
-	    int outlen;
-	    EVP_EncryptFinal(&m_encrypt_ctx, ciphertext + clen, &outlen);
+      uint8_t tweak[kAesBlockSize];
+      make_tweak(address, tweak);
+      int clen = (int)len;
+      EVP_EncryptInit_ex(m_encrypt_ctx, 0, 0, 0, tweak);
+      if (m_cbc)
+        EVP_CIPHER_CTX_set_padding(m_encrypt_ctx, 0);
+      EVP_EncryptUpdate(m_encrypt_ctx, ciphertext, &clen, plaintext,
+                      (int)len);
     }
 
     /*
-     * Decrypts |len| bytes of |ciphertext|, stores the decoded data in
-     * |plaintext|.
+     * Decrypts |len| bytes of the page at |address| in |ciphertext|, stores
+     * the decoded data in |plaintext|. Both buffers can be identical.
      *
-     * The input data length must be aligned to the aes block size (16 bytes)!
+     * The length must be aligned to the aes block size (16 bytes)!
      */
-    void decrypt(const uint8_t *ciphertext, uint8_t *plaintext, size_t len) {
+    void decrypt(uint64_t address, const uint8_t *ciphertext,
+                    uint8_t *plaintext, size_t len) {
       assert(len % kAesBlockSize == 0);
 
-	    int plen = (int)len, flen = 0;
-	    EVP_DecryptUpdate(&m_decrypt_ctx, plaintext, &plen, ciphertext, (int)len);
-	    EVP_DecryptFinal(&m_decrypt_ctx, plaintext + plen, &flen);
+      uint8_t tweak[kAesBlockSize];
+      make_tweak(address, tweak);
+      int plen = (int)len;
+      EVP_DecryptInit_ex(m_decrypt_ctx, 0, 0, 0, tweak);
+      if (m_cbc)
+        EVP_CIPHER_CTX_set_padding(m_decrypt_ctx, 0);
+      EVP_DecryptUpdate(m_decrypt_ctx, plaintext, &plen, ciphertext,
+                      (int)len);
+    }
+
+    // Returns a buffer for encrypted data with at least |size| bytes; it
+    // is aligned for direct I/O and reused by subsequent calls
+    uint8_t *scratch(size_t size) {
+      if (size > m_scratch_size) {
+        if (m_scratch)
+          os_free_aligned(m_scratch);
+        m_scratch = 0;
+        m_scratch_size = 0;
+        m_scratch = (uint8_t *)os_alloc_aligned(size,
+                        File::kDirectIoAlignment, false);
+        m_scratch_size = size;
+      }
+      return m_scratch;
+    }
+
+  private:
+    // The XTS tweak (and the CBC initialization vector) is the
+    // little-endian address of the page
+    static void make_tweak(uint64_t address, uint8_t tweak[kAesBlockSize]) {
+      for (int i = 0; i < kAesBlockSize; i++) {
+        tweak[i] = (uint8_t)address;
+        address >>= 8;
+      }
+    }
+
+    // Derives the tweak key from |key|; the two XTS keys must not be
+    // identical
+    static void derive_tweak_key(const uint8_t key[kAesBlockSize],
+                    uint8_t tweak_key[kAesBlockSize]) {
+      static const uint8_t constant[kAesBlockSize] = {
+        'u', 'p', 's', 'c', 'a', 'l', 'e', 'd', 'b', '-', 'x', 't', 's', 0, 0, 1
+      };
+      int len = kAesBlockSize;
+      EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+      EVP_EncryptInit_ex(ctx, EVP_aes_128_ecb(), 0, key, 0);
+      EVP_CIPHER_CTX_set_padding(ctx, 0);
+      EVP_EncryptUpdate(ctx, tweak_key, &len, constant, kAesBlockSize);
+      EVP_CIPHER_CTX_free(ctx);
+    }
+
+    // True if the cipher uses CBC mode
+    bool m_cbc;
+
+    EVP_CIPHER_CTX *m_encrypt_ctx;
+    EVP_CIPHER_CTX *m_decrypt_ctx;
+
+    // A buffer for encrypted pages, see |scratch()|
+    uint8_t *m_scratch;
+
+    // The size of |m_scratch|
+    size_t m_scratch_size;
+};
+
+class AesCipherPool : public Uncopyable {
+  public:
+    // Constructor; the ciphers are created on demand, and use CBC mode
+    // if |cbc| is true
+    AesCipherPool(const uint8_t key[AesCipher::kAesBlockSize],
+                    bool cbc = false)
+      : m_cbc(cbc) {
+      ::memcpy(m_key, key, sizeof(m_key));
+    }
+
+    // Destructor; all ciphers must have been released
+    ~AesCipherPool() {
+      for (size_t i = 0; i < m_free.size(); i++)
+        delete m_free[i];
+      ::memset(m_key, 0, sizeof(m_key));
+    }
+
+    // Returns a cipher for exclusive use; creates a new one if all
+    // existing ciphers are in use
+    AesCipher *acquire() {
+      {
+        ScopedSpinlock lock(m_mutex);
+        if (!m_free.empty()) {
+          AesCipher *aes = m_free.back();
+          m_free.pop_back();
+          return aes;
+        }
+      }
+      return new AesCipher(m_key, m_cbc);
+    }
+
+    // Returns a cipher to the pool
+    void release(AesCipher *aes) {
+      ScopedSpinlock lock(m_mutex);
+      m_free.push_back(aes);
+    }
+
+  private:
+    // The encryption key
+    uint8_t m_key[AesCipher::kAesBlockSize];
+
+    // True if the ciphers use CBC mode
+    bool m_cbc;
+
+    // Protects |m_free|
+    Spinlock m_mutex;
+
+    // Ciphers which are currently not in use
+    std::vector<AesCipher *> m_free;
+};
+
+// Borrows a cipher from an AesCipherPool for the lifetime of this object.
+// If |pool| is null then no cipher is borrowed.
+class ScopedAesCipher : public Uncopyable {
+  public:
+    ScopedAesCipher(AesCipherPool *pool)
+      : m_pool(pool), m_aes(pool ? pool->acquire() : 0) {
+    }
+
+    ~ScopedAesCipher() {
+      if (m_aes)
+        m_pool->release(m_aes);
+    }
+
+    AesCipher *get() {
+      return m_aes;
+    }
+
+    AesCipher *operator->() {
+      return m_aes;
     }
 
   private:
-    EVP_CIPHER_CTX m_encrypt_ctx;
-    EVP_CIPHER_CTX m_decrypt_ctx;
+    AesCipherPool *m_pool;
+    AesCipher *m_aes;
 };
 
 } // namespace upscaledb
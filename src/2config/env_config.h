@@ -51,8 +51,17 @@ struct EnvConfig
       cache_size_bytes(UPS_DEFAULT_CACHE_SIZE),
       file_size_limit_bytes(std::numeric_limits<size_t>::max()), 
       remote_timeout_sec(0), journal_compressor(0),
-      is_encryption_enabled(false), journal_switch_threshold(0),
-      posix_advice(UPS_POSIX_FADVICE_NORMAL) {
+      is_encryption_enabled(false), is_encryption_cbc(false),
+      journal_switch_threshold(0),
+      posix_advice(UPS_POSIX_FADVICE_NORMAL), num_worker_threads(1),
+      cache_policy(UPS_CACHE_POLICY_LRU), use_huge_pages(false),
+      io_queue_depth(0), use_direct_io(false), read_ahead_pages(8),
+      checksum(UPS_CHECKSUM_CRC32C), fast_tier_size_bytes(0),
+      file_growth_bytes(0), compaction_rate(0),
+      journal_group_commit_window(0), journal_group_commit_bytes(0),
+      journal_segments(2), journal_segment_size(0),
+      recovery_progress_callback(0), recovery_progress_context(0),
+      journal_checkpoint_interval(0), journal_checkpoint_bytes(0) {
   }
 
   // the environment's flags
@@ -88,6 +97,10 @@ struct EnvConfig
   // true if AES encryption is enabled
   bool is_encryption_enabled;
 
+  // true if the pages are encrypted in CBC mode (files of older releases)
+  // instead of AES-XTS
+  bool is_encryption_cbc;
+
   // the AES encryption key
   uint8_t encryption_key[16];
 
@@ -96,6 +109,73 @@ struct EnvConfig
 
   // parameter for posix_fadvise()
   int posix_advice;
+
+  // the number of worker threads
+  uint32_t num_worker_threads;
+
+  // the page replacement policy of the cache (UPS_CACHE_POLICY_*)
+  int cache_policy;
+
+  // true if the page buffers are backed by huge pages
+  bool use_huge_pages;
+
+  // the queue depth of the io_uring backend; 0 for synchronous I/O
+  uint32_t io_queue_depth;
+
+  // true if the file bypasses the page cache of the operating system
+  bool use_direct_io;
+
+  // the number of leaf pages which are loaded in advance during sequential
+  // scans; 0 disables the read-ahead
+  uint32_t read_ahead_pages;
+
+  // the algorithm of the page checksums (UPS_CHECKSUM_*)
+  int checksum;
+
+  // the secondary file for cold pages; tiered storage is disabled if
+  // this is empty
+  std::string cold_storage_path;
+
+  // the capacity of the database file with tiered storage; 0 moves all
+  // cold pages to the secondary file
+  uint64_t fast_tier_size_bytes;
+
+  // the step size (in bytes) by which the database file grows; 0 grows
+  // the file in proportion to its size
+  uint64_t file_growth_bytes;
+
+  // the maximum number of pages per second which are moved by the online
+  // compaction; 0 disables the compaction
+  uint32_t compaction_rate;
+
+  // the time (in microseconds) which the journal waits for further
+  // commits before writing them
+  uint32_t journal_group_commit_window;
+
+  // ends the group commit window if this many bytes are waiting; 0 for
+  // no limit
+  uint32_t journal_group_commit_bytes;
+
+  // the number of journal segments
+  uint32_t journal_segments;
+
+  // the (preallocated) size of a journal segment; 0 if the segments are
+  // only switched after a number of Transactions
+  uint64_t journal_segment_size;
+
+  // reports the progress of the recovery
+  ups_recovery_progress_fun recovery_progress_callback;
+
+  // the context pointer of |recovery_progress_callback|
+  void *recovery_progress_context;
+
+  // the interval of the journal checkpoints (in milliseconds); 0 if
+  // checkpoints are not timed
+  uint32_t journal_checkpoint_interval;
+
+  // runs a journal checkpoint after this many bytes were logged; 0 if
+  // checkpoints do not depend on the journal size
+  uint64_t journal_checkpoint_bytes;
 };
 
 } // namespace upscaledb
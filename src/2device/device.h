@@ -28,10 +28,14 @@
 
 #include "0root/root.h"
 
-#include "ups/upscaledb.h"
+#include <vector>
+
+#include "ups/upscaledb_int.h"
 
 // Always verify that a file of level N does not include headers > N!
+#include "1mem/mem.h"
 #include "2config/env_config.h"
+#include "2page/page.h"
 
 #ifndef UPS_ROOT_H
 #  error "root.h was not included"
@@ -39,7 +43,14 @@
 
 namespace upscaledb {
 
-class Page;
+// Tells the Device which pages are currently cached (see |migrate_pages|)
+struct CachedPages {
+  virtual ~CachedPages() {
+  }
+
+  // Returns true if the page at |address| is cached
+  virtual bool is_cached(uint64_t address) = 0;
+};
 
 struct Device {
   // Constructor
@@ -77,6 +88,12 @@ struct Device {
   // Returns the current file/storage size
   virtual uint64_t file_size() = 0;
 
+  // Returns the size of the storage which is in use, i.e. the file size
+  // without the storage which was allocated in advance
+  virtual uint64_t used_size() {
+    return file_size();
+  }
+
   // Seek position in a file
   virtual void seek(uint64_t offset, int whence) = 0;
 
@@ -100,17 +117,72 @@ struct Device {
   // can use mmap if available
   virtual void alloc_page(Page *page) = 0;
 
+  // Reads multiple pages from the device; the address of each page must
+  // be set. This function CAN use mmap
+  virtual void read_pages(std::vector<Page *> &pages) {
+    for (std::vector<Page *>::iterator it = pages.begin();
+            it != pages.end(); it++)
+      read_page(*it, (*it)->address());
+  }
+
+  // Writes multiple dirty pages to the device and flushes the device
+  // afterwards if |sync| is true
+  virtual void write_pages(std::vector<Page *> &pages, bool sync) {
+    for (std::vector<Page *>::iterator it = pages.begin();
+            it != pages.end(); it++)
+      (*it)->flush();
+    if (sync)
+      flush();
+  }
+
   // Frees a page on the device.
   // The caller is responsible for flushing the page; the @ref free_page
   // function will assert that the page is not dirty.
   virtual void free_page(Page *page) = 0;
 
+  // Asks the device to read a range in advance; the data is not
+  // returned. Used for read-ahead
+  virtual void prefetch(uint64_t address, size_t len) {
+  }
+
+  // Releases a page buffer which was allocated in |read_page| or
+  // |alloc_page|
+  virtual void release_page_buffer(void *buffer) {
+    Memory::release(buffer);
+  }
+
   // Returns true if the specified range is in mapped memory
   virtual bool is_mapped(uint64_t file_offset, size_t size) const = 0;
 
   // Removes unused space at the end of the file
   virtual void reclaim_space() = 0;
 
+  // Returns true if the device wants to move pages between its storage
+  // tiers (see |migrate_pages|)
+  virtual bool needs_migration() {
+    return false;
+  }
+
+  // Moves pages between the storage tiers; cached pages are never moved
+  // to slower storage. Only implemented by the TieredDevice
+  virtual void migrate_pages(CachedPages *cached_pages) {
+  }
+
+  // Returns true if the device wants to reserve storage at the end of
+  // the file in advance (see |preallocate|)
+  virtual bool needs_preallocation() {
+    return false;
+  }
+
+  // Reserves storage for the next growth of the file; called in the
+  // background. Only implemented by the DiskDevice
+  virtual void preallocate() {
+  }
+
+  // Fills in the metrics of the device
+  virtual void fill_metrics(ups_env_metrics_t *metrics) {
+  }
+
   // the Environment configuration settings
   const EnvConfig &config;
 };
@@ -20,8 +20,33 @@
  * for most operations, but currently it's possible that the Page is modified
  * if DiskDevice::read_page fails in the middle.
  *
+ * Positional reads and writes (read, write, read_page and the page
+ * flushes) are not serialized; pread/pwrite are thread-safe, and the
+ * file handle and the mapping do not change while the device is open.
+ * Only operations which change the file size or the device state
+ * (alloc, truncate, reclaim_space, open, close) are synchronized.
+ *
+ * The file is mapped in segments. The first segment is mapped when the
+ * file is opened; more segments are added when pages beyond the mapped
+ * range are read and the file has grown by at least |kMinSegmentSize| (or
+ * by a quarter of the mapped size). Segments are never moved while the
+ * device is open, therefore pointers into the mapped memory remain valid.
+ * Only if the file is truncated, the memory beyond the new end of the file
+ * is unmapped; the pages in this range were already discarded.
+ *
+ * The file grows in steps (UPS_PARAM_FILE_GROWTH_BYTES, or in proportion
+ * to the file size); the storage of a step is reserved with fallocate()
+ * instead of creating a sparse file with ftruncate(). The next step is
+ * reserved in the background (|preallocate|) without changing the file
+ * size, therefore growing the file later only updates its size.
+ *
+ * With direct I/O (UPS_PARAM_DIRECT_IO) the file bypasses the page cache
+ * of the operating system, and mmap is disabled. Page buffers are aligned
+ * because they are taken from the PageBufferPool; all other (unaligned)
+ * requests are copied through an aligned temporary buffer.
+ *
  * @exception_safe: basic/strong
- * @thread_safe: no
+ * @thread_safe: yes
  */
 
 #ifndef UPS_DEVICE_DISK_H
@@ -29,10 +54,15 @@
 
 #include "0root/root.h"
 
+#include <algorithm>
+#include <boost/atomic.hpp>
+
 // Always verify that a file of level N does not include headers > N!
 #include "1base/error.h"
 #include "1base/dynamic_array.h"
+#include "1base/scoped_ptr.h"
 #include "1mem/mem.h"
+#include "1mem/page_buffer_pool.h"
 #include "1os/file.h"
 #ifdef UPS_ENABLE_ENCRYPTION
 #  include "2aes/aes.h"
@@ -54,28 +84,52 @@ class DiskDevice : public Device {
       // the database file
       File file;
 
-      // pointer to the the mmapped data
-      uint8_t *mmapptr;
-
-      // the size of mmapptr as used in mmap
-      uint64_t mapped_size;
-
       // the (cached) size of the file
       uint64_t file_size;
 
       // excess storage at the end of the file
       uint64_t excess_at_end;
+
+      // the end of the storage which was reserved with fallocate(); can
+      // exceed the file size
+      uint64_t preallocated_end;
+    };
+
+    // A range of the file which is mapped into memory
+    struct Segment {
+      // the file offset of the first mapped byte
+      uint64_t offset;
+
+      // the size of the mapped range
+      uint64_t size;
+
+      // pointer to the mapped data
+      uint8_t *ptr;
     };
 
   public:
+    enum {
+      // The maximum number of mapped segments; pages beyond the last
+      // segment are read with pread()
+      kMaxSegments = 64,
+
+      // The minimum size of a new segment
+      kMinSegmentSize = 4 * 1024 * 1024
+    };
+
     DiskDevice(const EnvConfig &config)
-      : Device(config) {
+      : Device(config), m_segment_count(0), m_can_preallocate(true),
+        m_preallocating(false) {
       State state;
-      state.mmapptr = 0;
-      state.mapped_size = 0;
       state.file_size = 0;
       state.excess_at_end = 0;
+      state.preallocated_end = 0;
       std::swap(m_state, state);
+#ifdef UPS_ENABLE_ENCRYPTION
+      if (config.is_encryption_enabled)
+        m_cipher_pool.reset(new AesCipherPool(config.encryption_key,
+                                config.is_encryption_cbc));
+#endif
     }
 
     // Create a new device
@@ -85,6 +139,8 @@ class DiskDevice : public Device {
       File file;
       file.create(config.filename.c_str(), config.file_mode);
       file.set_posix_advice(config.posix_advice);
+      if (config.use_direct_io)
+        file.set_direct_io(true);
       m_state.file = file;
     }
 
@@ -99,33 +155,15 @@ class DiskDevice : public Device {
       State state = m_state;
       state.file.open(config.filename.c_str(), read_only);
       state.file.set_posix_advice(config.posix_advice);
+      if (config.use_direct_io)
+        state.file.set_direct_io(true);
 
       // the file size which backs the mapped ptr
       state.file_size = state.file.file_size();
-
-      if (config.flags & UPS_DISABLE_MMAP) {
-        std::swap(m_state, state);
-        return;
-      }
-
-      // make sure we do not exceed the "real" size of the file, otherwise
-      // we crash when accessing memory which exceeds the mapping (at least
-      // on Win32)
-      size_t granularity = File::granularity();
-      if (state.file_size == 0 || state.file_size % granularity) {
-        std::swap(m_state, state);
-        return;
-      }
-
-      state.mapped_size = state.file_size;
-      try {
-        state.file.mmap(0, state.mapped_size, read_only, &state.mmapptr);
-      }
-      catch (Exception &ex) {
-        ups_log(("mmap failed with error %d, falling back to read/write",
-                    ex.code));
-      }
+      state.preallocated_end = 0;
       std::swap(m_state, state);
+
+      map_tail_nolock(true);
     }
 
     // returns true if the device is open
@@ -138,8 +176,10 @@ class DiskDevice : public Device {
     virtual void close() {
       ScopedSpinlock lock(m_mutex);
       State state = m_state;
-      if (state.mmapptr)
-        state.file.munmap(state.mmapptr, state.mapped_size);
+      uint32_t count = m_segment_count;
+      for (uint32_t i = 0; i < count; i++)
+        state.file.munmap(m_segments[i].ptr, m_segments[i].size);
+      m_segment_count = 0;
       state.file.close();
 
       std::swap(m_state, state);
@@ -147,7 +187,6 @@ class DiskDevice : public Device {
 
     // flushes the device
     virtual void flush() {
-      ScopedSpinlock lock(m_mutex);
       m_state.file.flush();
     }
 
@@ -164,6 +203,12 @@ class DiskDevice : public Device {
       return m_state.file_size;
     }
 
+    // get the size of the file without the excess storage at the end
+    virtual uint64_t used_size() {
+      ScopedSpinlock lock(m_mutex);
+      return m_state.file_size - m_state.excess_at_end;
+    }
+
     // seek to a position in a file
     virtual void seek(uint64_t offset, int whence) {
       ScopedSpinlock lock(m_mutex);
@@ -178,12 +223,11 @@ class DiskDevice : public Device {
 
     // reads from the device; this function does NOT use mmap
     virtual void read(uint64_t offset, void *buffer, size_t len) {
-      ScopedSpinlock lock(m_mutex);
-      m_state.file.pread(offset, buffer, len);
+      pread(offset, buffer, len);
 #ifdef UPS_ENABLE_ENCRYPTION
       if (config.is_encryption_enabled) {
-        AesCipher aes(config.encryption_key, offset);
-        aes.decrypt((uint8_t *)buffer, (uint8_t *)buffer, len);
+        ScopedAesCipher aes(m_cipher_pool.get());
+        aes->decrypt(offset, (uint8_t *)buffer, (uint8_t *)buffer, len);
       }
 #endif
     }
@@ -192,20 +236,55 @@ class DiskDevice : public Device {
     // and is responsible for writing the data is run through the file
     // filters
     virtual void write(uint64_t offset, void *buffer, size_t len) {
-      ScopedSpinlock lock(m_mutex);
 #ifdef UPS_ENABLE_ENCRYPTION
       if (config.is_encryption_enabled) {
-        // encryption disables direct I/O -> only full pages are allowed
+        // pages are encrypted as a whole -> only full pages are allowed
         assert(offset % len == 0);
 
-        uint8_t *encryption_buffer = (uint8_t *)::alloca(len);
-        AesCipher aes(config.encryption_key, offset);
-        aes.encrypt((uint8_t *)buffer, encryption_buffer, len);
-        m_state.file.pwrite(offset, encryption_buffer, len);
+        ScopedAesCipher aes(m_cipher_pool.get());
+        uint8_t *p = aes->scratch(len);
+        aes->encrypt(offset, (uint8_t *)buffer, p, len);
+        pwrite(offset, p, len);
         return;
       }
 #endif
-      m_state.file.pwrite(offset, buffer, len);
+      pwrite(offset, buffer, len);
+    }
+
+    // Writes multiple dirty pages. The pages are sorted by address, and
+    // runs of adjacent pages are written with a single pwritev() call.
+    // Encrypted runs are encrypted into a single buffer.
+    virtual void write_pages(std::vector<Page *> &pages, bool sync) {
+      std::vector<Page *> dirty;
+      collect_dirty_pages(pages, dirty);
+
+#ifdef UPS_ENABLE_ENCRYPTION
+      ScopedAesCipher aes(m_cipher_pool.get());
+#endif
+
+      std::vector<File::IoVector> vec;
+      for (size_t begin = 0, end; begin < dirty.size(); begin = end) {
+        end = next_run(dirty, begin);
+        collect_run(dirty, begin, end, vec);
+#ifdef UPS_ENABLE_ENCRYPTION
+        if (aes.get())
+          encrypt_run(aes.get(), aes->scratch(run_size(vec)),
+                          dirty[begin]->address(), vec);
+#endif
+
+        if (vec.size() == 1)
+          pwrite(dirty[begin]->address(), vec[0].data, vec[0].size);
+        else
+          m_state.file.pwritev(dirty[begin]->address(), &vec[0], vec.size());
+
+        for (size_t i = begin; i < end; i++)
+          dirty[i]->set_dirty(false);
+        Page::ms_page_count_flushed += end - begin;
+        Page::ms_page_flush_writes++;
+      }
+
+      if (sync)
+        flush();
     }
 
     // allocate storage from this device; this function
@@ -228,23 +307,15 @@ class DiskDevice : public Device {
         //
         // Disabled on win32 because truncating a mapped file is not allowed!
 #ifdef WIN32
-        if (m_state.mapped_size != 0)
+        if (m_segment_count != 0)
           allocate_excess = false;
 #endif
 
-        if (allocate_excess) {
-          if (m_state.file_size < requested_length * 100)
-            excess = 0;
-          else if (m_state.file_size < requested_length * 250)
-            excess = requested_length * 100;
-          else if (m_state.file_size < requested_length * 1000)
-            excess = requested_length * 250;
-          else
-            excess = requested_length * 1000;
-        }
+        if (allocate_excess)
+          excess = growth_nolock(requested_length);
 
         address = m_state.file_size;
-        truncate_nolock(address + requested_length + excess);
+        grow_nolock(address + requested_length + excess);
         m_state.excess_at_end = excess;
       }
       return address;
@@ -253,14 +324,25 @@ class DiskDevice : public Device {
     // reads a page from the device; this function CAN return a
 	// pointer to mmapped memory
     virtual void read_page(Page *page, uint64_t address) {
-      ScopedSpinlock lock(m_mutex);
       // if this page is in the mapped area: return a pointer into that area.
       // otherwise fall back to read/write.
-      if (address < m_state.mapped_size && m_state.mmapptr != 0) {
+      uint8_t *mapped = map_page(address);
+      if (mapped) {
+#ifdef UPS_ENABLE_ENCRYPTION
+        // encrypted pages are decrypted from the mapped memory
+        if (config.is_encryption_enabled) {
+          if (page->data() == 0)
+            page->assign_allocated_buffer(allocate_page_buffer(), address);
+          ScopedAesCipher aes(m_cipher_pool.get());
+          aes->decrypt(address, mapped, (uint8_t *)page->data(),
+                  config.page_size_bytes);
+          return;
+        }
+#endif
         // the following line will not throw a C++ exception, but can
         // raise a signal. If that's the case then we don't catch it because
         // something is seriously wrong and proper recovery is not possible.
-        page->assign_mapped_buffer(&m_state.mmapptr[address], address);
+        page->assign_mapped_buffer(mapped, address);
         return;
       }
 
@@ -269,16 +351,16 @@ class DiskDevice : public Device {
         // note that |p| will not leak if file.pread() throws; |p| is stored
         // in the |page| object and will be cleaned up by the caller in
         // case of an exception.
-        uint8_t *p = Memory::allocate<uint8_t>(config.page_size_bytes);
+        uint8_t *p = allocate_page_buffer();
         page->assign_allocated_buffer(p, address);
       }
 
-      m_state.file.pread(address, page->data(), config.page_size_bytes);
+      pread(address, page->data(), config.page_size_bytes);
 #ifdef UPS_ENABLE_ENCRYPTION
       if (config.is_encryption_enabled) {
-        AesCipher aes(config.encryption_key, page->address());
-        aes.decrypt((uint8_t *)page->data(), (uint8_t *)page->data(),
-                config.page_size_bytes);
+        ScopedAesCipher aes(m_cipher_pool.get());
+        aes->decrypt(page->address(), (uint8_t *)page->data(),
+                (uint8_t *)page->data(), config.page_size_bytes);
       }
 #endif
     }
@@ -290,49 +372,467 @@ class DiskDevice : public Device {
       page->set_address(address);
 
       // allocate a memory buffer
-      uint8_t *p = Memory::allocate<uint8_t>(config.page_size_bytes);
+      uint8_t *p = allocate_page_buffer();
       page->assign_allocated_buffer(p, address);
     }
 
     // Frees a page on the device; plays counterpoint to |alloc_page|
     virtual void free_page(Page *page) {
-      ScopedSpinlock lock(m_mutex);
       assert(page->data() != 0);
       page->free_buffer();
     }
 
-    // Returns true if the specified range is in mapped memory
+    // Asks the operating system to read a range in advance, unless the
+    // range is mapped or the page cache is bypassed
+    virtual void prefetch(uint64_t address, size_t len) {
+      if (!config.use_direct_io && !is_mapped(address, len))
+        m_state.file.prefetch(address, len);
+    }
+
+    // Returns a page buffer to the pool
+    virtual void release_page_buffer(void *buffer) {
+      assert(m_buffer_pool.get() != 0);
+      m_buffer_pool->release(buffer);
+    }
+
+    // Returns true if the specified range is in mapped memory. Encrypted
+    // data is never used directly from the mapped memory.
     virtual bool is_mapped(uint64_t file_offset, size_t size) const {
-      return file_offset + size <= m_state.mapped_size;
+      return !config.is_encryption_enabled
+          && find_mapping(file_offset, size) != 0;
     }
 
-    // Removes unused space at the end of the file
+    // Removes unused space at the end of the file, including the storage
+    // which was reserved beyond the end of the file
     virtual void reclaim_space() {
       ScopedSpinlock lock(m_mutex);
-      if (m_state.excess_at_end > 0) {
+      if (m_state.excess_at_end > 0
+            || m_state.preallocated_end > m_state.file_size) {
         truncate_nolock(m_state.file_size - m_state.excess_at_end);
         m_state.excess_at_end = 0;
       }
     }
 
+    // Returns true if less than half of a growth step is reserved beyond
+    // the used part of the file
+    virtual bool needs_preallocation() {
+      if (isset(config.flags, UPS_READ_ONLY))
+        return false;
+
+      ScopedSpinlock lock(m_mutex);
+      if (!m_can_preallocate || m_preallocating || !m_state.file.is_open())
+        return false;
+      uint64_t step = growth_nolock(config.page_size_bytes);
+      uint64_t used = m_state.file_size - m_state.excess_at_end;
+      return step > 0 && m_state.preallocated_end < used + step / 2;
+    }
+
+    // Reserves storage for the next growth step beyond the used part of
+    // the file; does not change the file size. fallocate() is called
+    // without holding the lock; the file handle does not change while
+    // the device is open.
+    virtual void preallocate() {
+      uint64_t start, end;
+      {
+        ScopedSpinlock lock(m_mutex);
+        if (!m_can_preallocate || m_preallocating || !m_state.file.is_open())
+          return;
+        uint64_t used = m_state.file_size - m_state.excess_at_end;
+        start = std::max(m_state.preallocated_end, used);
+        end = used + 2 * growth_nolock(config.page_size_bytes);
+        if (end > config.file_size_limit_bytes)
+          end = config.file_size_limit_bytes;
+        if (start >= end)
+          return;
+        m_preallocating = true;
+      }
+
+      bool success = m_state.file.preallocate(start, end - start, true);
+
+      ScopedSpinlock lock(m_mutex);
+      m_preallocating = false;
+      if (!success)
+        m_can_preallocate = false;
+      else if (end > m_state.preallocated_end)
+        m_state.preallocated_end = end;
+    }
+
+    // Returns the end of the storage which was reserved with fallocate();
+    // used by the unittests
+    uint64_t preallocated_end() {
+      ScopedSpinlock lock(m_mutex);
+      return m_state.preallocated_end;
+    }
+
     // Returns a pointer directly into mapped memory
     uint8_t *mapped_pointer(uint64_t address) const {
-      return &m_state.mmapptr[address];
+      uint8_t *p = find_mapping(address, 1);
+      assert(p != 0);
+      return p;
+    }
+
+    // Returns the number of mapped segments
+    uint32_t mapped_segments() const {
+      return m_segment_count;
+    }
+
+    // Returns the pool for the page buffers; used by the unittests
+    PageBufferPool *buffer_pool() {
+      return m_buffer_pool.get();
+    }
+
+  protected:
+    enum {
+      // The maximum number of adjacent pages which are merged into a
+      // single write
+      kMaxPagesPerWrite = 64
+    };
+
+    // Copies the dirty pages of |pages| to |dirty|, sorted by address, and
+    // prepares them for flushing
+    static void collect_dirty_pages(std::vector<Page *> &pages,
+                    std::vector<Page *> &dirty) {
+      dirty.reserve(pages.size());
+      for (std::vector<Page *>::iterator it = pages.begin();
+              it != pages.end(); it++) {
+        if ((*it)->is_dirty()) {
+          (*it)->prepare_flush();
+          dirty.push_back(*it);
+        }
+      }
+      std::sort(dirty.begin(), dirty.end(), compare_address);
+    }
+
+    // Returns the end of the run of adjacent pages which starts at
+    // |dirty[begin]|. Pages which are not aligned for direct I/O are
+    // written separately.
+    size_t next_run(const std::vector<Page *> &dirty, size_t begin) const {
+      const Page::PersistedData &first = dirty[begin]->persisted_data;
+      if (is_unaligned(first.address, first.raw_data, first.size))
+        return begin + 1;
+
+      size_t end = begin + 1;
+      uint64_t next = first.address + first.size;
+      while (end < dirty.size() && end - begin < kMaxPagesPerWrite) {
+        const Page::PersistedData &pd = dirty[end]->persisted_data;
+        if (pd.address != next || is_unaligned(pd.address, pd.raw_data,
+                                        pd.size))
+          break;
+        next += pd.size;
+        end++;
+      }
+      return end;
+    }
+
+    // Stores the buffers of the run |dirty[begin..end[| in |vec|
+    static void collect_run(const std::vector<Page *> &dirty, size_t begin,
+                    size_t end, std::vector<File::IoVector> &vec) {
+      vec.resize(end - begin);
+      for (size_t i = begin; i < end; i++) {
+        vec[i - begin].data = dirty[i]->persisted_data.raw_data;
+        vec[i - begin].size = dirty[i]->persisted_data.size;
+      }
+    }
+
+    // Returns the number of bytes in a run
+    static size_t run_size(const std::vector<File::IoVector> &vec) {
+      size_t size = 0;
+      for (size_t i = 0; i < vec.size(); i++)
+        size += vec[i].size;
+      return size;
+    }
+
+#ifdef UPS_ENABLE_ENCRYPTION
+    // Encrypts the pages of a run (see |collect_run|) which starts at
+    // |address| to |buffer|, which then replaces the buffers in |vec|
+    static void encrypt_run(AesCipher *aes, uint8_t *buffer,
+                    uint64_t address, std::vector<File::IoVector> &vec) {
+      size_t size = 0;
+      for (size_t i = 0; i < vec.size(); i++) {
+        aes->encrypt(address + size, (const uint8_t *)vec[i].data,
+                        buffer + size, vec[i].size);
+        size += vec[i].size;
+      }
+      vec.resize(1);
+      vec[0].data = buffer;
+      vec[0].size = size;
+    }
+#endif
+
+    // Sort predicate for |collect_dirty_pages|
+    static bool compare_address(const Page *lhs, const Page *rhs) {
+      return lhs->persisted_data.address < rhs->persisted_data.address;
+    }
+
+    // Returns a pointer to the mapped range [address, address + size[, or
+    // null if the range is not mapped (or spans two segments)
+    uint8_t *find_mapping(uint64_t address, size_t size) const {
+      uint32_t count = m_segment_count.load(boost::memory_order_acquire);
+      // new pages are at the end of the file; search backwards
+      for (uint32_t i = count; i > 0; i--) {
+        const Segment &s = m_segments[i - 1];
+        if (address >= s.offset) {
+          if (address + size <= s.offset + s.size)
+            return s.ptr + (address - s.offset);
+          return 0;
+        }
+      }
+      return 0;
+    }
+
+    // Returns a pointer to the mapped page at |address|; maps the end of
+    // the file if required. Returns null if the page cannot be mapped.
+    uint8_t *map_page(uint64_t address) {
+      uint8_t *p = find_mapping(address, config.page_size_bytes);
+      if (p || (config.flags & UPS_DISABLE_MMAP))
+        return p;
+
+      ScopedSpinlock lock(m_mutex);
+      map_tail_nolock(false);
+      return find_mapping(address, config.page_size_bytes);
+    }
+
+    // Maps the part of the file which follows the last segment. Unless
+    // |force| is true, this is only done if the unmapped part is large
+    // enough. Mapping errors are not fatal; the pages are then read with
+    // pread().
+    void map_tail_nolock(bool force) {
+      if ((config.flags & UPS_DISABLE_MMAP) || !m_state.file.is_open())
+        return;
+
+      uint32_t count = m_segment_count;
+      if (count == kMaxSegments)
+        return;
+
+      // never map beyond the end of the file, otherwise we crash when
+      // accessing memory which exceeds the mapping. Segments must not
+      // split pages.
+      uint64_t alignment = File::granularity();
+      if (alignment < config.page_size_bytes)
+        alignment = config.page_size_bytes;
+      uint64_t end = count
+                        ? m_segments[count - 1].offset + m_segments[count - 1].size
+                        : 0;
+      uint64_t limit = m_state.file_size - (m_state.file_size % alignment);
+      if (limit <= end)
+        return;
+
+      uint64_t min_size = end / 4;
+      if (min_size < kMinSegmentSize)
+        min_size = kMinSegmentSize;
+      if (!force && limit - end < min_size)
+        return;
+
+      Segment &s = m_segments[count];
+      try {
+        m_state.file.mmap(end, (size_t)(limit - end),
+                        (config.flags & UPS_READ_ONLY) != 0, &s.ptr);
+      }
+      catch (Exception &ex) {
+        ups_log(("mmap failed with error %d, falling back to read/write",
+                    ex.code));
+        return;
+      }
+      s.offset = end;
+      s.size = limit - end;
+      m_segment_count.store(count + 1, boost::memory_order_release);
+    }
+
+    // Unmaps the mapped memory beyond |new_file_size| before the file is
+    // truncated; accessing it afterwards would raise SIGBUS. The pages
+    // in this range are no longer in use. If the file grows again then
+    // the new end is mapped by |map_tail_nolock|.
+    void unmap_tail_nolock(uint64_t new_file_size) {
+      uint64_t alignment = File::granularity();
+      if (alignment < config.page_size_bytes)
+        alignment = config.page_size_bytes;
+      uint64_t keep = new_file_size - (new_file_size % alignment);
+
+      uint32_t count = m_segment_count;
+      while (count > 0 && m_segments[count - 1].offset >= keep) {
+        // readers must no longer see the segment when it is unmapped
+        m_segment_count.store(count - 1, boost::memory_order_release);
+        Segment &s = m_segments[count - 1];
+        m_state.file.munmap(s.ptr, s.size);
+        count--;
+      }
+
+#ifndef WIN32
+      // UnmapViewOfFile cannot release parts of a view; on Linux the tail
+      // of the last segment is released with munmap()
+      if (count > 0) {
+        Segment &s = m_segments[count - 1];
+        if (s.offset + s.size > keep) {
+          uint64_t tail = s.offset + s.size - keep;
+          s.size = keep - s.offset;
+          m_state.file.munmap(s.ptr + s.size, (size_t)tail);
+        }
+      }
+#endif
+    }
+
+    // Returns true if a request has to be copied through an aligned
+    // buffer because the file uses direct I/O
+    bool is_unaligned(uint64_t offset, const void *buffer, size_t len) const {
+      return config.use_direct_io
+          && ((offset | len | (uintptr_t)buffer)
+                  & (File::kDirectIoAlignment - 1)) != 0;
     }
 
-  private:
-    // truncate/resize the device, sans locking
+    // Positional read; handles unaligned requests with direct I/O
+    void pread(uint64_t offset, void *buffer, size_t len) {
+      if (likely(!is_unaligned(offset, buffer, len))) {
+        m_state.file.pread(offset, buffer, len);
+        return;
+      }
+
+      uint64_t start = offset - offset % File::kDirectIoAlignment;
+      size_t size = align(offset + len) - start;
+      uint8_t *p = (uint8_t *)os_alloc_aligned(size,
+                          File::kDirectIoAlignment, false);
+      try {
+        m_state.file.pread(start, p, size);
+      }
+      catch (Exception &) {
+        os_free_aligned(p);
+        throw;
+      }
+      ::memcpy(buffer, p + (offset - start), len);
+      os_free_aligned(p);
+    }
+
+    // Positional write; handles unaligned requests with direct I/O. A
+    // partial block is read, modified and written back; concurrent writes
+    // to the same block are not supported (pages never share a block).
+    void pwrite(uint64_t offset, const void *buffer, size_t len) {
+      if (likely(!is_unaligned(offset, buffer, len))) {
+        m_state.file.pwrite(offset, buffer, len);
+        return;
+      }
+
+      uint64_t start = offset - offset % File::kDirectIoAlignment;
+      size_t size = align(offset + len) - start;
+      uint8_t *p = (uint8_t *)os_alloc_aligned(size,
+                          File::kDirectIoAlignment, false);
+      try {
+        if (start != offset || size != len)
+          m_state.file.pread(start, p, size);
+        ::memcpy(p + (offset - start), buffer, len);
+        m_state.file.pwrite(start, p, size);
+      }
+      catch (Exception &) {
+        os_free_aligned(p);
+        throw;
+      }
+      os_free_aligned(p);
+    }
+
+    // Rounds |offset| up to the direct I/O alignment
+    static uint64_t align(uint64_t offset) {
+      return (offset + File::kDirectIoAlignment - 1)
+                & ~((uint64_t)File::kDirectIoAlignment - 1);
+    }
+
+    // Allocates a page buffer from the pool. The pool is created on first
+    // use because the page size is not known before the header page of an
+    // existing file was read.
+    uint8_t *allocate_page_buffer() {
+      if (!m_buffer_pool.get()) {
+        ScopedSpinlock lock(m_pool_mutex);
+        if (!m_buffer_pool.get())
+          m_buffer_pool.reset(new PageBufferPool(config.page_size_bytes,
+                                  config.use_huge_pages));
+      }
+      assert(m_buffer_pool->buffer_size() == config.page_size_bytes);
+      return m_buffer_pool->allocate();
+    }
+
+    // truncate/resize the device, sans locking. Shrinking the file also
+    // releases the storage which was reserved beyond its end.
     void truncate_nolock(uint64_t new_file_size) {
       if (new_file_size > config.file_size_limit_bytes)
         throw Exception(UPS_LIMITS_REACHED);
+      if (new_file_size < m_state.file_size)
+        unmap_tail_nolock(new_file_size);
       m_state.file.truncate(new_file_size);
+      if (new_file_size <= m_state.file_size
+            && m_state.preallocated_end > new_file_size)
+        m_state.preallocated_end = new_file_size;
       m_state.file_size = new_file_size;
     }
 
-    // For synchronizing access
+    // Returns the number of bytes which are allocated in excess when the
+    // file grows by |requested_length| bytes. With a configured growth step
+    // the new file size is a multiple of the step, otherwise the excess is
+    // proportional to the file size.
+    uint64_t growth_nolock(size_t requested_length) const {
+      uint64_t step = config.file_growth_bytes;
+      if (step > 0) {
+        step -= step % config.page_size_bytes;
+        if (step < config.page_size_bytes)
+          step = config.page_size_bytes;
+        uint64_t end = m_state.file_size + requested_length;
+        return end % step ? step - end % step : 0;
+      }
+
+      if (m_state.file_size < requested_length * 100)
+        return 0;
+      if (m_state.file_size < requested_length * 250)
+        return requested_length * 100;
+      if (m_state.file_size < requested_length * 1000)
+        return requested_length * 250;
+      return requested_length * 1000;
+    }
+
+    // Grows the file to |new_file_size|, sans locking. Storage which was
+    // not yet reserved is allocated with fallocate(), otherwise only the
+    // file size is updated.
+    void grow_nolock(uint64_t new_file_size) {
+      if (new_file_size > config.file_size_limit_bytes)
+        throw Exception(UPS_LIMITS_REACHED);
+
+      if (m_can_preallocate && new_file_size > m_state.preallocated_end) {
+        if (m_state.file.preallocate(m_state.file_size,
+                    new_file_size - m_state.file_size, false)) {
+          m_state.file_size = new_file_size;
+          m_state.preallocated_end = new_file_size;
+          return;
+        }
+        m_can_preallocate = false;
+      }
+
+      truncate_nolock(new_file_size);
+    }
+
+    // Synchronizes changes of the file size and of |m_state|; not
+    // required for positional I/O
     Spinlock m_mutex;
 
     State m_state;
+
+    // The mapped segments, sorted by file offset
+    Segment m_segments[kMaxSegments];
+
+    // The number of valid entries in |m_segments|
+    boost::atomic<uint32_t> m_segment_count;
+
+    // Protects the (lazy) creation of |m_buffer_pool|
+    Spinlock m_pool_mutex;
+
+    // Recycles the page buffers
+    ScopedPtr<PageBufferPool> m_buffer_pool;
+
+    // False if the file system does not support fallocate()
+    bool m_can_preallocate;
+
+    // True while |preallocate| reserves storage
+    bool m_preallocating;
+
+#ifdef UPS_ENABLE_ENCRYPTION
+    // Recycles the ciphers and their scratch buffers; null if encryption
+    // is disabled
+    ScopedPtr<AesCipherPool> m_cipher_pool;
+#endif
 };
 
 } // namespace upscaledb
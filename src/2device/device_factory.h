@@ -31,6 +31,8 @@
 #include "2config/env_config.h"
 #include "2device/device_disk.h"
 #include "2device/device_inmem.h"
+#include "2device/device_tiered.h"
+#include "2device/device_uring.h"
 
 #ifndef UPS_ROOT_H
 #  error "root.h was not included"
@@ -43,8 +45,11 @@ struct DeviceFactory {
   static Device *create(const EnvConfig &config) {
     if (isset(config.flags, UPS_IN_MEMORY))
       return new InMemoryDevice(config);
-    else
-      return new DiskDevice(config);
+    if (!config.cold_storage_path.empty())
+      return new TieredDevice(config);
+    if (config.io_queue_depth > 1)
+      return new UringDevice(config);
+    return new DiskDevice(config);
   }
 };
 
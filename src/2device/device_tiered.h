@@ -0,0 +1,756 @@
+/*
+ * Copyright (C) 2005-2016 Christoph Rupp (chris@crupp.de).
+ * All Rights Reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the file COPYING for License information.
+ */
+
+/*
+ * Tiered storage (UPS_PARAM_COLD_STORAGE_PATH): a DiskDevice which moves
+ * cold pages to a secondary file.
+ *
+ * The database file (on fast storage) keeps the address space of all
+ * pages. A cold page is copied to a "slot" of the secondary file (on slow
+ * storage), and its range in the database file is released with
+ * File::punch_hole(); the database file then only occupies storage for
+ * the hot pages. The map file (the secondary file's name plus ".map")
+ * stores the address of the page in each slot, or 0 if the slot is free.
+ *
+ * The age of a page is the number of migration rounds since it was last
+ * accessed. Reads and writes of the device reset the age. Cached pages
+ * are hot although they are not read from disk; the PageManager therefore
+ * tells the round which of the oldest pages are cached. A round is due
+ * after |kRoundInterval| page accesses. If the database file stores more
+ * than UPS_PARAM_FAST_TIER_SIZE bytes then the oldest pages (with an age
+ * of at least |kColdAge|) are moved to the secondary file. Cold pages
+ * which were read |kPromoteReads| times in a round are moved back.
+ *
+ * The pages are moved by a worker thread while other threads read and
+ * write pages. Reads and writes hold |m_tier_mutex| in shared mode and
+ * only update atomic counters; the mutex is locked exclusively to change
+ * the location of a page, which therefore waits till the pending I/O of
+ * the page is completed. A page which is moved is marked in its age
+ * (|kAgeDemoting| or |kAgePromoting|); a write of the page overwrites
+ * the marker after the data was written, and the move is discarded. The
+ * map file never points to an outdated copy:
+ *   - demotion: copy the page, flush the secondary file, store the map
+ *     entry, flush the map file, then release the range in the database
+ *     file
+ *   - promotion: copy the page, flush the database file, clear the map
+ *     entry and flush the map file before the page is written to the
+ *     database file
+ *
+ * Encrypted pages are moved without decrypting them because the page
+ * address (and not the file offset) is used as the tweak.
+ *
+ * @exception_safe: basic
+ * @thread_safe: yes
+ */
+
+#ifndef UPS_DEVICE_TIERED_H
+#define UPS_DEVICE_TIERED_H
+
+#include "0root/root.h"
+
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <boost/atomic.hpp>
+
+// Always verify that a file of level N does not include headers > N!
+#include "1base/mutex.h"
+#include "1os/file.h"
+#include "1os/os.h"
+#include "2device/device_disk.h"
+
+#ifndef UPS_ROOT_H
+#  error "root.h was not included"
+#endif
+
+namespace upscaledb {
+
+class TieredDevice : public DiskDevice {
+    typedef std::map<uint64_t, uint64_t> SlotMap;
+
+    // The temperature of a page
+    struct PageAge {
+      // the age (in rounds), or one of the markers |kAgeDemoting|,
+      // |kAgePromoting| and |kAgeCold|
+      boost::atomic<uint8_t> age;
+
+      // the number of reads in the current round; only counted for pages
+      // in the secondary file
+      boost::atomic<uint8_t> reads;
+    };
+
+  public:
+    enum {
+      // Pages which were not accessed for this many rounds are cold
+      kColdAge = 4,
+
+      // Cold pages which are read this often in a round are moved back
+      kPromoteReads = 2,
+
+      // A migration round is due after this many page accesses
+      kRoundInterval = 1024,
+
+      // The maximum number of pages which are moved in each direction
+      // per round
+      kMaxPagesPerRound = 256,
+
+      // The age of pages which are currently moved to the secondary file
+      kAgeDemoting = 253,
+
+      // The age of pages which are currently moved to the database file
+      kAgePromoting = 254,
+
+      // The age of pages in the secondary file
+      kAgeCold = 255
+    };
+
+    // The "slot" of a page in the database file
+    static const uint64_t kHot = ~(uint64_t)0;
+
+    TieredDevice(const EnvConfig &config)
+      : DiskDevice(config), m_slot_count(0), m_ages(0), m_age_count(0),
+        m_ages_valid(false), m_manual_rounds(false), m_io_count(0),
+        m_last_round(0), m_pages_demoted(0), m_pages_promoted(0) {
+    }
+
+    ~TieredDevice() {
+      delete [] m_ages;
+    }
+
+    // Creates the database file, the secondary file and the map file
+    virtual void create() {
+      assert(isset(config.flags, UPS_DISABLE_MMAP));
+      DiskDevice::create();
+
+      ScopedWriteLock lock(m_tier_mutex);
+      File cold, map;
+      cold.create(config.cold_storage_path.c_str(), config.file_mode);
+      map.create(map_path().c_str(), config.file_mode);
+      m_cold_file = cold;
+      m_map_file = map;
+    }
+
+    // Opens the files and reads the map. If the secondary file does not
+    // exist then the Environment is converted to tiered storage.
+    virtual void open() {
+      assert(isset(config.flags, UPS_DISABLE_MMAP));
+      DiskDevice::open();
+
+      bool read_only = isset(config.flags, UPS_READ_ONLY);
+      ScopedWriteLock lock(m_tier_mutex);
+      File cold, map;
+      try {
+        cold.open(config.cold_storage_path.c_str(), read_only);
+      }
+      catch (Exception &ex) {
+        if (ex.code != UPS_FILE_NOT_FOUND || read_only)
+          throw;
+        cold.create(config.cold_storage_path.c_str(), config.file_mode);
+        map.create(map_path().c_str(), config.file_mode);
+      }
+      if (!map.is_open())
+        map.open(map_path().c_str(), read_only);
+
+      // entries beyond the end of the database file are outdated (the
+      // file was truncated); their slots are free
+      uint64_t file_size = m_state.file_size;
+      uint64_t count = map.file_size() / sizeof(uint64_t);
+      std::vector<uint64_t> entries(count);
+      if (count)
+        map.pread(0, &entries[0], count * sizeof(uint64_t));
+      for (uint64_t slot = 0; slot < count; slot++) {
+        if (entries[slot] != 0 && entries[slot] < file_size)
+          m_cold[entries[slot]] = slot;
+        else
+          m_free_slots.push_back(slot);
+      }
+      m_slot_count = count;
+      m_cold_file = cold;
+      m_map_file = map;
+    }
+
+    // Closes all files
+    virtual void close() {
+      DiskDevice::close();
+
+      ScopedWriteLock lock(m_tier_mutex);
+      m_cold_file.close();
+      m_map_file.close();
+      m_cold.clear();
+      m_free_slots.clear();
+      delete [] m_ages;
+      m_ages = 0;
+      m_age_count = 0;
+      m_slot_count = 0;
+      m_ages_valid = false;
+    }
+
+    // Flushes all files; the map file first, because a cleared map entry
+    // makes the copy of a page in the database file valid
+    virtual void flush() {
+      m_map_file.flush();
+      m_cold_file.flush();
+      DiskDevice::flush();
+    }
+
+    // Truncates the database file; moved pages beyond the new end of the
+    // file are dropped
+    virtual void truncate(uint64_t new_file_size) {
+      ScopedWriteLock lock(m_tier_mutex);
+      drop_pages_nolock(new_file_size);
+      DiskDevice::truncate(new_file_size);
+    }
+
+    // Writes a page to the file which stores it
+    virtual void write(uint64_t offset, void *buffer, size_t len) {
+      assert(len == config.page_size_bytes);
+      ScopedReadLock lock(m_tier_mutex);
+      uint64_t slot = lookup_nolock(offset);
+      if (slot == kHot)
+        DiskDevice::write(offset, buffer, len);
+      else
+        write_cold(slot, offset, (uint8_t *)buffer);
+      touch_nolock(offset, slot, true);
+    }
+
+    // Writes multiple dirty pages; the pages in the database file are
+    // merged (see DiskDevice::write_pages), the others are written one
+    // by one
+    virtual void write_pages(std::vector<Page *> &pages, bool sync) {
+      std::vector<Page *> hot, cold;
+      {
+        ScopedReadLock lock(m_tier_mutex);
+        for (std::vector<Page *>::iterator it = pages.begin();
+                it != pages.end(); it++) {
+          if (!(*it)->is_dirty())
+            continue;
+          if (m_cold.find((*it)->address()) != m_cold.end())
+            cold.push_back(*it);
+          else
+            hot.push_back(*it);
+        }
+
+        DiskDevice::write_pages(hot, false);
+        for (std::vector<Page *>::iterator it = hot.begin();
+                it != hot.end(); it++)
+          touch_nolock((*it)->address(), kHot, true);
+      }
+
+      for (std::vector<Page *>::iterator it = cold.begin();
+              it != cold.end(); it++)
+        (*it)->flush();
+
+      if (sync)
+        flush();
+    }
+
+    // Reads a page from the file which stores it
+    virtual void read_page(Page *page, uint64_t address) {
+      ScopedReadLock lock(m_tier_mutex);
+      uint64_t slot = lookup_nolock(address);
+      if (slot == kHot) {
+        DiskDevice::read_page(page, address);
+        touch_nolock(address, slot, false);
+        return;
+      }
+
+      if (page->data() == 0)
+        page->assign_allocated_buffer(allocate_page_buffer(), address);
+      m_cold_file.pread(slot * config.page_size_bytes, page->data(),
+                      config.page_size_bytes);
+#ifdef UPS_ENABLE_ENCRYPTION
+      if (config.is_encryption_enabled) {
+        ScopedAesCipher aes(m_cipher_pool.get());
+        aes->decrypt(address, (uint8_t *)page->data(),
+                (uint8_t *)page->data(), config.page_size_bytes);
+      }
+#endif
+      touch_nolock(address, slot, false);
+    }
+
+    // Asks the operating system to read a page in advance
+    virtual void prefetch(uint64_t address, size_t len) {
+      {
+        ScopedReadLock lock(m_tier_mutex);
+        uint64_t slot = lookup_nolock(address);
+        if (slot != kHot) {
+          m_cold_file.prefetch(slot * config.page_size_bytes,
+                          config.page_size_bytes);
+          return;
+        }
+      }
+      DiskDevice::prefetch(address, len);
+    }
+
+    // Removes unused space at the end of the database file
+    virtual void reclaim_space() {
+      ScopedWriteLock lock(m_tier_mutex);
+      uint64_t end;
+      {
+        ScopedSpinlock state_lock(m_mutex);
+        end = m_state.file_size - m_state.excess_at_end;
+      }
+      drop_pages_nolock(end);
+      DiskDevice::reclaim_space();
+    }
+
+    // Returns true if a migration round is due; pages are never moved if
+    // the file is read-only
+    virtual bool needs_migration() {
+      return notset(config.flags, UPS_READ_ONLY)
+          && !m_manual_rounds.load()
+          && m_io_count.load() - m_last_round.load() >= kRoundInterval;
+    }
+
+    // Runs a migration round: first moves cold pages to the secondary
+    // file, then moves frequently read pages back
+    virtual void migrate_pages(CachedPages *cached_pages) {
+      ScopedTryLock<Mutex> round_lock(m_round_mutex);
+      if (!round_lock.is_locked() || isset(config.flags, UPS_READ_ONLY))
+        return;
+
+      m_last_round = m_io_count.load();
+
+      {
+        ScopedWriteLock lock(m_tier_mutex);
+        grow_ages_nolock();
+      }
+
+      std::vector<uint64_t> demotions, promotions;
+      {
+        ScopedReadLock lock(m_tier_mutex);
+        update_ages_nolock();
+        select_pages_nolock(demotions, promotions);
+      }
+
+      // cached pages are hot, even if they were not read from the device
+      // for a while
+      size_t count = 0;
+      for (size_t i = 0; i < demotions.size(); i++) {
+        if (cached_pages && cached_pages->is_cached(demotions[i]))
+          reset_age(demotions[i]);
+        else
+          demotions[count++] = demotions[i];
+      }
+      demotions.resize(count);
+
+      if (!demotions.empty())
+        demote(demotions);
+      if (!promotions.empty())
+        promote(promotions);
+    }
+
+    // Fills in the metrics
+    virtual void fill_metrics(ups_env_metrics_t *metrics) {
+      ScopedReadLock lock(m_tier_mutex);
+      metrics->tiered_cold_pages = m_cold.size();
+      metrics->tiered_pages_demoted = m_pages_demoted;
+      metrics->tiered_pages_promoted = m_pages_promoted;
+    }
+
+    // Returns true if the page at |address| is stored in the secondary
+    // file; used by the unittests
+    bool is_cold(uint64_t address) {
+      ScopedReadLock lock(m_tier_mutex);
+      return m_cold.find(address) != m_cold.end();
+    }
+
+    // If enabled then |needs_migration()| never requests a round, and
+    // rounds are only run by calling |migrate_pages()|; used by the
+    // unittests
+    void set_manual_rounds(bool enabled) {
+      m_manual_rounds = enabled;
+    }
+
+  private:
+    // Returns the path of the map file
+    std::string map_path() const {
+      return config.cold_storage_path + ".map";
+    }
+
+    // Returns the slot of the page at |address|, or |kHot| if it is
+    // stored in the database file
+    uint64_t lookup_nolock(uint64_t address) {
+      SlotMap::iterator it = m_cold.find(address);
+      return it == m_cold.end() ? kHot : it->second;
+    }
+
+    // Updates the temperature of a page after it was read or written.
+    // A hot page becomes young (and is no longer demoted), a written cold
+    // page is no longer promoted, and the reads of cold pages are counted.
+    // Pages which were appended since the last round are not yet tracked.
+    void touch_nolock(uint64_t address, uint64_t slot, bool is_write) {
+      m_io_count++;
+      size_t index = (size_t)(address / config.page_size_bytes);
+      if (index >= m_age_count)
+        return;
+      PageAge &page = m_ages[index];
+      if (slot == kHot)
+        page.age = 0;
+      else if (is_write)
+        page.age = kAgeCold;
+      else if (page.reads.load() < kPromoteReads)
+        page.reads++;
+    }
+
+    // Resets the age of a page which is not moved
+    void reset_age(uint64_t address) {
+      ScopedReadLock lock(m_tier_mutex);
+      size_t index = (size_t)(address / config.page_size_bytes);
+      uint8_t age = m_ages[index].age.load();
+      if (age < kAgeDemoting)
+        mark_nolock(address, age, 0);
+    }
+
+    // Writes a page to its slot in the secondary file
+    void write_cold(uint64_t slot, uint64_t address, uint8_t *buffer) {
+      size_t page_size = config.page_size_bytes;
+#ifdef UPS_ENABLE_ENCRYPTION
+      if (config.is_encryption_enabled) {
+        ScopedAesCipher aes(m_cipher_pool.get());
+        uint8_t *p = aes->scratch(page_size);
+        aes->encrypt(address, buffer, p, page_size);
+        m_cold_file.pwrite(slot * page_size, p, page_size);
+        return;
+      }
+#endif
+      m_cold_file.pwrite(slot * page_size, buffer, page_size);
+    }
+
+    // Stores |address| in the map entry of |slot|
+    void write_map_entry_nolock(uint64_t slot, uint64_t address) {
+      m_map_file.pwrite(slot * sizeof(uint64_t), &address, sizeof(address));
+    }
+
+    // Returns a free slot of the secondary file
+    uint64_t allocate_slot_nolock() {
+      if (m_free_slots.empty())
+        return m_slot_count++;
+      uint64_t slot = m_free_slots.back();
+      m_free_slots.pop_back();
+      return slot;
+    }
+
+    // Drops all moved pages at or beyond |end|. The map entries are
+    // cleared immediately because the file can grow again.
+    void drop_pages_nolock(uint64_t end) {
+      SlotMap::iterator it = m_cold.lower_bound(end);
+      if (it == m_cold.end())
+        return;
+      for (SlotMap::iterator i = it; i != m_cold.end(); i++) {
+        write_map_entry_nolock(i->second, 0);
+        m_free_slots.push_back(i->second);
+        size_t index = (size_t)(i->first / config.page_size_bytes);
+        if (index < m_age_count)
+          m_ages[index].age = 0;
+      }
+      m_cold.erase(it, m_cold.end());
+      m_map_file.flush();
+    }
+
+    // Tracks the ages of all pages of the database file. Pages which were
+    // not accessed since the file was opened start with age 0.
+    void grow_ages_nolock() {
+      size_t pages;
+      {
+        ScopedSpinlock lock(m_mutex);
+        pages = (size_t)(m_state.file_size / config.page_size_bytes);
+      }
+
+      // the page size of an existing file is not known in |open()|
+      if (!m_ages_valid && !m_cold.empty())
+        pages = std::max(pages,
+                    (size_t)(m_cold.rbegin()->first / config.page_size_bytes)
+                        + 1);
+
+      if (pages > m_age_count) {
+        PageAge *ages = new PageAge[pages];
+        for (size_t i = 0; i < pages; i++) {
+          ages[i].age = i < m_age_count ? m_ages[i].age.load() : 0;
+          ages[i].reads = i < m_age_count ? m_ages[i].reads.load() : 0;
+        }
+        delete [] m_ages;
+        m_ages = ages;
+        m_age_count = pages;
+      }
+
+      if (!m_ages_valid) {
+        for (SlotMap::iterator it = m_cold.begin(); it != m_cold.end(); it++)
+          m_ages[(size_t)(it->first / config.page_size_bytes)].age = kAgeCold;
+        m_ages_valid = true;
+      }
+    }
+
+    // Increments the age of all hot pages; a concurrent access wins
+    void update_ages_nolock() {
+      for (size_t i = 0; i < m_age_count; i++) {
+        uint8_t age = m_ages[i].age.load();
+        if (age < kAgeDemoting - 1)
+          m_ages[i].age.compare_exchange_strong(age, (uint8_t)(age + 1));
+      }
+    }
+
+    // Selects the oldest pages for demotion and the frequently read
+    // pages for promotion; resets the read counters
+    void select_pages_nolock(std::vector<uint64_t> &demotions,
+                    std::vector<uint64_t> &promotions) {
+      size_t page_size = config.page_size_bytes;
+      size_t end;
+      {
+        ScopedSpinlock lock(m_mutex);
+        end = (size_t)((m_state.file_size - m_state.excess_at_end)
+                        / page_size);
+      }
+      end = std::min(end, m_age_count);
+
+      size_t hot = end > m_cold.size() ? end - m_cold.size() : 0;
+      size_t capacity = (size_t)(config.fast_tier_size_bytes / page_size);
+      size_t wanted = kMaxPagesPerRound;
+      if (capacity > 0)
+        wanted = std::min(wanted, hot > capacity ? hot - capacity : 0);
+
+      if (wanted > 0) {
+        // the histogram of the ages determines the youngest age which
+        // is demoted; the header page is never moved
+        std::vector<uint8_t> ages(end);
+        size_t histogram[kAgeDemoting] = {0};
+        for (size_t i = 1; i < end; i++) {
+          ages[i] = m_ages[i].age.load();
+          if (ages[i] >= kColdAge && ages[i] < kAgeDemoting)
+            histogram[ages[i]]++;
+        }
+
+        size_t threshold = kAgeDemoting - 1;
+        size_t count = histogram[threshold];
+        while (threshold > kColdAge && count < wanted)
+          count += histogram[--threshold];
+
+        for (size_t i = 1; i < end && demotions.size() < wanted; i++)
+          if (ages[i] > threshold && ages[i] < kAgeDemoting)
+            demotions.push_back((uint64_t)i * page_size);
+        for (size_t i = 1; i < end && demotions.size() < wanted; i++)
+          if (ages[i] == threshold)
+            demotions.push_back((uint64_t)i * page_size);
+        hot = hot > demotions.size() ? hot - demotions.size() : 0;
+      }
+
+      for (SlotMap::iterator it = m_cold.begin(); it != m_cold.end(); it++) {
+        size_t index = (size_t)(it->first / page_size);
+        if (index >= m_age_count)
+          continue;
+        if (m_ages[index].reads.exchange(0) >= kPromoteReads
+              && promotions.size() < kMaxPagesPerRound
+              && (capacity == 0 || hot + promotions.size() < capacity))
+          promotions.push_back(it->first);
+      }
+    }
+
+    // Replaces the age |expected| of a page with |age|
+    bool mark_nolock(uint64_t address, uint8_t expected, uint8_t age) {
+      size_t index = (size_t)(address / config.page_size_bytes);
+      return index < m_age_count
+          && m_ages[index].age.compare_exchange_strong(expected, age);
+    }
+
+    // Moves pages from the database file to the secondary file
+    void demote(const std::vector<uint64_t> &addresses) {
+      size_t page_size = config.page_size_bytes;
+      std::vector<std::pair<uint64_t, uint64_t> > moves;
+      {
+        ScopedWriteLock lock(m_tier_mutex);
+        for (std::vector<uint64_t>::const_iterator it = addresses.begin();
+                it != addresses.end(); it++) {
+          size_t index = (size_t)(*it / page_size);
+          uint8_t age = index < m_age_count ? m_ages[index].age.load() : 0;
+          if (age < kColdAge || age >= kAgeDemoting
+                  || m_cold.find(*it) != m_cold.end()
+                  || !mark_nolock(*it, age, kAgeDemoting))
+            continue;
+          moves.push_back(std::make_pair(*it, allocate_slot_nolock()));
+        }
+      }
+
+      uint8_t *buffer = (uint8_t *)os_alloc_aligned(page_size,
+                          File::kDirectIoAlignment, false);
+      try {
+        for (size_t i = 0; i < moves.size(); i++) {
+          pread(moves[i].first, buffer, page_size);
+          m_cold_file.pwrite(moves[i].second * page_size, buffer, page_size);
+        }
+        m_cold_file.flush();
+      }
+      catch (Exception &) {
+        os_free_aligned(buffer);
+        ScopedWriteLock lock(m_tier_mutex);
+        for (size_t i = 0; i < moves.size(); i++) {
+          mark_nolock(moves[i].first, kAgeDemoting, 0);
+          m_free_slots.push_back(moves[i].second);
+        }
+        throw;
+      }
+      os_free_aligned(buffer);
+
+      // discard pages which were accessed in the meantime (or which are
+      // now beyond the end of the file)
+      std::vector<std::pair<uint64_t, uint64_t> > committed;
+      {
+        ScopedWriteLock lock(m_tier_mutex);
+        uint64_t file_size;
+        {
+          ScopedSpinlock state_lock(m_mutex);
+          file_size = m_state.file_size;
+        }
+        for (size_t i = 0; i < moves.size(); i++) {
+          uint64_t address = moves[i].first;
+          if (address >= file_size
+                  || !mark_nolock(address, kAgeDemoting, kAgeCold)) {
+            mark_nolock(address, kAgeDemoting, 0);
+            m_free_slots.push_back(moves[i].second);
+            continue;
+          }
+          write_map_entry_nolock(moves[i].second, address);
+          m_cold[address] = moves[i].second;
+          m_ages[(size_t)(address / page_size)].reads = 0;
+          committed.push_back(moves[i]);
+          m_pages_demoted++;
+        }
+      }
+
+      if (committed.empty())
+        return;
+      m_map_file.flush();
+
+      // pages which were dropped in the meantime are skipped
+      ScopedWriteLock lock(m_tier_mutex);
+      for (size_t i = 0; i < committed.size(); i++) {
+        SlotMap::iterator it = m_cold.find(committed[i].first);
+        if (it != m_cold.end() && it->second == committed[i].second)
+          m_state.file.punch_hole(it->first, page_size);
+      }
+    }
+
+    // Moves pages from the secondary file back to the database file
+    void promote(const std::vector<uint64_t> &addresses) {
+      size_t page_size = config.page_size_bytes;
+      std::vector<std::pair<uint64_t, uint64_t> > moves;
+      {
+        ScopedWriteLock lock(m_tier_mutex);
+        for (std::vector<uint64_t>::const_iterator it = addresses.begin();
+                it != addresses.end(); it++) {
+          SlotMap::iterator c = m_cold.find(*it);
+          if (c != m_cold.end() && mark_nolock(*it, kAgeCold, kAgePromoting))
+            moves.push_back(*c);
+        }
+      }
+
+      uint8_t *buffer = (uint8_t *)os_alloc_aligned(page_size,
+                          File::kDirectIoAlignment, false);
+      try {
+        for (size_t i = 0; i < moves.size(); i++) {
+          m_cold_file.pread(moves[i].second * page_size, buffer, page_size);
+          pwrite(moves[i].first, buffer, page_size);
+        }
+        DiskDevice::flush();
+      }
+      catch (Exception &) {
+        os_free_aligned(buffer);
+        ScopedWriteLock lock(m_tier_mutex);
+        for (size_t i = 0; i < moves.size(); i++)
+          mark_nolock(moves[i].first, kAgePromoting, kAgeCold);
+        throw;
+      }
+      os_free_aligned(buffer);
+
+      // the cleared map entries are persisted before the pages are
+      // written to the database file; until then, the pages remain in
+      // the secondary file. Pages which were written in the meantime
+      // stay there, and their copy in the database file is released.
+      ScopedWriteLock lock(m_tier_mutex);
+      std::vector<uint64_t> promoted;
+      for (size_t i = 0; i < moves.size(); i++) {
+        uint64_t address = moves[i].first;
+        SlotMap::iterator it = m_cold.find(address);
+        if (it == m_cold.end() || it->second != moves[i].second)
+          continue;
+        if (!mark_nolock(address, kAgePromoting, 0)) {
+          m_state.file.punch_hole(address, page_size);
+          continue;
+        }
+        write_map_entry_nolock(it->second, 0);
+        promoted.push_back(address);
+      }
+      if (promoted.empty())
+        return;
+      m_map_file.flush();
+
+      for (size_t i = 0; i < promoted.size(); i++) {
+        SlotMap::iterator it = m_cold.find(promoted[i]);
+        m_free_slots.push_back(it->second);
+        m_cold.erase(it);
+        m_pages_promoted++;
+      }
+    }
+
+    // Serializes the migration rounds
+    Mutex m_round_mutex;
+
+    // Protects the location of the pages and the following members; held
+    // in shared mode while a page is read or written
+    RwMutex m_tier_mutex;
+
+    // The secondary file with the cold pages
+    File m_cold_file;
+
+    // The map file; stores the address of the page in each slot
+    File m_map_file;
+
+    // Maps the addresses of the cold pages to their slots
+    SlotMap m_cold;
+
+    // The number of slots in the secondary file
+    uint64_t m_slot_count;
+
+    // Slots which can be reused
+    std::vector<uint64_t> m_free_slots;
+
+    // The temperature of each page, indexed by page number; only grows
+    // while |m_tier_mutex| is locked exclusively
+    PageAge *m_ages;
+
+    // The number of pages in |m_ages|
+    size_t m_age_count;
+
+    // True if the cold pages are marked in |m_ages|
+    bool m_ages_valid;
+
+    // True if rounds are not requested automatically
+    boost::atomic<bool> m_manual_rounds;
+
+    // The number of page accesses; determines when a round is due
+    boost::atomic<uint64_t> m_io_count;
+
+    // The value of |m_io_count| when the last round started
+    boost::atomic<uint64_t> m_last_round;
+
+    // Metrics
+    uint64_t m_pages_demoted;
+    uint64_t m_pages_promoted;
+};
+
+} // namespace upscaledb
+
+#endif /* UPS_DEVICE_TIERED_H */
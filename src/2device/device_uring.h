@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2005-2016 Christoph Rupp (chris@crupp.de).
+ * All Rights Reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the file COPYING for License information.
+ */
+
+/*
+ * Device-implementation for disk-based files which uses io_uring for
+ * batched page I/O. Multiple pages are read or written with a single
+ * system call, and up to |config.io_queue_depth| requests are in flight.
+ *
+ * Everything else (mmap, allocation, single reads/writes) is inherited
+ * from the DiskDevice. If io_uring is not available then this device
+ * behaves exactly like the DiskDevice.
+ *
+ * @exception_safe: basic/strong
+ * @thread_safe: no
+ */
+
+#ifndef UPS_DEVICE_URING_H
+#define UPS_DEVICE_URING_H
+
+#include "0root/root.h"
+
+// Always verify that a file of level N does not include headers > N!
+#include "1base/mutex.h"
+#include "1os/io_uring.h"
+#include "2device/device_disk.h"
+
+#ifndef UPS_ROOT_H
+#  error "root.h was not included"
+#endif
+
+namespace upscaledb {
+
+/*
+ * a File-based device with batched, asynchronous I/O
+ */
+class UringDevice : public DiskDevice {
+  public:
+    UringDevice(const EnvConfig &config)
+      : DiskDevice(config) {
+    }
+
+    // Create a new device
+    virtual void create() {
+      DiskDevice::create();
+      open_ring();
+    }
+
+    // opens an existing device
+    virtual void open() {
+      DiskDevice::open();
+      open_ring();
+    }
+
+    // closes the device
+    virtual void close() {
+      ScopedLock lock(m_ring_mutex);
+      m_ring.close();
+      DiskDevice::close();
+    }
+
+    // Returns true if io_uring is used; otherwise all I/O is synchronous
+    bool is_uring_enabled() {
+      ScopedLock lock(m_ring_mutex);
+      return m_ring.is_open();
+    }
+
+    // Reads multiple pages with a single batch. Mapped pages are not read
+    // but point directly into the mapped memory (or are decrypted from
+    // the mapped memory).
+    virtual void read_pages(std::vector<Page *> &pages) {
+      ScopedLock lock(m_ring_mutex);
+      if (!m_ring.is_open()) {
+        DiskDevice::read_pages(pages);
+        return;
+      }
+
+      std::vector<Page *> queued;
+      for (std::vector<Page *>::iterator it = pages.begin();
+              it != pages.end(); it++) {
+        Page *page = *it;
+        uint64_t address = page->address();
+
+        // DiskDevice::read_page() decrypts mapped pages
+        uint8_t *mapped = map_page(address);
+        if (mapped) {
+          DiskDevice::read_page(page, address);
+          continue;
+        }
+
+        if (page->data() == 0)
+          page->assign_allocated_buffer(allocate_page_buffer(), address);
+
+        m_ring.read(m_state.file.fd(), page->data(), config.page_size_bytes,
+                        address);
+        queued.push_back(page);
+      }
+
+      m_ring.wait();
+
+#ifdef UPS_ENABLE_ENCRYPTION
+      if (config.is_encryption_enabled) {
+        ScopedAesCipher aes(m_cipher_pool.get());
+        for (std::vector<Page *>::iterator it = queued.begin();
+                it != queued.end(); it++)
+          aes->decrypt((*it)->address(), (uint8_t *)(*it)->data(),
+                  (uint8_t *)(*it)->data(), config.page_size_bytes);
+      }
+#endif
+    }
+
+    // Writes all dirty pages with a single batch; runs of adjacent pages
+    // are merged into a single vectored write. If |sync| is true then
+    // an fdatasync() is queued behind the writes.
+    //
+    // Encrypted runs are encrypted into a scratch buffer which holds up to
+    // |kMaxPagesPerWrite| pages; if it is full then the queued writes are
+    // completed before it is reused.
+    virtual void write_pages(std::vector<Page *> &pages, bool sync) {
+      ScopedLock lock(m_ring_mutex);
+      if (!m_ring.is_open()) {
+        DiskDevice::write_pages(pages, sync);
+        return;
+      }
+
+      std::vector<Page *> dirty;
+      collect_dirty_pages(pages, dirty);
+
+      if (dirty.empty() && !sync)
+        return;
+
+#ifdef UPS_ENABLE_ENCRYPTION
+      ScopedAesCipher aes(m_cipher_pool.get());
+      size_t scratch_size = kMaxPagesPerWrite * config.page_size_bytes;
+      uint8_t *scratch = aes.get() ? aes->scratch(scratch_size) : 0;
+      size_t scratch_used = 0;
+#endif
+
+      std::vector<File::IoVector> vec;
+      size_t writes = 0;
+      for (size_t begin = 0, end; begin < dirty.size(); begin = end) {
+        end = next_run(dirty, begin);
+        collect_run(dirty, begin, end, vec);
+#ifdef UPS_ENABLE_ENCRYPTION
+        if (aes.get()) {
+          size_t size = run_size(vec);
+          if (scratch_used + size > scratch_size) {
+            m_ring.wait();
+            scratch_used = 0;
+          }
+          encrypt_run(aes.get(), scratch + scratch_used,
+                          dirty[begin]->address(), vec);
+          scratch_used += size;
+        }
+#endif
+
+        uint64_t address = dirty[begin]->address();
+        // pages which are not aligned for direct I/O are written
+        // synchronously through an aligned buffer
+        if (is_unaligned(address, vec[0].data, vec[0].size))
+          pwrite(address, vec[0].data, vec[0].size);
+        else if (vec.size() == 1)
+          m_ring.write(m_state.file.fd(), vec[0].data, vec[0].size, address);
+        else
+          m_ring.writev(m_state.file.fd(), &vec[0], vec.size(), address);
+        writes++;
+      }
+
+      if (sync)
+        m_ring.fsync(m_state.file.fd());
+      m_ring.wait();
+
+      for (std::vector<Page *>::iterator it = dirty.begin();
+              it != dirty.end(); it++)
+        (*it)->set_dirty(false);
+      Page::ms_page_count_flushed += dirty.size();
+      Page::ms_page_flush_writes += writes;
+    }
+
+  private:
+    // Creates the io_uring queue; falls back to synchronous I/O if this
+    // fails
+    void open_ring() {
+      ScopedLock lock(m_ring_mutex);
+      if (!m_ring.is_open() && !m_ring.open(config.io_queue_depth))
+        ups_trace(("io_uring is not available, using synchronous I/O"));
+    }
+
+    // Serializes access to |m_ring|
+    Mutex m_ring_mutex;
+
+    // The submission/completion queue
+    IoUring m_ring;
+};
+
+} // namespace upscaledb
+
+#endif /* UPS_DEVICE_URING_H */
@@ -18,8 +18,8 @@
 #include "0root/root.h"
 
 #include <string.h>
-#include "3rdparty/murmurhash3/MurmurHash3.h"
 
+#include "1base/checksum.h"
 #include "1base/error.h"
 #include "1os/os.h"
 #include "2page/page.h"
@@ -28,10 +28,12 @@
 
 namespace upscaledb {
 
-uint64_t Page::ms_page_count_flushed = 0;
+boost::atomic<uint64_t> Page::ms_page_count_flushed(0);
+boost::atomic<uint64_t> Page::ms_page_flush_writes(0);
 
 Page::Page(Device *device, LocalDatabase *db)
-  : device_(device), db_(db), cursor_list_(0), node_proxy_(0)
+  : device_(device), db_(db), cursor_list_(0), node_proxy_(0),
+    is_referenced_(false), cache_timestamp_(0)
 {
   persisted_data.raw_data = 0;
   persisted_data.is_dirty = false;
@@ -44,6 +46,7 @@ Page::~Page()
 {
   assert(cursor_list_ == 0);
   free_buffer();
+  release_allocated_buffer();
 }
 
 uint32_t
@@ -78,28 +81,47 @@ void
 Page::flush()
 {
   if (persisted_data.is_dirty) {
-    // update crc32
-    if (isset(device_->config.flags, UPS_ENABLE_CRC32)
-        && likely(!persisted_data.is_without_header)) {
-      MurmurHash3_x86_32(persisted_data.raw_data->header.payload,
-                         persisted_data.size - (sizeof(PPageHeader) - 1),
-                         (uint32_t)persisted_data.address,
-                         &persisted_data.raw_data->header.crc32);
-    }
+    prepare_flush();
     device_->write(persisted_data.address, persisted_data.raw_data,
                     persisted_data.size);
     persisted_data.is_dirty = false;
     ms_page_count_flushed++;
+    ms_page_flush_writes++;
   }
 }
 
+uint32_t
+Page::calculate_crc32() const
+{
+  return Checksum::calculate(device_->config.checksum,
+                  persisted_data.raw_data->header.payload,
+                  persisted_data.size - (sizeof(PPageHeader) - 1),
+                  (uint32_t)persisted_data.address);
+}
+
+void
+Page::prepare_flush()
+{
+  // update crc32
+  if (isset(device_->config.flags, UPS_ENABLE_CRC32)
+      && likely(!persisted_data.is_without_header))
+    persisted_data.raw_data->header.crc32 = calculate_crc32();
+}
+
+void
+Page::release_allocated_buffer()
+{
+  // the buffer is returned to the device which allocated it
+  if (persisted_data.is_allocated && persisted_data.raw_data)
+    device_->release_page_buffer(persisted_data.raw_data);
+  persisted_data.raw_data = 0;
+  persisted_data.is_allocated = false;
+}
+
 void
 Page::free_buffer()
 {
-  if (node_proxy_) {
-    delete node_proxy_;
-    node_proxy_ = 0;
-  }
+  delete node_proxy_.exchange(0);
 }
 
 } // namespace upscaledb
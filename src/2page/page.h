@@ -100,13 +100,14 @@ class Page {
 #ifdef UPS_DEBUG
         mutex.safe_unlock();
 #endif
-        if (is_allocated)
-          Memory::release(raw_data);
+        // the buffer is released in ~Page(), because it belongs to the
+        // Device
         raw_data = 0;
       }
 
-      // The spinlock is locked if the page is in use or written to disk
-      Spinlock mutex;
+      // The spinlock is locked if the page is in use or written to disk;
+      // read-only operations lock it in shared mode
+      ReadWriteSpinlock mutex;
 
       // address of this page - the absolute offset in the file
       uint64_t address;
@@ -117,7 +118,7 @@ class Page {
       // is this page dirty and needs to be flushed to disk?
       bool is_dirty;
 
-      // Page buffer was allocated with malloc() (if not then it was mapped
+      // Page buffer was allocated by the Device (if not then it was mapped
       // with mmap)
       bool is_allocated;
 
@@ -148,8 +149,14 @@ class Page {
       // a bucket in the hash table of the cache
       kListBucket             = 2,
 
+      // the cache's FIFO queue of recently added pages (2Q policy only)
+      kListCacheIn            = 3,
+
+      // the cache's queue of frequently used pages (2Q policy only)
+      kListCacheMain          = 4,
+
       // array limit
-      kListMax                = 3
+      kListMax                = 5
     };
 
     // non-persistent page flags
@@ -199,10 +206,31 @@ class Page {
     uint32_t usable_page_size();
 
     // Returns the spinlock
-    Spinlock &mutex() {
+    ReadWriteSpinlock &mutex() {
       return persisted_data.mutex;
     }
 
+    // Returns true if the page was accessed since the cache last visited it
+    bool is_referenced() const {
+      return is_referenced_;
+    }
+
+    // Sets or clears the "referenced" flag; used by the cache's replacement
+    // policy
+    void set_referenced(bool referenced) {
+      is_referenced_ = referenced;
+    }
+
+    // Returns the cache's logical time when the page was added to the cache
+    uint64_t cache_timestamp() const {
+      return cache_timestamp_;
+    }
+
+    // Sets the cache's logical time when the page was added to the cache
+    void set_cache_timestamp(uint64_t timestamp) {
+      cache_timestamp_ = timestamp;
+    }
+
     // Returns the database which manages this page; can be NULL if this
     // page belongs to the Environment (i.e. for freelist-pages)
     LocalDatabase *db() {
@@ -244,6 +272,10 @@ class Page {
       persisted_data.raw_data->header.crc32 = crc32;
     }
 
+    // Calculates the crc32 of the payload with the checksum algorithm of
+    // the Environment
+    uint32_t calculate_crc32() const;
+
     // Returns the lsn
     uint64_t lsn() const {
       return persisted_data.raw_data->header.lsn;
@@ -289,7 +321,7 @@ class Page {
       persisted_data.is_dirty = dirty;
     }
 
-    // Returns true if the page's buffer was allocated with malloc
+    // Returns true if the page's buffer was allocated by the Device
     bool is_allocated() const {
       return persisted_data.is_allocated;
     }
@@ -304,7 +336,8 @@ class Page {
       persisted_data.is_without_header = is_without_header;
     }
 
-    // Assign a buffer which was allocated with malloc()
+    // Assign a buffer which was allocated by the Device; it is released
+    // with Device::release_page_buffer()
     void assign_allocated_buffer(void *buffer, uint64_t address) {
       free_buffer();
       persisted_data.raw_data = (PPageData *)buffer;
@@ -315,11 +348,16 @@ class Page {
     // Assign a buffer from mmapped storage
     void assign_mapped_buffer(void *buffer, uint64_t address) {
       free_buffer();
+      release_allocated_buffer();
       persisted_data.raw_data = (PPageData *)buffer;
       persisted_data.is_allocated = false;
       persisted_data.address = address;
     }
 
+    // Updates the checksum of a dirty page before it is written to disk;
+    // called by flush() and by Devices which write pages in batches
+    void prepare_flush();
+
     // Free resources associated with the buffer
     void free_buffer();
 
@@ -333,6 +371,18 @@ class Page {
       cursor_list_ = cursor;
     }
 
+    // Returns true if cursors are coupled to this page
+    bool has_cursors() {
+      ScopedSpinlock lock(cursor_mutex_);
+      return cursor_list_ != 0;
+    }
+
+    // Returns the spinlock which protects the linked list of cursors;
+    // concurrent read-only operations couple and uncouple their cursors
+    Spinlock &cursor_mutex() {
+      return cursor_mutex_;
+    }
+
     // Allocates a new page from the device
     // |flags|: either 0 or kInitializeWithZeroes
     void alloc(uint32_t type, uint32_t flags = 0);
@@ -353,6 +403,15 @@ class Page {
       node_proxy_ = proxy;
     }
 
+    // Sets the cached BtreeNodeProxy unless a concurrent reader was faster;
+    // returns the proxy which is cached
+    BtreeNodeProxy *set_node_proxy_if_null(BtreeNodeProxy *proxy) {
+      BtreeNodeProxy *expected = 0;
+      if (node_proxy_.compare_exchange_strong(expected, proxy))
+        return proxy;
+      return expected;
+    }
+
     // Returns the next page in a linked list
     Page *next(int list) {
       return list_node.next[list];
@@ -364,7 +423,11 @@ class Page {
     }
 
     // tracks number of flushed pages
-    static uint64_t ms_page_count_flushed;
+    static boost::atomic<uint64_t> ms_page_count_flushed;
+
+    // tracks number of write operations for flushing pages; adjacent pages
+    // can be flushed with a single write
+    static boost::atomic<uint64_t> ms_page_flush_writes;
 
     // the persistent data of this page
     PersistedData persisted_data;
@@ -373,6 +436,9 @@ class Page {
     IntrusiveListNode<Page, Page::kListMax> list_node;
 
   private:
+    // Returns an allocated buffer to the Device
+    void release_allocated_buffer();
+
     // the Device for allocating storage
     Device *device_;
 
@@ -382,8 +448,17 @@ class Page {
     // linked list of all cursors which are coupled to that page
     BtreeCursor *cursor_list_;
 
-    // the cached BtreeNodeProxy object
-    BtreeNodeProxy *node_proxy_;
+    // protects |cursor_list_|
+    Spinlock cursor_mutex_;
+
+    // the cached BtreeNodeProxy object; created lazily by concurrent readers
+    boost::atomic<BtreeNodeProxy *> node_proxy_;
+
+    // true if the page was accessed since the cache last visited it
+    bool is_referenced_;
+
+    // the cache's logical time when the page was added to the cache
+    uint64_t cache_timestamp_;
 };
 
 } // namespace upscaledb
@@ -16,7 +16,7 @@
  */
 
 /*
- * The worker thread
+ * The worker threads
  */
 
 #ifndef UPS_WORKER_H
@@ -24,7 +24,9 @@
 
 #include "0root/root.h"
 
+#include <vector>
 #include <boost/asio.hpp>
+#include <boost/atomic.hpp>
 #include <boost/thread/thread.hpp>
 
 // Always verify that a file of level N does not include headers > N!
@@ -48,20 +50,76 @@ struct WorkerThread {
 
   WorkerPool &pool; 
 };
+
+// Wraps a work item; decrements the pool's queue depth after the item
+// was processed, even if it threw an exception
+template<typename F>
+struct CountedWorkItem {
+  // Decrements the queue depth when it goes out of scope
+  struct DepthGuard {
+    DepthGuard(boost::atomic<size_t> *queue_depth_)
+      : queue_depth(queue_depth_) {
+    }
+
+    ~DepthGuard() {
+      queue_depth->fetch_sub(1);
+    }
+
+    boost::atomic<size_t> *queue_depth;
+  };
+
+  CountedWorkItem(const F &f_, boost::atomic<size_t> *queue_depth_)
+    : f(f_), queue_depth(queue_depth_) {
+  }
+
+  void operator()() {
+    DepthGuard guard(queue_depth);
+    f();
+  }
+
+  F f;
+  boost::atomic<size_t> *queue_depth;
+};
  
 // the actual thread pool
 struct WorkerPool {
   // the constructor just launches some amount of workers
   WorkerPool(size_t num_threads)
-    : working(service), strand(service) {
+    : working(service), strand(service), queue_depth(0), max_queue_depth(0) {
+    if (num_threads == 0)
+      num_threads = 1;
     for (size_t i = 0; i < num_threads; ++i)
       workers.push_back(new boost::thread(WorkerThread(*this)));
   }
 
-  // Add a new work item to the pool
+  // Add a new work item to the pool. All items which are added with this
+  // method are processed sequentially, in the order in which they were
+  // added
   template<typename F>
   void enqueue(F &f) {
-    strand.post(f);
+    strand.post(counted(f));
+  }
+
+  // Add a new work item to the pool. The item is processed by the next
+  // idle thread, and can run in parallel to other work items
+  template<typename F>
+  void enqueue_parallel(const F &f) {
+    service.post(counted(f));
+  }
+
+  // Returns the number of threads
+  size_t num_threads() const {
+    return workers.size();
+  }
+
+  // Returns the number of work items which were not yet processed
+  size_t get_queue_depth() const {
+    return queue_depth.load();
+  }
+
+  // Returns the maximum number of queued work items
+  size_t get_max_queue_depth() const {
+    return max_queue_depth.load();
   }
 
   // the destructor joins all threads
@@ -74,13 +132,31 @@ struct WorkerPool {
     }
   }
 
+  // Wraps |f| in a CountedWorkItem and updates the queue depth
+  template<typename F>
+  CountedWorkItem<F> counted(const F &f) {
+    size_t depth = queue_depth.fetch_add(1) + 1;
+    size_t max = max_queue_depth.load();
+    while (depth > max && !max_queue_depth.compare_exchange_weak(max, depth))
+      ;
+    return CountedWorkItem<F>(f, &queue_depth);
+  }
+
   // keep track of the threads so we can join them
   std::vector<boost::thread *> workers;
    
   // the io_service we are wrapping
   boost::asio::io_service service;
   boost::asio::io_service::work working;
-  boost::asio::strand strand;
+
+  // serializes the work items which were added with enqueue()
+  boost::asio::io_service::strand strand;
+
+  // the number of work items which were not yet processed
+  boost::atomic<size_t> queue_depth;
+
+  // the maximum number of queued work items
+  boost::atomic<size_t> max_queue_depth;
 };
 
 inline void
@@ -159,8 +159,8 @@ struct BlobManager
   // Usage tracking - number of blobs allocated
   uint64_t metric_total_allocated;
 
-  // Usage tracking - number of blobs read
-  uint64_t metric_total_read;
+  // Usage tracking - number of blobs read; incremented by concurrent readers
+  boost::atomic<uint64_t> metric_total_read;
 };
 
 } // namespace upscaledb
@@ -20,9 +20,8 @@
 #include <algorithm>
 #include <vector>
 
-#include "3rdparty/murmurhash3/MurmurHash3.h"
-
 // Always verify that a file of level N does not include headers > N!
+#include "1base/checksum.h"
 #include "1base/error.h"
 #include "1base/dynamic_array.h"
 #include "2compressor/compressor.h"
@@ -215,7 +214,8 @@ read_chunk(DiskBlobManager *dbm, Context *context, Page *page, Page **ppage,
   else
     data = page->raw_payload();
 
-  uint32_t read_start = (uint32_t)(address - page->address());
+  // |page| is null if the data was read from mapped memory
+  uint32_t read_start = (uint32_t)(address - pageid);
   return &data[read_start];
 }
 
@@ -374,9 +374,8 @@ DiskBlobManager::allocate(Context *context, ups_record_t *record,
     // multi-page blobs store their CRC in the first freelist offset
     if (unlikely(num_pages > 1
             && (config->flags & UPS_ENABLE_CRC32))) {
-      uint32_t crc32 = 0;
-      MurmurHash3_x86_32(record->data, record->size, 0, &crc32);
-      header->freelist[0].offset = crc32;
+      header->freelist[0].offset = Checksum::calculate(config->checksum,
+                      record->data, record->size, 0);
     }
 
     address = page->address() + kPageOverhead;
@@ -461,8 +460,11 @@ DiskBlobManager::read(Context *context, uint64_t blob_id,
       assert(compressor != 0);
 
       // read into temporary buffer; we reuse the compressor's memory arena
-      // for this
-      ByteArray *dest = &compressor->arena;
+      // for this, unless other read-only operations can use it concurrently
+      ByteArray local;
+      ByteArray *dest = context->changeset.is_read_only
+                            ? &local
+                            : &compressor->arena;
       dest->resize(blob_header->allocated_size - sizeof(PBlobHeader));
 
       copy_chunk(this, context, page, 0, blob_id + sizeof(PBlobHeader),
@@ -502,8 +504,8 @@ DiskBlobManager::read(Context *context, uint64_t blob_id,
   if (unlikely(header->num_pages > 1
         && (config->flags & UPS_ENABLE_CRC32))) {
     uint32_t old_crc32 = header->freelist[0].offset;
-    uint32_t new_crc32;
-    MurmurHash3_x86_32(record->data, record->size, 0, &new_crc32);
+    uint32_t new_crc32 = Checksum::calculate(config->checksum,
+                    record->data, record->size, 0);
 
     if (old_crc32 != new_crc32) {
       ups_trace(("crc32 mismatch in page %lu: 0x%lx != 0x%lx",
@@ -588,9 +590,8 @@ DiskBlobManager::overwrite(Context *context, uint64_t old_blobid,
     // multi-page blobs store their CRC in the first freelist offset
     if (unlikely(header->num_pages > 1
             && (config->flags & UPS_ENABLE_CRC32))) {
-      uint32_t crc32 = 0;
-      MurmurHash3_x86_32(record->data, record->size, 0, &crc32);
-      header->freelist[0].offset = crc32;
+      header->freelist[0].offset = Checksum::calculate(config->checksum,
+                      record->data, record->size, 0);
     }
 
     // the old rid is the new rid
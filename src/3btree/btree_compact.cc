@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2005-2016 Christoph Rupp (chris@crupp.de).
+ * All Rights Reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the file COPYING for License information.
+ */
+
+/*
+ * btree compaction; moves nodes to free pages at the beginning of the file
+ */
+
+#include "0root/root.h"
+
+#include <string.h>
+
+// Always verify that a file of level N does not include headers > N!
+#include "2page/page.h"
+#include "3page_manager/page_manager.h"
+#include "3btree/btree_index.h"
+#include "3btree/btree_cursor.h"
+#include "3btree/btree_node_proxy.h"
+
+#ifndef UPS_ROOT_H
+#  error "root.h was not included"
+#endif
+
+namespace upscaledb {
+
+void
+BtreeIndex::collect_nodes(Context *context, uint64_t min_address,
+                BtreeNodeMap *nodes)
+{
+  PageManager *page_manager = state.page_manager;
+
+  Page *page = page_manager->fetch(context, root_address());
+  BtreeNodeProxy *node = get_node_from_page(page);
+  if (page->address() >= min_address)
+    (*nodes)[page->address()] = BtreeNodeRef(this, 0, 0, node->is_leaf());
+
+  // walk through the internal levels, from left to right; the children
+  // of one level are the nodes of the next level
+  while (!node->is_leaf()) {
+    Page *first = page_manager->fetch(context, node->left_child());
+    bool is_leaf = get_node_from_page(first)->is_leaf();
+
+    while (true) {
+      uint64_t parent = page->address();
+      if (node->left_child() >= min_address)
+        (*nodes)[node->left_child()] = BtreeNodeRef(this, parent, -1,
+                        is_leaf);
+      for (int slot = 0; slot < (int)node->length(); slot++) {
+        uint64_t child = node->record_id(context, slot);
+        if (child >= min_address)
+          (*nodes)[child] = BtreeNodeRef(this, parent, slot, is_leaf);
+      }
+
+      if (!node->right_sibling())
+        break;
+      page = page_manager->fetch(context, node->right_sibling());
+      node = get_node_from_page(page);
+    }
+
+    page = first;
+    node = get_node_from_page(page);
+  }
+}
+
+void
+BtreeIndex::relocate_node(Context *context, uint64_t address,
+                const BtreeNodeRef &ref)
+{
+  PageManager *page_manager = state.page_manager;
+
+  Page *page = page_manager->fetch(context, address);
+  BtreeNodeProxy *node = get_node_from_page(page);
+  assert(node->is_leaf() == ref.is_leaf);
+
+  // the cursors will couple to the new page when they are used again
+  if (node->is_leaf())
+    BtreeCursor::uncouple_all_cursors(context, page, 0);
+
+  // copy the node; the page header is initialized by alloc()
+  Page *new_page = page_manager->alloc(context, page->type());
+  ::memcpy(new_page->payload(), page->payload(), page->usable_page_size());
+  BtreeNodeProxy *new_node = get_node_from_page(new_page);
+
+  // update the parent (or the PBtreeHeader, if this is the root)
+  if (ref.parent == 0) {
+    assert(address == root_address());
+    set_root_address(new_page->address());
+    Page *header = page_manager->fetch(context, 0);
+    header->set_dirty(true);
+  }
+  else {
+    Page *parent = page_manager->fetch(context, ref.parent);
+    BtreeNodeProxy *parent_node = get_node_from_page(parent);
+    if (ref.slot == -1) {
+      assert(parent_node->left_child() == address);
+      parent_node->set_left_child(new_page->address());
+    }
+    else {
+      assert(parent_node->record_id(context, ref.slot) == address);
+      parent_node->set_record_id(context, ref.slot, new_page->address());
+    }
+    parent->set_dirty(true);
+  }
+
+  // fix the linked list
+  if (new_node->left_sibling()) {
+    Page *p = page_manager->fetch(context, new_node->left_sibling());
+    get_node_from_page(p)->set_right_sibling(new_page->address());
+    p->set_dirty(true);
+  }
+  if (new_node->right_sibling()) {
+    Page *p = page_manager->fetch(context, new_node->right_sibling());
+    get_node_from_page(p)->set_left_sibling(new_page->address());
+    p->set_dirty(true);
+  }
+
+  state.statistics.reset_page(address);
+  page_manager->del(context, page);
+}
+
+} // namespace upscaledb
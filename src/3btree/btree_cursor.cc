@@ -18,6 +18,8 @@
 #include "0root/root.h"
 
 #include <string.h>
+#include <algorithm>
+#include <vector>
 
 // Always verify that a file of level N does not include headers > N!
 #include "1base/error.h"
@@ -41,6 +43,7 @@ remove_cursor_from_page(BtreeCursor *cursor, Page *page)
   BtreeCursorState &st_ = cursor->st_;
   BtreeCursor *n, *p;
 
+  ScopedSpinlock lock(page->cursor_mutex());
   if (cursor == page->cursor_list()) {
     n = st_.m_next_in_page;
     if (n)
@@ -182,6 +185,42 @@ couple_or_throw(BtreeCursor *cursor, Context *context)
     throw Exception(UPS_CURSOR_IS_NIL);
 }
 
+// Read-ahead for sequential scans: after the cursor moved to the right
+// sibling |page| a few times in a row, the blobs of the records in |page|
+// and the following leaves are loaded asynchronously into the cache
+static void
+read_ahead(BtreeCursor *cursor, Context *context, Page *page)
+{
+  BtreeCursorState &st_ = cursor->st_;
+  LocalDatabase *db = st_.m_parent->ldb();
+  LocalEnvironment *env = db->lenv();
+  uint32_t window = env->config().read_ahead_pages;
+
+  if (window == 0 || isset(env->config().flags, UPS_IN_MEMORY)
+        || ++st_.m_sequential_leaves < BtreeCursor::kReadAheadThreshold)
+    return;
+
+  BtreeNodeProxy *node = st_.m_btree->get_node_from_page(page);
+
+  // collect the (first) pages of the blobs
+  uint64_t page_size = env->config().page_size_bytes;
+  std::vector<uint64_t> blob_pages;
+  for (uint32_t i = 0; i < node->length(); i++) {
+    uint64_t blob_id = node->blob_id(context, i);
+    if (blob_id == 0)
+      continue;
+    uint64_t address = blob_id - blob_id % page_size;
+    if (blob_pages.empty() || blob_pages.back() != address)
+      blob_pages.push_back(address);
+  }
+  env->page_manager()->prefetch_pages(db, blob_pages);
+
+  // the window of leaves is extended after every half window
+  uint32_t step = std::max(window / 2, 1u);
+  if ((st_.m_sequential_leaves - BtreeCursor::kReadAheadThreshold) % step == 0)
+    env->page_manager()->prefetch_leaves(db, node->right_sibling(), window);
+}
+
 // move cursor to the next key
 static inline ups_status_t
 move_next(BtreeCursor *cursor, Context *context, uint32_t flags)
@@ -236,6 +275,7 @@ move_next(BtreeCursor *cursor, Context *context, uint32_t flags)
   // couple this cursor to the smallest key in this page
   cursor->couple_to_page(page, 0, 0);
 
+  read_ahead(cursor, context, page);
   return 0;
 }
 
@@ -247,6 +287,9 @@ move_previous(BtreeCursor *cursor, Context *context, uint32_t flags)
   LocalDatabase *db = st_.m_parent->ldb();
   LocalEnvironment *env = db->lenv();
 
+  // the scan is no longer sequential
+  st_.m_sequential_leaves = 0;
+
   // uncoupled cursor: couple it
   couple_or_throw(cursor, context);
 
@@ -309,6 +352,7 @@ BtreeCursor::BtreeCursor(LocalCursor *parent)
   st_.m_coupled_index = 0;
   st_.m_next_in_page = 0;
   st_.m_previous_in_page = 0;
+  st_.m_sequential_leaves = 0;
   ::memset(&st_.m_uncoupled_key, 0, sizeof(st_.m_uncoupled_key));
   st_.m_btree = parent->ldb()->btree_index();
 }
@@ -325,6 +369,7 @@ BtreeCursor::set_to_nil()
 
   st_.m_state = BtreeCursor::kStateNil;
   st_.m_duplicate_index = 0;
+  st_.m_sequential_leaves = 0;
 }
 
 void
@@ -366,6 +411,7 @@ BtreeCursor::couple_to_page(Page *page, uint32_t index, int duplicate_index)
   st_.m_coupled_page = page;
 
   // add the cursor to the page
+  ScopedSpinlock lock(page->cursor_mutex());
   if (page->cursor_list()) {
     st_.m_next_in_page = page->cursor_list();
     st_.m_previous_in_page = 0;
@@ -516,6 +562,7 @@ BtreeCursor::move_to_next_page(Context *context)
   Page *page = env->page_manager()->fetch(context, node->right_sibling(),
                         PageManager::kReadOnly);
   couple_to_page(page, 0, 0);
+  read_ahead(this, context, page);
   return 0;
 }
 
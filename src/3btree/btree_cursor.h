@@ -92,6 +92,10 @@ struct BtreeCursorState
 
   // Linked list of cursors which point to the same page
   BtreeCursor *m_next_in_page, *m_previous_in_page;
+
+  // the number of leaf pages which were reached by moving to the right
+  // sibling in a row; used to detect sequential scans
+  uint32_t m_sequential_leaves;
 };
 
 
@@ -106,7 +110,11 @@ struct BtreeCursor
     // Cursor flag: the cursor is coupled
     kStateCoupled   = 1,
     // Cursor flag: the cursor is uncoupled
-    kStateUncoupled = 2
+    kStateUncoupled = 2,
+
+    // The read-ahead starts after the cursor moved to the right sibling
+    // this many times in a row
+    kReadAheadThreshold = 2
   };
 
   // Constructor
@@ -64,6 +64,13 @@ struct BtreeEraseAction : public BtreeUpdateAction
         BtreeNodeProxy *node = btree->get_node_from_page(coupled_page);
         assert(node->is_leaf());
 
+        // Keep a copy of the last key of the page; it's required to remove
+        // the page if it becomes empty
+        ByteArray arena;
+        ups_key_t last_key = {0};
+        if (node->length() == 1)
+          node->key(context, coupled_index, &arena, &last_key);
+
         // Now try to delete the key. This can require a page split if the
         // KeyList is not "delete-stable" (some compressed lists can
         // grow when keys are deleted).
@@ -75,7 +82,13 @@ struct BtreeEraseAction : public BtreeUpdateAction
             throw ex;
           goto fall_through;
         }
-        // TODO if the page is empty then move it to the freelist
+        // if the page is empty then move it to the freelist; the cursor
+        // is set to nil by the caller anyway
+        if (node->length() == 0) {
+          cursor->set_to_nil();
+          key = &last_key;
+          remove_empty_leaf();
+        }
         return 0;
 
 fall_through:
@@ -107,6 +120,14 @@ fall_through:
     return remove_entry(page, parent, slot);
   }
 
+  // Descends to the (now empty) leaf of |key| a second time; the traversal
+  // removes empty leaves from the tree
+  void remove_empty_leaf() {
+    Page *parent;
+    BtreeStatistics::InsertHints hints = {0};
+    traverse_tree(key, hints, &parent);
+  }
+
   ups_status_t remove_entry(Page *page, Page *parent, int slot) {
     LocalDatabase *db = btree->db();
     BtreeNodeProxy *node = btree->get_node_from_page(page);
@@ -208,6 +229,10 @@ fall_through:
       return erase();
     }
 
+    // if the leaf is now empty then move it to the freelist
+    if (parent != 0 && node->length() == 0)
+      remove_empty_leaf();
+
     return 0;
   }
 
@@ -51,6 +51,12 @@ template<typename KeyList, typename RecordList>
 class BaseNodeImpl
 {
   public:
+    enum {
+      // Concurrent readers of this node have to be serialized because the
+      // KeyList or the RecordList modify their caches while they are read
+      kLockReaders = KeyList::kCachesOnRead || RecordList::kCachesOnRead
+    };
+
     // Constructor
     BaseNodeImpl(Page *page_)
       : page(page_), node(PBtreeNode::from_page(page_)),
@@ -416,6 +422,11 @@ class BaseNodeImpl
       records.set_record_id(slot, ptr);
     }
 
+    // Returns the id of the blob which stores the record
+    uint64_t blob_id(Context *context, int slot) const {
+      return records.blob_id(slot);
+    }
+
     // The page we're operating on
     Page *page;
 
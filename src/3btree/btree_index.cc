@@ -118,6 +118,24 @@ BtreeIndex::find_lower_bound(Context *context, Page *page, const ups_key_t *key,
   return state.page_manager->fetch(context, record_id, page_manager_flags);
 }
 
+BtreeNodeProxy *
+BtreeIndex::create_node_proxy(Page *page)
+{
+  BtreeNodeProxy *proxy;
+  PBtreeNode *node = PBtreeNode::from_page(page);
+  if (node->is_leaf())
+    proxy = leaf_node_from_page_impl(page);
+  else
+    proxy = internal_node_from_page_impl(page);
+
+  // readers only hold a shared lock on the page; if another reader
+  // cached its proxy in the meantime then use that one
+  BtreeNodeProxy *cached = page->set_node_proxy_if_null(proxy);
+  if (cached != proxy)
+    delete proxy;
+  return cached;
+}
+
 //
 // visitor object for estimating / counting the number of keys
 ///
@@ -21,6 +21,7 @@
 #include "0root/root.h"
 
 #include <algorithm>
+#include <map>
 
 // Always verify that a file of level N does not include headers > N!
 #include "1base/abi.h"
@@ -138,6 +139,35 @@ struct BtreeIndexTraits
 };
 
 
+struct BtreeIndex;
+
+//
+// A reference to a btree node, collected by BtreeIndex::collect_nodes()
+// for the compaction
+//
+struct BtreeNodeRef
+{
+  BtreeNodeRef(BtreeIndex *btree_ = 0, uint64_t parent_ = 0, int slot_ = 0,
+                  bool is_leaf_ = true)
+    : btree(btree_), parent(parent_), slot(slot_), is_leaf(is_leaf_) {
+  }
+
+  // the btree which owns the node
+  BtreeIndex *btree;
+
+  // address of the parent node; 0 if the node is the root
+  uint64_t parent;
+
+  // the slot in the parent which points to the node; -1 for the left child
+  int slot;
+
+  // true if the node is a leaf
+  bool is_leaf;
+};
+
+// Maps the address of a node to its BtreeNodeRef
+typedef std::map<uint64_t, BtreeNodeRef> BtreeNodeMap;
+
 struct BtreeIndexState
 {
   // The Environment's page manager
@@ -248,6 +278,17 @@ struct BtreeIndex
   // in-memory Databases and to clean up when deleting on-disk Databases.
   void drop(Context *context);
 
+  // Adds all nodes at or above |min_address| to |nodes|. Only the internal
+  // nodes (and the first leaf) are read.
+  void collect_nodes(Context *context, uint64_t min_address,
+                  BtreeNodeMap *nodes);
+
+  // Moves the node at |address| to a new page, which is allocated from the
+  // Freelist, and updates its parent and its siblings. The old page is
+  // moved to the Freelist.
+  void relocate_node(Context *context, uint64_t address,
+                  const BtreeNodeRef &ref);
+
   // Searches |parent| page for key |key| and returns the child
   // page in |child|.
   //
@@ -268,18 +309,10 @@ struct BtreeIndex
 
   // Returns a BtreeNodeProxy for a Page
   BtreeNodeProxy *get_node_from_page(Page *page) {
-    if (page->node_proxy())
-      return page->node_proxy();
-
-    BtreeNodeProxy *proxy;
-    PBtreeNode *node = PBtreeNode::from_page(page);
-    if (node->is_leaf())
-      proxy = leaf_node_from_page_impl(page);
-    else
-      proxy = internal_node_from_page_impl(page);
-
-    page->set_node_proxy(proxy);
-    return proxy;
+    BtreeNodeProxy *proxy = page->node_proxy();
+    if (proxy)
+      return proxy;
+    return create_node_proxy(page);
   }
 
   // Returns the usage metrics
@@ -304,6 +337,9 @@ struct BtreeIndex
     return state.leaf_traits->test_get_classname();
   }
 
+  // Creates the BtreeNodeProxy of a Page and caches it in the Page
+  BtreeNodeProxy *create_node_proxy(Page *page);
+
   // Implementation of get_node_from_page() (for leaf nodes)
   BtreeNodeProxy *leaf_node_from_page_impl(Page *page) const {
     return state.leaf_traits->get_node_from_page_impl(page);
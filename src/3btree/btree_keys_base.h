@@ -49,6 +49,9 @@ struct BaseKeyList
 
     // A flag whether this KeyList supports the scan() call
     kSupportsBlockScans = 0,
+
+    // This KeyList does NOT modify its state when it is read
+    kCachesOnRead = 0,
   };
 
   BaseKeyList()
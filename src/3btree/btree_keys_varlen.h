@@ -95,6 +95,9 @@ class VariableLengthKeyList : public BaseKeyList
 
       // This KeyList can reduce its capacity in order to release storage
       kCanReduceCapacity = 1,
+
+      // This KeyList caches extended keys when they are read
+      kCachesOnRead = 1,
     };
 
     // Constructor
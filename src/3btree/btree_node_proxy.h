@@ -176,6 +176,10 @@ struct BtreeNodeProxy
   // Only for internal nodes!
   virtual void set_record_id(Context *context, int slot, uint64_t id) = 0;
 
+  // Returns the id of the blob which stores the record at the given |slot|,
+  // or 0 if the record is not stored in a blob. Only for leaf nodes!
+  virtual uint64_t blob_id(Context *context, int slot) const = 0;
+
   // Returns the full record and stores it in |dest|. The record is identified
   // by |slot| and |duplicate_index|. TINY and SMALL records are handled
   // correctly, as well as UPS_DIRECT_ACCESS.
@@ -243,6 +247,31 @@ struct BtreeNodeProxy
   virtual std::string test_get_classname() const = 0;
 
   Page *page;
+
+  // Serializes concurrent readers of nodes whose KeyList or RecordList
+  // cache decoded blocks, extended keys or duplicate tables. Writers hold
+  // the Environment exclusively and do not need it
+  mutable Spinlock mutex;
+};
+
+//
+// Locks the |mutex| of a node, but only if the node modifies its state
+// when it is read. All other nodes are read without a lock
+//
+struct ScopedNodeReadLock
+{
+  ScopedNodeReadLock(Spinlock &mutex, bool enabled)
+    : m_mutex(enabled ? &mutex : 0) {
+    if (m_mutex)
+      m_mutex->lock();
+  }
+
+  ~ScopedNodeReadLock() {
+    if (m_mutex)
+      m_mutex->unlock();
+  }
+
+  Spinlock *m_mutex;
 };
 
 //
@@ -348,12 +377,14 @@ struct BtreeNodeProxyImpl : public BtreeNodeProxy
 
   // Checks the integrity of the node
   virtual void check_integrity(Context *context) const {
+    ScopedNodeReadLock lock(mutex, NodeImpl::kLockReaders);
     impl.check_integrity(context);
   }
 
   // Iterates all keys, calls the |visitor| on each
   virtual void scan(Context *context, ScanVisitor *visitor,
                   SelectStatement *statement, uint32_t start, bool distinct) {
+    ScopedNodeReadLock lock(mutex, NodeImpl::kLockReaders);
     impl.scan(context, visitor, statement, start, distinct);
   }
 
@@ -365,13 +396,16 @@ struct BtreeNodeProxyImpl : public BtreeNodeProxy
 
   // Compares a public key and an internal key
   virtual int compare(Context *context, const ups_key_t *lhs, int rhs) {
+    ScopedNodeReadLock lock(mutex, NodeImpl::kLockReaders);
     Comparator cmp(page->db());
     return impl.compare(context, lhs, rhs, cmp);
   }
 
   // Returns true if the public key and an internal key are equal
   virtual bool equals(Context *context, const ups_key_t *lhs, int rhs) {
-    return 0 == compare(context, lhs, rhs);
+    ScopedNodeReadLock lock(mutex, NodeImpl::kLockReaders);
+    Comparator cmp(page->db());
+    return 0 == impl.compare(context, lhs, rhs, cmp);
   }
 
   // Searches the node for the key and returns the slot of this key.
@@ -387,6 +421,7 @@ struct BtreeNodeProxyImpl : public BtreeNodeProxy
         *precord_id = left_child();
       return -1;
     }
+    ScopedNodeReadLock lock(mutex, NodeImpl::kLockReaders);
     Comparator cmp(page->db());
     return impl.find_lower_bound(context, key, cmp, precord_id ? precord_id : 0,
                             pcmp ? pcmp : &dummy);
@@ -397,6 +432,7 @@ struct BtreeNodeProxyImpl : public BtreeNodeProxy
   virtual int find(Context *context, ups_key_t *key) {
     if (unlikely(length() == 0))
       return -1;
+    ScopedNodeReadLock lock(mutex, NodeImpl::kLockReaders);
     Comparator cmp(page->db());
     return impl.find(context, key, cmp);
   }
@@ -405,12 +441,14 @@ struct BtreeNodeProxyImpl : public BtreeNodeProxy
   // and respects UPS_KEY_USER_ALLOC in dest->flags.
   virtual void key(Context *context, int slot, ByteArray *arena,
                   ups_key_t *dest) {
+    ScopedNodeReadLock lock(mutex, NodeImpl::kLockReaders);
     impl.key(context, slot, arena, dest);
   }
 
   // Returns the number of records of a key at the given |slot|
   virtual int record_count(Context *context, int slot) {
     assert(slot < (int)length());
+    ScopedNodeReadLock lock(mutex, NodeImpl::kLockReaders);
     return impl.record_count(context, slot);
   }
 
@@ -421,6 +459,7 @@ struct BtreeNodeProxyImpl : public BtreeNodeProxy
                   ups_record_t *record, uint32_t flags,
                   int duplicate_index = 0) {
     assert(slot < (int)length());
+    ScopedNodeReadLock lock(mutex, NodeImpl::kLockReaders);
     impl.record(context, slot, arena, record, flags, duplicate_index);
   }
 
@@ -435,6 +474,7 @@ struct BtreeNodeProxyImpl : public BtreeNodeProxy
   virtual uint32_t record_size(Context *context, int slot,
                   int duplicate_index) {
     assert(slot < (int)length());
+    ScopedNodeReadLock lock(mutex, NodeImpl::kLockReaders);
     return impl.record_size(context, slot, duplicate_index);
   }
 
@@ -445,6 +485,12 @@ struct BtreeNodeProxyImpl : public BtreeNodeProxy
     return impl.record_id(context, slot);
   }
 
+  // Returns the id of the blob which stores the record at the given |slot|
+  virtual uint64_t blob_id(Context *context, int slot) const {
+    assert(slot < (int)length());
+    return impl.blob_id(context, slot);
+  }
+
   // Sets the record id of the key at the given |slot|
   // Only for internal nodes!
   virtual void set_record_id(Context *context, int slot, uint64_t id) {
@@ -37,6 +37,9 @@ struct BaseRecordList
   enum {
     // A flag whether this RecordList supports the scan() call
     kSupportsBlockScans = 0,
+
+    // This RecordList does NOT modify its state when it is read
+    kCachesOnRead = 0,
   };
 
   BaseRecordList()
@@ -69,6 +72,12 @@ struct BaseRecordList
     assert(!"shouldn't be here");
   }
 
+  // Returns the id of the blob which stores the record, or 0 if the
+  // record is not stored in a blob
+  uint64_t blob_id(int slot) const {
+    return 0;
+  }
+
   // The size of the range (in bytes)
   size_t m_range_size;
 };
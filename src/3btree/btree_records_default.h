@@ -246,6 +246,12 @@ struct DefaultRecordList : public BaseRecordList
     return data[slot];
   }
 
+  // Returns the id of the blob which stores the record, or 0 if the
+  // record is stored inline
+  uint64_t blob_id(int slot) const {
+    return is_record_inline(slot) ? 0 : record_id(slot);
+  }
+
   // Returns true if there's not enough space for another record
   bool requires_split(size_t node_count) const {
     return (node_count + 1) * full_record_size() >= m_range_size;
@@ -495,7 +495,10 @@ class DuplicateRecordList : public BaseRecordList
   public:
     enum {
       // A flag whether this RecordList has sequential data
-      kHasSequentialData = 0
+      kHasSequentialData = 0,
+
+      // This RecordList caches duplicate tables when they are read
+      kCachesOnRead = 1
     };
 
     // Constructor
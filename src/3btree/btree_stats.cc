@@ -34,26 +34,29 @@
 namespace upscaledb {
 
 BtreeStatistics::BtreeStatistics()
+  : find_leaf_page(0), find_leaf_count(0)
 {
   ::memset(&state, 0, sizeof(state));
 }
 
+// The find statistics are only hints; concurrent readers can overwrite
+// each other's updates, which is harmless
 void
 BtreeStatistics::find_succeeded(Page *page)
 {
-  if (state.last_leaf_pages[kOperationFind] != page->address()) {
-    state.last_leaf_pages[kOperationFind] = page->address();
-    state.last_leaf_count[kOperationFind] = 0;
+  if (find_leaf_page.load(boost::memory_order_relaxed) != page->address()) {
+    find_leaf_page.store(page->address(), boost::memory_order_relaxed);
+    find_leaf_count.store(0, boost::memory_order_relaxed);
   }
   else
-    state.last_leaf_count[kOperationFind]++;
+    find_leaf_count.fetch_add(1, boost::memory_order_relaxed);
 }
 
 void
 BtreeStatistics::find_failed()
 {
-  state.last_leaf_pages[kOperationFind] = 0;
-  state.last_leaf_count[kOperationFind] = 0;
+  find_leaf_page.store(0, boost::memory_order_relaxed);
+  find_leaf_count.store(0, boost::memory_order_relaxed);
 }
 
 void
@@ -107,15 +110,31 @@ BtreeStatistics::erase_failed()
   state.last_leaf_count[kOperationErase] = 0;
 }
 
+void
+BtreeStatistics::reset_page(uint64_t address)
+{
+  if (find_leaf_page.load(boost::memory_order_relaxed) == address) {
+    find_leaf_page.store(0, boost::memory_order_relaxed);
+    find_leaf_count.store(0, boost::memory_order_relaxed);
+  }
+
+  for (int i = kOperationInsert; i < kOperationMax; i++) {
+    if (state.last_leaf_pages[i] == address) {
+      state.last_leaf_pages[i] = 0;
+      state.last_leaf_count[i] = 0;
+    }
+  }
+}
+
 BtreeStatistics::FindHints
 BtreeStatistics::find_hints(uint32_t flags)
 {
   BtreeStatistics::FindHints hints = {flags, flags, 0, false};
 
   /* if the last 5 lookups hit the same page: reuse that page */
-  if (state.last_leaf_count[kOperationFind] >= 5) {
-    hints.try_fast_track = true;
-    hints.leaf_page_addr = state.last_leaf_pages[kOperationFind];
+  if (find_leaf_count.load(boost::memory_order_relaxed) >= 5) {
+    hints.leaf_page_addr = find_leaf_page.load(boost::memory_order_relaxed);
+    hints.try_fast_track = hints.leaf_page_addr != 0;
   }
 
   return hints;
@@ -25,6 +25,7 @@
 #include "0root/root.h"
 
 #include <limits>
+#include <boost/atomic.hpp>
 
 #include "ups/upscaledb_int.h"
 
@@ -112,6 +113,9 @@ struct BtreeStatistics
   // Reports that a ups_erase/ups_cursor_erase failed
   void erase_failed();
 
+  // Forgets the leaf page at |address|; called when the page is moved
+  void reset_page(uint64_t address);
+
   // Keep track of the KeyList range size
   void set_keylist_range_size(bool leaf, size_t size) {
     state.keylist_range_size[(int)leaf] = size;
@@ -149,8 +153,15 @@ struct BtreeStatistics
     data->_instances++;
   }
 
+  // last leaf page for find; updated by concurrent readers, therefore
+  // it is not part of |state|
+  boost::atomic<uint64_t> find_leaf_page;
+
+  // count of how often the find leaf page was used
+  boost::atomic<size_t> find_leaf_count;
+
   struct BtreeStatsState {
-    // last leaf page for find/insert/erase
+    // last leaf page for insert/erase; the slot for kOperationFind is unused
     uint64_t last_leaf_pages[kOperationMax];
 
     // count of how often this leaf page was used
@@ -124,12 +124,78 @@ merge_page(BtreeUpdateAction &state, Page *page, Page *sibling)
     p->set_dirty(true);
   }
 
+  state.btree->statistics()->reset_page(sibling->address());
   env->page_manager()->del(state.context, sibling);
 
   Globals::ms_btree_smo_merge++;
   return page;
 }
 
+/* Merges the internal node |sibling| into |page|. |sibling| is the right
+ * neighbour of |page| and stored at |slot| in the |parent|. The separator
+ * key of the parent is moved down into the merged page */
+static inline Page *
+merge_internal_page(BtreeUpdateAction &state, Page *parent, int slot,
+                Page *page, Page *sibling)
+{
+  BtreeNodeProxy *parent_node = state.btree->get_node_from_page(parent);
+  BtreeNodeProxy *sib_node = state.btree->get_node_from_page(sibling);
+
+  // the separator key now points to the left child of the sibling
+  ByteArray arena;
+  ups_key_t separator = {0};
+  parent_node->key(state.context, slot, &arena, &separator);
+  uint64_t rid = sib_node->left_child();
+  ups_record_t record = ups_make_record(&rid, sizeof(rid));
+  BtreeStatistics::InsertHints hints = {0};
+  state.insert_in_page(page, &separator, &record, hints, false, true);
+
+  merge_page(state, page, sibling);
+
+  parent_node->erase(state.context, slot);
+  parent->set_dirty(true);
+  return page;
+}
+
+/* Removes the empty leaf |page| (stored at |slot|) from its |parent| and
+ * moves it to the freelist. The neighbour takes over its range */
+static inline void
+remove_leaf(BtreeUpdateAction &state, Page *parent, int slot, Page *page)
+{
+  LocalEnvironment *env = state.btree->db()->lenv();
+  BtreeNodeProxy *parent_node = state.btree->get_node_from_page(parent);
+  BtreeNodeProxy *node = state.btree->get_node_from_page(page);
+  assert(node->length() == 0);
+  assert(parent_node->length() > 0);
+
+  if (slot == -1) {
+    parent_node->set_left_child(parent_node->record_id(state.context, 0));
+    parent_node->erase(state.context, 0);
+  }
+  else
+    parent_node->erase(state.context, slot);
+  parent->set_dirty(true);
+
+  // fix the linked list
+  if (node->left_sibling()) {
+    Page *p = env->page_manager()->fetch(state.context, node->left_sibling());
+    state.btree->get_node_from_page(p)->set_right_sibling(
+                    node->right_sibling());
+    p->set_dirty(true);
+  }
+  if (node->right_sibling()) {
+    Page *p = env->page_manager()->fetch(state.context, node->right_sibling());
+    state.btree->get_node_from_page(p)->set_left_sibling(
+                    node->left_sibling());
+    p->set_dirty(true);
+  }
+
+  state.btree->statistics()->reset_page(page->address());
+  env->page_manager()->del(state.context, page);
+
+  Globals::ms_btree_smo_merge++;
+}
+
 /* collapse the root node; returns the new root */
 static inline Page *
 collapse_root(BtreeUpdateAction &state, Page *root_page)
@@ -185,6 +251,18 @@ BtreeUpdateAction::traverse_tree(const ups_key_t *key,
     Page *child_page = btree->find_lower_bound(context, page, key, 0, &slot);
     BtreeNodeProxy *child_node = btree->get_node_from_page(child_page);
 
+    // Empty leaves are removed from the tree, and the traversal continues
+    // with the neighbour. The parent must keep at least one child, and
+    // the leaf must not be used by a cursor.
+    while (unlikely(child_node->is_leaf()
+            && child_node->length() == 0
+            && node->length() > 0
+            && child_page->cursor_list() == 0)) {
+      remove_leaf(*this, page, slot, child_page);
+      child_page = btree->find_lower_bound(context, page, key, 0, &slot);
+      child_node = btree->get_node_from_page(child_page);
+    }
+
     // We can merge this child with the RIGHT sibling iff...
     // 1. it's not the right-most slot (and therefore the right sibling has
     //      the same parent as the child)
@@ -233,6 +311,31 @@ BtreeUpdateAction::traverse_tree(const ups_key_t *key,
       }
     }
 
+    // Internal nodes are merged iff both siblings have the same parent
+    // and both have too few elements. Unlike leaves, the sibling is also
+    // fetched if it's not cached; otherwise the tree would never shrink.
+    else if (unlikely(!child_node->is_leaf()
+                && child_node->requires_merge())) {
+      if (slot < (int)node->length() - 1) {
+        sibling = env->page_manager()->fetch(context,
+                        node->record_id(context, slot + 1));
+        if (btree->get_node_from_page(sibling)->requires_merge())
+          merge_internal_page(*this, page, slot + 1, child_page, sibling);
+      }
+      else if (slot >= 0) {
+        sibling = env->page_manager()->fetch(context, slot == 0
+                        ? node->left_child()
+                        : node->record_id(context, slot - 1));
+        BtreeNodeProxy *sib_node = btree->get_node_from_page(sibling);
+        if (sib_node->requires_merge()) {
+          merge_internal_page(*this, page, slot, sibling, child_page);
+          // continue traversal with the sibling
+          child_page = sibling;
+          child_node = sib_node;
+        }
+      }
+    }
+
     *parent = page;
 
     // go down one level in the tree
@@ -369,6 +369,9 @@ class BlockKeyList : public BaseKeyList
       // This KeyList has a custom insert() implementation
       kCustomInsert = 1,
 
+      // This KeyList caches decoded blocks when they are read
+      kCachesOnRead = 1,
+
       // Each KeyList has a static overhead of 8 bytes
       kSizeofOverhead = 8
     };
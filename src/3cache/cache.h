@@ -25,6 +25,43 @@
  * at the head. The tail therefore points to the page which was not used
  * in a long time, and is the primary candidate for purging.
  *
+ * Alternatively the cache implements a simplified "2Q" policy
+ * (UPS_CACHE_POLICY_2Q), which is resistant against large scans. New pages
+ * are appended to a small FIFO queue ("A1in"). If a page is evicted from
+ * this queue then its address is remembered in a "ghost" list ("A1out").
+ * Pages which are loaded again while they are still in the ghost list
+ * were accessed repeatedly and are moved to the main queue ("Am"), which is
+ * managed with the CLOCK algorithm: a cache hit only sets a "referenced"
+ * flag, and referenced pages get a second chance when they are visited
+ * during eviction. A table scan therefore only churns the small A1in
+ * queue, but does not evict the hot pages from Am.
+ *
+ * Large caches are split into up to kMaxShards independent shards. The
+ * shard of a page is derived from its hash bucket; each shard has its own
+ * lock, eviction lists and hit/miss counters, and evicts down to its share
+ * of the capacity. Threads accessing different shards therefore do not
+ * contend with each other. A cache hit of the PageManager only locks the
+ * shard (see |get_pinned|).
+ *
+ * The capacity can be changed at runtime. In addition, all caches of the
+ * process share an optional memory budget (see ups_set_cache_budget()). If
+ * the budget is exceeded then each cache evicts pages in proportion to its
+ * share of the cached memory. Each shard evicts at most
+ * kMaxEvictionsPerShard pages per purge, so a shrinking cache is trimmed
+ * incrementally.
+ *
+ * For diagnostics, each shard counts hits and misses per page type, and
+ * the evicted pages and their age (measured in cache accesses). Two
+ * simulated LRU caches ("ghost caches") with twice and half the capacity
+ * only store addresses; they estimate how the hit ratio would change if
+ * the cache was resized. Large caches only simulate a sample of the pages:
+ * a page is sampled if its page id (the address divided by the page size)
+ * is a multiple of the sample rate, independent of its hash bucket. The
+ * ghost caches shrink by the same rate, therefore their hit ratios
+ * estimate those of full-sized simulations. A cache hit only buffers the
+ * sampled address; the buffered accesses are simulated on the next miss,
+ * insertion or purge, or when the buffer is full.
+ *
  * @exception_safe: nothrow
  * @thread_safe: yes
  */
@@ -35,10 +72,13 @@
 #include "0root/root.h"
 
 #include <vector>
+#include <map>
+#include <algorithm>
 
 #include "ups/upscaledb_int.h"
 
 // Always verify that a file of level N does not include headers > N!
+#include "1globals/globals.h"
 #include "2page/page.h"
 #include "2page/page_collection.h"
 #include "2config/env_config.h"
@@ -63,18 +103,19 @@ struct Cache
 {
   template<typename Purger>
   struct PurgeIfSelector {
-    PurgeIfSelector(Cache *cache, Purger &purger)
-      : cache_(cache), purger_(purger) {
+    PurgeIfSelector(Cache *cache, CacheShard &shard, Purger &purger)
+      : cache_(cache), shard_(shard), purger_(purger) {
     }
 
     bool operator()(Page *page) {
       if (purger_(page))
-        cache_->del(page);
+        cache_->del_unlocked(shard_, page);
       // don't remove page from list; it was already removed above
       return false;
     }
 
     Cache *cache_;
+    CacheShard &shard_;
     Purger &purger_;
   };
 
@@ -84,85 +125,205 @@ struct Cache
   }
 
   // Fills in the current metrics
-  void fill_metrics(ups_env_metrics_t *metrics) const {
-    metrics->cache_hits = state.cache_hits;
-    metrics->cache_misses = state.cache_misses;
+  void fill_metrics(ups_env_metrics_t *metrics) {
+    uint64_t evictions = 0;
+    uint64_t eviction_age = 0;
+    uint64_t double_hits = 0, double_accesses = 0;
+    uint64_t half_hits = 0, half_accesses = 0;
+
+    metrics->cache_hits = 0;
+    metrics->cache_misses = 0;
+    metrics->cache_shards = (uint32_t)state.num_shards;
+    for (size_t i = 0; i < state.num_shards; i++) {
+      CacheShard &shard = state.shards[i];
+      ScopedSpinlock lock(shard.mutex);
+      simulate(shard);
+      metrics->cache_shard_hits[i] = shard.cache_hits;
+      metrics->cache_shard_misses[i] = shard.cache_misses;
+      metrics->cache_hits += shard.cache_hits;
+      metrics->cache_misses += shard.cache_misses;
+      metrics->cache_hits_index
+              += shard.type_hits[CacheShard::kPageTypeIndex];
+      metrics->cache_misses_index
+              += shard.type_misses[CacheShard::kPageTypeIndex];
+      metrics->cache_hits_blob
+              += shard.type_hits[CacheShard::kPageTypeBlob];
+      metrics->cache_misses_blob
+              += shard.type_misses[CacheShard::kPageTypeBlob];
+      metrics->cache_hits_page_manager
+              += shard.type_hits[CacheShard::kPageTypePageManager];
+      metrics->cache_misses_page_manager
+              += shard.type_misses[CacheShard::kPageTypePageManager];
+      evictions += shard.evictions;
+      eviction_age += shard.eviction_age;
+      double_hits += shard.ghost_double.hits;
+      double_accesses += shard.ghost_double.accesses;
+      half_hits += shard.ghost_half.hits;
+      half_accesses += shard.ghost_half.accesses;
+    }
+
+    metrics->cache_evictions_clean = evictions;
+    metrics->cache_evictions_dirty = state.dirty_evictions.load();
+    metrics->cache_eviction_avg_age = evictions ? eviction_age / evictions : 0;
+    metrics->cache_hit_ratio_double = double_accesses
+            ? (double)double_hits / double_accesses
+            : 0.0;
+    metrics->cache_hit_ratio_half = half_accesses
+            ? (double)half_hits / half_accesses
+            : 0.0;
   }
 
   // Retrieves a page from the cache, also removes the page from the cache
   // and re-inserts it at the front. Returns null if the page was not cached.
   Page *get(uint64_t address) {
     size_t hash = Impl::calc_hash(address);
+    CacheShard &shard = shard_of(hash);
+    ScopedSpinlock lock(shard.mutex);
+
+    shard.clock++;
+    sample(shard, address);
 
     Page *page = state.buckets[hash].get(address);
     if (!page) {
-      state.cache_misses++;
+      shard.cache_misses++;
+      simulate(shard);
       return 0;
     }
 
-    // Now re-insert the page at the head of the "totallist", and
-    // thus move far away from the tail. The pages at the tail are highest
-    // candidates to be deleted when the cache is purged.
-    state.totallist.del(page);
-    state.totallist.put(page);
-    state.cache_hits++;
+    hit(shard, page);
     return page;
   }
 
+  // Retrieves a page like |get()|, but only if |pin(page)| succeeds while
+  // the shard is locked. |pin| must lock the page without blocking; a
+  // locked page is not evicted. Returns null if the page was not cached or
+  // could not be pinned; misses are not counted.
+  template<typename Pin>
+  Page *get_pinned(uint64_t address, Pin &pin) {
+    size_t hash = Impl::calc_hash(address);
+    CacheShard &shard = shard_of(hash);
+    ScopedSpinlock lock(shard.mutex);
+
+    Page *page = state.buckets[hash].get(address);
+    if (!page || !pin(page))
+      return 0;
+
+    shard.clock++;
+    sample(shard, address);
+    hit(shard, page);
+    return page;
+  }
+
+  // Returns a page from the cache, but does not update the statistics or
+  // the eviction order. Returns null if the page was not cached.
+  Page *peek(uint64_t address) {
+    size_t hash = Impl::calc_hash(address);
+    ScopedSpinlock lock(shard_of(hash).mutex);
+    return state.buckets[hash].get(address);
+  }
+
   // Stores a page in the cache
   void put(Page *page) {
     size_t hash = Impl::calc_hash(page->address());
+    CacheShard &shard = shard_of(hash);
+    ScopedSpinlock lock(shard.mutex);
 
     /* First remove the page from the cache, if it's already cached
      *
      * Then re-insert the page at the head of the list. The tail will
      * point to the least recently used page.
      */
-    state.totallist.del(page);
-    state.totallist.put(page);
-    if (page->is_allocated())
-      state.alloc_elements++;
+    simulate(shard);
+
+    if (!shard.totallist.del(page)) {
+      page->set_cache_timestamp(shard.clock++);
+      state.total_elements++;
+      Globals::ms_cache_usage += state.page_size_bytes;
+      if (page->is_allocated())
+        state.alloc_elements++;
+    }
+    shard.totallist.put(page);
 
     state.buckets[hash].put(page);
+
+    if (state.policy == UPS_CACHE_POLICY_2Q)
+      put_2q(shard, page);
   }
 
   // Removes a page from the cache
   void del(Page *page) {
     assert(page->address() != 0);
 
-    /* remove it from the list of all cached pages */
-    if (state.totallist.del(page) && page->is_allocated())
-      state.alloc_elements--;
+    CacheShard &shard = shard_of(Impl::calc_hash(page->address()));
+    ScopedSpinlock lock(shard.mutex);
+    del_unlocked(shard, page);
+  }
 
-    /* remove the page from the cache buckets */
-    size_t hash = Impl::calc_hash(page->address());
-    state.buckets[hash].del(page);
+  // Removes a (clean) page from the cache because it was evicted; updates
+  // the eviction statistics
+  void evict(Page *page) {
+    CacheShard &shard = shard_of(Impl::calc_hash(page->address()));
+    ScopedSpinlock lock(shard.mutex);
+    shard.evictions++;
+    // the hash spreads the accesses evenly over the shards; the age in
+    // accesses of all shards is therefore approximated
+    shard.eviction_age += (shard.clock - page->cache_timestamp())
+                            * state.num_shards;
+    del_unlocked(shard, page);
+  }
+
+  // Counts dirty pages which are flushed because they were selected for
+  // eviction
+  void count_dirty_evictions(size_t count) {
+    state.dirty_evictions += count;
+  }
+
+  // Counts a page which was fetched from disk after a cache miss
+  void count_fetched_page(Page *page) {
+    CacheShard &shard = shard_of(Impl::calc_hash(page->address()));
+    ScopedSpinlock lock(shard.mutex);
+    shard.type_misses[type_index(page)]++;
   }
 
-  // Purges the cache. Implements a LRU eviction algorithm. Dirty pages are
-  // forwarded to the |processor()| for flushing.
+  // Purges the cache. Implements a LRU (or 2Q) eviction algorithm. Each
+  // shard evicts its surplus pages, and its share of the pages exceeding
+  // the global budget. Dirty pages are forwarded to the |processor()| for
+  // flushing.
   // The |ignore_page| is passed by the caller; this page will not be purged
   // under any circumstance. This is used by the PageManager to make sure
   // that the "last blob page" is not evicted by the cache.
   void purge_candidates(std::vector<uint64_t> &candidates,
                   std::vector<Page *> &garbage,
                   Page *ignore_page) {
-    int limit = (int)(current_elements()
-                      - (state.capacity_bytes / state.page_size_bytes));
-
-    Page *page = state.totallist.tail();
-    for (int i = 0; i < limit && page != 0; i++) {
-      if (page->mutex().try_lock()) {
-        if (page->cursor_list() == 0 && page != ignore_page) {
-          if (page->is_dirty())
-            candidates.push_back(page->address());
-          else
-            garbage.push_back(page);
-        }
-        page->mutex().unlock();
+    size_t budget_excess = budget_excess_pages();
+    size_t total = current_elements();
+
+    for (size_t s = 0; s < state.num_shards; s++) {
+      CacheShard &shard = state.shards[s];
+      ScopedSpinlock lock(shard.mutex);
+      simulate(shard);
+
+      size_t size = shard.totallist.size();
+      size_t excess = size > shard.capacity_pages
+                        ? size - shard.capacity_pages
+                        : 0;
+      if (budget_excess > 0 && total > 0)
+        excess = std::max(excess, (budget_excess * size + total - 1) / total);
+      if (excess == 0)
+        continue;
+      int limit = (int)std::min(excess,
+                      (size_t)CacheState::kMaxEvictionsPerShard);
+
+      if (state.policy == UPS_CACHE_POLICY_2Q) {
+        purge_candidates_2q(shard, limit, candidates, garbage, ignore_page);
+        continue;
       }
 
-      page = page->previous(Page::kListCache);
+      Page *page = shard.totallist.tail();
+      for (int i = 0; i < limit && page != 0; i++) {
+        select_candidate(page, candidates, garbage, ignore_page);
+        page = page->previous(Page::kListCache);
+      }
     }
   }
 
@@ -171,30 +332,244 @@ struct Cache
   // to flush (and delete) pages.
   template<typename Purger>
   void purge_if(Purger &purger) {
-    PurgeIfSelector<Purger> selector(this, purger);
-    state.totallist.extract(selector);
+    for (size_t s = 0; s < state.num_shards; s++) {
+      CacheShard &shard = state.shards[s];
+      ScopedSpinlock lock(shard.mutex);
+      PurgeIfSelector<Purger> selector(this, shard, purger);
+      shard.totallist.extract(selector);
+    }
   }
 
-  // Returns true if the capacity limits are exceeded
+  // Returns true if the capacity limits or the global budget are exceeded
   bool is_cache_full() const {
-    return state.totallist.size() * state.page_size_bytes
-            > state.capacity_bytes;
+    return state.total_elements.load() * state.page_size_bytes
+            > state.capacity_bytes.load()
+        || budget_excess_pages() > 0;
   }
 
   // Returns the capacity (in bytes)
   uint64_t capacity() const {
-    return state.capacity_bytes;
+    return state.capacity_bytes.load();
+  }
+
+  // Changes the capacity (in bytes); the new capacity is distributed over
+  // the shards
+  void set_capacity(uint64_t capacity) {
+    assert(capacity > 0 && !state.is_unlimited());
+    state.capacity_bytes = capacity;
+    state.assign_capacity();
+  }
+
+  // Returns the number of pages which this cache has to evict because
+  // all caches together exceed the global budget. The excess is shared by
+  // all caches in proportion to their size.
+  size_t budget_excess_pages() const {
+    uint64_t budget = Globals::ms_cache_budget.load();
+    uint64_t usage = Globals::ms_cache_usage.load();
+    size_t total = current_elements();
+    if (budget == 0 || usage <= budget || total == 0 || state.is_unlimited())
+      return 0;
+
+    uint64_t excess = (usage - budget) / state.page_size_bytes;
+    uint64_t usage_pages = usage / state.page_size_bytes;
+    if (excess == 0 || usage_pages == 0)
+      return 0;
+    return (size_t)std::min((excess * total + usage_pages - 1) / usage_pages,
+                    (uint64_t)total);
   }
 
   // Returns the number of currently cached elements
   size_t current_elements() const {
-    return state.totallist.size();
+    return state.total_elements.load();
   }
 
   // Returns the number of currently cached elements (excluding those that
   // are mmapped)
   size_t allocated_elements() const {
-    return state.alloc_elements;
+    return state.alloc_elements.load();
+  }
+
+  // Returns the number of shards
+  size_t num_shards() const {
+    return state.num_shards;
+  }
+
+  // Returns the shard which manages the hash bucket |hash|
+  CacheShard &shard_of(size_t hash) {
+    return state.shards[hash % state.num_shards];
+  }
+
+  // Removes a page from the cache; the caller must hold the shard's lock
+  void del_unlocked(CacheShard &shard, Page *page) {
+    /* remove it from the list of all cached pages */
+    if (shard.totallist.del(page)) {
+      state.total_elements--;
+      Globals::ms_cache_usage -= state.page_size_bytes;
+      if (page->is_allocated())
+        state.alloc_elements--;
+    }
+
+    /* remove the page from the cache buckets */
+    size_t hash = Impl::calc_hash(page->address());
+    state.buckets[hash].del(page);
+
+    /* remember pages which leave the A1in queue */
+    if (state.policy == UPS_CACHE_POLICY_2Q) {
+      if (shard.in_queue.del(page))
+        remember_ghost(shard, page->address());
+      else
+        shard.main_queue.del(page);
+    }
+  }
+
+  // Counts a cache hit and updates the eviction order
+  void hit(CacheShard &shard, Page *page) {
+    shard.cache_hits++;
+    shard.type_hits[type_index(page)]++;
+
+    // 2Q does not relink the page; it is sufficient to mark the page as
+    // "referenced"
+    if (state.policy == UPS_CACHE_POLICY_2Q) {
+      page->set_referenced(true);
+      return;
+    }
+
+    // Now re-insert the page at the head of the "totallist", and
+    // thus move far away from the tail. The pages at the tail are highest
+    // candidates to be deleted when the cache is purged.
+    shard.totallist.del(page);
+    shard.totallist.put(page);
+  }
+
+  // Returns the index of the page's type for the per-type counters
+  static int type_index(Page *page) {
+    if (page->is_without_header())
+      return CacheShard::kPageTypeBlob;
+    switch (page->type()) {
+      case Page::kTypeBroot:
+      case Page::kTypeBindex:
+        return CacheShard::kPageTypeIndex;
+      case Page::kTypeBlob:
+        return CacheShard::kPageTypeBlob;
+      case Page::kTypePageManager:
+        return CacheShard::kPageTypePageManager;
+      default:
+        return CacheShard::kPageTypeOther;
+    }
+  }
+
+  // Buffers an access for the ghost caches, if the page id of |address|
+  // is sampled. A full buffer is simulated first; dropping the accesses
+  // of cache hits would lower the estimated hit ratios.
+  void sample(CacheShard &shard, uint64_t address) {
+    if (state.is_unlimited()
+        || (address / state.page_size_bytes) % state.sample_rate.load() != 0)
+      return;
+    if (shard.sampled_count == CacheShard::kMaxSampledAccesses)
+      simulate(shard);
+    shard.sampled[shard.sampled_count++] = address;
+  }
+
+  // Simulates the buffered accesses in the ghost caches
+  static void simulate(CacheShard &shard) {
+    for (size_t i = 0; i < shard.sampled_count; i++) {
+      shard.ghost_double.access(shard.sampled[i]);
+      shard.ghost_half.access(shard.sampled[i]);
+    }
+    shard.sampled_count = 0;
+  }
+
+  // Forwards a page to the |candidates| (if it is dirty) or the |garbage|
+  // (if it is not dirty), unless it is currently in use
+  static void select_candidate(Page *page, std::vector<uint64_t> &candidates,
+                  std::vector<Page *> &garbage, Page *ignore_page) {
+    if (page->mutex().try_lock()) {
+      if (!page->has_cursors() && page != ignore_page) {
+        if (page->is_dirty())
+          candidates.push_back(page->address());
+        else
+          garbage.push_back(page);
+      }
+      page->mutex().unlock();
+    }
+  }
+
+  // Inserts a new page into the 2Q queues. Pages which were recently
+  // evicted from A1in are promoted to Am.
+  static void put_2q(CacheShard &shard, Page *page) {
+    if (shard.in_queue.has(page) || shard.main_queue.has(page))
+      return;
+
+    page->set_referenced(false);
+
+    std::map<uint64_t, uint64_t>::iterator it
+            = shard.ghost_index.find(page->address());
+    if (it != shard.ghost_index.end()) {
+      shard.ghost_index.erase(it);
+      shard.main_queue.put(page);
+    }
+    else
+      shard.in_queue.put(page);
+  }
+
+  // Adds an address to the A1out ghost list; the list remembers about
+  // half as many addresses as the shard can store pages
+  static void remember_ghost(CacheShard &shard, uint64_t address) {
+    size_t limit = std::max(shard.capacity_pages / 2, (size_t)1);
+
+    uint64_t sequence = shard.ghost_sequence++;
+    shard.ghost_index[address] = sequence;
+    shard.ghost_queue.push_back(std::make_pair(sequence, address));
+
+    while (shard.ghost_index.size() > limit
+            || shard.ghost_queue.size() > 2 * limit) {
+      std::pair<uint64_t, uint64_t> &front = shard.ghost_queue.front();
+      std::map<uint64_t, uint64_t>::iterator it
+              = shard.ghost_index.find(front.second);
+      if (it != shard.ghost_index.end() && it->second == front.first)
+        shard.ghost_index.erase(it);
+      shard.ghost_queue.pop_front();
+    }
+  }
+
+  // 2Q eviction: first evicts from the tail of A1in while A1in exceeds
+  // a quarter of the capacity, then runs the CLOCK over Am. If Am does not
+  // have enough candidates then the remaining pages of A1in are used.
+  static void purge_candidates_2q(CacheShard &shard, int limit,
+                  std::vector<uint64_t> &candidates,
+                  std::vector<Page *> &garbage, Page *ignore_page) {
+    size_t in_limit = std::max(shard.capacity_pages / 4, (size_t)1);
+    size_t in_size = shard.in_queue.size();
+    int i = 0;
+
+    Page *in_page = shard.in_queue.tail();
+    for (; i < limit && in_page != 0 && in_size > in_limit; i++, in_size--) {
+      select_candidate(in_page, candidates, garbage, ignore_page);
+      in_page = in_page->previous(Page::kListCacheIn);
+    }
+
+    // Referenced pages are cleared and moved to the head; they are visited
+    // again after all other pages. Each page is visited at most twice.
+    Page *page = shard.main_queue.tail();
+    size_t steps = 2 * shard.main_queue.size();
+    for (; i < limit && page != 0 && steps > 0; steps--) {
+      Page *previous = page->previous(Page::kListCacheMain);
+      if (page->is_referenced()) {
+        page->set_referenced(false);
+        shard.main_queue.del(page);
+        shard.main_queue.put(page);
+      }
+      else {
+        select_candidate(page, candidates, garbage, ignore_page);
+        i++;
+      }
+      page = previous;
+    }
+
+    for (; i < limit && in_page != 0; i++) {
+      select_candidate(in_page, candidates, garbage, ignore_page);
+      in_page = in_page->previous(Page::kListCacheIn);
+    }
   }
 
   CacheState state;
@@ -21,10 +21,19 @@
 #include "0root/root.h"
 
 #include <vector>
+#include <deque>
+#include <map>
+#include <list>
+#include <algorithm>
+#include <limits>
 
-#include "ups/types.h"
+#include <boost/atomic.hpp>
+
+#include "ups/upscaledb_int.h"
 
 // Always verify that a file of level N does not include headers > N!
+#include "1base/spinlock.h"
+#include "1globals/globals.h"
 #include "2page/page.h"
 #include "2page/page_collection.h"
 #include "2config/env_config.h"
@@ -35,6 +44,143 @@
 
 namespace upscaledb {
 
+// A simulated LRU cache which only stores page addresses. Used to estimate
+// the hit ratio of a larger or smaller cache.
+struct GhostCache
+{
+  typedef std::list<uint64_t> List;
+
+  GhostCache()
+    : capacity(0), hits(0), accesses(0) {
+  }
+
+  // Simulates an access to |address|
+  void access(uint64_t address) {
+    accesses++;
+
+    std::map<uint64_t, List::iterator>::iterator it = index.find(address);
+    if (it != index.end()) {
+      hits++;
+      lru.splice(lru.begin(), lru, it->second);
+      return;
+    }
+
+    lru.push_front(address);
+    index[address] = lru.begin();
+    shrink();
+  }
+
+  // Removes the least recently used addresses till the capacity is reached
+  void shrink() {
+    while (lru.size() > capacity) {
+      index.erase(lru.back());
+      lru.pop_back();
+    }
+  }
+
+  // the capacity (in pages)
+  size_t capacity;
+
+  // the simulated addresses; the most recently used address is at the front
+  List lru;
+
+  // maps an address to its position in |lru|
+  std::map<uint64_t, List::iterator> index;
+
+  // number of simulated hits
+  uint64_t hits;
+
+  // number of simulated accesses
+  uint64_t accesses;
+};
+
+// A partition of the cache. Each shard manages the pages of a subset of
+// the hash buckets and has its own lock, eviction lists and counters.
+struct CacheShard
+{
+  CacheShard()
+    : capacity_pages(0), ghost_sequence(0), cache_hits(0), cache_misses(0),
+      evictions(0), eviction_age(0), clock(0), sampled_count(0) {
+    for (int i = 0; i < kPageTypeMax; i++)
+      type_hits[i] = type_misses[i] = 0;
+  }
+
+  // Page types for the per-type counters
+  enum {
+    kPageTypeOther = 0,
+    kPageTypeIndex,
+    kPageTypeBlob,
+    kPageTypePageManager,
+    kPageTypeMax
+  };
+
+  // The number of sampled accesses which are buffered till they are
+  // simulated in the ghost caches
+  enum { kMaxSampledAccesses = 64 };
+
+  // protects all members of this shard, and the hash buckets which
+  // belong to this shard
+  Spinlock mutex;
+
+  // the capacity of this shard (in pages)
+  size_t capacity_pages;
+
+  // linked list of ALL pages of this shard
+  PageCollection<Page::kListCache> totallist;
+
+  // 2Q: FIFO queue of pages which were accessed only once ("A1in")
+  PageCollection<Page::kListCacheIn> in_queue;
+
+  // 2Q: CLOCK queue of pages which were accessed repeatedly ("Am")
+  PageCollection<Page::kListCacheMain> main_queue;
+
+  // 2Q: addresses of pages recently evicted from |in_queue| ("A1out"),
+  // mapped to their insertion sequence number
+  std::map<uint64_t, uint64_t> ghost_index;
+
+  // 2Q: the insertion order of |ghost_index|; (sequence, address) pairs.
+  // Entries whose sequence no longer matches |ghost_index| are stale
+  std::deque<std::pair<uint64_t, uint64_t> > ghost_queue;
+
+  // 2Q: sequence number for the next ghost entry
+  uint64_t ghost_sequence;
+
+  // counts the cache hits
+  uint64_t cache_hits;
+
+  // counts the cache misses
+  uint64_t cache_misses;
+
+  // counts the cache hits per page type (kPageType*)
+  uint64_t type_hits[kPageTypeMax];
+
+  // counts the pages fetched from disk per page type (kPageType*)
+  uint64_t type_misses[kPageTypeMax];
+
+  // counts the evicted (clean) pages
+  uint64_t evictions;
+
+  // sum of the ages of all evicted pages
+  uint64_t eviction_age;
+
+  // the logical time of this shard; incremented whenever the shard is
+  // accessed. Each shard has its own clock, therefore cache hits do not
+  // modify shared memory
+  uint64_t clock;
+
+  // simulates a cache with twice the capacity
+  GhostCache ghost_double;
+
+  // simulates a cache with half the capacity
+  GhostCache ghost_half;
+
+  // sampled accesses which were not yet simulated in the ghost caches
+  uint64_t sampled[kMaxSampledAccesses];
+
+  // the number of addresses in |sampled|
+  size_t sampled_count;
+};
+
 struct CacheState
 {
   typedef PageCollection<Page::kListBucket> CacheLine;
@@ -43,38 +189,118 @@ struct CacheState
     // The number of buckets should be a prime number or similar, as it
     // is used in a MODULO hash scheme
     kBucketSize = 10317,
+
+    // The maximum number of shards
+    kMaxShards = UPS_MAX_CACHE_SHARDS,
+
+    // Each shard manages at least this many pages; smaller caches use
+    // fewer shards, because each shard evicts independently
+    kMinPagesPerShard = 256,
+
+    // A shard evicts at most this many pages per purge; a cache which was
+    // shrunk (or exceeds the global budget) is therefore trimmed
+    // incrementally
+    kMaxEvictionsPerShard = 64,
+
+    // Caches with more pages only simulate the pages whose page id is a
+    // multiple of kGhostSampleRate in their ghost caches
+    kMinSampledPages = 1024,
+
+    // The sample rate for the ghost caches of large caches
+    kGhostSampleRate = 16,
   };
 
   CacheState(const EnvConfig &config)
     : capacity_bytes(isset(config.flags, UPS_CACHE_UNLIMITED)
                             ? std::numeric_limits<uint64_t>::max()
                             : config.cache_size_bytes),
-      page_size_bytes(config.page_size_bytes), alloc_elements(0),
-      buckets(kBucketSize), cache_hits(0), cache_misses(0) {
+      page_size_bytes(config.page_size_bytes),
+      policy(isset(config.flags, UPS_CACHE_UNLIMITED)
+                    ? UPS_CACHE_POLICY_LRU
+                    : config.cache_policy),
+      num_shards(1), shards(0), total_elements(0), alloc_elements(0),
+      dirty_evictions(0), sample_rate(1), buckets(kBucketSize) {
     assert(capacity_bytes > 0);
+
+    size_t capacity = capacity_pages();
+    num_shards = std::min(std::max(capacity / kMinPagesPerShard, (size_t)1),
+                    (size_t)kMaxShards);
+    shards = new CacheShard[num_shards];
+    assign_capacity();
+  }
+
+  ~CacheState() {
+    Globals::ms_cache_usage -= total_elements.load() * page_size_bytes;
+    delete [] shards;
   }
 
-  // the capacity (in bytes)
-  uint64_t capacity_bytes;
+  // Distributes the capacity over the shards, and adjusts the sample rate
+  // of the ghost caches. The number of shards is fixed when the cache is
+  // created. Addresses which were sampled with a previous rate age out
+  // of the ghost caches.
+  void assign_capacity() {
+    size_t capacity = capacity_pages();
+    sample_rate = capacity > kMinSampledPages ? kGhostSampleRate : 1;
+    for (size_t i = 0; i < num_shards; i++) {
+      ScopedSpinlock lock(shards[i].mutex);
+      shards[i].capacity_pages = capacity / num_shards;
+      if (i == 0)
+        shards[i].capacity_pages += capacity % num_shards;
+
+      size_t sampled = is_unlimited()
+                          ? 0
+                          : shards[i].capacity_pages / sample_rate;
+      shards[i].ghost_double.capacity = 2 * sampled;
+      shards[i].ghost_double.shrink();
+      shards[i].ghost_half.capacity = sampled / 2;
+      shards[i].ghost_half.shrink();
+    }
+  }
+
+  // Returns true if the cache has no capacity limit
+  bool is_unlimited() const {
+    return capacity_bytes.load() == std::numeric_limits<uint64_t>::max();
+  }
+
+  // Returns the capacity (in pages)
+  size_t capacity_pages() const {
+    return (size_t)std::min(capacity_bytes.load() / page_size_bytes,
+                    (uint64_t)std::numeric_limits<size_t>::max());
+  }
+
+  // the capacity (in bytes); changed at runtime while other threads
+  // check whether the cache is full
+  boost::atomic<uint64_t> capacity_bytes;
 
   // the current page size (in bytes)
   uint64_t page_size_bytes;
 
+  // the page replacement policy (UPS_CACHE_POLICY_*); unlimited caches
+  // never evict and therefore always use LRU
+  int policy;
+
+  // the number of shards
+  size_t num_shards;
+
+  // the shards
+  CacheShard *shards;
+
+  // the current number of cached elements (of all shards)
+  boost::atomic<size_t> total_elements;
+
   // the current number of cached elements that were allocated (and not
   // mapped)
-  size_t alloc_elements;
+  boost::atomic<size_t> alloc_elements;
 
-  // linked list of ALL cached pages
-  PageCollection<Page::kListCache> totallist;
+  // counts the dirty pages which were flushed because they were evicted
+  boost::atomic<uint64_t> dirty_evictions;
 
-  // The hash table buckets - each is a linked list of Page pointers
-  std::vector<CacheLine> buckets;
+  // only every |sample_rate|-th page is simulated in the ghost caches
+  boost::atomic<size_t> sample_rate;
 
-  // counts the cache hits
-  uint64_t cache_hits;
-
-  // counts the cache misses
-  uint64_t cache_misses;
+  // The hash table buckets - each is a linked list of Page pointers.
+  // Bucket |i| belongs to shard |i % num_shards|
+  std::vector<CacheLine> buckets;
 };
 
 } // namespace upscaledb
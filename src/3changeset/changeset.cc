@@ -67,8 +67,11 @@ struct FlushChangesetVisitor
 static void
 async_flush_changeset(std::vector<Page *> list, Device *device,
                 Journal *journal, uint64_t lsn,
-                bool enable_fsync, int fd_index)
+                bool enable_fsync, int fd_index, uint64_t journal_seq)
 {
+  /* the journal entry has to be synced before the pages are written */
+  journal->wait_until_durable(journal_seq);
+
   std::vector<Page *>::iterator it = list.begin();
   for (; it != list.end(); it++) {
     Page *page = *it;
@@ -81,16 +84,17 @@ async_flush_changeset(std::vector<Page *> list, Device *device,
 
     if (likely(page->is_without_header() == false))
       page->set_lsn(lsn);
+  }
 
-    page->flush();
-    page->mutex().unlock();
+  /* write all pages (and flush the file handle, if required) with a
+   * single batch */
+  device->write_pages(list, enable_fsync);
+
+  for (it = list.begin(); it != list.end(); it++) {
+    (*it)->mutex().unlock();
     UPS_INDUCE_ERROR(ErrorInducer::kChangesetFlush);
   }
 
-  /* flush the file handle (if required) */
-  if (enable_fsync)
-    device->flush();
-
   /* inform the journal that the Changeset was flushed */
   journal->changeset_flushed(fd_index);
 
@@ -103,6 +107,12 @@ Changeset::clear()
   UnlockPage unlocker;
   collection.for_each(unlocker);
   collection.clear();
+
+  for (std::vector<Page *>::iterator it = shared_pages.begin();
+                  it != shared_pages.end();
+                  it++)
+    (*it)->mutex().unlock_shared();
+  shared_pages.clear();
 }
 
 void
@@ -126,6 +136,8 @@ Changeset::flush(uint64_t lsn)
   int fd_index = env->journal()->append_changeset(visitor.list,
                                       env->page_manager()->last_blob_page_id(),
                                       lsn);
+  uint64_t journal_seq = env->journal()->queued_sequence();
+  env->signal_checkpoint();
 
   UPS_INDUCE_ERROR(ErrorInducer::kChangesetFlush);
 
@@ -138,7 +150,7 @@ Changeset::flush(uint64_t lsn)
   env->page_manager()->run_async(boost::bind(&async_flush_changeset,
                           visitor.list, env->device(), env->journal(), lsn,
                           isset(env->config().flags, UPS_ENABLE_FSYNC),
-                          fd_index));
+                          fd_index, journal_seq));
 }
 
 } // namespace upscaledb
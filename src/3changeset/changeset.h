@@ -29,6 +29,8 @@
 #include "0root/root.h"
 
 #include <stdlib.h>
+#include <vector>
+#include <algorithm>
 
 // Always verify that a file of level N does not include headers > N!
 #include "2config/env_config.h"
@@ -45,8 +47,8 @@ class LocalEnvironment;
 
 struct Changeset
 {
-  Changeset(LocalEnvironment *env_)
-  : env(env_) {
+  Changeset(LocalEnvironment *env_, bool is_read_only_ = false)
+  : env(env_), is_read_only(is_read_only_) {
   }
 
   /*
@@ -57,27 +59,63 @@ struct Changeset
     return collection.get(address);
   }
 
-  /* Append a new page to the changeset. The page is locked. */
+  /*
+   * Append a new page to the changeset. The page is locked.
+   *
+   * A read-only changeset locks the page in shared mode, and tracks it
+   * in |shared_pages| instead of the intrusive |collection|, because the
+   * same page can be part of several read-only changesets at once.
+   */
   void put(Page *page) {
+    if (is_read_only) {
+      if (!shared_pages.empty() && shared_pages.back() == page)
+        return;
+      page->mutex().lock_shared();
+      shared_pages.push_back(page);
+      return;
+    }
     if (!has(page))
       page->mutex().lock();
     collection.put(page);
   }
 
+  /*
+   * Like |put|, but does not block; returns false if the page is locked
+   * by another thread
+   */
+  bool try_put(Page *page) {
+    if (is_read_only) {
+      if (!shared_pages.empty() && shared_pages.back() == page)
+        return true;
+      if (!page->mutex().try_lock_shared())
+        return false;
+      shared_pages.push_back(page);
+      return true;
+    }
+    if (!has(page) && !page->mutex().try_lock())
+      return false;
+    collection.put(page);
+    return true;
+  }
+
   /* Removes a page from the changeset. The page is unlocked. */
   void del(Page *page) {
+    assert(!is_read_only);
     page->mutex().unlock();
     collection.del(page);
   }
 
   /* Check if the page is already part of the changeset */
   bool has(Page *page) const {
+    if (is_read_only)
+      return std::find(shared_pages.begin(), shared_pages.end(), page)
+                != shared_pages.end();
     return collection.has(page);
   }
 
   /* Returns true if the changeset is empty */
   bool is_empty() const {
-    return collection.is_empty();
+    return collection.is_empty() && shared_pages.empty();
   }
 
   /* Removes all pages from the changeset. The pages are unlocked. */
@@ -93,8 +131,14 @@ struct Changeset
   /* The Environment */
   LocalEnvironment *env;
 
+  /* True if the pages are only read, but not modified */
+  bool is_read_only;
+
   /* The pages which were added to this Changeset */
   PageCollection<Page::kListChangeset> collection;
+
+  /* The pages which were added to a read-only Changeset */
+  std::vector<Page *> shared_pages;
 };
 
 } // namespace upscaledb
@@ -22,14 +22,19 @@
 #  include <libgen.h>
 #endif
 
+#include <set>
+#include <map>
+#include <algorithm>
+
 #include "1base/error.h"
 #include "1errorinducer/errorinducer.h"
 #include "1os/os.h"
 #include "2device/device.h"
 #include "2compressor/compressor_factory.h"
+#include "3btree/btree_index.h"
 #include "3journal/journal.h"
 #include "3page_manager/page_manager.h"
-#include "4db/db.h"
+#include "4db/db_local.h"
 #include "4txn/txn_local.h"
 #include "4env/env_local.h"
 #include "4context/context.h"
@@ -48,11 +53,149 @@ enum {
 
   // flush buffers if this limit is exceeded
   kBufferLimit = 1024 * 1024, // 1 mb
+
+  // report the recovery progress after this many operations
+  kRecoveryProgressInterval = 1000,
+
+  // modified ranges of a page which are separated by fewer unmodified
+  // bytes are merged
+  kPageDeltaMinGap = 16,
+
+  // the maximum size of the page images which are remembered for the
+  // delta encoding
+  kMaxPageImageBytes = 16 * 1024 * 1024,
 };
 
+// Waits till the log writer wrote and synced all data up to the sequence
+// number |seq|; returns the error of the log writer
+static inline ups_status_t
+wait_for_log_writer(JournalState &state, uint64_t seq)
+{
+  ScopedLock lock(state.writer_mutex);
+  while (state.durable_seq < seq && state.writer_status == 0)
+    state.durable_cond.wait(lock);
+  return state.writer_status;
+}
+
+// Waits till the log writer wrote all queued data; required before
+// the files are modified or read directly
+static inline void
+drain_log_writer(JournalState &state)
+{
+  if (state.writer) {
+    uint64_t seq;
+    {
+      ScopedLock lock(state.writer_mutex);
+      seq = state.queued_seq;
+    }
+    (void)wait_for_log_writer(state, seq);
+  }
+}
+
+// Returns the number of bytes which are queued for the log writer
+static inline size_t
+queued_bytes(JournalState &state)
+{
+  size_t bytes = 0;
+  for (uint32_t i = 0; i < state.num_segments; i++)
+    bytes += state.queued[i].size();
+  return bytes;
+}
+
+// The log writer thread; waits for queued data, then writes and syncs
+// all data which was queued in the meantime with a single call per file
+static void
+run_log_writer(JournalState *state)
+{
+  uint32_t window = state->env->config().journal_group_commit_window;
+  uint32_t max_bytes = state->env->config().journal_group_commit_bytes;
+  std::vector<uint8_t> data[JournalState::kMaxSegments];
+
+  ScopedLock lock(state->writer_mutex);
+  while (true) {
+    while (state->queued_seq == state->durable_seq && !state->writer_stopped)
+      state->writer_cond.wait(lock);
+    // all data was written before the thread stops
+    if (state->queued_seq == state->durable_seq)
+      break;
+
+    // wait for further commits, unless enough bytes are waiting
+    if (window > 0) {
+      boost::system_time deadline = boost::get_system_time()
+                + boost::posix_time::microseconds(window);
+      while (!state->writer_stopped
+              && (max_bytes == 0 || queued_bytes(*state) < max_bytes)
+              && state->writer_cond.timed_wait(lock, deadline))
+        ;
+    }
+
+    uint64_t seq = state->queued_seq;
+    for (uint32_t i = 0; i < state->num_segments; i++)
+      data[i].swap(state->queued[i]);
+    lock.unlock();
+
+    ups_status_t st = 0;
+    uint64_t bytes = 0;
+    try {
+      for (uint32_t i = 0; i < state->num_segments; i++) {
+        if (data[i].empty())
+          continue;
+        state->files[i].write(&data[i][0], data[i].size());
+        state->files[i].flush();
+        bytes += data[i].size();
+      }
+    }
+    catch (Exception &ex) {
+      ups_log(("failed to write the journal, error %d", ex.code));
+      st = ex.code;
+    }
+
+    lock.lock();
+    state->count_bytes_flushed += bytes;
+    state->count_group_commits++;
+    if (st)
+      state->writer_status = st;
+    state->durable_seq = seq;
+    state->durable_cond.notify_all();
+    for (uint32_t i = 0; i < state->num_segments; i++)
+      data[i].clear();
+  }
+}
+
 static inline void
-clear_file(JournalState &state, int idx)
+start_log_writer(JournalState &state)
 {
+  if (notset(state.env->get_flags(), UPS_ENABLE_FSYNC))
+    return;
+
+  state.writer_stopped = false;
+  state.writer.reset(new Thread(boost::bind(&run_log_writer, &state)));
+}
+
+// Stops the log writer; all queued data is written before it stops
+static inline void
+stop_log_writer(JournalState &state)
+{
+  if (!state.writer)
+    return;
+
+  {
+    ScopedLock lock(state.writer_mutex);
+    state.writer_stopped = true;
+    state.writer_cond.notify_all();
+  }
+
+  state.writer->join();
+  state.writer.reset();
+}
+
+// Clears a segment. If |preallocate| is true then the storage of the
+// segment is reserved again, otherwise it is released
+static inline void
+clear_file(JournalState &state, int idx, bool preallocate = false)
+{
+  drain_log_writer(state);
+
   if (state.files[idx].is_open()) {
     state.files[idx].truncate(0);
 
@@ -60,14 +203,24 @@ clear_file(JournalState &state, int idx)
     // reset the file pointer, or the next write will resize the file to
     // the original size
     state.files[idx].seek(0, File::kSeekSet);
+
+    // the file size does not change; appending to the segment then
+    // does not have to allocate storage
+    if (preallocate && state.segment_size > 0)
+      (void)state.files[idx].preallocate(0, state.segment_size, true);
   }
 
   // clear the transaction counters
   state.open_txn[idx] = 0;
   state.closed_txn[idx] = 0;
+  state.segment_bytes[idx] = 0;
 
   // also clear the buffer with the outstanding data
   state.buffer[idx].clear();
+
+  // and forget the page images of this segment
+  if (state.page_images_fd == (uint32_t)idx)
+    state.page_images.clear();
 }
 
 static inline std::string
@@ -92,18 +245,30 @@ log_file_path(JournalState &state, int i)
     path += ::basename((char *)state.env->config().filename.c_str());
 #endif
   }
-  if (i == 0)
-    path += ".jrn0";
-  else if (i == 1)
-    path += ".jrn1";
-  else
-    assert(!"invalid index");
+  assert(i >= 0 && i < JournalState::kMaxSegments);
+  char suffix[16];
+  ::snprintf(suffix, sizeof(suffix), ".jrn%d", i);
+  path += suffix;
   return (path);
 }
 
+// Flushes the buffer of file |idx|. If the log writer is running then the
+// data is only queued, and written (and synced) in the background; use
+// Journal::wait_until_durable() to wait for it.
 static inline void
 flush_buffer(JournalState &state, int idx, bool fsync = false)
 {
+  if (state.buffer[idx].size() > 0 && state.writer) {
+    ScopedLock lock(state.writer_mutex);
+    const uint8_t *data = state.buffer[idx].data();
+    state.queued[idx].insert(state.queued[idx].end(), data,
+                    data + state.buffer[idx].size());
+    state.queued_seq++;
+    state.writer_cond.notify_one();
+    state.buffer[idx].clear();
+    return;
+  }
+
   if (state.buffer[idx].size() > 0) {
     state.files[idx].write(state.buffer[idx].data(),
                     state.buffer[idx].size());
@@ -122,10 +287,64 @@ maybe_flush_buffer(JournalState &state, int idx)
     flush_buffer(state, idx);
 }
 
+// Returns the lsn of the first (oldest) entry of a segment, or 0 if the
+// segment is empty
+static inline uint64_t
+first_lsn(JournalState &state, int idx)
+{
+  if (!state.files[idx].is_open()
+        || state.files[idx].file_size() < sizeof(PJournalEntry))
+    return 0;
+
+  PJournalEntry entry;
+  state.files[idx].pread(0, &entry, sizeof(entry));
+  return entry.lsn;
+}
+
+// Returns the segment which follows the segment starting with |lsn|, or
+// -1 if there is none. The segments are ordered by the lsn of their
+// first entry. The first lsn of the returned segment is stored in
+// |next_lsn|; if there is none then |next_lsn| is set to |lsn|.
+static inline int
+next_segment(JournalState &state, uint64_t lsn, uint64_t *next_lsn)
+{
+  int next = -1;
+  uint64_t min_lsn = lsn;
+
+  for (uint32_t i = 0; i < state.num_segments; i++) {
+    uint64_t l = first_lsn(state, i);
+    if (l > lsn && (next == -1 || l < min_lsn)) {
+      next = i;
+      min_lsn = l;
+    }
+  }
+
+  *next_lsn = min_lsn;
+  return next;
+}
+
+// Returns the segment which contains |min_lsn|, or the oldest segment if
+// |min_lsn| is older than all segments. The recovery skips all older
+// segments. The first lsn of the returned segment is stored in |lsn|.
+static inline int
+first_segment(JournalState &state, uint64_t min_lsn, uint64_t *lsn)
+{
+  int idx = next_segment(state, 0, lsn);
+  uint64_t next_lsn = 0;
+  int next;
+  while (idx >= 0
+          && (next = next_segment(state, *lsn, &next_lsn)) >= 0
+          && next_lsn <= min_lsn) {
+    idx = next;
+    *lsn = next_lsn;
+  }
+  return idx;
+}
+
 // Sequentially returns the next journal entry, starting with
 // the oldest entry.
 //
-// |iter| must be initialized with zeroes for the first call.
+// |iter| must be default-constructed for the first call.
 // |auxbuffer| returns the auxiliary data of the entry and is either
 // a structure of type PJournalEntryInsert or PJournalEntryErase.
 //
@@ -136,42 +355,27 @@ read_entry(JournalState &state, Journal::Iterator *iter, PJournalEntry *entry,
 {
   auxbuffer->clear();
 
-  // if iter->offset is 0, then the iterator was created from scratch
-  // and we start reading from the first (oldest) entry.
-  //
-  // The oldest of the two logfiles is always the "other" one (the one
-  // NOT in current_fd).
-  if (iter->offset == 0) {
-    iter->fdstart = iter->fdidx =
-                        state.current_fd == 0
-                            ? 1
-                            : 0;
-  }
-
-  // get the size of the journal file
-  uint64_t filesize = state.files[iter->fdidx].file_size();
+  try {
+    // if the iterator was created from scratch then we start reading from
+    // the oldest segment
+    if (iter->fdidx < 0 && iter->first_lsn == 0) {
+      iter->fdidx = next_segment(state, 0, &iter->first_lsn);
+      iter->offset = 0;
+    }
 
-  // reached EOF? then either skip to the next file or we're done
-  if (filesize == iter->offset) {
-    if (iter->fdstart == iter->fdidx) {
-      iter->fdidx = iter->fdidx == 1 ? 0 : 1;
+    // reached EOF? then either skip to the next segment or we're done
+    while (iter->fdidx >= 0
+            && state.files[iter->fdidx].file_size() == iter->offset) {
+      iter->fdidx = next_segment(state, iter->first_lsn, &iter->first_lsn);
       iter->offset = 0;
-      filesize = state.files[iter->fdidx].file_size();
     }
-    else {
+
+    if (iter->fdidx < 0) {
       entry->lsn = 0;
       return;
     }
-  }
-
-  // second file is also empty? then return
-  if (filesize == iter->offset) {
-    entry->lsn = 0;
-    return;
-  }
 
-  // now try to read the next entry
-  try {
+    // now try to read the next entry
     state.files[iter->fdidx].pread(iter->offset, entry, sizeof(*entry));
 
     iter->offset += sizeof(*entry);
@@ -211,31 +415,46 @@ append_entry(JournalState &state, int idx,
     state.buffer[idx].append(ptr4, ptr4_size);
   if (ptr5_size)
     state.buffer[idx].append(ptr5, ptr5_size);
+
+  uint32_t size = ptr1_size + ptr2_size + ptr3_size + ptr4_size + ptr5_size;
+  state.segment_bytes[idx] += size;
+  state.bytes_appended += size;
 }
 
-// Switches the log file if necessary; returns the new log descriptor in the
-// transaction
+// Switches to the next segment if necessary; returns the new log descriptor
+// in the transaction
 static inline int
 switch_files_maybe(JournalState &state)
 {
-  int other = state.current_fd ? 0 : 1;
-
-  // determine the journal file which is used for this transaction 
-  // if the "current" file is not yet full, continue to write to this file
-  if (state.open_txn[state.current_fd] + state.closed_txn[state.current_fd]
-                  < state.threshold)
-    return state.current_fd;
-
-  // If the other file does no longer have open Transactions then
-  // delete the other file and use the other file as the current file
-  if (state.open_txn[other] == 0) {
-    clear_file(state, other);
-    state.current_fd = other;
-    // fall through
+  uint32_t cur = state.current_fd;
+
+  // determine the journal segment which is used for this transaction
+  // if the "current" segment is not yet full, continue to write to it
+  if (state.open_txn[cur] + state.closed_txn[cur] < state.threshold
+          && (state.segment_size == 0
+            || state.segment_bytes[cur] < state.segment_size))
+    return cur;
+
+  // Otherwise use the next segment which is no longer required for
+  // recovery, because all of its Transactions and Changesets were flushed.
+  // The segments are visited in a round-robin fashion, starting with the
+  // oldest one
+  for (uint32_t i = 1; i < state.num_segments; i++) {
+    uint32_t idx = (cur + i) % state.num_segments;
+    if (state.open_txn[idx] != 0 || state.pending_changesets[idx] != 0)
+      continue;
+
+    if (state.segment_bytes[idx] > 0) {
+      clear_file(state, idx, true);
+      state.count_segments_recycled++;
+    }
+    state.current_fd = idx;
+    return idx;
   }
 
-  // Otherwise just continue using the current file
-  return state.current_fd;
+  // Otherwise just continue using the current segment
+  state.count_segment_overflows++;
+  return cur;
 }
 
 // Returns a pointer to database. If the database was not yet opened then
@@ -259,21 +478,6 @@ get_db(JournalState &state, uint16_t dbname)
   return db;
 }
 
-// Returns a pointer to a Transaction object.
-static inline Transaction *
-get_txn(JournalState &state, LocalTransactionManager *txn_manager,
-                uint64_t txn_id)
-{
-  Transaction *txn = txn_manager->get_oldest_txn();
-  while (txn) {
-    if (txn->get_id() == txn_id)
-      return txn;
-    txn = txn->get_next();
-  }
-
-  return 0;
-}
-
 // Closes all databases.
 static inline void
 close_all_databases(JournalState &state)
@@ -292,32 +496,135 @@ close_all_databases(JournalState &state)
   state.database_map.clear();
 }
 
-// Aborts all transactions which are still active.
-static inline void
-abort_uncommitted_txns(JournalState &state,
-                LocalTransactionManager *txn_manager)
+// Returns the number of bytes at the beginning of |data| which are equal
+// to |base|, or which are zero if |base| is null
+static inline uint32_t
+count_unmodified(const uint8_t *data, const uint8_t *base, uint32_t size)
 {
-  Transaction *txn = txn_manager->get_oldest_txn();
+  uint32_t i = 0;
+
+  // compare word by word, then byte by byte
+  if (base) {
+    while (i + sizeof(uint64_t) <= size
+            && *(const uint64_t *)(data + i) == *(const uint64_t *)(base + i))
+      i += sizeof(uint64_t);
+    while (i < size && data[i] == base[i])
+      i++;
+  }
+  else {
+    while (i + sizeof(uint64_t) <= size && *(const uint64_t *)(data + i) == 0)
+      i += sizeof(uint64_t);
+    while (i < size && data[i] == 0)
+      i++;
+  }
+  return i;
+}
+
+// Stores the ranges of |data| which differ from |base| (or from a page
+// filled with zeroes, if |base| is null) in |delta|. Returns false if the
+// delta is not smaller than the page
+static inline bool
+encode_page_delta(const uint8_t *data, const uint8_t *base,
+                uint32_t page_size, std::vector<uint8_t> *delta)
+{
+  delta->clear();
+
+  uint32_t i = 0;
+  while (true) {
+    i += count_unmodified(data + i, base ? base + i : 0, page_size - i);
+    if (i == page_size)
+      return true;
+
+    // the range ends with |kPageDeltaMinGap| unmodified bytes (or with
+    // the end of the page)
+    uint32_t start = i;
+    uint32_t end = i + 1;
+    for (i = end; i < page_size && i - end < kPageDeltaMinGap; i++) {
+      if (data[i] != (base ? base[i] : 0))
+        end = i + 1;
+    }
+
+    PJournalEntryPageDelta range(start, end - start);
+    if (delta->size() + sizeof(range) + range.size >= page_size)
+      return false;
+    delta->insert(delta->end(), (uint8_t *)&range,
+                    (uint8_t *)&range + sizeof(range));
+    delta->insert(delta->end(), data + start, data + end);
+    i = end;
+  }
+}
 
-  while (txn) {
-    if (!txn->is_committed())
-      txn->abort();
-    txn = txn->get_next();
+// Applies the ranges of a |delta| to a page image
+static inline void
+apply_page_delta(uint8_t *data, uint32_t page_size, const uint8_t *delta,
+                uint32_t delta_size)
+{
+  const uint8_t *end = delta + delta_size;
+  while (delta < end) {
+    PJournalEntryPageDelta range;
+    if (end - delta < (ptrdiff_t)sizeof(range))
+      throw Exception(UPS_INTEGRITY_VIOLATED);
+    ::memcpy(&range, delta, sizeof(range));
+    delta += sizeof(range);
+    if (range.offset > page_size || range.size > page_size - range.offset
+            || range.size > (uint32_t)(end - delta))
+      throw Exception(UPS_INTEGRITY_VIOLATED);
+    ::memcpy(data + range.offset, delta, range.size);
+    delta += range.size;
   }
 }
 
 // Helper function which adds a single page from the changeset to
-// the Journal; returns the page size (or compressed size, if compression
-// was enabled)
+// the Journal; returns the number of bytes which were appended
+//
+// The page is stored as a delta relative to its previous image in the
+// current segment (or to a page filled with zeroes), unless the delta is
+// not smaller than the page
 static inline uint32_t
 append_changeset_page(JournalState &state, Page *page, uint32_t page_size)
 {
   PJournalEntryPageHeader header(page->address());
+  const uint8_t *data = (const uint8_t *)page->data();
 
-  if (state.compressor.get()) {
-    state.count_bytes_before_compression += page_size;
-    header.compressed_size = state.compressor->compress((uint8_t *)page->data(),
-                    page_size);
+  // the page images are only valid within a segment
+  if (state.page_images_fd != state.current_fd) {
+    state.page_images.clear();
+    state.page_images_fd = state.current_fd;
+  }
+
+  std::vector<uint8_t> *image = 0;
+  JournalState::PageImageMap::iterator it
+          = state.page_images.find(header.address);
+  if (it != state.page_images.end())
+    image = &it->second;
+  else if ((state.page_images.size() + 1) * page_size <= kMaxPageImageBytes)
+    image = &state.page_images[header.address];
+
+  const uint8_t *payload = data;
+  uint32_t payload_size = page_size;
+  const uint8_t *base = image && !image->empty() ? &(*image)[0] : 0;
+  if (encode_page_delta(data, base, page_size, &state.page_delta)) {
+    header.delta_size = (uint32_t)state.page_delta.size();
+    header.flags |= PJournalEntryPageHeader::kDelta;
+    if (base)
+      header.flags |= PJournalEntryPageHeader::kDeltaFromPrevious;
+    payload = state.page_delta.empty() ? 0 : &state.page_delta[0];
+    payload_size = header.delta_size;
+  }
+
+  // remember the image of the page for the next delta
+  if (image) {
+    image->assign(data, data + page_size);
+    header.flags |= PJournalEntryPageHeader::kRememberImage;
+  }
+
+  state.count_page_bytes_before_delta += page_size;
+  state.count_page_bytes_after_delta += payload_size;
+
+  if (state.compressor.get() && payload_size > 0) {
+    state.count_bytes_before_compression += payload_size;
+    header.compressed_size = state.compressor->compress(payload,
+                    payload_size);
     append_entry(state, state.current_fd, (uint8_t *)&header, sizeof(header),
                     state.compressor->arena.data(),
                     header.compressed_size);
@@ -326,8 +633,8 @@ append_changeset_page(JournalState &state, Page *page, uint32_t page_size)
   }
 
   append_entry(state, state.current_fd, (uint8_t *)&header, sizeof(header),
-                (uint8_t *)page->data(), page_size);
-  return page_size + sizeof(header);
+                payload, payload_size);
+  return payload_size + sizeof(header);
 }
 
 // Scans a file for the oldest changeset. Returns the lsn of this
@@ -364,15 +671,61 @@ scan_for_oldest_changeset(JournalState &state, File *file)
   return 0;
 }
 
-// Redo all Changesets of a log file, in chronological order
-// Returns the highest lsn of the last changeset applied
+// Scans all segments for the newest checkpoint. Returns the lsn from
+// which the recovery starts, or 0 if there is no checkpoint
 static inline uint64_t
-redo_all_changesets(JournalState &state, int fdidx)
+scan_for_newest_checkpoint(JournalState &state)
+{
+  uint64_t cp_lsn = 0;
+  uint64_t min_lsn = 0;
+
+  for (uint32_t i = 0; i < state.num_segments; i++) {
+    if (!state.files[i].is_open())
+      continue;
+
+    try {
+      uint64_t filesize = state.files[i].file_size();
+      uint64_t offset = 0;
+      PJournalEntry entry;
+
+      while (offset + sizeof(entry) <= filesize) {
+        state.files[i].pread(offset, &entry, sizeof(entry));
+        if (entry.lsn == 0)
+          break;
+
+        if (entry.type == Journal::kEntryTypeCheckpoint
+                && entry.lsn > cp_lsn) {
+          PJournalEntryCheckpoint checkpoint;
+          state.files[i].pread(offset + sizeof(entry), &checkpoint,
+                          sizeof(checkpoint));
+          cp_lsn = entry.lsn;
+          min_lsn = checkpoint.min_lsn;
+        }
+
+        offset += sizeof(entry) + entry.followup_size;
+      }
+    }
+    catch (Exception &ex) {
+      ups_log(("exception (error %d) while reading journal", ex.code));
+    }
+  }
+
+  return min_lsn;
+}
+
+// Redo all Changesets of a log file, in chronological order; Changesets
+// with an lsn lower than |min_lsn| are already stored in the database
+// file, but they are still read because the following deltas can depend
+// on their page images. Returns the highest lsn of the last changeset
+// applied
+static inline uint64_t
+redo_all_changesets(JournalState &state, int fdidx, uint64_t min_lsn)
 {
   Journal::Iterator it;
   PJournalEntry entry;
   ByteArray buffer;
   uint64_t max_lsn = 0;
+  JournalState::PageImageMap images;
 
   // for each entry...
   try {
@@ -387,7 +740,17 @@ redo_all_changesets(JournalState &state, int fdidx)
         continue;
       }
 
-      max_lsn = entry.lsn;
+      // changesets of a newer release cannot be parsed
+      if (entry.version > PJournalEntry::kFormatVersion) {
+        ups_log(("journal was written by a newer release (format %d)",
+                        (int)entry.version));
+        throw Exception(UPS_INV_FILE_VERSION);
+      }
+
+      // changesets older than the checkpoint are not written
+      bool apply = entry.lsn >= min_lsn;
+      if (apply)
+        max_lsn = entry.lsn;
 
       it.offset += sizeof(entry);
 
@@ -399,30 +762,70 @@ redo_all_changesets(JournalState &state, int fdidx)
       uint32_t page_size = state.env->config().page_size_bytes;
       ByteArray arena(page_size);
       ByteArray tmp;
+      ByteArray delta;
 
       uint64_t file_size = state.env->device()->file_size();
 
-      state.env->page_manager()->set_last_blob_page_id(changeset.last_blob_page);
+      if (apply)
+        state.env->page_manager()->set_last_blob_page_id(
+                        changeset.last_blob_page);
 
       // for each page in this changeset...
       for (uint32_t i = 0; i < changeset.num_pages; i++) {
+        // older releases only stored the address and the compressed size,
+        // followed by the full page image; the remaining fields (and
+        // therefore the flags) stay 0
         PJournalEntryPageHeader page_header;
-        state.files[fdidx].pread(it.offset, &page_header,
-                        sizeof(page_header));
-        it.offset += sizeof(page_header);
+        size_t header_size = entry.version == 0
+                                ? PJournalEntryPageHeader::kSizeofVersion0
+                                : sizeof(page_header);
+        state.files[fdidx].pread(it.offset, &page_header, header_size);
+        it.offset += header_size;
+
+        bool is_delta = isset(page_header.flags,
+                        PJournalEntryPageHeader::kDelta);
+        uint32_t size = is_delta ? page_header.delta_size : page_size;
+        if (size > page_size)
+          throw Exception(UPS_INTEGRITY_VIOLATED);
+
         if (page_header.compressed_size > 0) {
-          tmp.resize(page_size);
+          tmp.resize(page_header.compressed_size);
           state.files[fdidx].pread(it.offset, tmp.data(),
                         page_header.compressed_size);
           it.offset += page_header.compressed_size;
           state.compressor->decompress(tmp.data(),
-                        page_header.compressed_size, page_size, &arena);
+                        page_header.compressed_size, size, &arena);
         }
-        else {
-          state.files[fdidx].pread(it.offset, arena.data(), page_size);
-          it.offset += page_size;
+        else if (size > 0) {
+          state.files[fdidx].pread(it.offset, arena.data(), size);
+          it.offset += size;
         }
 
+        // rebuild the page from its delta
+        if (is_delta) {
+          delta.resize(size);
+          if (size > 0)
+            ::memcpy(delta.data(), arena.data(), size);
+          if (isset(page_header.flags,
+                      PJournalEntryPageHeader::kDeltaFromPrevious)) {
+            JournalState::PageImageMap::iterator iit
+                    = images.find(page_header.address);
+            if (iit == images.end())
+              throw Exception(UPS_INTEGRITY_VIOLATED);
+            ::memcpy(arena.data(), &iit->second[0], page_size);
+          }
+          else
+            ::memset(arena.data(), 0, page_size);
+          apply_page_delta(arena.data(), page_size, delta.data(), size);
+        }
+
+        if (isset(page_header.flags, PJournalEntryPageHeader::kRememberImage))
+          images[page_header.address].assign(arena.data(),
+                          arena.data() + page_size);
+
+        if (!apply)
+          continue;
+
         Page *page;
 
         // now write the page to disk
@@ -472,44 +875,331 @@ redo_all_changesets(JournalState &state, int fdidx)
 // Recovers (re-applies) the physical changelog; returns the lsn of the
 // Changelog
 static inline uint64_t
-recover_changeset(JournalState &state)
+recover_changeset(JournalState &state, uint64_t min_lsn)
 {
-  // scan through both files, look for the file with the oldest changeset.
-  uint64_t lsn1 = scan_for_oldest_changeset(state, &state.files[0]);
-  uint64_t lsn2 = scan_for_oldest_changeset(state, &state.files[1]);
+  uint64_t max_lsn = 0;
+  uint64_t lsn = 0;
+
+  // redo all changesets chronologically; the segments are ordered by
+  // their first lsn
+  int idx = first_segment(state, min_lsn, &lsn);
+  while (idx >= 0) {
+    if (scan_for_oldest_changeset(state, &state.files[idx]) != 0)
+      max_lsn = std::max(max_lsn, redo_all_changesets(state, idx, min_lsn));
+    idx = next_segment(state, lsn, &lsn);
+  }
 
-  // both files are empty or do not contain a changeset?
-  if (lsn1 == 0 && lsn2 == 0)
-    return 0;
+  // return the lsn of the newest changeset
+  return max_lsn;
+}
 
-  // now redo all changesets chronologically
-  state.current_fd = lsn1 < lsn2 ? 0 : 1;
+// A logical operation (insert or erase) which is replayed during recovery
+struct RecoveryOperation
+{
+  // the lsn of the journal entry
+  uint64_t lsn;
 
-  uint64_t max_lsn1 = redo_all_changesets(state, state.current_fd);
-  uint64_t max_lsn2 = redo_all_changesets(state, state.current_fd == 0 ? 1 : 0);
+  // the Transaction of this operation; 0 for temporary Transactions
+  uint64_t txn_id;
 
-  // return the lsn of the newest changeset
-  return std::max(max_lsn1, max_lsn2);
+  // the entry type (kEntryTypeInsert or kEntryTypeErase)
+  uint32_t type;
+
+  // the flags of the operation
+  uint32_t flags;
+
+  // the offset and size of the journal payload in
+  // RecoveryPartition::payload; after decoding, |offset| is the offset
+  // of the key in RecoveryPartition::data, followed by the record
+  size_t offset;
+  uint32_t size;
+
+  // the size of the decoded key and record
+  uint32_t key_size;
+  uint32_t record_size;
+};
+
+// All operations of a single database
+struct RecoveryPartition
+{
+  RecoveryPartition()
+    : db(0), status(0) {
+  }
+
+  // the database
+  LocalDatabase *db;
+
+  // the operations, in lsn order; after decoding they are sorted by key
+  std::vector<RecoveryOperation> operations;
+
+  // the journal payload of the operations
+  std::vector<uint8_t> payload;
+
+  // the decoded keys and records
+  std::vector<uint8_t> data;
+
+  // the error which occurred while decoding the operations
+  ups_status_t status;
+};
+
+// Orders the operations of a partition by key; operations of the same
+// key remain in lsn order
+struct RecoveryOperationCompare
+{
+  RecoveryOperationCompare(RecoveryPartition *partition_)
+    : partition(partition_) {
+  }
+
+  bool operator()(const RecoveryOperation &lhs,
+                  const RecoveryOperation &rhs) const {
+    uint8_t *data = partition->data.empty() ? 0 : &partition->data[0];
+    ups_key_t k1 = ups_make_key(data + lhs.offset, (uint16_t)lhs.key_size);
+    ups_key_t k2 = ups_make_key(data + rhs.offset, (uint16_t)rhs.key_size);
+    int cmp = partition->db->btree_index()->compare_keys(&k1, &k2);
+    if (cmp != 0)
+      return cmp < 0;
+    return lhs.lsn < rhs.lsn;
+  }
+
+  RecoveryPartition *partition;
+};
+
+struct RecoveryOperationLsnCompare
+{
+  bool operator()(const RecoveryOperation &lhs,
+                  const RecoveryOperation &rhs) const {
+    return lhs.lsn < rhs.lsn;
+  }
+};
+
+// Appends |size| bytes to |data|; decompresses them if |compressed_size|
+// is not 0
+static inline void
+decode_payload(Compressor *compressor, std::vector<uint8_t> &data,
+                const uint8_t *p, uint32_t size, uint32_t compressed_size)
+{
+  size_t offset = data.size();
+  data.resize(offset + size);
+  if (size == 0)
+    return;
+  if (compressed_size != 0)
+    compressor->decompress(p, compressed_size, size, &data[offset]);
+  else
+    ::memcpy(&data[offset], p, size);
+}
+
+// Decodes the operations of a partition which belong to committed
+// Transactions, and sorts them by key; the partitions are prepared in
+// parallel
+static void
+prepare_partition(RecoveryPartition *partition, int compressor_algo,
+                const std::set<uint64_t> *committed)
+{
+  try {
+    ScopedPtr<Compressor> compressor(compressor_algo
+                    ? CompressorFactory::create(compressor_algo)
+                    : 0);
+    std::vector<RecoveryOperation> operations;
+    operations.reserve(partition->operations.size());
+
+    for (std::vector<RecoveryOperation>::iterator it
+                = partition->operations.begin();
+            it != partition->operations.end(); it++) {
+      RecoveryOperation op = *it;
+
+      // skip all operations of aborted or incomplete Transactions
+      if (op.txn_id != 0 && committed->find(op.txn_id) == committed->end())
+        continue;
+
+      uint8_t *p = &partition->payload[op.offset];
+      op.offset = partition->data.size();
+
+      if (op.type == Journal::kEntryTypeInsert) {
+        PJournalEntryInsert *ins = (PJournalEntryInsert *)p;
+        uint8_t *payload = ins->key_data();
+        decode_payload(compressor.get(), partition->data, payload,
+                        ins->key_size, ins->compressed_key_size);
+        payload += ins->compressed_key_size
+                        ? ins->compressed_key_size
+                        : ins->key_size;
+        decode_payload(compressor.get(), partition->data, payload,
+                        ins->record_size, ins->compressed_record_size);
+        op.flags = ins->insert_flags;
+        op.key_size = ins->key_size;
+        op.record_size = ins->record_size;
+      }
+      else {
+        PJournalEntryErase *e = (PJournalEntryErase *)p;
+        decode_payload(compressor.get(), partition->data, e->key_data(),
+                        e->key_size, e->compressed_key_size);
+        op.flags = e->erase_flags;
+        op.key_size = e->key_size;
+        op.record_size = 0;
+      }
+
+      operations.push_back(op);
+    }
+
+    partition->operations.swap(operations);
+    std::vector<uint8_t>().swap(partition->payload);
+
+    // The segments are not read in lsn order. Record numbers have to be
+    // replayed in their original order; all other keys are replayed in
+    // key order, which visits each btree leaf only once
+    if (isset(partition->db->get_flags(),
+                UPS_RECORD_NUMBER32 | UPS_RECORD_NUMBER64))
+      std::sort(partition->operations.begin(), partition->operations.end(),
+                    RecoveryOperationLsnCompare());
+    else
+      std::sort(partition->operations.begin(), partition->operations.end(),
+                    RecoveryOperationCompare(partition));
+  }
+  catch (Exception &ex) {
+    partition->status = ex.code;
+  }
+}
+
+// Decodes the partitions; |next| is shared by all threads and selects the
+// next partition
+static void
+prepare_partitions_thread(std::vector<RecoveryPartition *> *partitions,
+                boost::atomic<size_t> *next, int compressor_algo,
+                const std::set<uint64_t> *committed)
+{
+  size_t i;
+  while ((i = next->fetch_add(1)) < partitions->size())
+    prepare_partition((*partitions)[i], compressor_algo, committed);
+}
+
+// Decodes all partitions in parallel
+static inline void
+prepare_partitions(JournalState &state,
+                std::vector<RecoveryPartition *> &partitions,
+                const std::set<uint64_t> &committed)
+{
+  size_t num_threads = std::max(boost::thread::hardware_concurrency(), 1u);
+  num_threads = std::min(num_threads, partitions.size());
+
+  boost::atomic<size_t> next(0);
+  boost::thread_group threads;
+  for (size_t t = 0; t < num_threads; t++)
+    threads.create_thread(boost::bind(&prepare_partitions_thread,
+                            &partitions, &next,
+                            state.env->config().journal_compressor,
+                            &committed));
+  threads.join_all();
+
+  for (size_t i = 0; i < partitions.size(); i++) {
+    if (partitions[i]->status)
+      throw Exception(partitions[i]->status);
+  }
+}
+
+// Writes the decoded operations of all partitions to the btrees and
+// reports the progress. Unlike the decoding, this is not parallelized:
+// the btrees of different databases share the header page, the blob pages
+// and the freelist, and their page locks are blocking. Two partitions
+// could therefore deadlock on each other's pages.
+static inline void
+replay_partitions(JournalState &state,
+                std::vector<RecoveryPartition *> &partitions)
+{
+  ups_recovery_progress_fun callback
+          = state.env->config().recovery_progress_callback;
+  void *callback_context = state.env->config().recovery_progress_context;
+
+  uint64_t total = 0;
+  for (size_t i = 0; i < partitions.size(); i++)
+    total += partitions[i]->operations.size();
+
+  uint64_t done = 0;
+  if (callback)
+    callback(callback_context, done, total);
+
+  for (size_t i = 0; i < partitions.size(); i++) {
+    RecoveryPartition *partition = partitions[i];
+    LocalDatabase *db = partition->db;
+    uint8_t *data = partition->data.empty() ? 0 : &partition->data[0];
+    Context context(state.env, 0, db);
+
+    // the pages are flushed with the newest lsn of the partition
+    uint64_t lsn = 0;
+    for (size_t j = 0; j < partition->operations.size(); j++)
+      lsn = std::max(lsn, partition->operations[j].lsn);
+
+    try {
+      for (std::vector<RecoveryOperation>::iterator it
+                  = partition->operations.begin();
+              it != partition->operations.end(); it++) {
+        state.env->page_manager()->purge_cache(&context);
+
+        ups_status_t st;
+        ups_key_t key = ups_make_key(data + it->offset,
+                        (uint16_t)it->key_size);
+        if (it->type == Journal::kEntryTypeInsert) {
+          ups_record_t record = ups_make_record(data + it->offset
+                          + it->key_size, it->record_size);
+          // like flush_txn_operation(), a non-duplicate key is overwritten;
+          // the flushed batches are not rolled back if the recovery is
+          // interrupted, and the next recovery replays them again
+          uint32_t flags = it->flags;
+          if (notset(flags, UPS_DUPLICATE))
+            flags |= UPS_OVERWRITE;
+          st = db->btree_index()->insert(&context, 0, &key, &record, flags);
+        }
+        else {
+          st = db->btree_index()->erase(&context, 0, &key, 0, it->flags);
+          // the key might have already been erased when the changeset
+          // was flushed
+          if (st == UPS_KEY_NOT_FOUND)
+            st = 0;
+        }
+        if (st)
+          throw Exception(st);
+
+        // the modified pages remain locked in the changeset, and are
+        // written in batches
+        if (++done % kRecoveryProgressInterval == 0) {
+          context.changeset.flush(lsn);
+          if (callback)
+            callback(callback_context, done, total);
+        }
+      }
+
+      context.changeset.flush(lsn);
+    }
+    catch (Exception &) {
+      context.changeset.clear();
+      throw;
+    }
+  }
+
+  if (callback && done % kRecoveryProgressInterval != 0)
+    callback(callback_context, done, total);
 }
 
 // Recovers the logical journal
 static inline void
 recover_journal(JournalState &state, Context *context,
-                LocalTransactionManager *txn_manager, uint64_t start_lsn)
+                LocalTransactionManager *txn_manager, uint64_t min_lsn,
+                uint64_t start_lsn)
 {
   ups_status_t st = 0;
   Journal::Iterator it;
   ByteArray buffer;
-
-  /* recovering the journal is rather simple - we iterate over the
-   * files and re-apply EVERY operation (incl. txn_begin and txn_abort),
-   * that was not yet flushed with a Changeset.
+  std::map<uint16_t, RecoveryPartition *> partition_map;
+  std::vector<RecoveryPartition *> partitions;
+  std::set<uint64_t> committed;
+  uint64_t max_txn_id = 0;
+
+  /* The journal is read only once. All inserts and erases which were not
+   * yet flushed with a Changeset (their lsn is greater than the one of
+   * the last Changeset) are partitioned by database.
    *
-   * Basically we iterate over both log files and skip everything with
-   * a sequence number (lsn) smaller the one of the last Changeset.
-   *
-   * When done then auto-abort all transactions that were not yet
-   * committed.
+   * The partitions are then decoded in parallel; operations of aborted or
+   * incomplete Transactions are skipped. Afterwards the partitions are
+   * replayed one after the other; their operations are written directly
+   * to the btree in key order, without creating Transactions.
    */
 
   // make sure that there are no pending transactions - start with
@@ -520,148 +1210,90 @@ recover_journal(JournalState &state, Context *context,
   // do not append to the journal during recovery
   state.disable_logging = true;
 
-  do {
-    PJournalEntry entry;
+  // start with the segment of the checkpoint; the older segments are
+  // no longer required
+  it.fdidx = first_segment(state, min_lsn, &it.first_lsn);
 
-    // get the next entry
-    read_entry(state, &it, &entry, &buffer);
+  try {
+    do {
+      PJournalEntry entry;
 
-    // reached end of logfile?
-    if (!entry.lsn)
-      break;
+      // get the next entry
+      read_entry(state, &it, &entry, &buffer);
 
-    // re-apply this operation
-    switch (entry.type) {
-      case Journal::kEntryTypeTxnBegin: {
-        Transaction *txn = 0;
-        st = ups_txn_begin((ups_txn_t **)&txn, (ups_env_t *)state.env, 
-                (const char *)buffer.data(), 0, UPS_DONT_LOCK);
-        // on success: patch the txn ID
-        if (st == 0) {
-          txn->set_id(entry.txn_id);
-          txn_manager->set_txn_id(entry.txn_id);
-        }
+      // reached end of logfile?
+      if (!entry.lsn)
         break;
-      }
-      case Journal::kEntryTypeTxnAbort: {
-        Transaction *txn = get_txn(state, txn_manager, entry.txn_id);
-        st = ups_txn_abort((ups_txn_t *)txn, UPS_DONT_LOCK);
-        break;
-      }
-      case Journal::kEntryTypeTxnCommit: {
-        Transaction *txn = get_txn(state, txn_manager, entry.txn_id);
-        st = ups_txn_commit((ups_txn_t *)txn, UPS_DONT_LOCK);
-        break;
-      }
-      case Journal::kEntryTypeInsert: {
-        PJournalEntryInsert *ins = (PJournalEntryInsert *)buffer.data();
-        Transaction *txn = 0;
-        Database *db;
-        ups_key_t key = {0};
-        ups_record_t record = {0};
-        if (!ins) {
-          st = UPS_IO_ERROR;
-          goto bail;
-        }
-
-        // do not insert if the key was already flushed to disk
-        if (entry.lsn <= start_lsn)
-          continue;
-
-        uint8_t *payload = ins->key_data();
 
-        // extract the key - it can be compressed or uncompressed
-        ByteArray keyarena;
-        if (ins->compressed_key_size != 0) {
-          state.compressor->decompress(payload, ins->compressed_key_size,
-                          ins->key_size);
-          keyarena.append(state.compressor->arena.data(), ins->key_size);
-          key.data = keyarena.data();
-          payload += ins->compressed_key_size;
-        }
-        else {
-          key.data = payload;
-          payload += ins->key_size;
+      if (entry.txn_id > max_txn_id)
+        max_txn_id = entry.txn_id;
+
+      switch (entry.type) {
+        case Journal::kEntryTypeTxnBegin:
+        case Journal::kEntryTypeTxnAbort:
+        case Journal::kEntryTypeChangeset:
+        case Journal::kEntryTypeCheckpoint:
+          // the changesets were already applied, and the newest checkpoint
+          // was already evaluated
+          break;
+        case Journal::kEntryTypeTxnCommit:
+          committed.insert(entry.txn_id);
+          break;
+        case Journal::kEntryTypeInsert:
+        case Journal::kEntryTypeErase: {
+          if (buffer.size() == 0)
+            throw Exception(UPS_IO_ERROR);
+
+          // skip the operation if it was already flushed to disk
+          if (entry.lsn <= start_lsn)
+            break;
+
+          RecoveryPartition *partition = partition_map[entry.dbname];
+          if (!partition) {
+            partition = new RecoveryPartition;
+            partitions.push_back(partition);
+            partition_map[entry.dbname] = partition;
+            partition->db = (LocalDatabase *)get_db(state, entry.dbname);
+          }
+
+          RecoveryOperation op = {0};
+          op.lsn = entry.lsn;
+          op.txn_id = entry.txn_id;
+          op.type = entry.type;
+          op.offset = partition->payload.size();
+          op.size = (uint32_t)buffer.size();
+          partition->payload.insert(partition->payload.end(), buffer.data(),
+                          buffer.data() + buffer.size());
+          partition->operations.push_back(op);
+          break;
         }
-        key.size = ins->key_size;
-        // extract the record - it can be compressed or uncompressed
-        ByteArray recarena;
-        if (ins->compressed_record_size != 0) {
-          state.compressor->decompress(payload, ins->compressed_record_size,
-                          ins->record_size);
-          recarena.append(state.compressor->arena.data(), ins->record_size);
-          record.data = recarena.data();
-          payload += ins->compressed_record_size;
-        }
-        else {
-          record.data = payload;
-          payload += ins->record_size;
-        }
-        record.size = ins->record_size;
-        if (entry.txn_id)
-          txn = get_txn(state, txn_manager, entry.txn_id);
-        db = get_db(state, entry.dbname);
-        st = ups_db_insert((ups_db_t *)db, (ups_txn_t *)txn, &key, &record,
-                        ins->insert_flags | UPS_DONT_LOCK);
-        break;
+        default:
+          ups_log(("invalid journal entry type or journal is corrupt"));
+          throw Exception(UPS_IO_ERROR);
       }
-      case Journal::kEntryTypeErase: {
-        PJournalEntryErase *e = (PJournalEntryErase *)buffer.data();
-        Transaction *txn = 0;
-        Database *db;
-        ups_key_t key = {0};
-        if (!e) {
-          st = UPS_IO_ERROR;
-          goto bail;
-        }
+    } while (1);
 
-        // do not erase if the key was already erased from disk
-        if (entry.lsn <= start_lsn)
-          continue;
+    // new Transactions continue with the next id
+    txn_manager->set_txn_id(max_txn_id);
 
-        if (entry.txn_id)
-          txn = get_txn(state, txn_manager, entry.txn_id);
-        db = get_db(state, entry.dbname);
-        key.data = e->key_data();
-        if (e->compressed_key_size != 0) {
-          state.compressor->decompress(e->key_data(), e->compressed_key_size,
-                          e->key_size);
-          key.data = state.compressor->arena.data();
-        }
-        else
-          key.data = e->key_data();
-        key.size = e->key_size;
-        st = ups_db_erase((ups_db_t *)db, (ups_txn_t *)txn, &key,
-                        e->erase_flags | UPS_DONT_LOCK);
-        // key might have already been erased when the changeset
-        // was flushed
-        if (st == UPS_KEY_NOT_FOUND)
-          st = 0;
-        break;
-      }
-      case Journal::kEntryTypeChangeset: {
-        // skip this; the changeset was already applied
-        break;
-      }
-      default:
-        ups_log(("invalid journal entry type or journal is corrupt"));
-        st = UPS_IO_ERROR;
-      }
+    if (!partitions.empty())
+      prepare_partitions(state, partitions, committed);
 
-      if (st)
-        goto bail;
-  } while (1);
+    replay_partitions(state, partitions);
+  }
+  catch (Exception &ex) {
+    st = ex.code;
+  }
 
-bail:
-  // all transactions which are not yet committed will be aborted
-  abort_uncommitted_txns(state, txn_manager);
+  for (size_t i = 0; i < partitions.size(); i++)
+    delete partitions[i];
 
-  // also close and delete all open databases - they were created in get_db()
+  // close and delete all open databases - they were created in get_db()
   close_all_databases(state);
 
-  // flush all committed transactions
+  // write all modified pages to disk before the journal is cleared
   if (st == 0)
-    st = state.env->flush(UPS_FLUSH_COMMITTED_TRANSACTIONS);
+    st = state.env->flush(0);
 
   // re-enable the logging
   state.disable_logging = false;
@@ -670,20 +1302,32 @@ bail:
     throw Exception(st);
 }
 
-
 JournalState::JournalState(LocalEnvironment *env_)
   : env(env_), current_fd(0),
+    num_segments(env_->config().journal_segments),
+    segment_size(env_->config().journal_segment_size), last_cp_lsn(0),
+    bytes_appended(0), last_cp_bytes(0),
     threshold(env_->config().journal_switch_threshold),
     disable_logging(false), count_bytes_flushed(0),
-    count_bytes_before_compression(0), count_bytes_after_compression(0)
+    count_bytes_before_compression(0), count_bytes_after_compression(0),
+    count_page_bytes_before_delta(0), count_page_bytes_after_delta(0),
+    page_images_fd(0), queued_seq(0), durable_seq(0), writer_stopped(false),
+    writer_status(0), count_group_commits(0), count_segments_recycled(0),
+    count_segment_overflows(0), count_checkpoints(0)
 {
   if (threshold == 0)
     threshold = kSwitchTxnThreshold;
-
-  open_txn[0] = 0;
-  open_txn[1] = 0;
-  closed_txn[0] = 0;
-  closed_txn[1] = 0;
+  if (num_segments < 2)
+    num_segments = 2;
+  if (num_segments > kMaxSegments)
+    num_segments = kMaxSegments;
+
+  for (int i = 0; i < kMaxSegments; i++) {
+    segment_bytes[i] = 0;
+    open_txn[i] = 0;
+    closed_txn[i] = 0;
+    pending_changesets[i] = 0;
+  }
 }
 
 Journal::Journal(LocalEnvironment *env)
@@ -694,31 +1338,63 @@ Journal::Journal(LocalEnvironment *env)
     state.compressor.reset(CompressorFactory::create(algo));
 }
 
+Journal::~Journal()
+{
+  stop_log_writer(state);
+}
+
 void
 Journal::create()
 {
-  // create the two files
-  for (int i = 0; i < 2; i++) {
+  // create the segments and reserve their storage
+  for (uint32_t i = 0; i < state.num_segments; i++) {
     std::string path = log_file_path(state, i);
     state.files[i].create(path.c_str(), 0644);
+    if (state.segment_size > 0)
+      (void)state.files[i].preallocate(0, state.segment_size, true);
   }
+
+  start_log_writer(state);
 }
 
 void
 Journal::open()
 {
-  // open the two files
+  // open the segments; the first two are required. Additional segments
+  // are created if they do not yet exist. Segments which exist beyond the
+  // configured number are used as well, otherwise their data would be lost
   try {
-    std::string path = log_file_path(state, 0);
-    state.files[0].open(path.c_str(), false);
-    path = log_file_path(state, 1);
-    state.files[1].open(path.c_str(), 0);
+    for (uint32_t i = 0; i < JournalState::kMaxSegments; i++) {
+      std::string path = log_file_path(state, i);
+      if (i >= 2 && !os_file_exists(path.c_str())) {
+        if (i >= state.num_segments)
+          break;
+        state.files[i].create(path.c_str(), 0644);
+        continue;
+      }
+      state.files[i].open(path.c_str(), false);
+      if (i >= state.num_segments)
+        state.num_segments = i + 1;
+    }
   }
   catch (Exception &ex) {
-    state.files[1].close();
-    state.files[0].close();
+    for (int i = 0; i < JournalState::kMaxSegments; i++)
+      state.files[i].close();
     throw ex;
   }
+
+  // continue with the newest segment
+  uint64_t newest = 0;
+  for (uint32_t i = 0; i < state.num_segments; i++) {
+    state.segment_bytes[i] = state.files[i].file_size();
+    uint64_t lsn = first_lsn(state, i);
+    if (lsn > newest) {
+      newest = lsn;
+      state.current_fd = i;
+    }
+  }
+
+  start_log_writer(state);
 }
 
 void
@@ -737,6 +1413,7 @@ Journal::append_txn_begin(LocalTransaction *txn, const char *name, uint64_t lsn)
     entry.followup_size = ::strlen(name) + 1;
 
   txn->set_log_desc(switch_files_maybe(state));
+  txn->set_begin_lsn(lsn);
 
   int cur = txn->get_log_desc();
 
@@ -972,38 +1649,82 @@ Journal::append_changeset(std::vector<Page *> &pages,
                 (uint8_t *)&changeset, sizeof(PJournalEntryChangeset));
 
   size_t page_size = state.env->config().page_size_bytes;
-  for (std::vector<Page *>::iterator it = pages.begin();
-                  it != pages.end();
-                  ++it) {
-    entry.followup_size += append_changeset_page(state, *it, page_size);
-  }
 
-  UPS_INDUCE_ERROR(ErrorInducer::kChangesetFlush);
+  // if this changeset is not logged completely then the following deltas
+  // must not depend on the images of its pages
+  try {
+    for (std::vector<Page *>::iterator it = pages.begin();
+                    it != pages.end();
+                    ++it) {
+      entry.followup_size += append_changeset_page(state, *it, page_size);
+    }
+
+    UPS_INDUCE_ERROR(ErrorInducer::kChangesetFlush);
 
-  // and patch in the followup-size
-  state.buffer[state.current_fd].overwrite(entry_position,
-          (uint8_t *)&entry, sizeof(entry));
+    // and patch in the followup-size
+    state.buffer[state.current_fd].overwrite(entry_position,
+            (uint8_t *)&entry, sizeof(entry));
 
-  UPS_INDUCE_ERROR(ErrorInducer::kChangesetFlush);
+    UPS_INDUCE_ERROR(ErrorInducer::kChangesetFlush);
 
-  // and flush the file
-  flush_buffer(state, state.current_fd,
-                  isset(state.env->get_flags(), UPS_ENABLE_FSYNC));
+    // and flush the file
+    flush_buffer(state, state.current_fd,
+                    isset(state.env->get_flags(), UPS_ENABLE_FSYNC));
 
-  UPS_INDUCE_ERROR(ErrorInducer::kChangesetFlush);
+    UPS_INDUCE_ERROR(ErrorInducer::kChangesetFlush);
+  }
+  catch (Exception &) {
+    state.page_images.clear();
+    throw;
+  }
 
-  // if recovery is enabled (w/o transactions) then simulate a "commit" to
-  // make sure that the log files are switched properly. Here, the
-  // counter for "opened transactions" is incremented. It will be decremented
-  // by the worker thread as soon as the dirty pages are flushed to disk.
-  state.open_txn[state.current_fd]++;
+  // the segment must not be recycled till the pages of this changeset
+  // are written to disk. The counter is decremented by the worker thread
+  // as soon as the dirty pages are flushed.
+  state.pending_changesets[state.current_fd]++;
   return state.current_fd;
 }
 
 void
 Journal::changeset_flushed(int fd_index)
 {
+  // logging was disabled when the changeset was appended
+  if (fd_index < 0)
+    return;
+
+  // increment the closed transactions first; the segment is recycled as
+  // soon as there are no pending changesets
   state.closed_txn[fd_index]++;
+  state.pending_changesets[fd_index]--;
+}
+
+void
+Journal::append_checkpoint(uint64_t min_lsn, uint64_t lsn)
+{
+  if (unlikely(state.disable_logging))
+    return;
+
+  // a checkpoint can start a new segment; the older segments are then
+  // recycled as soon as they are no longer required
+  int idx = switch_files_maybe(state);
+
+  PJournalEntry entry;
+  PJournalEntryCheckpoint checkpoint;
+  entry.lsn = lsn;
+  entry.type = Journal::kEntryTypeCheckpoint;
+  entry.followup_size = sizeof(checkpoint);
+  checkpoint.min_lsn = min_lsn;
+
+  append_entry(state, idx, (uint8_t *)&entry, sizeof(entry),
+                (uint8_t *)&checkpoint, sizeof(checkpoint));
+
+  // no need to wait till the entry is durable; without the checkpoint,
+  // the recovery simply starts with an older lsn
+  flush_buffer(state, idx, isset(state.env->get_flags(), UPS_ENABLE_FSYNC));
+
+  state.last_cp_lsn = lsn;
+  state.last_cp_bytes = state.bytes_appended;
+  state.count_checkpoints++;
 }
 
 void
@@ -1026,14 +1747,17 @@ Journal::close(bool noclear)
   // contain the correct data. Flush the buffers, otherwise the tests will
   // fail because data is missing
   if (noclear) {
-    flush_buffer(state, 0);
-    flush_buffer(state, 1);
+    for (uint32_t i = 0; i < state.num_segments; i++)
+      flush_buffer(state, i);
   }
 
+  // the log writer writes all queued data before it stops
+  stop_log_writer(state);
+
   if (!noclear)
     clear();
 
-  for (int i = 0; i < 2; i++) {
+  for (uint32_t i = 0; i < state.num_segments; i++) {
     state.files[i].close();
     state.buffer[i].clear();
   }
@@ -1044,8 +1768,16 @@ Journal::recover(LocalTransactionManager *txn_manager)
 {
   Context context(state.env, 0, 0);
 
+  // the recovery starts with the newest checkpoint
+  uint64_t min_lsn = scan_for_newest_checkpoint(state);
+
   // first redo the changesets
-  uint64_t start_lsn = recover_changeset(state);
+  uint64_t start_lsn = recover_changeset(state, min_lsn);
+
+  // all operations older than the checkpoint are already stored in
+  // the database file
+  if (min_lsn > 0)
+    start_lsn = std::max(start_lsn, min_lsn - 1);
 
   // load the state of the PageManager; the PageManager state is loaded AFTER
   // physical recovery because its page might have been restored in
@@ -1056,24 +1788,44 @@ Journal::recover(LocalTransactionManager *txn_manager)
 
   // then start the normal recovery
   if (isset(state.env->get_flags(), UPS_ENABLE_TRANSACTIONS))
-    recover_journal(state, &context, txn_manager, start_lsn);
+    recover_journal(state, &context, txn_manager, min_lsn, start_lsn);
 
-  // clear the journal files
-  clear();
+  // clear the journal files and reserve their storage again
+  for (uint32_t i = 0; i < state.num_segments; i++)
+    clear_file(state, i, true);
 }
 
 void
 Journal::clear()
 {
-  for (int i = 0; i < 2; i++)
+  for (uint32_t i = 0; i < state.num_segments; i++)
     clear_file(state, i);
 }
 
+uint64_t
+Journal::queued_sequence()
+{
+  ScopedLock lock(state.writer_mutex);
+  return state.queued_seq;
+}
+
+void
+Journal::wait_until_durable(uint64_t sequence)
+{
+  if (!state.writer)
+    return;
+
+  ups_status_t st = wait_for_log_writer(state, sequence);
+  if (st)
+    throw Exception(st);
+}
+
 void
 Journal::test_flush_buffers()
 {
-  flush_buffer(state, 0);
-  flush_buffer(state, 1);
+  for (uint32_t i = 0; i < state.num_segments; i++)
+    flush_buffer(state, i);
+  drain_log_writer(state);
 }
 
 void
@@ -26,16 +26,35 @@
  * "Undo" information is not required because aborted Transactions are never
  * written to disk. The journal only can "redo" operations.
  *
- * The journal is organized in two files. If one of the files grows too large
- * then all new Transactions are stored in the other file
- * ("Log file switching"). When all Transactions from file #0 are committed,
- * and file #1 exceeds a limit, then the files are switched back again.
+ * The journal is organized in segments (at least two files). If the current
+ * segment exceeds a number of Transactions, or its size exceeds the segment
+ * size, then all new Transactions are stored in the next segment
+ * ("Log file switching"). A segment is recycled (truncated and reused)
+ * as soon as all of its Transactions and Changesets were flushed to the
+ * database file. If no segment can be recycled then the current segment
+ * continues to grow.
+ *
+ * With a segment size, the storage of each segment is preallocated without
+ * changing its file size; appending to a segment then does not allocate
+ * storage, and the journal is bounded by the number of segments times the
+ * segment size as long as segments can be recycled.
  *
  * For writing, files are buffered. The buffers are flushed when they
  * exceed a certain threshold, when a Transaction is committed or a Changeset
  * was written. In case of a commit or a changeset there will also be an
  * fsync, if UPS_ENABLE_FSYNC is enabled.
  *
+ * With UPS_ENABLE_FSYNC, the flushed buffers are handed to a log writer
+ * thread. ups_txn_commit waits for the writer after the Environment's
+ * lock was released; meanwhile other threads can commit, and the writer
+ * writes and syncs all of their data at once ("group commit"). The pages
+ * of a Changeset are only written after its journal entry was synced.
+ *
+ * A changeset does not store the full pages. Each page is stored as the
+ * ranges which were modified since the previous image of the same page in
+ * the current segment (or since a page filled with zeroes). The recovery
+ * rebuilds the images by reading each segment from its beginning.
+ *
  * The physical information is a collection of pages which are modified in
  * one or more database operations (i.e. ups_db_erase). This collection is
  * called a "changeset" and implemented in changeset.h/.cc. As soon as the
@@ -53,6 +72,8 @@
  * idempotent; if the database file was successfully modified then the
  * changes are re-applied; this is not a problem.)
  *
+ * The segments are ordered by the lsn of their first entry.
+ *
  * Afterwards, upscaledb uses the lsn's to figure out whether an update
  * was already applied or not. If the journal's last entry is a changeset then
  * this changeset's lsn marks the beginning of the sequence. Otherwise the lsn
@@ -63,6 +84,18 @@
  * already applied, and we know that all older changesets
  * have already been written successfully to the database file.
  *
+ * A checkpoint flushes all committed Transactions to the btree. As soon
+ * as their pages are written, the Journal logs the lowest lsn of the
+ * Transactions which are still active. The recovery skips all changesets,
+ * operations and segments older than this lsn.
+ *
+ * The remaining inserts and erases are partitioned by database. The
+ * partitions are decoded and sorted by key in parallel; operations of
+ * aborted or incomplete Transactions are dropped. Then the partitions are
+ * replayed one after the other: their operations are written directly to
+ * the btree in key order, and the progress is reported to the callback of
+ * UPS_PARAM_RECOVERY_PROGRESS_CALLBACK.
+ *
  * @exception_safe: basic
  * @thread_safe: no
  */
@@ -127,7 +160,10 @@ struct Journal
     kEntryTypeErase      = 5,
 
     // marks a whole changeset operation (writes modified pages)
-    kEntryTypeChangeset  = 6
+    kEntryTypeChangeset  = 6,
+
+    // marks a checkpoint; stores the lsn from which the recovery starts
+    kEntryTypeCheckpoint = 7
   };
 
   //
@@ -135,14 +171,15 @@ struct Journal
   //
   struct Iterator {
     Iterator()
-      : fdidx(0), fdstart(0), offset(0) {
+      : fdidx(-1), first_lsn(0), offset(0) {
     }
 
-    // selects the file descriptor [0..1]
+    // selects the segment; -1 if the iteration did not yet start or
+    // reached the end
     int fdidx;
 
-    // which file descriptor did we start with? [0..1]
-    int fdstart;
+    // the lsn of the first entry in the current segment
+    uint64_t first_lsn;
 
     // the offset in the file of the NEXT entry
     uint64_t offset;
@@ -151,6 +188,9 @@ struct Journal
   // Constructor
   Journal(LocalEnvironment *env);
 
+  // Destructor; stops the log writer
+  ~Journal();
+
   // Creates a new journal
   void create();
 
@@ -159,10 +199,9 @@ struct Journal
 
   // Returns true if the journal is empty
   bool is_empty() const {
-    if (!state.files[0].is_open() && !state.files[1].is_open())
-      return true;
-
-    for (int i = 0; i < 2; i++) {
+    for (uint32_t i = 0; i < state.num_segments; i++) {
+      if (!state.files[i].is_open())
+        continue;
       uint64_t size = state.files[i].file_size();
       if (size > 0)
         return false;
@@ -200,9 +239,28 @@ struct Journal
   // Called by the worker thread as soon as a changeset was flushed
   void changeset_flushed(int fd_index);
 
+  // Appends a journal entry for a checkpoint/kEntryTypeCheckpoint. All
+  // operations with an lsn lower than |min_lsn| must already be stored
+  // in the database file
+  void append_checkpoint(uint64_t min_lsn, uint64_t lsn);
+
+  // Returns the number of bytes which were appended since the
+  // previous checkpoint
+  uint64_t bytes_since_checkpoint() const {
+    return state.bytes_appended - state.last_cp_bytes;
+  }
+
   // Adjusts the transaction counters; called whenever |txn| is flushed.
   void transaction_flushed(LocalTransaction *txn);
 
+  // Returns the sequence number of the data which was most recently
+  // handed to the log writer
+  uint64_t queued_sequence();
+
+  // Waits till the log writer wrote and synced all data up to |sequence|.
+  // Returns immediately if UPS_ENABLE_FSYNC is not set.
+  void wait_until_durable(uint64_t sequence);
+
   // Empties the journal, removes all entries
   void clear();
 
@@ -210,7 +268,7 @@ struct Journal
   void close(bool noclear = false);
 
   // Performs the recovery! All committed Transactions will be re-applied,
-  // all others are automatically aborted
+  // all others are discarded
   void recover(LocalTransactionManager *txn_manager);
 
   // Fills the metrics
@@ -220,6 +278,15 @@ struct Journal
             = state.count_bytes_before_compression;
     metrics->journal_bytes_after_compression
             = state.count_bytes_after_compression;
+    metrics->journal_group_commits = state.count_group_commits;
+    metrics->journal_segments = state.num_segments;
+    metrics->journal_segments_recycled = state.count_segments_recycled;
+    metrics->journal_segment_overflows = state.count_segment_overflows;
+    metrics->journal_checkpoints = state.count_checkpoints;
+    metrics->journal_page_bytes_before_delta
+            = state.count_page_bytes_before_delta;
+    metrics->journal_page_bytes_after_delta
+            = state.count_page_bytes_after_delta;
   }
 
   // Flushes all buffers to disk. Used for testing.
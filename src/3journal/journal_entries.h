@@ -45,10 +45,17 @@ namespace upscaledb {
  * is the structure size of this follow-up structure.
  */
 UPS_PACK_0 struct UPS_PACK_1 PJournalEntry {
-  // Constructor - sets all fields to 0
+  enum {
+    // The current format of the journal entries. Older releases stored 0
+    // (the field was reserved); their changesets store the full page
+    // images with a smaller PJournalEntryPageHeader
+    kFormatVersion = 1
+  };
+
+  // Constructor - sets all fields to 0, and the current format version
   PJournalEntry()
     : lsn(0), followup_size(0), txn_id(0), type(0),
-        dbname(0), _reserved(0) {
+        dbname(0), version(kFormatVersion) {
   }
 
   // the lsn of this entry
@@ -66,8 +73,8 @@ UPS_PACK_0 struct UPS_PACK_1 PJournalEntry {
   // the name of the database which is modified by this entry
   uint16_t dbname;
 
-  // a reserved value - reqd for padding
-  uint16_t _reserved;
+  // the format version of this entry (see kFormatVersion)
+  uint16_t version;
 } UPS_PACK_2;
 
 #include "1base/packstop.h"
@@ -186,9 +193,26 @@ UPS_PACK_0 struct UPS_PACK_1 PJournalEntryChangeset {
 // a Journal entry for a single page
 //
 UPS_PACK_0 struct UPS_PACK_1 PJournalEntryPageHeader {
+  enum {
+    // the page is stored as a delta (a sequence of PJournalEntryPageDelta)
+    kDelta             = 1,
+
+    // the delta is relative to the previous image of this page in the
+    // same segment; otherwise it is relative to a page filled with zeroes
+    kDeltaFromPrevious = 2,
+
+    // the image of this page is remembered as the base of the next delta
+    kRememberImage     = 4,
+
+    // The size of this header in entries with format version 0; these
+    // only store |address| and |compressed_size|, followed by the full
+    // page image
+    kSizeofVersion0    = 12
+  };
+
   // Constructor - sets all fields to 0
   PJournalEntryPageHeader(uint64_t _address = 0)
-    : address(_address), compressed_size(0) {
+    : address(_address), compressed_size(0), delta_size(0), flags(0) {
   }
 
   // the page address
@@ -196,6 +220,53 @@ UPS_PACK_0 struct UPS_PACK_1 PJournalEntryPageHeader {
 
   // the compressed size, if compression is enabled
   uint32_t compressed_size;
+
+  // the size of the delta, if the page is stored as a delta
+  uint32_t delta_size;
+
+  // flags; see above
+  uint32_t flags;
+} UPS_PACK_2;
+
+#include "1base/packstop.h"
+
+
+#include "1base/packstart.h"
+
+//
+// A modified range of a page; the delta of a page is a sequence of
+// these ranges, each followed by |size| bytes of page data
+//
+UPS_PACK_0 struct UPS_PACK_1 PJournalEntryPageDelta {
+  // Constructor - sets all fields to 0
+  PJournalEntryPageDelta(uint32_t _offset = 0, uint32_t _size = 0)
+    : offset(_offset), size(_size) {
+  }
+
+  // the offset of the range in the page
+  uint32_t offset;
+
+  // the size of the range
+  uint32_t size;
+} UPS_PACK_2;
+
+#include "1base/packstop.h"
+
+
+#include "1base/packstart.h"
+
+//
+// a Journal entry for a checkpoint
+//
+UPS_PACK_0 struct UPS_PACK_1 PJournalEntryCheckpoint {
+  // Constructor - sets all fields to 0
+  PJournalEntryCheckpoint()
+    : min_lsn(0) {
+  }
+
+  // all operations with a lower lsn are stored in the database file;
+  // the recovery starts with this lsn
+  uint64_t min_lsn;
 } UPS_PACK_2;
 
 #include "1base/packstop.h"
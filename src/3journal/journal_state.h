@@ -20,12 +20,14 @@
 
 #include "0root/root.h"
 
+#include <map>
 #include <vector>
 #include <string>
 
 #include "ups/types.h" // for metrics
 
 #include "1base/dynamic_array.h"
+#include "1base/mutex.h"
 #include "1base/scoped_ptr.h"
 #include "1os/file.h"
 #include "2page/page_collection.h"
@@ -44,32 +46,58 @@ class LocalEnvironment;
 
 struct JournalState
 {
+  enum {
+    // The maximum number of segment files
+    kMaxSegments = 16
+  };
+
   JournalState(LocalEnvironment *env_);
 
   // References the Environment this journal file is for
   LocalEnvironment *env;
 
-  // The index of the file descriptor we are currently writing to (0 or 1)
+  // The index of the segment we are currently writing to
   uint32_t current_fd;
 
-  // The two file descriptors
-  File files[2];
+  // The number of segments (at least 2)
+  uint32_t num_segments;
+
+  // The size of a segment; a segment is preallocated with this size, and
+  // the journal switches to the next segment when it is exceeded.
+  // 0 if segments are only switched after |threshold| Transactions
+  uint64_t segment_size;
+
+  // The file descriptors of the segments
+  File files[kMaxSegments];
 
   // Buffers for writing data to the files
-  ByteArray buffer[2];
+  ByteArray buffer[kMaxSegments];
+
+  // The number of bytes appended to each segment since it was cleared
+  uint64_t segment_bytes[kMaxSegments];
 
   // For counting all open transactions in the files
-  uint64_t open_txn[2];
+  uint64_t open_txn[kMaxSegments];
 
   // For counting all closed transactions in the files
   // This needs to be atomic since it's updated from the worker thread
-  boost::atomic<uint64_t> closed_txn[2];
+  boost::atomic<uint64_t> closed_txn[kMaxSegments];
+
+  // For counting the Changesets which are not yet written to the
+  // database file; updated from the worker thread
+  boost::atomic<uint64_t> pending_changesets[kMaxSegments];
 
   // The lsn of the previous checkpoint
   uint64_t last_cp_lsn;
 
-  // When having more than these Transactions in one file, we
-  // swap the files
+  // The number of bytes which were appended to the journal
+  uint64_t bytes_appended;
+
+  // The value of |bytes_appended| when the previous checkpoint was written
+  uint64_t last_cp_bytes;
+
+  // When having more than these Transactions in one segment, we
+  // switch to the next segment
   uint64_t threshold;
 
   // Set to false to disable logging; used during recovery
@@ -84,12 +112,74 @@ struct JournalState
   // Counting the bytes after compression (for ups_env_get_metrics)
   uint64_t count_bytes_after_compression;
 
+  // Counting the page bytes of the changesets before the delta encoding
+  // (for ups_env_get_metrics)
+  uint64_t count_page_bytes_before_delta;
+
+  // Counting the page bytes of the changesets after the delta encoding
+  // (for ups_env_get_metrics)
+  uint64_t count_page_bytes_after_delta;
+
+  // The images of the pages which were logged in the segment
+  // |page_images_fd|; the changesets only store the modified ranges
+  // relative to these images
+  typedef std::map<uint64_t, std::vector<uint8_t> > PageImageMap;
+  PageImageMap page_images;
+
+  // The segment of |page_images|
+  uint32_t page_images_fd;
+
+  // A temporary buffer for the delta encoding
+  std::vector<uint8_t> page_delta;
+
   // A map of all opened Databases
   typedef std::map<uint16_t, Database *> DatabaseMap;
   DatabaseMap database_map;
 
   // The compressor; can be null
   ScopedPtr<Compressor> compressor;
+
+  // The log writer thread; only started with UPS_ENABLE_FSYNC. It writes
+  // and syncs the queued data of several commits at once (group commit)
+  ScopedPtr<Thread> writer;
+
+  // Protects the following members, which are shared with the log writer
+  boost::mutex writer_mutex;
+
+  // Signals the log writer that data was queued, or that it should stop
+  Condition writer_cond;
+
+  // Signals the waiting threads that the log writer made progress
+  Condition durable_cond;
+
+  // The data which is queued for the log writer, for each segment
+  std::vector<uint8_t> queued[kMaxSegments];
+
+  // The sequence number of the data which was queued most recently
+  uint64_t queued_seq;
+
+  // All data up to this sequence number is written and synced
+  uint64_t durable_seq;
+
+  // Set to true to stop the log writer
+  bool writer_stopped;
+
+  // The error of the log writer; reported to all waiting threads
+  ups_status_t writer_status;
+
+  // Counting the group commits (for ups_env_get_metrics)
+  uint64_t count_group_commits;
+
+  // Counting the segments which were cleared for reuse
+  // (for ups_env_get_metrics)
+  uint64_t count_segments_recycled;
+
+  // Counting the segment switches which were deferred because no segment
+  // could be recycled (for ups_env_get_metrics)
+  uint64_t count_segment_overflows;
+
+  // Counting the checkpoints (for ups_env_get_metrics)
+  uint64_t count_checkpoints;
 };
 
 } // namespace upscaledb
@@ -158,15 +158,12 @@ Freelist::has(uint64_t page_id) const
 }
 
 uint64_t
-Freelist::truncate(uint64_t file_size)
+Freelist::free_tail(uint64_t file_size) const
 {
   uint32_t page_size = config.page_size_bytes;
   uint64_t lower_bound = file_size;
 
-  if (free_pages.empty())
-    return file_size;
-
-  for (FreeMap::reverse_iterator it = free_pages.rbegin();
+  for (FreeMap::const_reverse_iterator it(free_pages.lower_bound(file_size));
             it != free_pages.rend();
             it++) {
     if (it->first + it->second * page_size == lower_bound)
@@ -175,6 +172,14 @@ Freelist::truncate(uint64_t file_size)
       break;
   }
 
+  return lower_bound;
+}
+
+uint64_t
+Freelist::truncate(uint64_t file_size)
+{
+  uint64_t lower_bound = free_tail(file_size);
+
   // remove all truncated pages
   while (!free_pages.empty() && free_pages.rbegin()->first >= lower_bound) {
     free_pages.erase(free_pages.rbegin()->first);
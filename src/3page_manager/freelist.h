@@ -84,6 +84,10 @@ struct Freelist
   // Returns true if a page is in the freelist
   bool has(uint64_t page_id) const;
 
+  // Returns the address of the first page of the unused pages in front of
+  // |file_size|, or |file_size| if the page in front of it is in use
+  uint64_t free_tail(uint64_t file_size) const;
+
   // Tries to truncate the file by counting how many pages at the file's end
   // are unused. Returns the address of the last unused page, or |file_size|
   // if there are no unused pages at the end.
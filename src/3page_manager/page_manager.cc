@@ -20,8 +20,8 @@
 #include "0root/root.h"
 
 #include <string.h>
+#include <algorithm>
 
-#include "3rdparty/murmurhash3/MurmurHash3.h"
 // Always verify that a file of level N does not include headers > N!
 #include "1base/signal.h"
 #include "1base/dynamic_array.h"
@@ -58,7 +58,7 @@ struct AsyncFlushMessage
   AsyncFlushMessage(PageManager *page_manager_, Device *device_,
           Signal *signal_)
     : page_manager(page_manager_), device(device_), signal(signal_),
-      in_progress(false) {
+      in_progress(false), pending(0) {
   }
 
   PageManager *page_manager;
@@ -66,44 +66,95 @@ struct AsyncFlushMessage
   Signal *signal;
   boost::atomic<bool> in_progress;
   std::vector<uint64_t> page_ids;
+
+  // number of work items which still process this message
+  boost::atomic<size_t> pending;
 };
 
+// Flushes the pages in the range [begin, end[ of |message->page_ids|.
+// The dirty pages are written with a single batch, which merges adjacent
+// pages.
 static void
-async_flush_pages(AsyncFlushMessage *message)
+async_flush_pages(AsyncFlushMessage *message, size_t begin, size_t end)
 {
-  for (std::vector<uint64_t>::iterator it = message->page_ids.begin();
-                  it != message->page_ids.end();
-                  it++) {
+  std::vector<Page *> list;
+  list.reserve(end - begin);
+
+  for (size_t i = begin; i < end; i++) {
     // skip page if it's already in use
-    Page *page = message->page_manager->try_lock_purge_candidate(*it);
+    Page *page = message->page_manager->try_lock_purge_candidate(
+                    message->page_ids[i]);
     if (!page)
       continue;
     assert(page->mutex().try_lock() == false);
 
     // flush page if it's dirty
-    if (page->is_dirty()) {
-      try {
-        page->flush();
-      }
-      catch (Exception &) {
-        // ignore page, fall through
-      }
+    if (page->is_dirty())
+      list.push_back(page);
+    else
+      page->mutex().unlock();
+  }
+
+  if (!list.empty()) {
+    try {
+      message->device->write_pages(list, false);
     }
-    page->mutex().unlock();
+    catch (Exception &) {
+      // ignore pages, fall through; they remain dirty
+    }
+    for (std::vector<Page *>::iterator it = list.begin();
+            it != list.end(); it++)
+      (*it)->mutex().unlock();
   }
+
+  // the last work item completes the message
+  if (message->pending.fetch_sub(1) != 1)
+    return;
   if (message->in_progress)
     message->in_progress = false;
   if (message->signal)
     message->signal->notify();
 }
 
+// Flushes all pages of |message| in a single work item. The work item
+// is executed after all Changesets which were flushed before, therefore
+// these pages are no longer locked.
+static void
+run_async_flush_ordered(PageManager *page_manager, AsyncFlushMessage *message)
+{
+  message->pending = 1;
+  page_manager->run_async(boost::bind(&async_flush_pages, message, 0,
+                          message->page_ids.size()));
+}
+
+// Distributes the pages of |message| over all worker threads. The order
+// of the writes is not relevant because the pages are independent of each
+// other.
+static void
+run_async_flush_parallel(PageManagerState *state, AsyncFlushMessage *message)
+{
+  // do not bother splitting if there are only few pages
+  const size_t kMinPagesPerWorkItem = 8;
+
+  // sort the pages, otherwise adjacent pages end up in different work
+  // items and cannot be merged
+  std::sort(message->page_ids.begin(), message->page_ids.end());
+
+  size_t size = message->page_ids.size();
+  size_t items = std::min(state->worker->num_threads(),
+                  std::max(size / kMinPagesPerWorkItem, (size_t)1));
+  size_t chunk = (size + items - 1) / items;
+
+  message->pending = (size + chunk - 1) / chunk;
+  for (size_t begin = 0; begin < size; begin += chunk)
+    state->worker->enqueue_parallel(boost::bind(&async_flush_pages, message,
+                            begin, std::min(begin + chunk, size)));
+}
+
 static inline void
 verify_crc32(Page *page)
 {
-  uint32_t crc32;
-  MurmurHash3_x86_32(page->payload(),
-                  page->persisted_data.size - (sizeof(PPageHeader) - 1),
-                  (uint32_t)page->address(), &crc32);
+  uint32_t crc32 = page->calculate_crc32();
   if (crc32 != page->crc32()) {
     ups_trace(("crc32 mismatch in page %lu: 0x%lx != 0x%lx",
                     page->address(), crc32, page->crc32()));
@@ -111,6 +162,178 @@ verify_crc32(Page *page)
   }
 }
 
+// Returns the right sibling of a btree leaf, or 0 if |page| is not a leaf
+static inline uint64_t
+leaf_right_sibling(Page *page)
+{
+  if (page->type() != Page::kTypeBindex && page->type() != Page::kTypeBroot)
+    return 0;
+  PBtreeNode *node = PBtreeNode::from_page(page);
+  return node->is_leaf() ? node->right_sibling() : 0;
+}
+
+// Loads the page at |address| into the cache, unless it is already cached.
+// The page is read without holding the PageManager's lock; it is discarded
+// if any page was written in the meantime, because it then could be stale.
+// Returns false if the page was not loaded. If |right_sibling| is not null
+// then it receives the right sibling of the page (if it is a btree leaf).
+static bool
+prefetch_page(PageManagerState *state, LocalDatabase *db, uint64_t address,
+                uint64_t *right_sibling)
+{
+  if (address == 0 || address % state->config.page_size_bytes != 0)
+    return false;
+
+  {
+    ScopedSpinlock lock(state->mutex);
+    Page *page = state->cache.peek(address);
+    if (page) {
+      if (!right_sibling)
+        return true;
+      if (!page->mutex().try_lock())
+        return false;
+      *right_sibling = leaf_right_sibling(page);
+      page->mutex().unlock();
+      return true;
+    }
+  }
+
+  if (address + state->config.page_size_bytes > state->device->file_size())
+    return false;
+
+  uint64_t flushed = Page::ms_page_count_flushed;
+  Page *page = new Page(state->device, db);
+  try {
+    page->fetch(address);
+    if (isset(state->config.flags, UPS_ENABLE_CRC32))
+      verify_crc32(page);
+  }
+  catch (Exception &) {
+    delete page;
+    return false;
+  }
+
+  ScopedSpinlock lock(state->mutex);
+  if (flushed != Page::ms_page_count_flushed
+        || state->cache.peek(address) != 0) {
+    delete page;
+    return false;
+  }
+
+  state->cache.put(page);
+  state->page_count_prefetched++;
+  if (right_sibling)
+    *right_sibling = leaf_right_sibling(page);
+  return true;
+}
+
+// Decrements the |pending| counter of a completed work item and wakes up
+// the threads which wait for it
+static void
+complete_async(PageManagerState *state, boost::atomic<int> *pending)
+{
+  ScopedLock lock(state->pending_mutex);
+  if (pending->fetch_sub(1) == 1)
+    state->pending_cond.notify_all();
+}
+
+// Sleeps till all work items which are counted by |pending| are completed
+static void
+wait_for_async(PageManagerState *state, boost::atomic<int> *pending)
+{
+  ScopedLock lock(state->pending_mutex);
+  while (pending->load() > 0)
+    state->pending_cond.wait(lock);
+}
+
+// Loads the leaf at |address| and up to |count - 1| of its right siblings
+static void
+async_prefetch_leaves(PageManagerState *state, LocalDatabase *db,
+                uint64_t address, uint32_t count)
+{
+  for (uint32_t i = 0; i < count && address != 0; i++) {
+    uint64_t right_sibling = 0;
+    if (!prefetch_page(state, db, address, &right_sibling))
+      break;
+    address = right_sibling;
+  }
+  complete_async(state, &state->pending_prefetches);
+}
+
+// Loads the pages at |addresses|
+static void
+async_prefetch_pages(PageManagerState *state, LocalDatabase *db,
+                std::vector<uint64_t> &addresses)
+{
+  for (std::vector<uint64_t>::iterator it = addresses.begin();
+          it != addresses.end(); it++)
+    prefetch_page(state, db, *it, 0);
+  complete_async(state, &state->pending_prefetches);
+}
+
+// Waits till all read-ahead work items are completed
+static void
+wait_for_prefetches(PageManagerState *state)
+{
+  wait_for_async(state, &state->pending_prefetches);
+}
+
+// Tiered storage: tells the Device which pages are cached; only locks the
+// shard of the page
+struct CachedPagesImpl : public CachedPages
+{
+  CachedPagesImpl(Cache &cache_)
+    : cache(cache_) {
+  }
+
+  virtual bool is_cached(uint64_t address) {
+    return cache.peek(address) != 0;
+  }
+
+  Cache &cache;
+};
+
+// Tiered storage: runs a migration round of the Device
+static void
+async_migrate_pages(PageManagerState *state)
+{
+  try {
+    CachedPagesImpl cached_pages(state->cache);
+    state->device->migrate_pages(&cached_pages);
+  }
+  catch (Exception &) {
+    // ignore; the pages remain where they are
+  }
+  complete_async(state, &state->pending_migrations);
+}
+
+// Waits till the migration round is completed
+static void
+wait_for_migrations(PageManagerState *state)
+{
+  wait_for_async(state, &state->pending_migrations);
+}
+
+// Reserves storage at the end of the file for the next allocations
+static void
+async_preallocate(PageManagerState *state)
+{
+  try {
+    state->device->preallocate();
+  }
+  catch (Exception &) {
+    // ignore; the file then grows synchronously
+  }
+  complete_async(state, &state->pending_preallocations);
+}
+
+// Waits till the file preallocation is completed
+static void
+wait_for_preallocations(PageManagerState *state)
+{
+  wait_for_async(state, &state->pending_preallocations);
+}
+
 static inline Page *
 add_to_changeset(Changeset *changeset, Page *page)
 {
@@ -119,6 +342,21 @@ add_to_changeset(Changeset *changeset, Page *page)
   return page;
 }
 
+// Adds a cached page to the Changeset without blocking; used by
+// Cache::get_pinned
+struct ChangesetPin
+{
+  ChangesetPin(Changeset *changeset_)
+    : changeset(changeset_) {
+  }
+
+  bool operator()(Page *page) {
+    return changeset->try_put(page);
+  }
+
+  Changeset *changeset;
+};
+
 static inline uint64_t
 store_state_impl(PageManagerState *state, Context *context)
 {
@@ -273,6 +511,7 @@ fetch_unlocked(PageManagerState *state, Context *context, uint64_t address,
   else if (isset(state->config.flags, UPS_ENABLE_CRC32))
     verify_crc32(page);
 
+  state->cache.count_fetched_page(page);
   state->page_count_fetched++;
   return add_to_changeset(&context->changeset, page);
 }
@@ -319,6 +558,13 @@ alloc_unlocked(PageManagerState *state, Context *context, uint32_t page_type,
     throw ex;
   }
 
+  /* reserve storage for the next allocations before it is required */
+  if (state->pending_preallocations.load() == 0
+        && state->device->needs_preallocation()) {
+    state->pending_preallocations.fetch_add(1);
+    state->worker->enqueue_parallel(boost::bind(&async_preallocate, state));
+  }
+
 done:
   /* clear the page with zeroes?  */
   if (isset(flags, PageManager::kClearWithZero))
@@ -371,9 +617,11 @@ PageManagerState::PageManagerState(LocalEnvironment *_env)
     device(_env->device()), lsn_manager(_env->lsn_manager()),
     cache(_env->config()), freelist(config), needs_flush(false),
     state_page(0), last_blob_page(0), last_blob_page_id(0),
-    page_count_fetched(0), page_count_index(0), page_count_blob(0),
-    page_count_page_manager(0), cache_hits(0), cache_misses(0), message(0),
-    worker(new WorkerPool(1))
+    page_count_fetched(0), page_count_prefetched(0), page_count_index(0),
+    page_count_blob(0), page_count_page_manager(0), cache_hits(0),
+    cache_misses(0), message(0), pending_prefetches(0),
+    pending_migrations(0), pending_preallocations(0),
+    worker(new WorkerPool(_env->config().num_worker_threads))
 {
 }
 
@@ -430,6 +678,24 @@ PageManager::initialize(uint64_t pageid)
 Page *
 PageManager::fetch(Context *context, uint64_t address, uint32_t flags)
 {
+  // read-only operations run concurrently; they must never persist the
+  // PageManager state
+  if (context->changeset.is_read_only)
+    flags |= PageManager::kReadOnly;
+
+  // a cache hit only locks the shard of the page. The page is added to the
+  // Changeset before the shard is unlocked, therefore it is not evicted in
+  // the meantime. The header page and the state page are not cached.
+  if (address != 0) {
+    ChangesetPin pin(&context->changeset);
+    Page *page = state->cache.get_pinned(address, pin);
+    if (page) {
+      if (isset(flags, PageManager::kNoHeader))
+        page->set_without_header(true);
+      return page;
+    }
+  }
+
   ScopedSpinlock lock(state->mutex);
   return fetch_unlocked(state.get(), context, address, flags);
 }
@@ -437,6 +703,8 @@ PageManager::fetch(Context *context, uint64_t address, uint32_t flags)
 Page *
 PageManager::alloc(Context *context, uint32_t page_type, uint32_t flags)
 {
+  assert(context->changeset.is_read_only == false);
+
   ScopedSpinlock lock(state->mutex);
   return alloc_unlocked(state.get(), context, page_type, flags);
 }
@@ -497,12 +765,20 @@ void
 PageManager::fill_metrics(ups_env_metrics_t *metrics) const
 {
   metrics->page_count_fetched = state->page_count_fetched;
+  metrics->page_count_prefetched = state->page_count_prefetched;
   metrics->page_count_flushed = Page::ms_page_count_flushed;
+  metrics->page_flush_writes = Page::ms_page_flush_writes;
+  if (metrics->page_flush_writes > 0)
+    metrics->page_flush_merge_ratio = (double)metrics->page_count_flushed
+                                / metrics->page_flush_writes;
   metrics->page_count_type_index = state->page_count_index;
   metrics->page_count_type_blob = state->page_count_blob;
   metrics->page_count_type_page_manager = state->page_count_page_manager;
   metrics->freelist_hits = state->freelist.freelist_hits;
   metrics->freelist_misses = state->freelist.freelist_misses;
+  metrics->worker_threads = (uint32_t)state->worker->num_threads();
+  metrics->worker_queue_depth = state->worker->get_queue_depth();
+  metrics->worker_max_queue_depth = state->worker->get_max_queue_depth();
   state->cache.fill_metrics(metrics);
 }
 
@@ -543,16 +819,36 @@ PageManager::flush_all_pages()
   }
 
   if (message->page_ids.size() > 0) {
-    run_async(boost::bind(&async_flush_pages, message));
+    run_async_flush_ordered(this, message);
     signal.wait();
   }
 
   delete message;
 }
 
+void
+PageManager::set_cache_size(uint64_t cache_size)
+{
+  ScopedSpinlock lock(state->mutex);
+  state->cache.set_capacity(cache_size);
+}
+
 void
 PageManager::purge_cache(Context *context)
 {
+  // tiered storage: the migration round runs in the background
+  if (state->pending_migrations.load() == 0
+        && state->device->needs_migration()) {
+    state->pending_migrations.fetch_add(1);
+    state->worker->enqueue_parallel(boost::bind(&async_migrate_pages,
+                            state.get()));
+  }
+
+  // read-only operations purge the cache as well, although they only hold
+  // the Environment lock in shared mode. A page is only deleted if it is
+  // not locked (i.e. not used by another reader) and has no cursors.
+  // Readers which fetch a page which is not cached have to wait for
+  // |state->mutex|, and then load it again.
   ScopedSpinlock lock(state->mutex);
 
   // do NOT purge the cache iff
@@ -575,8 +871,9 @@ PageManager::purge_cache(Context *context)
 
   // don't bother if there are only few pages
   if (state->message->page_ids.size() > 10) {
+    state->cache.count_dirty_evictions(state->message->page_ids.size());
     state->message->in_progress = true;
-    run_async(boost::bind(&async_flush_pages, state->message));
+    run_async_flush_parallel(state.get(), state->message);
   }
 
   for (std::vector<Page *>::iterator it = state->garbage.begin();
@@ -584,14 +881,61 @@ PageManager::purge_cache(Context *context)
                   it++) {
     Page *page = *it;
     if (likely(page->mutex().try_lock())) {
-      assert(page->cursor_list() == 0);
-      state->cache.del(page);
+      // a reader could have coupled a cursor since the page was selected
+      if (unlikely(page->has_cursors())) {
+        page->mutex().unlock();
+        continue;
+      }
+      state->cache.evict(page);
       page->mutex().unlock();
       delete page;
     }
   }
 }
 
+void
+PageManager::prefetch_leaves(LocalDatabase *db, uint64_t address,
+                uint32_t count)
+{
+  if (address == 0 || count == 0
+        || isset(state->config.flags, UPS_IN_MEMORY))
+    return;
+
+  // the kernel can start reading the first page while the request waits
+  // for a worker thread
+  if (!state->cache.peek(address))
+    state->device->prefetch(address, state->config.page_size_bytes);
+
+  state->pending_prefetches.fetch_add(1);
+  state->worker->enqueue_parallel(boost::bind(&async_prefetch_leaves,
+                          state.get(), db, address, count));
+}
+
+void
+PageManager::prefetch_pages(LocalDatabase *db,
+                const std::vector<uint64_t> &addresses)
+{
+  if (isset(state->config.flags, UPS_IN_MEMORY))
+    return;
+
+  // skip the pages which are already cached
+  std::vector<uint64_t> missing;
+  for (std::vector<uint64_t>::const_iterator it = addresses.begin();
+          it != addresses.end(); it++) {
+    if (!state->cache.peek(*it)) {
+      state->device->prefetch(*it, state->config.page_size_bytes);
+      missing.push_back(*it);
+    }
+  }
+
+  if (missing.empty())
+    return;
+
+  state->pending_prefetches.fetch_add(1);
+  state->worker->enqueue_parallel(boost::bind(&async_prefetch_pages,
+                          state.get(), db, missing));
+}
+
 void
 PageManager::reclaim_space(Context *context)
 {
@@ -614,6 +958,9 @@ PageManager::reclaim_space(Context *context)
             page_id += page_size) {
       Page *page = state->cache.get(page_id);
       if (page) {
+        // wait till a pending flush released the page
+        page->mutex().lock();
+        page->mutex().unlock();
         state->cache.del(page);
         delete page;
       }
@@ -630,6 +977,105 @@ PageManager::reclaim_space(Context *context)
   }
 }
 
+uint64_t
+PageManager::compaction_candidate()
+{
+  ScopedSpinlock lock(state->mutex);
+
+  if (state->freelist.empty())
+    return 0;
+
+  uint32_t page_size = state->config.page_size_bytes;
+  uint64_t end = state->freelist.free_tail(state->device->used_size());
+  if (end < 2 * page_size)
+    return 0;
+
+  // is there a free page in front of the last page?
+  uint64_t address = end - page_size;
+  if (state->freelist.free_pages.begin()->first >= address)
+    return 0;
+  return address;
+}
+
+bool
+PageManager::relocate_state_page(Context *context, uint64_t address)
+{
+  ScopedSpinlock lock(state->mutex);
+
+  Page *old_page = state->state_page;
+  if (!old_page || old_page->address() != address)
+    return false;
+
+  uint64_t new_address = state->freelist.alloc(1);
+  if (new_address == 0)
+    return false;
+
+  // the state page is not stored in the cache
+  Page *page = state->cache.get(new_address);
+  if (page) {
+    page->mutex().lock();
+    page->mutex().unlock();
+    state->cache.del(page);
+  }
+  else {
+    page = new Page(state->device);
+    try {
+      page->fetch(new_address);
+    }
+    catch (Exception &ex) {
+      delete page;
+      state->freelist.put(new_address, 1);
+      throw ex;
+    }
+  }
+
+  // copy the state, including the overflow pointer
+  ::memcpy(page->payload(), old_page->payload(),
+                  state->config.page_size_bytes
+                      - Page::kSizeofPersistentHeader);
+  page->set_type(Page::kTypePageManager);
+  page->set_db(0);
+  page->set_without_header(false);
+  page->set_dirty(true);
+
+  // wait till a pending flush released the old page
+  if (context->changeset.has(old_page))
+    context->changeset.del(old_page);
+  else {
+    old_page->mutex().lock();
+    old_page->mutex().unlock();
+  }
+  delete old_page;
+
+  state->state_page = page;
+  state->freelist.put(address, 1);
+  state->needs_flush = true;
+  maybe_store_state(state.get(), context, true);
+  return true;
+}
+
+bool
+PageManager::truncate_free_pages(Context *context)
+{
+  wait_for_prefetches(state.get());
+  wait_for_migrations(state.get());
+
+  {
+    ScopedSpinlock lock(state->mutex);
+    uint64_t used_size = state->device->used_size();
+    uint64_t address = state->freelist.free_tail(used_size);
+    if (address >= used_size)
+      return false;
+  }
+
+  // the cached pages of the truncated range are discarded by
+  // |reclaim_space|; afterwards the device unmaps the memory beyond the
+  // new end of the file before it is truncated
+  state->device->reclaim_space();
+  reclaim_space(context);
+  return true;
+}
+
 struct CloseDatabaseVisitor
 {
   CloseDatabaseVisitor(LocalDatabase *db_, AsyncFlushMessage *message_)
@@ -658,6 +1104,9 @@ PageManager::close_database(Context *context, LocalDatabase *db)
 
   CloseDatabaseVisitor visitor(db, message);
 
+  // the read-ahead must not add pages of this database to the cache
+  wait_for_prefetches(state.get());
+
   {
     ScopedSpinlock lock(state->mutex);
 
@@ -674,7 +1123,7 @@ PageManager::close_database(Context *context, LocalDatabase *db)
   }
 
   if (message->page_ids.size() > 0) {
-    run_async(boost::bind(&async_flush_pages, message));
+    run_async_flush_ordered(this, message);
     signal.wait();
   }
 
@@ -732,6 +1181,10 @@ PageManager::close(Context *context)
 {
   // no need to lock the mutex; this method is called during shutdown
 
+  wait_for_prefetches(state.get());
+  wait_for_migrations(state.get());
+  wait_for_preallocations(state.get());
+
   // cut off unused space at the end of the file; this space is managed
   // by the device
   state->device->reclaim_space();
@@ -837,7 +1290,7 @@ PageManager::try_lock_purge_candidate(uint64_t address)
   // directly into the page's data, and these pointers will be invalidated
   // as soon as the page is purged.
   //
-  if (page->cursor_list() != 0) {
+  if (page->has_cursors()) {
     page->mutex().unlock();
     return 0;
   }
@@ -98,16 +98,45 @@ struct PageManager
   // The pages are locked and stored in |context->changeset|.
   Page *alloc_multiple_blob_pages(Context *context, size_t num_pages);
 
+  // Read-ahead: asynchronously loads the btree leaf at |address| and up to
+  // |count - 1| of its right siblings into the cache
+  void prefetch_leaves(LocalDatabase *db, uint64_t address, uint32_t count);
+
+  // Read-ahead: asynchronously loads the pages at |addresses| into the cache
+  void prefetch_pages(LocalDatabase *db,
+                  const std::vector<uint64_t> &addresses);
+
+  // Changes the capacity of the cache (in bytes); if the cache shrinks then
+  // the surplus pages are evicted incrementally by purge_cache()
+  void set_cache_size(uint64_t cache_size);
+
   // Flushes all pages to disk
   void flush_all_pages();
 
   // Asks the worker thread to purge the cache if the cache limits are
-  // exceeded
+  // exceeded. Also called by read-only operations; pages which are used
+  // by concurrent readers are skipped.
   void purge_cache(Context *context);
 
   // Reclaim file space; truncates unused file space at the end of the file.
   void reclaim_space(Context *context);
 
+  // Returns the address of the last page which is in use, if the Freelist
+  // has a free page in front of it; otherwise returns 0. Used by the
+  // compaction
+  uint64_t compaction_candidate();
+
+  // Moves the page with the state of the PageManager from |address| to a
+  // free page. Returns false if |address| is not the state page. Used by
+  // the compaction
+  bool relocate_state_page(Context *context, uint64_t address);
+
+  // Truncates the unused pages at the end of the file while the Environment
+  // is in use; unlike |reclaim_space| this also releases the storage which
+  // was allocated in advance. Mapped memory of the truncated pages is
+  // unmapped. Returns true if the file was truncated.
+  bool truncate_free_pages(Context *context);
+
   // Flushes and closes all pages of a database
   void close_database(Context *context, LocalDatabase *db);
 
@@ -32,6 +32,7 @@
 #include <boost/atomic.hpp>
 
 // Always verify that a file of level N does not include headers > N!
+#include "1base/mutex.h"
 #include "1base/spinlock.h"
 #include "2config/env_config.h"
 #include "3cache/cache.h"
@@ -102,6 +103,9 @@ struct PageManagerState
   // tracks number of fetched pages
   uint64_t page_count_fetched;
 
+  // tracks number of pages which were loaded by the read-ahead
+  uint64_t page_count_prefetched;
+
   // tracks number of index pages
   uint64_t page_count_index;
 
@@ -124,6 +128,23 @@ struct PageManagerState
   // For collecting unused pages; cached to avoid memory allocations
   std::vector<Page *> garbage;
 
+  // Number of read-ahead work items which were not yet completed; they
+  // have to finish before pages are deleted
+  boost::atomic<int> pending_prefetches;
+
+  // Number of tiered storage migration rounds which were not yet
+  // completed (0 or 1)
+  boost::atomic<int> pending_migrations;
+
+  // Number of file preallocations which were not yet completed (0 or 1)
+  boost::atomic<int> pending_preallocations;
+
+  // Protects the wake-ups when one of the |pending_*| counters drops to 0
+  boost::mutex pending_mutex;
+
+  // Signalled when one of the |pending_*| counters drops to 0
+  Condition pending_cond;
+
   // The worker thread which flushes dirty pages
   ScopedPtr<WorkerPool> worker;
 };
@@ -36,9 +36,12 @@ class LocalTransaction;
 
 struct Context
 {
+  // |is_read_only| is set by operations which do not modify any page
+  // (i.e. ups_db_find, ups_cursor_move); their pages are locked in shared
+  // mode and can be used by other read-only operations at the same time
   Context(LocalEnvironment *env, LocalTransaction *txn = 0,
-                  LocalDatabase *db = 0)
-    : env(env), txn(txn), db(db), changeset(env) {
+                  LocalDatabase *db = 0, bool is_read_only = false)
+    : env(env), txn(txn), db(db), changeset(env, is_read_only) {
   }
 
   ~Context() {
@@ -1140,7 +1140,7 @@ LocalCursor::get_duplicate_count(Context *context)
 ups_status_t
 LocalCursor::do_get_duplicate_count(uint32_t flags, uint32_t *pcount)
 {
-  Context context(ldb()->lenv(), (LocalTransaction *)m_txn, ldb());
+  Context context(ldb()->lenv(), (LocalTransaction *)m_txn, ldb(), true);
 
   if (is_nil()) {
     *pcount = 0;
@@ -1154,7 +1154,7 @@ LocalCursor::do_get_duplicate_count(uint32_t flags, uint32_t *pcount)
 ups_status_t
 LocalCursor::do_get_record_size(uint32_t *psize)
 {
-  Context context(ldb()->lenv(), (LocalTransaction *)m_txn, ldb());
+  Context context(ldb()->lenv(), (LocalTransaction *)m_txn, ldb(), true);
 
   if (is_nil())
     return (UPS_CURSOR_IS_NIL);
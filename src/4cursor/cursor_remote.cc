@@ -68,6 +68,8 @@ RemoteCursor::do_overwrite(ups_record_t *record, uint32_t flags)
 ups_status_t
 RemoteCursor::do_get_duplicate_position(uint32_t *pposition)
 {
+  ScopedLock lock(renv()->request_mutex());
+
   SerializedWrapper request;
   request.id = kCursorGetDuplicatePositionRequest;
   request.cursor_get_duplicate_position_request.cursor_handle = m_remote_handle;
@@ -85,6 +87,8 @@ RemoteCursor::do_get_duplicate_position(uint32_t *pposition)
 ups_status_t
 RemoteCursor::do_get_duplicate_count(uint32_t flags, uint32_t *pcount)
 {
+  ScopedLock lock(renv()->request_mutex());
+
   SerializedWrapper request;
   request.id = kCursorGetRecordCountRequest;
   request.cursor_get_record_count_request.cursor_handle = m_remote_handle;
@@ -105,6 +109,8 @@ RemoteCursor::do_get_duplicate_count(uint32_t flags, uint32_t *pcount)
 ups_status_t
 RemoteCursor::do_get_record_size(uint32_t *psize)
 {
+  ScopedLock lock(renv()->request_mutex());
+
   SerializedWrapper request;
   request.id = kCursorGetRecordSizeRequest;
   request.cursor_get_record_size_request.cursor_handle = m_remote_handle;
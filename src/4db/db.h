@@ -30,6 +30,7 @@
 
 // Always verify that a file of level N does not include headers > N!
 #include "1base/dynamic_array.h"
+#include "1base/mutex.h"
 #include "2config/db_config.h"
 #include "4env/env.h"
 
@@ -72,6 +73,13 @@ class Database
       return (m_config);
     }
 
+    // Returns this Database's mutex. Modifying operations lock it
+    // exclusively, read-only operations lock it in shared mode (see
+    // ScopedDatabaseReadLock and ScopedDatabaseWriteLock below)
+    RwMutex &mutex() {
+      return (m_mutex);
+    }
+
     // Returns the runtime-flags - the flags are "mixed" with the flags from
     // the Environment
     uint32_t get_flags() {
@@ -149,19 +157,19 @@ class Database
       return (m_cursor_list);
     }
 
-    // Returns the memory buffer for the key data: the per-database buffer
+    // Returns the memory buffer for the key data: the per-thread buffer
     // if |txn| is null or temporary, otherwise the buffer from the |txn|
     ByteArray &key_arena(Transaction *txn) {
       return ((txn == 0 || (txn->get_flags() & UPS_TXN_TEMPORARY))
-                 ? m_key_arena
+                 ? thread_arenas().key
                  : txn->key_arena());
     }
 
-    // Returns the memory buffer for the record data: the per-database buffer
+    // Returns the memory buffer for the record data: the per-thread buffer
     // if |txn| is null or temporary, otherwise the buffer from the |txn|
     ByteArray &record_arena(Transaction *txn) {
       return ((txn == 0 || (txn->get_flags() & UPS_TXN_TEMPORARY))
-                 ? m_record_arena
+                 ? thread_arenas().record
                  : txn->record_arena());
     }
 
@@ -187,13 +195,98 @@ class Database
     // linked list of all cursors
     Cursor *m_cursor_list;
 
-    // This is where key->data points to when returning a
-    // key to the user; used if Transactions are disabled
-    ByteArray m_key_arena;
+    // Protects the Database; see mutex()
+    RwMutex m_mutex;
+
+    // The arenas of a single thread
+    struct ThreadArenas {
+      // This is where key->data points to when returning a
+      // key to the user; used if Transactions are disabled
+      ByteArray key;
+
+      // This is where record->data points to when returning a
+      // record to the user; used if Transactions are disabled
+      ByteArray record;
+    };
+
+    // Returns the arenas of the calling thread. Read-only operations
+    // run concurrently, therefore each thread gets its own buffers
+    ThreadArenas &thread_arenas() {
+      ThreadArenas *arenas = m_arenas.get();
+      if (!arenas) {
+        arenas = new ThreadArenas;
+        m_arenas.reset(arenas);
+      }
+      return (*arenas);
+    }
+
+    // The key/record arenas, one per thread; they are released when the
+    // thread terminates
+    boost::thread_specific_ptr<ThreadArenas> m_arenas;
+};
+
+// Locks a Database for a read-only operation: the Environment and the
+// Database are locked in shared mode
+struct ScopedDatabaseReadLock
+{
+  ScopedDatabaseReadLock(Database *db, bool lock = true)
+    : env_lock(db->get_env()->mutex(), boost::defer_lock),
+      db_lock(db->mutex(), boost::defer_lock) {
+    if (lock) {
+      env_lock.lock();
+      db_lock.lock();
+    }
+  }
+
+  ScopedReadLock env_lock;
+  ScopedReadLock db_lock;
+};
 
-    // This is where record->data points to when returning a
-    // record to the user; used if Transactions are disabled
-    ByteArray m_record_arena;
+// Locks a Database for a modifying operation.
+//
+// Without Transactions, the Environment is only locked in shared mode and
+// the Database is locked exclusively; readers of the other Databases are
+// not blocked. The writers of all Databases are serialized with the
+// Environment's |writer_mutex()|, because they share the blob pages, the
+// header page and the PageManager's state, and would otherwise lock these
+// pages in different order.
+//
+// With Transactions, the Environment is locked exclusively, because a
+// commit flushes the committed operations of all Databases.
+struct ScopedDatabaseWriteLock
+{
+  ScopedDatabaseWriteLock(Database *db, bool lock = true)
+    : env_read_lock(db->get_env()->mutex(), boost::defer_lock),
+      env_write_lock(db->get_env()->mutex(), boost::defer_lock),
+      writer_lock(db->get_env()->writer_mutex(), boost::defer_lock),
+      db_lock(db->mutex(), boost::defer_lock) {
+    if (!lock)
+      return;
+    if (isset(db->get_env()->get_flags(), UPS_ENABLE_TRANSACTIONS)) {
+      env_write_lock.lock();
+      return;
+    }
+    env_read_lock.lock();
+    writer_lock.lock();
+    db_lock.lock();
+  }
+
+  // Releases the locks before the object goes out of scope
+  void unlock() {
+    if (db_lock.owns_lock())
+      db_lock.unlock();
+    if (writer_lock.owns_lock())
+      writer_lock.unlock();
+    if (env_write_lock.owns_lock())
+      env_write_lock.unlock();
+    if (env_read_lock.owns_lock())
+      env_read_lock.unlock();
+  }
+
+  ScopedReadLock env_read_lock;
+  ScopedWriteLock env_write_lock;
+  ScopedLock writer_lock;
+  ScopedWriteLock db_lock;
 };
 
 } // namespace upscaledb
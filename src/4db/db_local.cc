@@ -781,7 +781,7 @@ LocalDatabase::fill_metrics(ups_env_metrics_t *metrics)
 
   try {
     MetricsVisitor visitor(metrics);
-    Context context(lenv(), 0, this);
+    Context context(lenv(), 0, this, true);
     m_btree_index->visit_nodes(&context, visitor, true);
 
     // calculate the "avg" values
@@ -796,7 +796,7 @@ ups_status_t
 LocalDatabase::get_parameters(ups_parameter_t *param)
 {
   try {
-    Context context(lenv(), 0, this);
+    Context context(lenv(), 0, this, true);
 
     Page *page = 0;
     ups_parameter_t *p = param;
@@ -855,7 +855,7 @@ ups_status_t
 LocalDatabase::check_integrity(uint32_t flags)
 {
   try {
-    Context context(lenv(), 0, this);
+    Context context(lenv(), 0, this, true);
 
     /* purge cache if necessary */
     lenv()->page_manager()->purge_cache(&context);
@@ -878,7 +878,7 @@ LocalDatabase::count(Transaction *htxn, bool distinct, uint64_t *pcount)
   LocalTransaction *txn = dynamic_cast<LocalTransaction *>(htxn);
 
   try {
-    Context context(lenv(), txn, this);
+    Context context(lenv(), txn, this, true);
 
     /* purge cache if necessary */
     lenv()->page_manager()->purge_cache(&context);
@@ -914,7 +914,7 @@ LocalDatabase::scan(Transaction *txn, ScanVisitor *visitor, bool distinct)
     distinct = true;
 
   try {
-    Context context(lenv(), (LocalTransaction *)txn, this);
+    Context context(lenv(), (LocalTransaction *)txn, this, true);
 
     Page *page;
     ups_key_t key = {0};
@@ -1186,7 +1186,7 @@ LocalDatabase::find(Cursor *hcursor, Transaction *txn, ups_key_t *key,
             ups_record_t *record, uint32_t flags)
 {
   LocalCursor *cursor = (LocalCursor *)hcursor;
-  Context context(lenv(), (LocalTransaction *)txn, this);
+  Context context(lenv(), (LocalTransaction *)txn, this, true);
 
   try {
     ups_status_t st = 0;
@@ -1276,7 +1276,7 @@ LocalDatabase::cursor_move(Cursor *hcursor, ups_key_t *key,
 
   try {
     Context context(lenv(), (LocalTransaction *)cursor->get_txn(),
-            this);
+            this, true);
 
     return (cursor_move_impl(&context, cursor, key, record, flags));
   }
@@ -1546,7 +1546,7 @@ LocalDatabase::select_range(SelectStatement *stmt, LocalCursor *begin,
   if (!visitor.get())
     return (UPS_PARSER_ERROR);
 
-  Context context(lenv(), 0, this);
+  Context context(lenv(), 0, this, true);
 
   Result *result = new Result;
 
@@ -40,6 +40,7 @@ RemoteDatabase::get_parameters(ups_parameter_t *param)
 {
   try {
     RemoteEnvironment *env = renv();
+    ScopedLock lock(env->request_mutex());
 
     Protocol request(Protocol::DB_GET_PARAMETERS_REQUEST);
     request.mutable_db_get_parameters_request()->set_db_handle(m_remote_handle);
@@ -107,6 +108,7 @@ RemoteDatabase::check_integrity(uint32_t flags)
 {
   try {
     RemoteEnvironment *env = renv();
+    ScopedLock lock(env->request_mutex());
 
     Protocol request(Protocol::DB_CHECK_INTEGRITY_REQUEST);
     request.mutable_db_check_integrity_request()->set_db_handle(m_remote_handle);
@@ -128,6 +130,7 @@ RemoteDatabase::count(Transaction *htxn, bool distinct, uint64_t *pcount)
 {
   try {
     RemoteEnvironment *env = renv();
+    ScopedLock lock(env->request_mutex());
     RemoteTransaction *txn = dynamic_cast<RemoteTransaction *>(htxn);
 
     SerializedWrapper request;
@@ -325,6 +328,7 @@ RemoteDatabase::find(Cursor *hcursor, Transaction *htxn, ups_key_t *key,
       htxn = cursor->get_txn();
 
     RemoteEnvironment *env = renv();
+    ScopedLock lock(env->request_mutex());
     RemoteTransaction *txn = dynamic_cast<RemoteTransaction *>(htxn);
 
     SerializedWrapper request;
@@ -438,6 +442,7 @@ RemoteDatabase::cursor_move(Cursor *hcursor, ups_key_t *key,
 
   try {
     RemoteEnvironment *env = renv();
+    ScopedLock lock(env->request_mutex());
 
     RemoteTransaction *txn = dynamic_cast<RemoteTransaction *>(cursor->get_txn());
     ByteArray *pkey_arena = &key_arena(txn);
@@ -86,11 +86,21 @@ class Environment
       return (m_config);
     }
 
-    // Returns this Environment's mutex
-    Mutex &mutex() {
+    // Returns this Environment's mutex. Operations which modify the
+    // Environment lock it exclusively. Operations on a Database lock it in
+    // shared mode and then lock the Database; only the writers of an
+    // Environment with Transactions lock it exclusively (see
+    // ScopedDatabaseWriteLock in 4db/db.h)
+    RwMutex &mutex() {
       return (m_mutex);
     }
 
+    // Returns the mutex which serializes the writers of the Databases if
+    // Transactions are disabled
+    Mutex &writer_mutex() {
+      return (m_writer_mutex);
+    }
+
     // Creates a new Environment (ups_env_create)
     ups_status_t create();
 
@@ -103,6 +113,9 @@ class Environment
     // Returns environment parameters and flags (ups_env_get_parameters)
     ups_status_t get_parameters(ups_parameter_t *param);
 
+    // Changes environment parameters at runtime (ups_env_set_parameters)
+    ups_status_t set_parameters(const ups_parameter_t *param);
+
     // Flushes the environment and its databases to disk (ups_env_flush)
     // Accepted flags: UPS_FLUSH_BLOCKING
     ups_status_t flush(uint32_t flags);
@@ -134,6 +147,10 @@ class Environment
     // Commits a transaction (ups_txn_commit)
     ups_status_t txn_commit(Transaction *txn, uint32_t flags);
 
+    // Waits till the committed transactions are durable; the caller must
+    // not hold the lock
+    ups_status_t txn_sync();
+
     // Commits a transaction (ups_txn_abort)
     ups_status_t txn_abort(Transaction *txn, uint32_t flags);
 
@@ -143,7 +160,7 @@ class Environment
     // Fills in the current metrics
     ups_status_t fill_metrics(ups_env_metrics_t *metrics);
 
-    // Performs a UQI select
+    // Performs a UQI select; locks the Environment
     virtual ups_status_t select_range(const char *query, Cursor *begin,
                             const Cursor *end, Result **result) = 0;
 
@@ -164,6 +181,9 @@ class Environment
     // Returns environment parameters and flags (ups_env_get_parameters)
     virtual ups_status_t do_get_parameters(ups_parameter_t *param) = 0;
 
+    // Changes environment parameters at runtime (ups_env_set_parameters)
+    virtual ups_status_t do_set_parameters(const ups_parameter_t *param) = 0;
+
     // Flushes the environment and its databases to disk (ups_env_flush)
     virtual ups_status_t do_flush(uint32_t flags) = 0;
 
@@ -190,6 +210,10 @@ class Environment
     // Commits a transaction (ups_txn_commit)
     virtual ups_status_t do_txn_commit(Transaction *txn, uint32_t flags) = 0;
 
+    // Waits till the committed transactions are durable; called without
+    // holding the lock, therefore other threads can commit meanwhile
+    virtual void do_txn_sync() = 0;
+
     // Commits a transaction (ups_txn_abort)
     virtual ups_status_t do_txn_abort(Transaction *txn, uint32_t flags) = 0;
 
@@ -200,8 +224,11 @@ class Environment
     virtual void do_fill_metrics(ups_env_metrics_t *metrics) const = 0;
 
   protected:
-    // A mutex to serialize access to this Environment
-    Mutex m_mutex;
+    // A reader/writer mutex to serialize access to this Environment
+    RwMutex m_mutex;
+
+    // Serializes the writers of the Databases; see writer_mutex()
+    Mutex m_writer_mutex;
 
     // The Environment's configuration
     EnvConfig m_config;
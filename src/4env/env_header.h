@@ -53,8 +53,11 @@ typedef UPS_PACK_0 struct UPS_PACK_1
   // version information - major, minor, rev, file
   uint8_t  version[4];
 
+  // persistent flags (EnvironmentHeader::kFlag*)
+  uint32_t flags;
+
   // reserved
-  uint64_t _reserved1;
+  uint32_t _reserved1;
 
   // size of the page
   uint32_t page_size;
@@ -65,8 +68,9 @@ typedef UPS_PACK_0 struct UPS_PACK_1
   // for storing journal compression algorithm
   uint8_t journal_compression;
 
-  // reserved
-  uint8_t _reserved2;
+  // the algorithm of the page checksums (UPS_CHECKSUM_*); files of
+  // version 5 only store MurmurHash3 checksums
+  uint8_t checksum;
 
   // blob id of the PageManager's state
   uint64_t page_manager_blobid;
@@ -84,6 +88,20 @@ typedef UPS_PACK_0 struct UPS_PACK_1
 class EnvironmentHeader
 {
   public:
+    enum {
+      // The file version which older releases can open; a file is only
+      // upgraded to UPS_FILE_VERSION when it uses a feature which these
+      // releases cannot read
+      kFileVersionCompatible = 5,
+
+      // Pages can be stored in a secondary file (UPS_PARAM_COLD_STORAGE_PATH)
+      kFlagTieredStorage = 1,
+
+      // Pages are encrypted with AES-XTS (UPS_PARAM_ENCRYPTION_KEY); older
+      // releases encrypted them in CBC mode
+      kFlagAesXts = 2
+    };
+
     // Constructor
     EnvironmentHeader(Page *page)
       : m_header_page(page) {
@@ -124,6 +142,17 @@ class EnvironmentHeader
       header()->version[3] = file;
     }
 
+    // Returns the file version, without the msb which was set to
+    // distinguish the PRO version
+    uint8_t file_version() {
+      return (header()->version[3] & ~0x80);
+    }
+
+    // Upgrades the file to UPS_FILE_VERSION
+    void set_current_file_version() {
+      header()->version[3] = UPS_FILE_VERSION;
+    }
+
     // Returns get the maximum number of databases for this file
     uint16_t max_databases() {
       return (header()->max_databases);
@@ -164,6 +193,36 @@ class EnvironmentHeader
       header()->journal_compression = algorithm << 4;
     }
 
+    // Returns the algorithm of the page checksums
+    int checksum() {
+      return (header()->checksum);
+    }
+
+    // Sets the algorithm of the page checksums
+    void set_checksum(int algorithm) {
+      header()->checksum = (uint8_t)algorithm;
+    }
+
+    // Returns true if pages can be stored in a secondary file
+    bool is_tiered() {
+      return ((header()->flags & kFlagTieredStorage) != 0);
+    }
+
+    // Enables tiered storage
+    void set_tiered() {
+      header()->flags |= kFlagTieredStorage;
+    }
+
+    // Returns true if the pages are encrypted with AES-XTS
+    bool is_aes_xts() {
+      return ((header()->flags & kFlagAesXts) != 0);
+    }
+
+    // Marks the pages as encrypted with AES-XTS
+    void set_aes_xts() {
+      header()->flags |= kFlagAesXts;
+    }
+
     // Returns the header page with persistent configuration settings
     Page *header_page() {
       return (m_header_page);
@@ -18,6 +18,7 @@
 #include "0root/root.h"
 
 // Always verify that a file of level N does not include headers > N!
+#include "1os/file.h"
 #include "1os/os.h"
 #include "2compressor/compressor_factory.h"
 #include "2device/device_factory.h"
@@ -34,6 +35,9 @@
 #include "4txn/txn_cursor.h"
 #include "4uqi/parser.h"
 #include "4uqi/statements.h"
+#ifdef UPS_ENABLE_ENCRYPTION
+#  include "2aes/aes.h"
+#endif
 
 #ifndef UPS_ROOT_H
 #  error "root.h was not included"
@@ -43,9 +47,81 @@ using namespace upscaledb;
 
 namespace upscaledb {
 
+// The compaction runs at most this often per second
+static const uint32_t kCompactionRoundsPerSecond = 10;
+
+// The maximum number of pages above the compaction candidate whose btree
+// nodes are collected at once
+static const uint64_t kCompactionWindow = 1024;
+
+// The compaction thread waits this long (in milliseconds) for the
+// Environment's lock before it skips a round
+static const uint32_t kCompactionLockTimeout = 20;
+
+// The checkpoint thread waits this long (in milliseconds) for the
+// Environment's lock before it checks whether it was stopped
+static const uint32_t kCheckpointLockTimeout = 20;
+
+// The states of a pending checkpoint
+enum {
+  kCheckpointIdle    = 0,
+  kCheckpointWriting = 1,
+  kCheckpointWritten = 2,
+  kCheckpointFailed  = 3
+};
+
 LocalEnvironment::LocalEnvironment(EnvConfig &config)
-  : Environment(config)
+  : Environment(config), m_compaction_stopped(false),
+    m_page_count_relocated(0), m_checkpoint_stopped(false),
+    m_checkpoint_requested(false), m_checkpoint_min_lsn(0),
+    m_checkpoint_state(kCheckpointIdle)
+{
+}
+
+#ifdef UPS_ENABLE_ENCRYPTION
+// Returns true if the header page in |hdrbuf| (which was decrypted with
+// AES-XTS) was encrypted in CBC mode by an earlier release
+static bool
+is_cbc_encrypted(const uint8_t key[AesCipher::kAesBlockSize],
+                uint8_t *hdrbuf, size_t size)
+{
+  std::vector<uint8_t> buffer(size);
+
+  // XTS is a permutation; encrypting the data again restores the
+  // original ciphertext
+  AesCipher xts(key);
+  xts.encrypt(0, hdrbuf, &buffer[0], size);
+  AesCipher cbc(key, true);
+  cbc.decrypt(0, &buffer[0], &buffer[0], size);
+
+  // the header starts with the file magic
+  const uint8_t *magic = ((PPageData *)&buffer[0])->header.payload;
+  return (::memcmp(magic, "HAM\0", 4) == 0);
+}
+#endif
+
+static ups_status_t
+select_range_impl(LocalDatabase *db, SelectStatement *stmt, Cursor *begin,
+                const Cursor *end, Result **result)
 {
+  // if Cursors are passed: check if they belong to this database
+  if (begin && begin->db()->name() != stmt->dbid) {
+    ups_log(("cursor 'begin' uses wrong database"));
+    return (UPS_INV_PARAMETER);
+  }
+  if (end && end->db()->name() != stmt->dbid) {
+    ups_log(("cursor 'begin' uses wrong database"));
+    return (UPS_INV_PARAMETER);
+  }
+
+  // optimization: if duplicates are disabled then the query is always
+  // non-distinct
+  if (!(db->get_flags() & UPS_ENABLE_DUPLICATE_KEYS))
+    stmt->distinct = true;
+
+  // The Database object will do the remaining work
+  return (db->select_range(stmt, (LocalCursor *)begin,
+                    (LocalCursor *)end, result));
 }
 
 ups_status_t
@@ -60,6 +136,22 @@ LocalEnvironment::select_range(const char *query, Cursor *begin,
   if (st)
     return (st);
 
+  // if the database is already open then the query is read-only, and
+  // other read-only operations can run in parallel
+  {
+    ScopedReadLock lock(m_mutex);
+    DatabaseMap::iterator it = m_database_map.find(stmt.dbid);
+    if (it != m_database_map.end()) {
+      LocalDatabase *db = (LocalDatabase *)it->second;
+      ScopedReadLock db_lock(db->mutex());
+      return (select_range_impl(db, &stmt, begin, end, result));
+    }
+  }
+
+  // otherwise the database is opened (and closed) temporarily, which
+  // modifies the Environment
+  ScopedWriteLock lock(m_mutex);
+
   // load (or open) the database
   bool is_opened = false;
   LocalDatabase *db;
@@ -67,24 +159,7 @@ LocalEnvironment::select_range(const char *query, Cursor *begin,
   if (st)
     return (st);
 
-  // if Cursors are passed: check if they belong to this database
-  if (begin && begin->db()->name() != stmt.dbid) {
-    ups_log(("cursor 'begin' uses wrong database"));
-    return (UPS_INV_PARAMETER);
-  }
-  if (end && end->db()->name() != stmt.dbid) {
-    ups_log(("cursor 'begin' uses wrong database"));
-    return (UPS_INV_PARAMETER);
-  }
-
-  // optimization: if duplicates are disabled then the query is always
-  // non-distinct
-  if (!(db->get_flags() & UPS_ENABLE_DUPLICATE_KEYS))
-    stmt.distinct = true;
-
-  // The Database object will do the remaining work
-  st = db->select_range(&stmt, (LocalCursor *)begin,
-                    (LocalCursor *)end, result);
+  st = select_range_impl(db, &stmt, begin, end, result);
 
   // Don't leak the database handle if it was opened above
   if (is_opened)
@@ -201,7 +276,19 @@ LocalEnvironment::do_create()
   /* initialize the header */
   m_header->set_magic('H', 'A', 'M', '\0');
   m_header->set_version(UPS_VERSION_MAJ, UPS_VERSION_MIN, UPS_VERSION_REV,
-          UPS_FILE_VERSION);
+          EnvironmentHeader::kFileVersionCompatible);
+  m_header->set_checksum(m_config.checksum);
+  if (isset(m_config.flags, UPS_ENABLE_CRC32)
+      && m_config.checksum != UPS_CHECKSUM_MURMUR3)
+    m_header->set_current_file_version();
+  if (m_config.is_encryption_enabled) {
+    m_header->set_aes_xts();
+    m_header->set_current_file_version();
+  }
+  if (!m_config.cold_storage_path.empty()) {
+    m_header->set_tiered();
+    m_header->set_current_file_version();
+  }
   m_header->set_page_size(m_config.page_size_bytes);
   m_header->set_max_databases(m_config.max_databases);
 
@@ -228,6 +315,8 @@ LocalEnvironment::do_create()
   if (m_journal.get())
     m_header->header_page()->flush();
 
+  start_compaction();
+  start_checkpoints();
   return (0);
 }
 
@@ -262,6 +351,25 @@ LocalEnvironment::do_open()
   {
     Page *page = 0;
     uint8_t hdrbuf[512];
+    uint8_t file_version;
+
+#ifdef UPS_ENABLE_ENCRYPTION
+    /* files of older releases were encrypted in CBC mode; they are read
+     * and written in CBC mode, only new files use AES-XTS. Otherwise
+     * a wrong key is reported below */
+    if (m_config.is_encryption_enabled) {
+      m_device->read(0, hdrbuf, sizeof(hdrbuf));
+      const uint8_t *magic = ((PPageData *)&hdrbuf[0])->header.payload;
+      if (::memcmp(magic, "HAM\0", 4) != 0
+          && is_cbc_encrypted(m_config.encryption_key, hdrbuf,
+                  sizeof(hdrbuf))) {
+        m_config.is_encryption_cbc = true;
+        m_device->close();
+        m_device.reset(DeviceFactory::create(m_config));
+        m_device->open();
+      }
+    }
+#endif
 
     /*
      * in here, we're going to set up a faked headerpage for the
@@ -294,6 +402,15 @@ LocalEnvironment::do_open()
 
     m_config.page_size_bytes = m_header->page_size();
 
+    /* direct I/O requires aligned pages */
+    if (m_config.use_direct_io
+        && m_config.page_size_bytes % File::kDirectIoAlignment != 0) {
+      ups_trace(("direct I/O requires a page size which is a multiple "
+                  "of %d", (int)File::kDirectIoAlignment));
+      st = UPS_INV_PARAMETER;
+      goto fail_with_fake_cleansing;
+    }
+
     /** check the file magic */
     if (!m_header->verify_magic('H', 'A', 'M', '\0')) {
       ups_log(("invalid file type"));
@@ -302,13 +419,15 @@ LocalEnvironment::do_open()
     }
 
     /* Check the database version; everything with a different file version
-     * is incompatible.
+     * is incompatible. Version 5 files do not use the features of version
+     * 6 (i.e. CRC32C checksums), and are upgraded when they do.
      *
      * The msb was set to distinguish the PRO version. It is ignored here to
-     * remain compatible with PRO. This can be removed when the
-     * UPS_FILE_VERSION is incremented (current value: 4).
+     * remain compatible with PRO.
      */
-    if ((m_header->version(3) & ~0x80) != UPS_FILE_VERSION) {
+    file_version = m_header->file_version();
+    if (file_version != UPS_FILE_VERSION
+          && file_version != EnvironmentHeader::kFileVersionCompatible) {
       ups_log(("invalid file version"));
       st = UPS_INV_FILE_VERSION;
       goto fail_with_fake_cleansing;
@@ -320,6 +439,33 @@ LocalEnvironment::do_open()
       st = UPS_INV_FILE_VERSION;
       goto fail_with_fake_cleansing;
     }
+    /* the cipher mode is recorded since AES-XTS was introduced; files
+     * without it are encrypted in CBC mode */
+    else if (m_config.is_encryption_enabled && !m_config.is_encryption_cbc
+        && !m_header->is_aes_xts()) {
+      ups_log(("invalid file version; unknown cipher mode"));
+      st = UPS_INV_FILE_VERSION;
+      goto fail_with_fake_cleansing;
+    }
+    else if (m_header->checksum() != UPS_CHECKSUM_MURMUR3
+        && m_header->checksum() != UPS_CHECKSUM_CRC32C) {
+      ups_log(("unknown checksum algorithm %d", m_header->checksum()));
+      st = UPS_INV_FILE_HEADER;
+      goto fail_with_fake_cleansing;
+    }
+    /* older releases would read the moved pages as zeroed pages */
+    else if (m_header->is_tiered() && file_version != UPS_FILE_VERSION) {
+      ups_log(("invalid file version; tiered storage requires version %d",
+                  UPS_FILE_VERSION));
+      st = UPS_INV_FILE_VERSION;
+      goto fail_with_fake_cleansing;
+    }
+    /* pages of a tiered Environment are missing in the database file */
+    else if (m_header->is_tiered() && m_config.cold_storage_path.empty()) {
+      ups_trace(("this Environment requires UPS_PARAM_COLD_STORAGE_PATH"));
+      st = UPS_INV_PARAMETER;
+      goto fail_with_fake_cleansing;
+    }
 
     st = 0;
 
@@ -340,11 +486,36 @@ fail_with_fake_cleansing:
     page = new Page(m_device.get());
     page->fetch(0);
     m_header.reset(new EnvironmentHeader(page));
+
+    /* an existing Environment is converted to tiered storage; the flag
+     * is persisted before any page is moved, and older releases can no
+     * longer open the file */
+    if (!m_config.cold_storage_path.empty() && !m_header->is_tiered()
+        && notset(m_config.flags, UPS_READ_ONLY)) {
+      m_header->set_tiered();
+      m_header->set_current_file_version();
+      page->set_dirty(true);
+      page->flush();
+      m_device->flush();
+    }
+
+    /* the first CRC32C checksum makes the file incompatible with older
+     * releases; the file is upgraded before any page is written */
+    if (isset(m_config.flags, UPS_ENABLE_CRC32)
+        && m_header->checksum() != UPS_CHECKSUM_MURMUR3
+        && m_header->file_version() != UPS_FILE_VERSION
+        && notset(m_config.flags, UPS_READ_ONLY)) {
+      m_header->set_current_file_version();
+      page->set_dirty(true);
+      page->flush();
+      m_device->flush();
+    }
   }
 
   /* Now that the header page was fetched we can retrieve the compression
    * information */
   m_config.journal_compressor = m_header->journal_compression();
+  m_config.checksum = m_header->checksum();
 
   /* load page manager after setting up the blobmanager and the device! */
   m_page_manager.reset(new PageManager(this));
@@ -360,6 +531,8 @@ fail_with_fake_cleansing:
   if (m_header->page_manager_blobid() != 0)
     m_page_manager->initialize(m_header->page_manager_blobid());
 
+  start_compaction();
+  start_checkpoints();
   return (0);
 }
 
@@ -389,6 +562,38 @@ LocalEnvironment::do_get_database_names(uint16_t *names, uint32_t *count)
   return 0;
 }
 
+ups_status_t
+LocalEnvironment::do_set_parameters(const ups_parameter_t *param)
+{
+  for (const ups_parameter_t *p = param; p->name; p++) {
+    switch (p->name) {
+    case UPS_PARAM_CACHE_SIZE:
+      if (p->value == 0
+          || isset(m_config.flags, UPS_IN_MEMORY)
+          || isset(m_config.flags, UPS_CACHE_UNLIMITED)) {
+        ups_trace(("cannot change the cache size of this Environment"));
+        return (UPS_INV_PARAMETER);
+      }
+      break;
+    default:
+      ups_trace(("unknown parameter %d", (int)p->name));
+      return (UPS_INV_PARAMETER);
+    }
+  }
+
+  // all parameters were validated; now apply them
+  for (const ups_parameter_t *p = param; p->name; p++) {
+    switch (p->name) {
+    case UPS_PARAM_CACHE_SIZE:
+      m_config.cache_size_bytes = p->value;
+      m_page_manager->set_cache_size(p->value);
+      break;
+    }
+  }
+
+  return (0);
+}
+
 ups_status_t
 LocalEnvironment::do_get_parameters(ups_parameter_t *param)
 {
@@ -433,6 +638,61 @@ LocalEnvironment::do_get_parameters(ups_parameter_t *param)
       case UPS_PARAM_POSIX_FADVISE:
         p->value = m_config.posix_advice;
         break;
+      case UPS_PARAM_WORKER_THREADS:
+        p->value = m_config.num_worker_threads;
+        break;
+      case UPS_PARAM_CACHE_POLICY:
+        p->value = m_config.cache_policy;
+        break;
+      case UPS_PARAM_HUGE_PAGES:
+        p->value = m_config.use_huge_pages ? 1 : 0;
+        break;
+      case UPS_PARAM_IO_QUEUE_DEPTH:
+        p->value = m_config.io_queue_depth;
+        break;
+      case UPS_PARAM_DIRECT_IO:
+        p->value = m_config.use_direct_io ? 1 : 0;
+        break;
+      case UPS_PARAM_READ_AHEAD:
+        p->value = m_config.read_ahead_pages;
+        break;
+      case UPS_PARAM_CHECKSUM:
+        p->value = m_config.checksum;
+        break;
+      case UPS_PARAM_COLD_STORAGE_PATH:
+        if (m_config.cold_storage_path.size())
+          p->value = (uint64_t)(m_config.cold_storage_path.c_str());
+        else
+          p->value = 0;
+        break;
+      case UPS_PARAM_FAST_TIER_SIZE:
+        p->value = m_config.fast_tier_size_bytes;
+        break;
+      case UPS_PARAM_FILE_GROWTH_BYTES:
+        p->value = m_config.file_growth_bytes;
+        break;
+      case UPS_PARAM_COMPACTION_RATE:
+        p->value = m_config.compaction_rate;
+        break;
+      case UPS_PARAM_JOURNAL_GROUP_COMMIT_WINDOW:
+        p->value = m_config.journal_group_commit_window;
+        break;
+      case UPS_PARAM_JOURNAL_GROUP_COMMIT_BYTES:
+        p->value = m_config.journal_group_commit_bytes;
+        break;
+      case UPS_PARAM_JOURNAL_SEGMENTS:
+        p->value = m_journal ? m_journal->state.num_segments
+                             : m_config.journal_segments;
+        break;
+      case UPS_PARAM_JOURNAL_SEGMENT_SIZE:
+        p->value = m_config.journal_segment_size;
+        break;
+      case UPS_PARAM_JOURNAL_CHECKPOINT_INTERVAL:
+        p->value = m_config.journal_checkpoint_interval;
+        break;
+      case UPS_PARAM_JOURNAL_CHECKPOINT_BYTES:
+        p->value = m_config.journal_checkpoint_bytes;
+        break;
       default:
         ups_trace(("unknown parameter %d", (int)p->name));
         return (UPS_INV_PARAMETER);
@@ -833,7 +1093,19 @@ LocalEnvironment::do_txn_begin(const char *name, uint32_t flags)
 ups_status_t
 LocalEnvironment::do_txn_commit(Transaction *txn, uint32_t flags)
 {
-  return (m_txn_manager->commit(txn, flags));
+  ups_status_t st = m_txn_manager->commit(txn, flags);
+  if (st == 0)
+    signal_checkpoint();
+  return (st);
+}
+
+void
+LocalEnvironment::do_txn_sync()
+{
+  // the journal is synced by the log writer; it also syncs the commits
+  // of other threads (group commit)
+  if (m_journal)
+    m_journal->wait_until_durable(m_journal->queued_sequence());
 }
 
 ups_status_t
@@ -845,6 +1117,9 @@ LocalEnvironment::do_txn_abort(Transaction *txn, uint32_t flags)
 ups_status_t
 LocalEnvironment::do_close(uint32_t flags)
 {
+  stop_compaction();
+  stop_checkpoints();
+
   Context context(this);
 
   /* flush all committed transactions */
@@ -885,20 +1160,347 @@ LocalEnvironment::do_fill_metrics(ups_env_metrics_t *metrics) const
 {
   // PageManager metrics (incl. cache and freelist)
   m_page_manager->fill_metrics(metrics);
+  // the Device (tiered storage)
+  m_device->fill_metrics(metrics);
   // the BlobManagers
   m_blob_manager->fill_metrics(metrics);
   // the Journal (if available)
   if (m_journal)
     m_journal->fill_metrics(metrics);
-  // the (first) database
+  // the (first) database; the Environment is only locked in shared mode,
+  // therefore the Database has to be locked against its writers
   if (!m_database_map.empty()) {
     LocalDatabase *db = (LocalDatabase *)m_database_map.begin()->second;
+    ScopedReadLock db_lock(db->mutex());
     db->fill_metrics(metrics);
   }
   // and of the btrees
   BtreeIndex::fill_metrics(metrics);
   // SIMD support enabled?
   metrics->simd_lane_width = os_get_simd_lane_width();
+  // the compaction
+  metrics->page_count_relocated = m_page_count_relocated;
+}
+
+uint32_t
+LocalEnvironment::compact(uint32_t max_pages)
+{
+  Context context(this, 0, 0);
+
+  uint32_t page_size = m_config.page_size_bytes;
+  uint32_t moved = 0;
+  BtreeNodeMap nodes;
+  uint64_t min_address = 0;
+  bool collect = true;
+
+  while (moved < max_pages) {
+    uint64_t address = m_page_manager->compaction_candidate();
+    if (address == 0)
+      break;
+
+    // collect the btree nodes close to the candidate. This is repeated
+    // after an internal node was moved, because its children then have
+    // a new parent.
+    if (collect || address < min_address) {
+      uint64_t window = std::min<uint64_t>(max_pages - moved,
+                      kCompactionWindow) * page_size;
+      min_address = address > window ? address - window : 0;
+      nodes.clear();
+      for (DatabaseMap::iterator it = m_database_map.begin();
+                      it != m_database_map.end(); it++) {
+        LocalDatabase *db = (LocalDatabase *)it->second;
+        context.db = db;
+        db->btree_index()->collect_nodes(&context, min_address, &nodes);
+      }
+      collect = false;
+    }
+
+    // the state of the PageManager can also be moved; stop at all other
+    // pages which are not btree nodes of an open database (i.e. blobs).
+    // Blobs are not relocated because their ids are stored in the leaf
+    // records, in duplicate tables and in extended keys. The file cannot
+    // shrink beyond them, therefore moving the pages in front of them
+    // would only cost I/O
+    BtreeNodeMap::iterator it = nodes.find(address);
+    if (it == nodes.end()) {
+      if (!m_page_manager->relocate_state_page(&context, address))
+        break;
+      moved++;
+      continue;
+    }
+
+    BtreeNodeRef ref = it->second;
+    nodes.erase(it);
+    context.db = ref.btree->db();
+    ref.btree->relocate_node(&context, address, ref);
+    if (!ref.is_leaf)
+      collect = true;
+    moved++;
+  }
+
+  if (journal())
+    context.changeset.flush(next_lsn());
+  context.changeset.clear();
+  context.db = 0;
+
+  bool try_reclaim = notset(m_config.flags, UPS_DISABLE_RECLAIM_INTERNAL);
+#ifdef WIN32
+  // Win32: it's not possible to truncate the file while there's an active
+  // mapping
+  if (notset(m_config.flags, UPS_DISABLE_MMAP))
+    try_reclaim = false;
+#endif
+
+  if (try_reclaim && m_page_manager->truncate_free_pages(&context)) {
+    if (journal())
+      context.changeset.flush(next_lsn());
+  }
+
+  m_page_count_relocated += moved;
+  return moved;
+}
+
+void
+LocalEnvironment::start_compaction()
+{
+  if (m_config.compaction_rate == 0
+        || isset(m_config.flags, UPS_IN_MEMORY)
+        || isset(m_config.flags, UPS_READ_ONLY)
+        || isset(m_config.flags, UPS_DISABLE_RECLAIM_INTERNAL))
+    return;
+
+  m_compaction_stopped = false;
+  m_compaction_thread.reset(new Thread(
+                  boost::bind(&LocalEnvironment::run_compaction, this)));
+}
+
+void
+LocalEnvironment::stop_compaction()
+{
+  if (!m_compaction_thread)
+    return;
+
+  {
+    ScopedLock lock(m_compaction_mutex);
+    m_compaction_stopped = true;
+    m_compaction_cond.notify_all();
+  }
+
+  m_compaction_thread->join();
+  m_compaction_thread.reset();
+}
+
+void
+LocalEnvironment::run_compaction()
+{
+  // low rates move a single page in longer intervals
+  uint32_t rate = m_config.compaction_rate;
+  uint32_t max_pages = 1;
+  uint32_t interval = 1000 / kCompactionRoundsPerSecond;
+  if (rate >= kCompactionRoundsPerSecond)
+    max_pages = rate / kCompactionRoundsPerSecond;
+  else
+    interval = 1000 / rate;
+
+  ScopedLock lock(m_compaction_mutex);
+  while (!m_compaction_stopped) {
+    m_compaction_cond.timed_wait(lock,
+                    boost::posix_time::milliseconds(interval));
+    if (m_compaction_stopped)
+      break;
+
+    // a pending writer blocks new readers and writers, therefore a busy
+    // Environment does not starve the compaction; the round is skipped
+    // if the current lock holders do not finish in time
+    ScopedWriteLock env_lock(mutex(),
+                  boost::posix_time::milliseconds(kCompactionLockTimeout));
+    if (!env_lock.owns_lock())
+      continue;
+
+    try {
+      compact(max_pages);
+    }
+    catch (Exception &ex) {
+      ups_log(("compaction failed with status %d", ex.code));
+    }
+  }
+}
+
+bool
+LocalEnvironment::checkpoint()
+{
+  if (!m_journal)
+    return false;
+
+  // the pages of the pending checkpoint are written: log the checkpoint
+  if (m_checkpoint_min_lsn != 0) {
+    int state = m_checkpoint_state.load();
+    if (state == kCheckpointWriting)
+      return false;
+
+    uint64_t min_lsn = m_checkpoint_min_lsn;
+    m_checkpoint_min_lsn = 0;
+    m_checkpoint_state = kCheckpointIdle;
+    if (state == kCheckpointFailed)
+      return false;
+
+    m_journal->append_checkpoint(min_lsn, next_lsn());
+    return true;
+  }
+
+  // otherwise start a new checkpoint. The committed Transactions are
+  // flushed to the btree, and the worker writes their Changesets. All
+  // operations which were not flushed (i.e. of active Transactions)
+  // are replayed during recovery.
+  Context context(this, 0, 0);
+  LocalTransactionManager *ltm = (LocalTransactionManager *)m_txn_manager.get();
+  if (ltm)
+    ltm->flush_committed_txns(&context);
+
+  uint64_t min_lsn = next_lsn();
+  uint64_t oldest_lsn = ltm ? ltm->oldest_unflushed_lsn() : 0;
+  if (oldest_lsn != 0 && oldest_lsn < min_lsn)
+    min_lsn = oldest_lsn;
+
+  // the checkpoint is completed by the worker after the pending
+  // Changesets were written; the Environment remains unlocked meanwhile
+  m_checkpoint_min_lsn = min_lsn;
+  m_checkpoint_state = kCheckpointWriting;
+  m_page_manager->run_async(boost::bind(&LocalEnvironment::write_checkpoint,
+                          this));
+  return false;
+}
+
+void
+LocalEnvironment::write_checkpoint()
+{
+  int state = kCheckpointWritten;
+  try {
+    if (isset(m_config.flags, UPS_ENABLE_FSYNC))
+      m_device->flush();
+  }
+  catch (Exception &ex) {
+    ups_log(("checkpoint failed with status %d", ex.code));
+    state = kCheckpointFailed;
+  }
+
+  // wake up the checkpoint thread (or stop_checkpoints()); it logs the
+  // checkpoint in its next round
+  ScopedLock lock(m_checkpoint_mutex);
+  m_checkpoint_state = state;
+  m_checkpoint_requested = true;
+  m_checkpoint_cond.notify_all();
+}
+
+void
+LocalEnvironment::signal_checkpoint()
+{
+  uint64_t max_bytes = m_config.journal_checkpoint_bytes;
+  if (!m_checkpoint_thread || max_bytes == 0
+        || m_journal->bytes_since_checkpoint() < max_bytes)
+    return;
+
+  ScopedLock lock(m_checkpoint_mutex);
+  m_checkpoint_requested = true;
+  m_checkpoint_cond.notify_all();
+}
+
+void
+LocalEnvironment::start_checkpoints()
+{
+  if ((m_config.journal_checkpoint_interval == 0
+            && m_config.journal_checkpoint_bytes == 0)
+        || !m_journal
+        || isset(m_config.flags, UPS_IN_MEMORY)
+        || isset(m_config.flags, UPS_READ_ONLY))
+    return;
+
+  m_checkpoint_stopped = false;
+  m_checkpoint_thread.reset(new Thread(
+                  boost::bind(&LocalEnvironment::run_checkpoints, this)));
+}
+
+void
+LocalEnvironment::stop_checkpoints()
+{
+  if (m_checkpoint_thread) {
+    {
+      ScopedLock lock(m_checkpoint_mutex);
+      m_checkpoint_stopped = true;
+      m_checkpoint_cond.notify_all();
+    }
+
+    m_checkpoint_thread->join();
+    m_checkpoint_thread.reset();
+  }
+
+  // the worker must not access the pending checkpoint after the
+  // Environment was closed
+  {
+    ScopedLock lock(m_checkpoint_mutex);
+    while (m_checkpoint_state.load() == kCheckpointWriting)
+      m_checkpoint_cond.wait(lock);
+    m_checkpoint_requested = false;
+  }
+  m_checkpoint_min_lsn = 0;
+  m_checkpoint_state = kCheckpointIdle;
+}
+
+void
+LocalEnvironment::run_checkpoints()
+{
+  uint32_t interval = m_config.journal_checkpoint_interval;
+  boost::system_time due = boost::get_system_time()
+                + boost::posix_time::milliseconds(interval);
+
+  ScopedLock lock(m_checkpoint_mutex);
+  while (!m_checkpoint_stopped) {
+    // sleep till the interval expired, or till the thread is woken up
+    // by a commit (UPS_PARAM_JOURNAL_CHECKPOINT_BYTES) or by the worker
+    // (the pages of the pending checkpoint were written)
+    int state = m_checkpoint_state.load();
+    bool is_ready = state == kCheckpointWritten
+            || state == kCheckpointFailed
+            || (state == kCheckpointIdle
+                && (m_checkpoint_requested
+                    || (interval != 0 && boost::get_system_time() >= due)));
+    if (!is_ready) {
+      if (interval != 0 && state == kCheckpointIdle)
+        m_checkpoint_cond.timed_wait(lock, due);
+      else
+        m_checkpoint_cond.wait(lock);
+      continue;
+    }
+
+    m_checkpoint_requested = false;
+    lock.unlock();
+
+    // the lock is requested with a timeout because the Environment is
+    // closed while it is locked; pending readers and writers are then
+    // blocked till the checkpoint thread had its turn
+    bool is_locked;
+    {
+      ScopedWriteLock env_lock(mutex(),
+                    boost::posix_time::milliseconds(kCheckpointLockTimeout));
+      is_locked = env_lock.owns_lock();
+      if (is_locked) {
+        try {
+          if (checkpoint())
+            due = boost::get_system_time()
+                    + boost::posix_time::milliseconds(interval);
+        }
+        catch (Exception &ex) {
+          ups_log(("checkpoint failed with status %d", ex.code));
+          due = boost::get_system_time()
+                  + boost::posix_time::milliseconds(interval);
+        }
+      }
+    }
+
+    lock.lock();
+    if (!is_locked)
+      m_checkpoint_requested = true;
+  }
 }
 
 void
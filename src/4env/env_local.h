@@ -28,6 +28,7 @@
 #include "0root/root.h"
 
 // Always verify that a file of level N does not include headers > N!
+#include "1base/mutex.h"
 #include "1base/scoped_ptr.h"
 #include "2lsn_manager/lsn_manager.h"
 #include "3journal/journal.h"
@@ -102,6 +103,23 @@ class LocalEnvironment : public Environment
     virtual ups_status_t select_range(const char *query, Cursor *begin,
                             const Cursor *end, Result **result);
 
+    // Moves up to |max_pages| btree nodes from the end of the file to free
+    // pages, then truncates the file. The caller must hold the
+    // Environment's write lock. Returns the number of moved pages.
+    uint32_t compact(uint32_t max_pages);
+
+    // Runs the next step of a fuzzy checkpoint. The first call flushes the
+    // committed Transactions; their pages are written in the background.
+    // A later call logs the checkpoint as soon as the pages were written.
+    // The caller must hold the Environment's write lock. Returns true if
+    // a checkpoint was logged.
+    bool checkpoint();
+
+    // Wakes up the checkpoint thread if the journal grew by more than
+    // UPS_PARAM_JOURNAL_CHECKPOINT_BYTES since the previous checkpoint.
+    // The caller must hold the Environment's write lock.
+    void signal_checkpoint();
+
     // Returns a test gateway
     LocalEnvironmentTest test();
 
@@ -119,6 +137,9 @@ class LocalEnvironment : public Environment
     // Returns environment parameters and flags (ups_env_get_parameters)
     virtual ups_status_t do_get_parameters(ups_parameter_t *param);
 
+    // Changes environment parameters at runtime (ups_env_set_parameters)
+    virtual ups_status_t do_set_parameters(const ups_parameter_t *param);
+
     // Flushes the environment and its databases to disk (ups_env_flush)
     virtual ups_status_t do_flush(uint32_t flags);
 
@@ -145,6 +166,9 @@ class LocalEnvironment : public Environment
     // Commits a transaction (ups_txn_commit)
     virtual ups_status_t do_txn_commit(Transaction *txn, uint32_t flags);
 
+    // Waits till the committed transactions are durable
+    virtual void do_txn_sync();
+
     // Commits a transaction (ups_txn_abort)
     virtual ups_status_t do_txn_abort(Transaction *txn, uint32_t flags);
 
@@ -165,6 +189,32 @@ class LocalEnvironment : public Environment
     ups_status_t get_or_open_database(uint16_t dbname, LocalDatabase **pdb,
                         bool *is_opened);
 
+    // Starts the compaction thread (if UPS_PARAM_COMPACTION_RATE is set)
+    void start_compaction();
+
+    // Stops the compaction thread and waits till it terminated
+    void stop_compaction();
+
+    // The compaction thread; moves pages whenever the Environment is not
+    // in use
+    void run_compaction();
+
+    // Starts the checkpoint thread (if UPS_PARAM_JOURNAL_CHECKPOINT_INTERVAL
+    // or UPS_PARAM_JOURNAL_CHECKPOINT_BYTES is set)
+    void start_checkpoints();
+
+    // Stops the checkpoint thread and waits till it terminated
+    void stop_checkpoints();
+
+    // Runs on the worker thread after the pages of the pending checkpoint
+    // were written; syncs the file (if required) and wakes up the
+    // checkpoint thread
+    void write_checkpoint();
+
+    // The checkpoint thread; runs a checkpoint after the configured
+    // interval or number of journal bytes
+    void run_checkpoints();
+
     // Get the btree configuration of the database #i, where |i| is a
     // zero-based index
     PBtreeHeader *btree_header(int i);
@@ -195,6 +245,47 @@ class LocalEnvironment : public Environment
 
     // The lsn manager
     LsnManager m_lsn_manager;
+
+    // The thread of the online compaction
+    ScopedPtr<Thread> m_compaction_thread;
+
+    // Protects |m_compaction_stopped|
+    boost::mutex m_compaction_mutex;
+
+    // Wakes up the compaction thread when it is stopped
+    Condition m_compaction_cond;
+
+    // Set to true when the compaction thread is stopped
+    bool m_compaction_stopped;
+
+    // The number of pages which were moved by the compaction
+    uint64_t m_page_count_relocated;
+
+    // The thread of the journal checkpoints
+    ScopedPtr<Thread> m_checkpoint_thread;
+
+    // Protects |m_checkpoint_stopped| and |m_checkpoint_requested|
+    boost::mutex m_checkpoint_mutex;
+
+    // Wakes up the checkpoint thread when it is stopped or a checkpoint
+    // is requested; also signalled when the worker wrote the pages of
+    // the pending checkpoint
+    Condition m_checkpoint_cond;
+
+    // Set to true when the checkpoint thread is stopped
+    bool m_checkpoint_stopped;
+
+    // Set to true when the checkpoint thread should run the next step
+    // of a checkpoint
+    bool m_checkpoint_requested;
+
+    // The minimum recovery lsn of the pending checkpoint; 0 if no
+    // checkpoint is pending
+    uint64_t m_checkpoint_min_lsn;
+
+    // The state of the pending checkpoint (kCheckpoint*); updated by the
+    // worker thread while it holds |m_checkpoint_mutex|
+    boost::atomic<int> m_checkpoint_state;
 };
 
 } // namespace upscaledb
@@ -110,6 +110,8 @@ ups_status_t
 RemoteEnvironment::select_range(const char *query, Cursor *begin,
                             const Cursor *end, Result **presult)
 {
+  ScopedWriteLock lock(m_mutex);
+
   Protocol request(Protocol::SELECT_RANGE_REQUEST);
   request.mutable_select_range_request();
   request.mutable_select_range_request()->set_env_handle(m_remote_handle);
@@ -234,6 +236,14 @@ RemoteEnvironment::do_get_database_names(uint16_t *names, uint32_t *count)
   return (0);
 }
 
+ups_status_t
+RemoteEnvironment::do_set_parameters(const ups_parameter_t *param)
+{
+  ups_trace(("ups_env_set_parameters is not supported for remote "
+             "Environments"));
+  return (UPS_NOT_IMPLEMENTED);
+}
+
 ups_status_t
 RemoteEnvironment::do_get_parameters(ups_parameter_t *param)
 {
@@ -460,6 +470,12 @@ RemoteEnvironment::do_txn_commit(Transaction *txn, uint32_t flags)
   return (m_txn_manager->commit(txn, flags));
 }
 
+void
+RemoteEnvironment::do_txn_sync()
+{
+  // the commit is durable when the server replies
+}
+
 ups_status_t
 RemoteEnvironment::do_txn_abort(Transaction *txn, uint32_t flags)
 {
@@ -63,6 +63,13 @@ class RemoteEnvironment : public Environment
     virtual ups_status_t select_range(const char *query, Cursor *begin,
                             const Cursor *end, Result **result);
 
+    // Returns the mutex which serializes read-only requests; they only
+    // hold a shared lock on the Environment, but share the socket and
+    // |m_buffer|, which the replies point into
+    Mutex &request_mutex() {
+      return (m_request_mutex);
+    }
+
   protected:
     // Creates a new Environment (ups_env_create)
     virtual ups_status_t do_create();
@@ -77,6 +84,9 @@ class RemoteEnvironment : public Environment
     // Returns environment parameters and flags (ups_env_get_parameters)
     virtual ups_status_t do_get_parameters(ups_parameter_t *param);
 
+    // Changes environment parameters at runtime (ups_env_set_parameters)
+    virtual ups_status_t do_set_parameters(const ups_parameter_t *param);
+
     // Flushes the environment and its databases to disk (ups_env_flush)
     virtual ups_status_t do_flush(uint32_t flags);
 
@@ -103,6 +113,9 @@ class RemoteEnvironment : public Environment
     // Commits a transaction (ups_txn_commit)
     virtual ups_status_t do_txn_commit(Transaction *txn, uint32_t flags);
 
+    // Waits till the committed transactions are durable
+    virtual void do_txn_sync();
+
     // Commits a transaction (ups_txn_abort)
     virtual ups_status_t do_txn_abort(Transaction *txn, uint32_t flags);
 
@@ -121,6 +134,9 @@ class RemoteEnvironment : public Environment
 
     // a buffer to avoid frequent memory allocations
     ByteArray m_buffer;
+
+    // serializes read-only requests
+    Mutex m_request_mutex;
 };
 
 } // namespace upscaledb
@@ -65,6 +65,7 @@ TransactionCursor::couple_to_op(TransactionOperation *op)
   set_to_nil();
   m_coupled_op = op;
 
+  ScopedSpinlock lock(get_db()->txn_index()->m_cursor_mutex);
   m_coupled_next = op->cursor_list();
   m_coupled_previous = 0;
 
@@ -352,6 +353,7 @@ TransactionCursor::remove_cursor_from_op(TransactionOperation *op)
 {
   assert(!is_nil());
 
+  ScopedSpinlock lock(get_db()->txn_index()->m_cursor_mutex);
   if (op->cursor_list() == this) {
     op->set_cursor_list(m_coupled_next);
     if (m_coupled_next)
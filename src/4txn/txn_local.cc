@@ -219,8 +219,8 @@ LocalTransactionManager::LocalTransactionManager(Environment *env)
 
 LocalTransaction::LocalTransaction(LocalEnvironment *env, const char *name,
         uint32_t flags)
-  : Transaction(env, name, flags), m_log_desc(0), m_oldest_op(0),
-    m_newest_op(0), m_op_counter(0), m_accum_data_size(0)
+  : Transaction(env, name, flags), m_log_desc(0), m_begin_lsn(0),
+    m_oldest_op(0), m_newest_op(0), m_op_counter(0), m_accum_data_size(0)
 {
   LocalTransactionManager *ltm = 
         (LocalTransactionManager *)env->txn_manager();
@@ -480,16 +480,21 @@ LocalTransactionManager::commit(Transaction *htxn, uint32_t flags)
 {
   LocalTransaction *txn = dynamic_cast<LocalTransaction *>(htxn);
   Context context(lenv(), txn, 0);
+  Journal *journal = lenv()->journal();
+  bool is_temporary = isset(txn->get_flags(), UPS_TXN_TEMPORARY);
 
   try {
     txn->commit(flags);
 
     /* append journal entry */
-    if (lenv()->journal() && !(txn->get_flags() & UPS_TXN_TEMPORARY))
-      lenv()->journal()->append_txn_commit(txn, lenv()->next_lsn());
+    if (journal && !is_temporary)
+      journal->append_txn_commit(txn, lenv()->next_lsn());
 
     /* flush committed transactions */
     maybe_flush_committed_txns(&context);
+
+    /* the caller waits till the transaction is durable, after the
+     * Environment was unlocked (see Environment::txn_sync) */
   }
   catch (Exception &ex) {
     return (ex.code);
@@ -538,6 +543,28 @@ LocalTransactionManager::flush_committed_txns(Context *context /* = 0 */)
     flush_committed_txns_impl(context);
 }
 
+uint64_t
+LocalTransactionManager::oldest_unflushed_lsn()
+{
+  uint64_t lsn = 0;
+
+  for (LocalTransaction *txn = (LocalTransaction *)get_oldest_txn();
+          txn != 0;
+          txn = (LocalTransaction *)txn->get_next()) {
+    if (txn->is_aborted())
+      continue;
+
+    // temporary Transactions do not log their begin
+    uint64_t l = txn->get_begin_lsn();
+    if (l == 0 && txn->get_oldest_op())
+      l = txn->get_oldest_op()->get_lsn();
+    if (l != 0 && (lsn == 0 || l < lsn))
+      lsn = l;
+  }
+
+  return (lsn);
+}
+
 void 
 LocalTransactionManager::flush_committed_txns_impl(Context *context)
 {
@@ -26,6 +26,7 @@
 #include "0root/root.h"
 
 // Always verify that a file of level N does not include headers > N!
+#include "1base/spinlock.h"
 #include "1rb/rb.h"
 #include "4txn/txn.h"
 
@@ -373,6 +374,10 @@ class TransactionIndex
     // the Database for all operations in this tree
     LocalDatabase *m_db;
 
+    // protects the cursor lists of the TransactionOperations; concurrent
+    // read-only operations couple and uncouple their cursors
+    Spinlock m_cursor_mutex;
+
     // stuff for rb.h
     TransactionNode *rbt_root;
     TransactionNode rbt_nil;
@@ -436,6 +441,11 @@ class LocalTransaction : public Transaction
       return (m_accum_data_size);
     }
 
+    // Returns the lsn of the journal's txn_begin entry
+    uint64_t get_begin_lsn() const {
+      return (m_begin_lsn);
+    }
+
   private:
     friend struct Journal;
     friend struct TxnFixture;
@@ -456,9 +466,18 @@ class LocalTransaction : public Transaction
       m_log_desc = desc;
     }
 
+    // Sets the lsn of the journal's txn_begin entry
+    void set_begin_lsn(uint64_t lsn) {
+      m_begin_lsn = lsn;
+    }
+
     // index of the log file descriptor for this transaction [0..1]
     int m_log_desc;
 
+    // the lsn of the txn_begin entry in the journal; 0 if the begin
+    // was not logged
+    uint64_t m_begin_lsn;
+
     // the linked list of operations - head is oldest operation
     TransactionOperation *m_oldest_op;
 
@@ -497,6 +516,10 @@ class LocalTransactionManager : public TransactionManager
     // Flushes committed (queued) transactions
     virtual void flush_committed_txns(Context *context = 0);
 
+    // Returns the lowest lsn of all Transactions which were not yet
+    // flushed, or 0 if there are none
+    uint64_t oldest_unflushed_lsn();
+
     // Increments the global transaction ID and returns the new value. 
     uint64_t get_incremented_txn_id() {
       return (++m_txn_id);
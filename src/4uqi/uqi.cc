@@ -136,9 +136,9 @@ uqi_select_range(ups_env_t *henv, const char *query, ups_cursor_t *begin,
     return (UPS_INV_PARAMETER);
   }
 
+  // the Environment is locked by |select_range()|, depending on whether
+  // the query has to open the Database or not
   Environment *env = (Environment *)henv;
-  ScopedLock lock(env->mutex());
-
   return (env->select_range(query,
                         (upscaledb::Cursor *)begin,
                         (upscaledb::Cursor *)end,
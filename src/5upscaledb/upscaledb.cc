@@ -26,7 +26,9 @@
 #include "1base/error.h"
 #include "1base/dynamic_array.h"
 #include "1globals/callbacks.h"
+#include "1globals/globals.h"
 #include "1mem/mem.h"
+#include "1os/file.h"
 #include "2config/db_config.h"
 #include "2config/env_config.h"
 #include "2page/page.h"
@@ -114,6 +116,20 @@ check_recno_key(ups_key_t *key, uint32_t flags)
   return (0);
 }
 
+// Releases the lock of a modifying operation. Without a Transaction the
+// operation was committed in a temporary Transaction; like ups_txn_commit,
+// it waits till it is durable after the Environment was unlocked, and the
+// commits of other threads can be synced in the same batch
+static inline ups_status_t
+finish_write(ScopedDatabaseWriteLock &lock, Database *db, Transaction *txn,
+                ups_status_t st)
+{
+  lock.unlock();
+  if (st == 0 && !txn)
+    st = db->get_env()->txn_sync();
+  return (st);
+}
+
 ups_status_t
 ups_txn_begin(ups_txn_t **htxn, ups_env_t *henv, const char *name,
                 void *, uint32_t flags)
@@ -267,6 +283,12 @@ ups_get_version(uint32_t *major, uint32_t *minor, uint32_t *revision)
     *revision = UPS_VERSION_REV;
 }
 
+void UPS_CALLCONV
+ups_set_cache_budget(uint64_t size)
+{
+  Globals::ms_cache_budget = size;
+}
+
 ups_status_t UPS_CALLCONV
 ups_env_create(ups_env_t **henv, const char *filename,
                 uint32_t flags, uint32_t mode, const ups_parameter_t *param)
@@ -355,7 +377,6 @@ ups_env_create(ups_env_t **henv, const char *filename,
         }
         ::memcpy(config.encryption_key, (uint8_t *)param->value, 16);
         config.is_encryption_enabled = true;
-        flags |= UPS_DISABLE_MMAP;
         break;
 #else
         ups_trace(("aes encryption was disabled at compile time"));
@@ -364,6 +385,80 @@ ups_env_create(ups_env_t **henv, const char *filename,
       case UPS_PARAM_POSIX_FADVISE:
         config.posix_advice = (int)param->value;
         break;
+      case UPS_PARAM_WORKER_THREADS:
+        if (param->value == 0) {
+          ups_trace(("invalid number of worker threads"));
+          return (UPS_INV_PARAMETER);
+        }
+        config.num_worker_threads = (uint32_t)param->value;
+        break;
+      case UPS_PARAM_CACHE_POLICY:
+        if (param->value != UPS_CACHE_POLICY_LRU
+            && param->value != UPS_CACHE_POLICY_2Q) {
+          ups_trace(("invalid cache policy %d", (int)param->value));
+          return (UPS_INV_PARAMETER);
+        }
+        config.cache_policy = (int)param->value;
+        break;
+      case UPS_PARAM_HUGE_PAGES:
+        config.use_huge_pages = param->value != 0;
+        break;
+      case UPS_PARAM_IO_QUEUE_DEPTH:
+        config.io_queue_depth = param->value > 1 ? (uint32_t)param->value : 0;
+        break;
+      case UPS_PARAM_DIRECT_IO:
+        config.use_direct_io = param->value != 0;
+        if (config.use_direct_io)
+          flags |= UPS_DISABLE_MMAP;
+        break;
+      case UPS_PARAM_READ_AHEAD:
+        config.read_ahead_pages = (uint32_t)param->value;
+        break;
+      case UPS_PARAM_CHECKSUM:
+        if (param->value != UPS_CHECKSUM_MURMUR3
+            && param->value != UPS_CHECKSUM_CRC32C) {
+          ups_trace(("unknown checksum algorithm"));
+          return (UPS_INV_PARAMETER);
+        }
+        config.checksum = (int)param->value;
+        break;
+      case UPS_PARAM_COLD_STORAGE_PATH:
+        if (param->value) {
+          config.cold_storage_path = (const char *)param->value;
+          flags |= UPS_DISABLE_MMAP;
+        }
+        break;
+      case UPS_PARAM_FAST_TIER_SIZE:
+        config.fast_tier_size_bytes = param->value;
+        break;
+      case UPS_PARAM_FILE_GROWTH_BYTES:
+        config.file_growth_bytes = param->value;
+        break;
+      case UPS_PARAM_COMPACTION_RATE:
+        config.compaction_rate = (uint32_t)param->value;
+        break;
+      case UPS_PARAM_JOURNAL_GROUP_COMMIT_WINDOW:
+        config.journal_group_commit_window = (uint32_t)param->value;
+        break;
+      case UPS_PARAM_JOURNAL_GROUP_COMMIT_BYTES:
+        config.journal_group_commit_bytes = (uint32_t)param->value;
+        break;
+      case UPS_PARAM_JOURNAL_SEGMENTS:
+        if (param->value < 2 || param->value > JournalState::kMaxSegments) {
+          ups_trace(("invalid number of journal segments"));
+          return (UPS_INV_PARAMETER);
+        }
+        config.journal_segments = (uint32_t)param->value;
+        break;
+      case UPS_PARAM_JOURNAL_SEGMENT_SIZE:
+        config.journal_segment_size = param->value;
+        break;
+      case UPS_PARAM_JOURNAL_CHECKPOINT_INTERVAL:
+        config.journal_checkpoint_interval = (uint32_t)param->value;
+        break;
+      case UPS_PARAM_JOURNAL_CHECKPOINT_BYTES:
+        config.journal_checkpoint_bytes = param->value;
+        break;
       default:
         ups_trace(("unknown parameter %d", (int)param->name));
         return (UPS_INV_PARAMETER);
@@ -376,6 +471,27 @@ ups_env_create(ups_env_t **henv, const char *filename,
     return (UPS_INV_PARAMETER);
   }
 
+  /* tiered storage requires a file */
+  if (!config.cold_storage_path.empty() && isset(flags, UPS_IN_MEMORY)) {
+    ups_trace(("combination of UPS_IN_MEMORY and UPS_PARAM_COLD_STORAGE_PATH "
+          "not allowed"));
+    return (UPS_INV_PARAMETER);
+  }
+
+  /* direct I/O requires aligned pages and is not possible in-memory */
+  if (config.use_direct_io) {
+    if (isset(flags, UPS_IN_MEMORY)) {
+      ups_trace(("combination of UPS_IN_MEMORY and UPS_PARAM_DIRECT_IO "
+            "not allowed"));
+      return (UPS_INV_PARAMETER);
+    }
+    if (config.page_size_bytes % File::kDirectIoAlignment != 0) {
+      ups_trace(("direct I/O requires a page size which is a multiple "
+                  "of %d", (int)File::kDirectIoAlignment));
+      return (UPS_INV_PAGESIZE);
+    }
+  }
+
   config.flags = flags;
 
   /*
@@ -526,6 +642,10 @@ ups_env_open(ups_env_t **henv, const char *filename, uint32_t flags,
         ups_trace(("Journal compression parameters are only allowed in "
                     "ups_env_create"));
         return (UPS_INV_PARAMETER);
+      case UPS_PARAM_CHECKSUM:
+        ups_trace(("the checksum algorithm can only be set in "
+                    "ups_env_create"));
+        return (UPS_INV_PARAMETER);
       case UPS_PARAM_CACHE_SIZE:
         /* don't allow cache limits with unlimited cache */
         if (isset(flags, UPS_CACHE_UNLIMITED) && param->value != 0) {
@@ -553,7 +673,6 @@ ups_env_open(ups_env_t **henv, const char *filename, uint32_t flags,
 #ifdef UPS_ENABLE_ENCRYPTION
         ::memcpy(config.encryption_key, (uint8_t *)param->value, 16);
         config.is_encryption_enabled = true;
-        flags |= UPS_DISABLE_MMAP;
         break;
 #else
         ups_trace(("aes encryption was disabled at compile time"));
@@ -562,6 +681,79 @@ ups_env_open(ups_env_t **henv, const char *filename, uint32_t flags,
       case UPS_PARAM_POSIX_FADVISE:
         config.posix_advice = (int)param->value;
         break;
+      case UPS_PARAM_WORKER_THREADS:
+        if (param->value == 0) {
+          ups_trace(("invalid number of worker threads"));
+          return (UPS_INV_PARAMETER);
+        }
+        config.num_worker_threads = (uint32_t)param->value;
+        break;
+      case UPS_PARAM_CACHE_POLICY:
+        if (param->value != UPS_CACHE_POLICY_LRU
+            && param->value != UPS_CACHE_POLICY_2Q) {
+          ups_trace(("invalid cache policy %d", (int)param->value));
+          return (UPS_INV_PARAMETER);
+        }
+        config.cache_policy = (int)param->value;
+        break;
+      case UPS_PARAM_HUGE_PAGES:
+        config.use_huge_pages = param->value != 0;
+        break;
+      case UPS_PARAM_IO_QUEUE_DEPTH:
+        config.io_queue_depth = param->value > 1 ? (uint32_t)param->value : 0;
+        break;
+      case UPS_PARAM_DIRECT_IO:
+        config.use_direct_io = param->value != 0;
+        if (config.use_direct_io)
+          flags |= UPS_DISABLE_MMAP;
+        break;
+      case UPS_PARAM_READ_AHEAD:
+        config.read_ahead_pages = (uint32_t)param->value;
+        break;
+      case UPS_PARAM_COLD_STORAGE_PATH:
+        if (param->value) {
+          config.cold_storage_path = (const char *)param->value;
+          flags |= UPS_DISABLE_MMAP;
+        }
+        break;
+      case UPS_PARAM_FAST_TIER_SIZE:
+        config.fast_tier_size_bytes = param->value;
+        break;
+      case UPS_PARAM_FILE_GROWTH_BYTES:
+        config.file_growth_bytes = param->value;
+        break;
+      case UPS_PARAM_COMPACTION_RATE:
+        config.compaction_rate = (uint32_t)param->value;
+        break;
+      case UPS_PARAM_JOURNAL_GROUP_COMMIT_WINDOW:
+        config.journal_group_commit_window = (uint32_t)param->value;
+        break;
+      case UPS_PARAM_JOURNAL_GROUP_COMMIT_BYTES:
+        config.journal_group_commit_bytes = (uint32_t)param->value;
+        break;
+      case UPS_PARAM_JOURNAL_SEGMENTS:
+        if (param->value < 2 || param->value > JournalState::kMaxSegments) {
+          ups_trace(("invalid number of journal segments"));
+          return (UPS_INV_PARAMETER);
+        }
+        config.journal_segments = (uint32_t)param->value;
+        break;
+      case UPS_PARAM_JOURNAL_SEGMENT_SIZE:
+        config.journal_segment_size = param->value;
+        break;
+      case UPS_PARAM_JOURNAL_CHECKPOINT_INTERVAL:
+        config.journal_checkpoint_interval = (uint32_t)param->value;
+        break;
+      case UPS_PARAM_JOURNAL_CHECKPOINT_BYTES:
+        config.journal_checkpoint_bytes = param->value;
+        break;
+      case UPS_PARAM_RECOVERY_PROGRESS_CALLBACK:
+        config.recovery_progress_callback
+                = (ups_recovery_progress_fun)param->value;
+        break;
+      case UPS_PARAM_RECOVERY_PROGRESS_CONTEXT:
+        config.recovery_progress_context = (void *)param->value;
+        break;
       default:
         ups_trace(("unknown parameter %d", (int)param->name));
         return (UPS_INV_PARAMETER);
@@ -687,6 +879,22 @@ ups_env_get_parameters(ups_env_t *henv, ups_parameter_t *param)
   return (env->get_parameters(param));
 }
 
+ups_status_t UPS_CALLCONV
+ups_env_set_parameters(ups_env_t *henv, const ups_parameter_t *param)
+{
+  Environment *env = (Environment *)henv;
+  if (unlikely(!env)) {
+    ups_trace(("parameter 'env' must not be NULL"));
+    return (UPS_INV_PARAMETER);
+  }
+  if (unlikely(!param)) {
+    ups_trace(("parameter 'param' must not be NULL"));
+    return (UPS_INV_PARAMETER);
+  }
+
+  return (env->set_parameters(param));
+}
+
 ups_status_t UPS_CALLCONV
 ups_env_flush(ups_env_t *henv, uint32_t flags)
 {
@@ -744,7 +952,7 @@ ups_db_get_parameters(ups_db_t *hdb, ups_parameter_t *param)
     return UPS_INV_PARAMETER;
   }
 
-  ScopedLock lock(db->get_env()->mutex());
+  ScopedDatabaseReadLock lock(db);
 
   /* get the parameters */
   return (db->get_parameters(param));
@@ -777,7 +985,7 @@ ups_db_set_compare_func(ups_db_t *hdb, ups_compare_func_t foo)
     return (UPS_INV_PARAMETER); 
   }
 
-  ScopedLock lock(ldb->get_env()->mutex());
+  ScopedDatabaseWriteLock lock(ldb);
 
   /* set the compare functions */
   return (ldb->set_compare_func(foo));
@@ -805,8 +1013,7 @@ ups_db_find(ups_db_t *hdb, ups_txn_t *htxn, ups_key_t *key,
   if (unlikely(!prepare_key(key) || !prepare_record(record)))
     return (UPS_INV_PARAMETER);
 
-  Environment *env = db->get_env();
-  ScopedLock lock(env->mutex());
+  ScopedDatabaseReadLock lock(db);
 
   if (unlikely(issetany(db->get_flags(),
         (UPS_RECORD_NUMBER32 | UPS_RECORD_NUMBER64)))
@@ -873,10 +1080,7 @@ ups_db_insert(ups_db_t *hdb, ups_txn_t *htxn, ups_key_t *key,
   if (unlikely(!prepare_key(key) || !prepare_record(record)))
     return (UPS_INV_PARAMETER);
 
-  Environment *env = db->get_env();
-  ScopedLock lock;
-  if (!(flags & UPS_DONT_LOCK))
-    lock = ScopedLock(env->mutex());
+  ScopedDatabaseWriteLock lock(db, !(flags & UPS_DONT_LOCK));
 
   if (unlikely(isset(db->get_flags(), UPS_READ_ONLY))) {
     ups_trace(("cannot insert in a read-only database"));
@@ -895,7 +1099,8 @@ ups_db_insert(ups_db_t *hdb, ups_txn_t *htxn, ups_key_t *key,
       return (st);
   }
 
-  return (db->insert(0, txn, key, record, flags));
+  return (finish_write(lock, db, txn,
+                db->insert(0, txn, key, record, flags)));
 }
 
 UPS_EXPORT ups_status_t UPS_CALLCONV
@@ -915,17 +1120,14 @@ ups_db_erase(ups_db_t *hdb, ups_txn_t *htxn, ups_key_t *key, uint32_t flags)
   if (unlikely(!prepare_key(key)))
     return (UPS_INV_PARAMETER);
 
-  Environment *env = db->get_env();
-  ScopedLock lock;
-  if (!(flags & UPS_DONT_LOCK))
-    lock = ScopedLock(env->mutex());
+  ScopedDatabaseWriteLock lock(db, !(flags & UPS_DONT_LOCK));
 
   if (unlikely(isset(db->get_flags(), UPS_READ_ONLY))) {
     ups_trace(("cannot erase from a read-only database"));
     return (UPS_WRITE_PROTECTED);
   }
 
-  return (db->erase(0, txn, key, flags));
+  return (finish_write(lock, db, txn, db->erase(0, txn, key, flags)));
 }
 
 UPS_EXPORT ups_status_t UPS_CALLCONV
@@ -942,7 +1144,7 @@ ups_db_check_integrity(ups_db_t *hdb, uint32_t flags)
     return (UPS_INV_PARAMETER);
   }
 
-  ScopedLock lock(db->get_env()->mutex());
+  ScopedDatabaseReadLock lock(db);
   return (db->check_integrity(flags));
 }
 
@@ -990,10 +1192,7 @@ ups_cursor_create(ups_cursor_t **hcursor, ups_db_t *hdb, ups_txn_t *htxn,
     return (UPS_INV_PARAMETER);
   }
 
-  Environment *env = db->get_env();
-  ScopedLock lock;
-  if (!(flags & UPS_DONT_LOCK))
-    lock = ScopedLock(env->mutex());
+  ScopedDatabaseWriteLock lock(db, !(flags & UPS_DONT_LOCK));
 
   return (db->cursor_create(cursor, txn, flags));
 }
@@ -1014,7 +1213,7 @@ ups_cursor_clone(ups_cursor_t *hsrc, ups_cursor_t **hdest)
   }
 
   Database *db = src->db();
-  ScopedLock lock(db->get_env()->mutex());
+  ScopedDatabaseWriteLock lock(db);
   return (db->cursor_clone(dest, src));
 }
 
@@ -1041,14 +1240,15 @@ ups_cursor_overwrite(ups_cursor_t *hcursor, ups_record_t *record,
     return (UPS_INV_PARAMETER);
 
   Database *db = cursor->db();
-  ScopedLock lock(db->get_env()->mutex());
+  ScopedDatabaseWriteLock lock(db);
 
   if (unlikely(isset(db->get_flags(), UPS_READ_ONLY))) {
     ups_trace(("cannot overwrite in a read-only database"));
     return (UPS_WRITE_PROTECTED);
   }
 
-  return (cursor->overwrite(record, flags));
+  return (finish_write(lock, db, cursor->get_txn(),
+                cursor->overwrite(record, flags)));
 }
 
 ups_status_t UPS_CALLCONV
@@ -1073,8 +1273,7 @@ ups_cursor_move(ups_cursor_t *hcursor, ups_key_t *key,
     return (UPS_INV_PARAMETER);
 
   Database *db = cursor->db();
-  Environment *env = db->get_env();
-  ScopedLock lock(env->mutex());
+  ScopedDatabaseReadLock lock(db);
 
   return (db->cursor_move(cursor, key, record, flags));
 }
@@ -1099,10 +1298,7 @@ ups_cursor_find(ups_cursor_t *hcursor, ups_key_t *key, ups_record_t *record,
     return (UPS_INV_PARAMETER);
 
   Database *db = cursor->db();
-  Environment *env = db->get_env();
-  ScopedLock lock;
-  if (!(flags & UPS_DONT_LOCK))
-    lock = ScopedLock(env->mutex());
+  ScopedDatabaseReadLock lock(db, !(flags & UPS_DONT_LOCK));
 
   return (db->find(cursor, cursor->get_txn(), key, record, flags));
 }
@@ -1138,7 +1334,7 @@ ups_cursor_insert(ups_cursor_t *hcursor, ups_key_t *key, ups_record_t *record,
     return (UPS_INV_PARAMETER);
 
   Database *db = cursor->db();
-  ScopedLock lock(db->get_env()->mutex());
+  ScopedDatabaseWriteLock lock(db);
 
   if (unlikely(isset(db->get_flags(), UPS_READ_ONLY))) {
     ups_trace(("cannot insert to a read-only database"));
@@ -1167,7 +1363,8 @@ ups_cursor_insert(ups_cursor_t *hcursor, ups_key_t *key, ups_record_t *record,
       return (st);
   }
 
-  return (db->insert(cursor, cursor->get_txn(), key, record, flags));
+  return (finish_write(lock, db, cursor->get_txn(),
+                db->insert(cursor, cursor->get_txn(), key, record, flags)));
 }
 
 ups_status_t UPS_CALLCONV
@@ -1181,14 +1378,15 @@ ups_cursor_erase(ups_cursor_t *hcursor, uint32_t flags)
   }
 
   Database *db = cursor->db();
-  ScopedLock lock(db->get_env()->mutex());
+  ScopedDatabaseWriteLock lock(db);
 
   if (isset(db->get_flags(), UPS_READ_ONLY)) {
     ups_trace(("cannot erase from a read-only database"));
     return (UPS_WRITE_PROTECTED);
   }
 
-  return (db->erase(cursor, cursor->get_txn(), 0, flags));
+  return (finish_write(lock, db, cursor->get_txn(),
+                db->erase(cursor, cursor->get_txn(), 0, flags)));
 }
 
 ups_status_t UPS_CALLCONV
@@ -1207,7 +1405,7 @@ ups_cursor_get_duplicate_count(ups_cursor_t *hcursor, uint32_t *count,
   }
 
   Database *db = cursor->db();
-  ScopedLock lock(db->get_env()->mutex());
+  ScopedDatabaseReadLock lock(db);
 
   return (cursor->get_duplicate_count(flags, count));
 }
@@ -1227,7 +1425,7 @@ ups_cursor_get_duplicate_position(ups_cursor_t *hcursor, uint32_t *position)
   }
 
   Database *db = cursor->db();
-  ScopedLock lock(db->get_env()->mutex());
+  ScopedDatabaseReadLock lock(db);
 
   return (cursor->get_duplicate_position(position));
 }
@@ -1247,7 +1445,7 @@ ups_cursor_get_record_size(ups_cursor_t *hcursor, uint32_t *size)
   }
 
   Database *db = cursor->db();
-  ScopedLock lock(db->get_env()->mutex());
+  ScopedDatabaseReadLock lock(db);
 
   return (cursor->get_record_size(size));
 }
@@ -1263,7 +1461,7 @@ ups_cursor_close(ups_cursor_t *hcursor)
   }
 
   Database *db = cursor->db();
-  ScopedLock lock(db->get_env()->mutex());
+  ScopedDatabaseWriteLock lock(db);
 
   return (db->cursor_close(cursor));
 }
@@ -1275,7 +1473,7 @@ ups_set_context_data(ups_db_t *hdb, void *data)
   if (unlikely(!db))
     return;
 
-  ScopedLock lock(db->get_env()->mutex());
+  ScopedDatabaseWriteLock lock(db);
   db->set_context_data(data);
 }
 
@@ -1289,7 +1487,7 @@ ups_get_context_data(ups_db_t *hdb, ups_bool_t dont_lock)
   if (dont_lock)
     return (db->get_context_data());
 
-  ScopedLock lock(db->get_env()->mutex());
+  ScopedDatabaseReadLock lock(db);
   return (db->get_context_data());
 }
 
@@ -1329,7 +1527,7 @@ ups_db_count(ups_db_t *hdb, ups_txn_t *htxn, uint32_t flags,
     return (UPS_INV_PARAMETER);
   }
 
-  ScopedLock lock(db->get_env()->mutex());
+  ScopedDatabaseReadLock lock(db);
 
   return (db->count(txn, (flags & UPS_SKIP_DUPLICATES) != 0, count));
 }
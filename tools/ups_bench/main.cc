@@ -969,8 +969,22 @@ print_metrics(Metrics *metrics, Configuration *conf)
           (long unsigned int)metrics->upscaledb_metrics.mem_peak_usage);
   printf("\tupscaledb page_count_fetched          %lu\n",
           (long unsigned int)metrics->upscaledb_metrics.page_count_fetched);
+  printf("\tupscaledb page_count_prefetched       %lu\n",
+          (long unsigned int)metrics->upscaledb_metrics.page_count_prefetched);
+  printf("\tupscaledb tiered_cold_pages           %lu\n",
+          (long unsigned int)metrics->upscaledb_metrics.tiered_cold_pages);
+  printf("\tupscaledb tiered_pages_demoted         %lu\n",
+          (long unsigned int)metrics->upscaledb_metrics.tiered_pages_demoted);
+  printf("\tupscaledb tiered_pages_promoted        %lu\n",
+          (long unsigned int)metrics->upscaledb_metrics.tiered_pages_promoted);
+  printf("\tupscaledb page_count_relocated        %lu\n",
+          (long unsigned int)metrics->upscaledb_metrics.page_count_relocated);
   printf("\tupscaledb page_count_flushed          %lu\n",
           (long unsigned int)metrics->upscaledb_metrics.page_count_flushed);
+  printf("\tupscaledb page_flush_writes           %lu\n",
+          (long unsigned int)metrics->upscaledb_metrics.page_flush_writes);
+  printf("\tupscaledb page_flush_merge_ratio      %f\n",
+          metrics->upscaledb_metrics.page_flush_merge_ratio);
   printf("\tupscaledb page_count_type_index       %lu\n",
           (long unsigned int)metrics->upscaledb_metrics.page_count_type_index);
   printf("\tupscaledb page_count_type_blob        %lu\n",
@@ -985,6 +999,30 @@ print_metrics(Metrics *metrics, Configuration *conf)
           (long unsigned int)metrics->upscaledb_metrics.cache_hits);
   printf("\tupscaledb cache_misses                %lu\n",
           (long unsigned int)metrics->upscaledb_metrics.cache_misses);
+  printf("\tupscaledb cache_shards                %u\n",
+          metrics->upscaledb_metrics.cache_shards);
+  printf("\tupscaledb cache_hits_index            %lu\n",
+          (long unsigned int)metrics->upscaledb_metrics.cache_hits_index);
+  printf("\tupscaledb cache_misses_index          %lu\n",
+          (long unsigned int)metrics->upscaledb_metrics.cache_misses_index);
+  printf("\tupscaledb cache_hits_blob             %lu\n",
+          (long unsigned int)metrics->upscaledb_metrics.cache_hits_blob);
+  printf("\tupscaledb cache_misses_blob           %lu\n",
+          (long unsigned int)metrics->upscaledb_metrics.cache_misses_blob);
+  printf("\tupscaledb cache_hits_page_manager     %lu\n",
+          (long unsigned int)metrics->upscaledb_metrics.cache_hits_page_manager);
+  printf("\tupscaledb cache_misses_page_manager   %lu\n",
+          (long unsigned int)metrics->upscaledb_metrics.cache_misses_page_manager);
+  printf("\tupscaledb cache_evictions_clean       %lu\n",
+          (long unsigned int)metrics->upscaledb_metrics.cache_evictions_clean);
+  printf("\tupscaledb cache_evictions_dirty       %lu\n",
+          (long unsigned int)metrics->upscaledb_metrics.cache_evictions_dirty);
+  printf("\tupscaledb cache_eviction_avg_age      %lu\n",
+          (long unsigned int)metrics->upscaledb_metrics.cache_eviction_avg_age);
+  printf("\tupscaledb cache_hit_ratio_double      %f\n",
+          metrics->upscaledb_metrics.cache_hit_ratio_double);
+  printf("\tupscaledb cache_hit_ratio_half        %f\n",
+          metrics->upscaledb_metrics.cache_hit_ratio_half);
   printf("\tupscaledb blob_total_allocated        %lu\n",
           (long unsigned int)metrics->upscaledb_metrics.blob_total_allocated);
   printf("\tupscaledb blob_total_read             %lu\n",
@@ -999,8 +1037,26 @@ print_metrics(Metrics *metrics, Configuration *conf)
           (long unsigned int)metrics->upscaledb_metrics.extended_duptables);
   printf("\tupscaledb journal_bytes_flushed       %lu\n",
           (long unsigned int)metrics->upscaledb_metrics.journal_bytes_flushed);
+  printf("\tupscaledb journal_group_commits       %lu\n",
+          (long unsigned int)metrics->upscaledb_metrics.journal_group_commits);
+  printf("\tupscaledb journal_segments            %u\n",
+          metrics->upscaledb_metrics.journal_segments);
+  printf("\tupscaledb journal_segments_recycled   %lu\n",
+          (long unsigned int)metrics->upscaledb_metrics.journal_segments_recycled);
+  printf("\tupscaledb journal_segment_overflows   %lu\n",
+          (long unsigned int)metrics->upscaledb_metrics.journal_segment_overflows);
+  printf("\tupscaledb journal_checkpoints         %lu\n",
+          (long unsigned int)metrics->upscaledb_metrics.journal_checkpoints);
+  printf("\tupscaledb journal_page_bytes_before_delta %lu\n",
+          (long unsigned int)metrics->upscaledb_metrics.journal_page_bytes_before_delta);
+  printf("\tupscaledb journal_page_bytes_after_delta %lu\n",
+          (long unsigned int)metrics->upscaledb_metrics.journal_page_bytes_after_delta);
   printf("\tupscaledb simd_lane_width             %d\n",
           metrics->upscaledb_metrics.simd_lane_width);
+  printf("\tupscaledb worker_threads              %u\n",
+          metrics->upscaledb_metrics.worker_threads);
+  printf("\tupscaledb worker_max_queue_depth      %lu\n",
+          (long unsigned int)metrics->upscaledb_metrics.worker_max_queue_depth);
 }
 
 struct Callable
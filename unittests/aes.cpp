@@ -17,11 +17,15 @@
 
 #include <string.h>
 #include <assert.h>
+#include <algorithm>
+#include <vector>
 
 #include "3rdparty/catch/catch.hpp"
 
 #include "utils.h"
 
+#include "1os/file.h"
+#include "2device/device_disk.h"
 #include "4env/env_local.h"
 
 using namespace upscaledb;
@@ -39,9 +43,10 @@ TEST_CASE("Aes/disabledIfInMemory", "")
                   UPS_IN_MEMORY, 0644, p));
 }
 
-TEST_CASE("Aes/disableMmap", "")
+TEST_CASE("Aes/mmap", "")
 {
   ups_env_t *env;
+  ups_db_t *db;
   ups_parameter_t p[] = {
           { UPS_PARAM_ENCRYPTION_KEY, (uint64_t)"foo" },
           { 0, 0 }
@@ -52,15 +57,126 @@ TEST_CASE("Aes/disableMmap", "")
   };
 
   REQUIRE(0 == ups_env_create(&env, Utils::opath("test.db"), 0, 0644, p));
-  REQUIRE((((Environment *)env)->get_flags() & UPS_DISABLE_MMAP) != 0);
+  REQUIRE((((Environment *)env)->get_flags() & UPS_DISABLE_MMAP) == 0);
+  REQUIRE(0 == ups_env_create_db(env, &db, 1, 0, 0));
+
+  // the record is stored in a blob
+  char buffer[1024];
+  ::memset(buffer, 'x', sizeof(buffer));
+  ups_key_t key = ups_make_key((void *)"key", 4);
+  ups_record_t rec = ups_make_record(buffer, sizeof(buffer));
+  REQUIRE(0 == ups_db_insert(db, 0, &key, &rec, 0));
   REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
 
+  // the file does not contain the plaintext
+  File f;
+  f.open(Utils::opath("test.db"), true);
+  std::vector<char> data((size_t)f.file_size());
+  f.pread(0, &data[0], data.size());
+  f.close();
+  REQUIRE(std::search(data.begin(), data.end(), buffer, buffer + 16)
+                  == data.end());
+
   REQUIRE(UPS_INV_FILE_HEADER ==
                   ups_env_open(&env, Utils::opath("test.db"), 0, 0));
   REQUIRE(UPS_INV_FILE_HEADER ==
                   ups_env_open(&env, Utils::opath("test.db"), 0, bad));
+
+  // the pages are decrypted from the mapped file
+  REQUIRE(0 == ups_env_open(&env, Utils::opath("test.db"), 0, p));
+  REQUIRE((((Environment *)env)->get_flags() & UPS_DISABLE_MMAP) == 0);
+  DiskDevice *device = (DiskDevice *)((LocalEnvironment *)env)->device();
+  REQUIRE(device->mapped_segments() > 0);
+  REQUIRE(device->is_mapped(0, 16) == false);
+
+  REQUIRE(0 == ups_env_open_db(env, &db, 1, 0, 0));
+  ups_record_t rec2 = {0};
+  REQUIRE(0 == ups_db_find(db, 0, &key, &rec2, 0));
+  REQUIRE(rec2.size == sizeof(buffer));
+  REQUIRE(0 == ::memcmp(rec2.data, buffer, sizeof(buffer)));
+  REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+}
+
+TEST_CASE("Aes/cbcFile", "")
+{
+  ups_env_t *env;
+  static const uint8_t key[16] = {
+    '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 0
+  };
+  ups_parameter_t p[] = {
+          { UPS_PARAM_ENCRYPTION_KEY, (uint64_t)&key[0] },
+          { 0, 0 }
+  };
+  ups_parameter_t bad[] = {
+          { UPS_PARAM_ENCRYPTION_KEY, (uint64_t)"bar" },
+          { 0, 0 }
+  };
+
+  // new files record the cipher mode and require the new file version
+  REQUIRE(0 == ups_env_create(&env, Utils::opath("test.db"), 0, 0644, p));
+  REQUIRE(UPS_FILE_VERSION == ((LocalEnvironment *)env)->header()->version(3));
+  REQUIRE(((LocalEnvironment *)env)->header()->is_aes_xts());
+  REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+
+  // encrypt a file in CBC mode, like earlier releases
+  ups_db_t *db;
+  char buffer[1024];
+  ::memset(buffer, 'x', sizeof(buffer));
+  ups_record_t rec = ups_make_record(buffer, sizeof(buffer));
+  REQUIRE(0 == ups_env_create(&env, Utils::opath("test.db"), 0, 0644, 0));
+  uint32_t page_size = ((LocalEnvironment *)env)->config().page_size_bytes;
+  REQUIRE(0 == ups_env_create_db(env, &db, 1, 0, 0));
+  for (int i = 0; i < 10; i++) {
+    ups_key_t k = ups_make_key(&i, sizeof(i));
+    REQUIRE(0 == ups_db_insert(db, 0, &k, &rec, 0));
+  }
+  REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+
+  File f;
+  f.open(Utils::opath("test.db"), false);
+  std::vector<uint8_t> data((size_t)f.file_size());
+  f.pread(0, &data[0], data.size());
+  for (size_t address = 0; address < data.size(); address += page_size) {
+    uint64_t iv[2] = {address, 0};
+    int len = (int)page_size;
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    EVP_EncryptInit_ex(ctx, EVP_aes_128_cbc(), 0, key, (uint8_t *)&iv[0]);
+    EVP_CIPHER_CTX_set_padding(ctx, 0);
+    EVP_EncryptUpdate(ctx, &data[address], &len, &data[address], len);
+    EVP_CIPHER_CTX_free(ctx);
+  }
+  f.pwrite(0, &data[0], data.size());
+  f.close();
+
+  // a wrong key is still reported as such
+  REQUIRE(UPS_INV_FILE_HEADER ==
+                  ups_env_open(&env, Utils::opath("test.db"), 0, bad));
+
+  // such files are read and written in CBC mode
+  REQUIRE(0 == ups_env_open(&env, Utils::opath("test.db"), 0, p));
+  REQUIRE(((LocalEnvironment *)env)->config().is_encryption_cbc);
+  REQUIRE(0 == ups_env_open_db(env, &db, 1, 0, 0));
+  for (int i = 0; i < 20; i++) {
+    ups_key_t k = ups_make_key(&i, sizeof(i));
+    if (i >= 10)
+      REQUIRE(0 == ups_db_insert(db, 0, &k, &rec, 0));
+    ups_record_t rec2 = {0};
+    REQUIRE(0 == ups_db_find(db, 0, &k, &rec2, 0));
+    REQUIRE(rec2.size == sizeof(buffer));
+    REQUIRE(0 == ::memcmp(rec2.data, buffer, sizeof(buffer)));
+  }
+  REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+
   REQUIRE(0 == ups_env_open(&env, Utils::opath("test.db"), 0, p));
-  REQUIRE((((Environment *)env)->get_flags() & UPS_DISABLE_MMAP) != 0);
+  REQUIRE(((LocalEnvironment *)env)->config().is_encryption_cbc);
+  REQUIRE(!((LocalEnvironment *)env)->header()->is_aes_xts());
+  REQUIRE(0 == ups_env_open_db(env, &db, 1, 0, 0));
+  for (int i = 0; i < 20; i++) {
+    ups_key_t k = ups_make_key(&i, sizeof(i));
+    ups_record_t rec2 = {0};
+    REQUIRE(0 == ups_db_find(db, 0, &k, &rec2, 0));
+    REQUIRE(rec2.size == sizeof(buffer));
+  }
   REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
 }
 
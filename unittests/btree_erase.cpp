@@ -20,7 +20,12 @@
 #include "utils.h"
 #include "os.hpp"
 
-#include "4db/db.h"
+#include "3btree/btree_index.h"
+#include "4context/context.h"
+#include "4db/db_local.h"
+#include "4env/env_local.h"
+
+using namespace upscaledb;
 
 struct BtreeEraseFixture {
   ups_db_t *m_db;
@@ -77,6 +82,15 @@ struct BtreeEraseFixture {
     }
   }
 
+  // Returns the number of nodes in the btree
+  size_t node_count() {
+    LocalDatabase *db = (LocalDatabase *)m_db;
+    Context context(db->lenv(), 0, db);
+    BtreeNodeMap nodes;
+    db->btree_index()->collect_nodes(&context, 0, &nodes);
+    return nodes.size();
+  }
+
   void collapseRootTest() {
     ups_key_t key = {};
 
@@ -152,6 +166,63 @@ struct BtreeEraseFixture {
       REQUIRE(0 == ups_db_erase(m_db, 0, &key, 0));
     }
   }
+
+  void reclaimEmptyLeavesTest(bool use_cursor) {
+    ups_key_t key = {};
+    ups_record_t rec = {};
+    ups_env_metrics_t metrics;
+
+    prepare(2000);
+
+    REQUIRE(0 == ups_env_get_metrics(m_env, &metrics));
+    size_t nodes = node_count();
+    uint64_t merges = metrics.btree_smo_merge;
+
+    // erase all keys but the last 10
+    char buffer[80] = {0};
+    key.data = &buffer[0];
+    key.size = sizeof(buffer);
+    ups_cursor_t *cursor;
+    REQUIRE(0 == ups_cursor_create(&cursor, m_db, 0, 0));
+    for (int i = 0; i < 19900; i += 10) {
+      *(int *)&buffer[0] = i;
+      if (use_cursor) {
+        REQUIRE(0 == ups_cursor_find(cursor, &key, 0, 0));
+        REQUIRE(0 == ups_cursor_erase(cursor, 0));
+      }
+      else
+        REQUIRE(0 == ups_db_erase(m_db, 0, &key, 0));
+    }
+    REQUIRE(0 == ups_cursor_close(cursor));
+
+    // the empty leaves were removed, and the tree shrunk
+    REQUIRE(0 == ups_env_get_metrics(m_env, &metrics));
+    REQUIRE(metrics.btree_smo_merge > merges);
+    REQUIRE(node_count() < nodes / 10);
+    REQUIRE(0 == ups_db_check_integrity(m_db, 0));
+
+    for (int i = 0; i < 20000; i += 10) {
+      *(int *)&buffer[0] = i;
+      key.data = &buffer[0];
+      key.size = sizeof(buffer);
+      REQUIRE((i < 19900 ? UPS_KEY_NOT_FOUND : 0)
+                      == ups_db_find(m_db, 0, &key, &rec, 0));
+    }
+
+    // the tree is still usable
+    for (int i = 0; i < 19900; i += 10) {
+      *(int *)&buffer[0] = i;
+      rec.data = &buffer[0];
+      rec.size = sizeof(buffer);
+      REQUIRE(0 == ups_db_insert(m_db, 0, &key, &rec, 0));
+    }
+    REQUIRE(0 == ups_db_check_integrity(m_db, 0));
+    for (int i = 0; i < 20000; i += 10) {
+      *(int *)&buffer[0] = i;
+      REQUIRE(0 == ups_db_find(m_db, 0, &key, &rec, 0));
+      REQUIRE(i == *(int *)rec.data);
+    }
+  }
 };
 
 TEST_CASE("BtreeErase/collapseRootTest", "")
@@ -179,6 +250,18 @@ TEST_CASE("BtreeErase/mergeWithLeftTest", "")
 }
 
 
+TEST_CASE("BtreeErase/reclaimEmptyLeavesTest", "")
+{
+  BtreeEraseFixture f;
+  f.reclaimEmptyLeavesTest(false);
+}
+
+TEST_CASE("BtreeErase/reclaimEmptyLeavesWithCursorTest", "")
+{
+  BtreeEraseFixture f;
+  f.reclaimEmptyLeavesTest(true);
+}
+
 TEST_CASE("BtreeErase-inmem/collapseRootTest", "")
 {
   BtreeEraseFixture f(UPS_IN_MEMORY);
@@ -203,3 +286,14 @@ TEST_CASE("BtreeErase-inmem/mergeWithLeftTest", "")
   f.mergeWithLeftTest();
 }
 
+TEST_CASE("BtreeErase-inmem/reclaimEmptyLeavesTest", "")
+{
+  BtreeEraseFixture f(UPS_IN_MEMORY);
+  f.reclaimEmptyLeavesTest(false);
+}
+
+TEST_CASE("BtreeErase-inmem/reclaimEmptyLeavesWithCursorTest", "")
+{
+  BtreeEraseFixture f(UPS_IN_MEMORY);
+  f.reclaimEmptyLeavesTest(true);
+}
@@ -124,5 +124,65 @@ TEST_CASE("Changeset/clear",
     delete page[i];
 }
 
+TEST_CASE("Changeset/readOnly",
+          "Read-only Changesets lock pages in shared mode")
+{
+  ChangesetFixture f;
+  Changeset ch1((LocalEnvironment *)f.m_env, true);
+  Changeset ch2((LocalEnvironment *)f.m_env, true);
+  Page *page[3];
+  for (int i = 0; i < 3; i++) {
+    page[i] = new Page(((LocalEnvironment *)f.m_env)->device());
+    page[i]->set_address(1024 * i);
+  }
+
+  // the same page can be added to several read-only Changesets
+  for (int i = 0; i < 3; i++) {
+    ch1.put(page[i]);
+    ch2.put(page[i]);
+    REQUIRE(true == ch1.has(page[i]));
+    REQUIRE(true == ch2.has(page[i]));
+    REQUIRE((Page *)NULL == page[i]->next(Page::kListChangeset));
+  }
+
+  // ... but then the page cannot be locked exclusively
+  REQUIRE(false == ch1.is_empty());
+  REQUIRE(false == page[0]->mutex().try_lock());
+  ch1.clear();
+  REQUIRE(true == ch1.is_empty());
+  REQUIRE(false == page[0]->mutex().try_lock());
+  ch2.clear();
+  REQUIRE(true == page[0]->mutex().try_lock());
+  page[0]->mutex().unlock();
+
+  for (int i = 0; i < 3; i++)
+    delete page[i];
+}
+
+TEST_CASE("Changeset/tryPut",
+          "try_put() does not block if the page is locked")
+{
+  ChangesetFixture f;
+  Changeset ch((LocalEnvironment *)f.m_env);
+  Changeset ro((LocalEnvironment *)f.m_env, true);
+  Page *page = new Page(((LocalEnvironment *)f.m_env)->device());
+  page->set_address(1024);
+
+  // a page which is locked by another Changeset is not added
+  REQUIRE(true == ch.try_put(page));
+  REQUIRE(true == ch.try_put(page));
+  REQUIRE(false == ro.try_put(page));
+  REQUIRE(true == ro.is_empty());
+  ch.clear();
+
+  REQUIRE(true == ro.try_put(page));
+  REQUIRE(true == ro.has(page));
+  REQUIRE(false == ch.try_put(page));
+  REQUIRE(true == ch.is_empty());
+  ro.clear();
+
+  delete page;
+}
+
 } // namespace upscaledb
 
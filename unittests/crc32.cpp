@@ -17,13 +17,15 @@
 
 #include <string.h>
 #include <assert.h>
+#include <vector>
 
 #include "3rdparty/catch/catch.hpp"
 
 #include "utils.h"
 
+#include "1base/checksum.h"
 #include "1os/file.h"
-#include "4env/env.h"
+#include "4env/env_local.h"
 
 using namespace upscaledb;
 
@@ -174,3 +176,111 @@ TEST_CASE("Crc32/corruptMultipageBlobTest", "")
   free(buffer);
 }
 
+
+// bitwise CRC32C, used as reference
+static uint32_t
+slowCrc32c(uint32_t crc, const uint8_t *p, size_t len)
+{
+  crc = ~crc;
+  while (len--) {
+    crc ^= *p++;
+    for (int k = 0; k < 8; k++)
+      crc = crc & 1 ? (crc >> 1) ^ 0x82f63b78 : crc >> 1;
+  }
+  return ~crc;
+}
+
+TEST_CASE("Crc32/crc32c", "")
+{
+  REQUIRE(0xe3069283u == Checksum::crc32c(0, "123456789", 9));
+  REQUIRE(0u == Checksum::crc32c(0, "", 0));
+
+  std::vector<uint8_t> buffer(1024 * 20);
+  for (size_t i = 0; i < buffer.size(); i++)
+    buffer[i] = (uint8_t)(i * 7 + (i >> 8));
+
+  // all alignments, and lengths which do (not) fill the interleaved streams
+  size_t lengths[] = {1, 7, 8, 255, 767, 768, 769, 1024 * 16 - 3, 1024 * 20 - 8};
+  for (size_t offset = 0; offset < 8; offset++) {
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+      size_t len = lengths[i];
+      if (offset + len > buffer.size())
+        continue;
+      uint32_t expected = slowCrc32c(0x1234, &buffer[offset], len);
+      REQUIRE(expected == Checksum::crc32c(0x1234, &buffer[offset], len));
+    }
+  }
+
+  // checksums can be continued
+  uint32_t crc = Checksum::crc32c(0, &buffer[0], 1000);
+  crc = Checksum::crc32c(crc, &buffer[1000], buffer.size() - 1000);
+  REQUIRE(crc == Checksum::crc32c(0, &buffer[0], buffer.size()));
+}
+
+static void
+createChecksumEnv(const ups_parameter_t *params, uint8_t file_version,
+                uint64_t algorithm)
+{
+  ups_env_t *env;
+  ups_db_t *db;
+  ups_key_t key = ups_make_key((void *)"1", 1);
+  ups_record_t rec = {0};
+
+  REQUIRE(0 == ups_env_create(&env, Utils::opath("test.db"),
+                  UPS_ENABLE_CRC32, 0644, params));
+  REQUIRE(0 == ups_env_create_db(env, &db, 1, 0, 0));
+  REQUIRE(0 == ups_db_insert(db, 0, &key, &rec, 0));
+  REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+
+  ups_parameter_t query[] = {
+    {UPS_PARAM_CHECKSUM, 0},
+    {0, 0}
+  };
+  REQUIRE(0 == ups_env_open(&env, Utils::opath("test.db"),
+                  UPS_ENABLE_CRC32, 0));
+  REQUIRE(file_version == ((LocalEnvironment *)env)->header()->version(3));
+  REQUIRE(0 == ups_env_get_parameters(env, query));
+  REQUIRE(algorithm == query[0].value);
+  REQUIRE(0 == ups_env_open_db(env, &db, 1, 0, 0));
+  REQUIRE(0 == ups_db_find(db, 0, &key, &rec, 0));
+  REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+}
+
+TEST_CASE("Crc32/checksumAlgorithm", "")
+{
+  ups_env_t *env;
+
+  // CRC32C is the default and requires the new file version
+  createChecksumEnv(0, UPS_FILE_VERSION, UPS_CHECKSUM_CRC32C);
+
+  // MurmurHash3 files keep the old version
+  ups_parameter_t murmur[] = {
+    {UPS_PARAM_CHECKSUM, UPS_CHECKSUM_MURMUR3},
+    {0, 0}
+  };
+  createChecksumEnv(murmur, 5, UPS_CHECKSUM_MURMUR3);
+
+  // the algorithm is persisted and cannot be changed
+  REQUIRE(UPS_INV_PARAMETER == ups_env_open(&env, Utils::opath("test.db"),
+                  0, murmur));
+
+  // without checksums the file keeps the old version; it is upgraded
+  // as soon as CRC32C checksums are stored
+  REQUIRE(0 == ups_env_create(&env, Utils::opath("test.db"), 0, 0644, 0));
+  REQUIRE(5 == ((LocalEnvironment *)env)->header()->version(3));
+  REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+  REQUIRE(0 == ups_env_open(&env, Utils::opath("test.db"), 0, 0));
+  REQUIRE(5 == ((LocalEnvironment *)env)->header()->version(3));
+  REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+  REQUIRE(0 == ups_env_open(&env, Utils::opath("test.db"),
+                  UPS_ENABLE_CRC32, 0));
+  REQUIRE(UPS_FILE_VERSION == ((LocalEnvironment *)env)->header()->version(3));
+  REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+
+  ups_parameter_t invalid[] = {
+    {UPS_PARAM_CHECKSUM, 99},
+    {0, 0}
+  };
+  REQUIRE(UPS_INV_PARAMETER == ups_env_create(&env, Utils::opath("test.db"),
+                  0, 0644, invalid));
+}
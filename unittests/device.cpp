@@ -15,9 +15,15 @@
  * See the file COPYING for License information.
  */
 
+#include <vector>
+
 #include "3rdparty/catch/catch.hpp"
 
+#include "1base/mutex.h"
+#include "1mem/page_buffer_pool.h"
 #include "2device/device.h"
+#include "2device/device_tiered.h"
+#include "2device/device_uring.h"
 #include "4env/env_local.h"
 
 #include "utils.h"
@@ -25,6 +31,46 @@
 
 using namespace upscaledb;
 
+// Writes and reads a range of pages; used by the concurrency test
+static void
+readWriteRange(Device *dev, int id, uint32_t ps, bool *result)
+{
+  std::vector<uint8_t> in(ps), out(ps);
+  *result = true;
+  for (int loop = 0; loop < 20; loop++) {
+    for (int i = 0; i < 16; i++) {
+      uint64_t address = (uint64_t)(id * 16 + i) * ps;
+      ::memset(&in[0], id + i + loop, ps);
+      dev->write(address, &in[0], ps);
+      dev->read(address, &out[0], ps);
+      if (in != out)
+        *result = false;
+    }
+  }
+}
+
+// Allocates and releases more buffers than an arena holds; each buffer
+// is filled with |id| and verified before it is released
+static void
+allocateBuffers(PageBufferPool *pool, int id, bool *result)
+{
+  size_t count = PageBufferPool::kArenaSize / pool->buffer_size() + 1;
+  std::vector<uint8_t *> v;
+  *result = true;
+  for (int loop = 0; loop < 20; loop++) {
+    for (size_t i = 0; i < count; i++) {
+      v.push_back(pool->allocate());
+      ::memset(v.back(), id, pool->buffer_size());
+    }
+    for (size_t i = 0; i < count; i++) {
+      if (v[i][0] != id || v[i][pool->buffer_size() - 1] != id)
+        *result = false;
+      pool->release(v[i]);
+    }
+    v.clear();
+  }
+}
+
 struct DeviceFixture
 {
   ups_db_t *m_db;
@@ -195,6 +241,177 @@ struct DeviceFixture
       delete pages[i];
     }
   }
+
+  void writePagesTest() {
+    uint32_t ps = UPS_DEFAULT_PAGE_SIZE;
+
+    EnvConfig &cfg = const_cast<EnvConfig &>(((LocalEnvironment *)m_env)->config());
+    cfg.flags |= UPS_DISABLE_MMAP;
+
+    // three runs of adjacent pages: [2, 3, 4], [6, 7] and [9]
+    uint64_t start = m_dev->file_size();
+    m_dev->truncate(start + ps * 10);
+    int ids[] = { 7, 3, 9, 2, 6, 4 };
+    std::vector<Page *> pages;
+    for (int i = 0; i < 6; i++) {
+      Page *page = new Page(m_dev);
+      m_dev->read_page(page, start + ps * ids[i]);
+      memset(page->payload(), ids[i], ps - Page::kSizeofPersistentHeader);
+      page->set_dirty(true);
+      pages.push_back(page);
+    }
+
+    uint64_t flushed = Page::ms_page_count_flushed;
+    uint64_t writes = Page::ms_page_flush_writes;
+    m_dev->write_pages(pages, false);
+    flushed = Page::ms_page_count_flushed - flushed;
+    writes = Page::ms_page_flush_writes - writes;
+    REQUIRE(6u == flushed);
+    REQUIRE(3u == writes);
+
+    std::vector<uint8_t> temp(ps);
+    for (int i = 0; i < 6; i++) {
+      REQUIRE(false == pages[i]->is_dirty());
+      m_dev->read(start + ps * ids[i], &temp[0], ps);
+      REQUIRE(0 == memcmp(&temp[Page::kSizeofPersistentHeader],
+                              pages[i]->payload(),
+                              ps - Page::kSizeofPersistentHeader));
+      delete pages[i];
+    }
+
+    ups_env_metrics_t metrics;
+    REQUIRE(0 == ups_env_get_metrics(m_env, &metrics));
+    REQUIRE(metrics.page_flush_writes <= metrics.page_count_flushed);
+    REQUIRE(metrics.page_flush_merge_ratio >= 1.0);
+  }
+
+  void concurrentReadWriteTest() {
+    uint32_t ps = UPS_DEFAULT_PAGE_SIZE;
+    m_dev->truncate(ps * 16 * 4);
+
+    bool results[4];
+    std::vector<Thread *> threads;
+    for (int i = 0; i < 4; i++)
+      threads.push_back(new Thread(boost::bind(&readWriteRange, m_dev, i, ps,
+                                  &results[i])));
+    for (int i = 0; i < 4; i++) {
+      threads[i]->join();
+      delete threads[i];
+      REQUIRE(results[i] == true);
+    }
+  }
+
+  void mappedSegmentsTest() {
+    DiskDevice *dev = (DiskDevice *)m_dev;
+    uint32_t ps = UPS_DEFAULT_PAGE_SIZE;
+    uint64_t segment = DiskDevice::kMinSegmentSize;
+    REQUIRE(dev->mapped_segments() == 0);
+
+    // a small growth does not map anything
+    m_dev->truncate(ps * 10);
+    Page page(m_dev);
+    m_dev->read_page(&page, ps * 5);
+    REQUIRE(page.is_allocated() == true);
+    REQUIRE(dev->mapped_segments() == 0);
+
+    // reading beyond the mapped range maps the end of the file
+    m_dev->truncate(segment);
+    Page page1(m_dev);
+    m_dev->read_page(&page1, ps * 5);
+    REQUIRE(page1.is_allocated() == false);
+    REQUIRE(dev->mapped_segments() == 1);
+    REQUIRE(m_dev->is_mapped(0, (size_t)segment));
+    REQUIRE(!m_dev->is_mapped(segment, ps));
+
+    // the file grows: a second segment is added; the pointers into the
+    // first segment remain valid
+    m_dev->truncate(segment * 2);
+    Page page2(m_dev);
+    m_dev->read_page(&page2, segment + ps);
+    REQUIRE(page2.is_allocated() == false);
+    REQUIRE(dev->mapped_segments() == 2);
+    REQUIRE(dev->mapped_pointer(segment + ps) == (uint8_t *)page2.data());
+    REQUIRE(dev->mapped_pointer(ps * 5) == (uint8_t *)page1.data());
+    REQUIRE(!m_dev->is_mapped(segment - ps, ps * 2));
+
+    // a page which was read with pread() switches to the mapped memory
+    // when it is read again; its buffer is returned to the pool
+    size_t in_use = dev->buffer_pool()->buffers_in_use();
+    m_dev->read_page(&page, ps * 5);
+    REQUIRE(page.is_allocated() == false);
+    REQUIRE(dev->buffer_pool()->buffers_in_use() == in_use - 1);
+
+    // truncating the file unmaps the memory beyond the new end
+    m_dev->truncate(segment + ps);
+    REQUIRE(dev->mapped_segments() == 2);
+    REQUIRE(m_dev->is_mapped(segment, ps));
+    REQUIRE(!m_dev->is_mapped(segment + ps, ps));
+    m_dev->truncate(segment / 2);
+    REQUIRE(dev->mapped_segments() == 1);
+    REQUIRE(m_dev->is_mapped(0, (size_t)segment / 2));
+    REQUIRE(!m_dev->is_mapped(segment / 2, ps));
+    REQUIRE(dev->mapped_pointer(ps * 5) == (uint8_t *)page1.data());
+
+    // the file grows again; the new end is mapped
+    m_dev->truncate(segment * 2);
+    Page page3(m_dev);
+    m_dev->read_page(&page3, segment + ps);
+    REQUIRE(page3.is_allocated() == false);
+    REQUIRE(dev->mapped_segments() == 2);
+  }
+
+  void bufferPoolTest() {
+    uint32_t ps = UPS_DEFAULT_PAGE_SIZE;
+    PageBufferPool pool(ps, false);
+    size_t per_arena = PageBufferPool::kArenaSize / ps;
+
+    // buffers are carved from 2 MB-aligned arenas
+    std::vector<uint8_t *> v;
+    for (size_t i = 0; i < per_arena; i++) {
+      v.push_back(pool.allocate());
+      ::memset(v.back(), (int)i, ps);
+    }
+    REQUIRE(pool.arena_count() == 1);
+    REQUIRE(pool.buffers_in_use() == per_arena);
+    REQUIRE(((uintptr_t)v[0] % PageBufferPool::kArenaSize) == 0);
+    REQUIRE(v[1] == v[0] + ps);
+
+    // a released buffer is recycled
+    uint8_t *p = v[3];
+    pool.release(p);
+    REQUIRE(pool.allocate() == p);
+
+    // a full arena requires a new one; an empty arena is kept as a spare
+    p = pool.allocate();
+    REQUIRE(pool.arena_count() == 2);
+    pool.release(p);
+    REQUIRE(pool.arena_count() == 2);
+    REQUIRE(pool.allocate() == p);
+    pool.release(p);
+
+    // only one empty arena is kept
+    for (size_t i = 0; i < v.size(); i++)
+      pool.release(v[i]);
+    REQUIRE(pool.buffers_in_use() == 0);
+    REQUIRE(pool.arena_count() == 1);
+  }
+
+  void concurrentBufferPoolTest() {
+    PageBufferPool pool(UPS_DEFAULT_PAGE_SIZE, false);
+
+    bool results[4];
+    std::vector<Thread *> threads;
+    for (int i = 0; i < 4; i++)
+      threads.push_back(new Thread(boost::bind(&allocateBuffers, &pool,
+                                  i + 1, &results[i])));
+    for (int i = 0; i < 4; i++) {
+      threads[i]->join();
+      delete threads[i];
+      REQUIRE(results[i] == true);
+    }
+    REQUIRE(pool.buffers_in_use() == 0);
+    REQUIRE(pool.arena_count() == 1);
+  }
 };
 
 TEST_CASE("Device/newDelete", "")
@@ -251,6 +468,470 @@ TEST_CASE("Device/readWritePage", "")
   f. readWritePageTest();
 }
 
+TEST_CASE("Device/writePages", "")
+{
+  DeviceFixture f(false);
+  f.writePagesTest();
+}
+
+TEST_CASE("Device/concurrentReadWrite", "")
+{
+  DeviceFixture f(false);
+  f.concurrentReadWriteTest();
+}
+
+TEST_CASE("Device/mappedSegments", "")
+{
+  DeviceFixture f(false);
+  f.mappedSegmentsTest();
+}
+
+TEST_CASE("Device/bufferPool", "")
+{
+  DeviceFixture f(false);
+  f.bufferPoolTest();
+}
+
+TEST_CASE("Device/concurrentBufferPool", "")
+{
+  DeviceFixture f(false);
+  f.concurrentBufferPoolTest();
+}
+
+TEST_CASE("Device/hugePages", "")
+{
+  ups_env_t *env;
+  ups_db_t *db;
+  ups_parameter_t params[] = {
+    { UPS_PARAM_HUGE_PAGES, 1 },
+    { 0, 0 }
+  };
+
+  REQUIRE(0 == ups_env_create(&env, Utils::opath(".test"), 0, 0644, params));
+  REQUIRE(0 == ups_env_create_db(env, &db, 1, 0, 0));
+
+  for (int i = 0; i < 1000; i++) {
+    ups_key_t key = ups_make_key(&i, sizeof(i));
+    ups_record_t rec = ups_make_record(&i, sizeof(i));
+    REQUIRE(0 == ups_db_insert(db, 0, &key, &rec, 0));
+  }
+
+  ups_parameter_t query[] = {
+    { UPS_PARAM_HUGE_PAGES, 0 },
+    { 0, 0 }
+  };
+  REQUIRE(0 == ups_env_get_parameters(env, query));
+  REQUIRE(1u == query[0].value);
+  REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+
+  REQUIRE(0 == ups_env_open(&env, Utils::opath(".test"), 0, params));
+  REQUIRE(0 == ups_env_open_db(env, &db, 1, 0, 0));
+  for (int i = 0; i < 1000; i++) {
+    ups_key_t key = ups_make_key(&i, sizeof(i));
+    ups_record_t rec = {0};
+    REQUIRE(0 == ups_db_find(db, 0, &key, &rec, 0));
+    REQUIRE(0 == ::memcmp(rec.data, &i, sizeof(i)));
+  }
+  REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+}
+
+
+TEST_CASE("Device/directIo", "")
+{
+  ups_env_t *env;
+  ups_db_t *db;
+  ups_parameter_t params[] = {
+    { UPS_PARAM_DIRECT_IO, 1 },
+    { 0, 0 }
+  };
+  std::vector<uint8_t> blob(10001);
+
+  REQUIRE(0 == ups_env_create(&env, Utils::opath(".test"), 0, 0644, params));
+  REQUIRE(0 == ups_env_create_db(env, &db, 1, 0, 0));
+
+  for (int i = 0; i < 1000; i++) {
+    ::memset(&blob[0], i & 0xff, blob.size());
+    ups_key_t key = ups_make_key(&i, sizeof(i));
+    ups_record_t rec = ups_make_record(&blob[0], (uint32_t)(i % 7) * 1111);
+    REQUIRE(0 == ups_db_insert(db, 0, &key, &rec, 0));
+  }
+
+  ups_parameter_t query[] = {
+    { UPS_PARAM_DIRECT_IO, 0 },
+    { UPS_PARAM_FLAGS, 0 },
+    { 0, 0 }
+  };
+  REQUIRE(0 == ups_env_get_parameters(env, query));
+  REQUIRE(1u == query[0].value);
+  REQUIRE((query[1].value & UPS_DISABLE_MMAP) != 0);
+  REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+
+  REQUIRE(0 == ups_env_open(&env, Utils::opath(".test"), 0, params));
+  REQUIRE(0 == ups_env_open_db(env, &db, 1, 0, 0));
+  for (int i = 0; i < 1000; i++) {
+    ups_key_t key = ups_make_key(&i, sizeof(i));
+    ups_record_t rec = {0};
+    REQUIRE(0 == ups_db_find(db, 0, &key, &rec, 0));
+    REQUIRE(rec.size == (uint32_t)(i % 7) * 1111);
+    for (uint32_t j = 0; j < rec.size; j++)
+      REQUIRE(((uint8_t *)rec.data)[j] == (uint8_t)(i & 0xff));
+  }
+  REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+
+  // the page size has to be a multiple of the direct I/O alignment
+  ups_parameter_t small[] = {
+    { UPS_PARAM_DIRECT_IO, 1 },
+    { UPS_PARAM_PAGESIZE, 1024 },
+    { 0, 0 }
+  };
+  REQUIRE(UPS_INV_PAGESIZE == ups_env_create(&env, Utils::opath(".test"),
+                  0, 0644, small));
+  REQUIRE(UPS_INV_PARAMETER == ups_env_create(&env, 0, UPS_IN_MEMORY,
+                  0644, params));
+}
+
+
+TEST_CASE("Device/uringReadWritePages", "")
+{
+  ups_env_t *env;
+  ups_parameter_t params[] = {
+    { UPS_PARAM_IO_QUEUE_DEPTH, 4 },
+    { 0, 0 }
+  };
+
+  REQUIRE(0 == ups_env_create(&env, Utils::opath(".test"), UPS_DISABLE_MMAP,
+                          0644, params));
+  LocalEnvironment *lenv = (LocalEnvironment *)env;
+  UringDevice *dev = dynamic_cast<UringDevice *>(lenv->device());
+  REQUIRE(dev != 0);
+
+  ups_parameter_t query[] = {
+    { UPS_PARAM_IO_QUEUE_DEPTH, 0 },
+    { 0, 0 }
+  };
+  REQUIRE(0 == ups_env_get_parameters(env, query));
+  REQUIRE(4u == query[0].value);
+
+  // write more pages than the queue depth with a single batch
+  uint32_t ps = lenv->config().page_size_bytes;
+  std::vector<Page *> pages;
+  for (int i = 0; i < 10; i++) {
+    Page *page = new Page(dev);
+    dev->alloc_page(page);
+    ::memset(page->payload(), i, ps - Page::kSizeofPersistentHeader);
+    page->set_dirty(true);
+    pages.push_back(page);
+  }
+  dev->write_pages(pages, true);
+  for (int i = 0; i < 10; i++) {
+    REQUIRE(false == pages[i]->is_dirty());
+    ::memset(pages[i]->data(), 0, ps);
+  }
+
+  // and read them back
+  dev->read_pages(pages);
+  for (int i = 0; i < 10; i++) {
+    std::vector<uint8_t> temp(ps - Page::kSizeofPersistentHeader, i);
+    REQUIRE(0 == ::memcmp(pages[i]->payload(), &temp[0], temp.size()));
+    delete pages[i];
+  }
+
+  REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+}
+
+TEST_CASE("Device/uringRecovery", "")
+{
+  ups_env_t *env;
+  ups_db_t *db;
+  ups_parameter_t params[] = {
+    { UPS_PARAM_IO_QUEUE_DEPTH, 16 },
+    { 0, 0 }
+  };
+
+  REQUIRE(0 == ups_env_create(&env, Utils::opath(".test"),
+                          UPS_ENABLE_TRANSACTIONS | UPS_ENABLE_FSYNC,
+                          0644, params));
+  REQUIRE(0 == ups_env_create_db(env, &db, 1, 0, 0));
+  for (int i = 0; i < 2000; i++) {
+    ups_key_t key = ups_make_key(&i, sizeof(i));
+    ups_record_t rec = ups_make_record(&i, sizeof(i));
+    REQUIRE(0 == ups_db_insert(db, 0, &key, &rec, 0));
+  }
+  REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+
+  REQUIRE(0 == ups_env_open(&env, Utils::opath(".test"),
+                          UPS_ENABLE_TRANSACTIONS, params));
+  REQUIRE(0 == ups_env_open_db(env, &db, 1, 0, 0));
+  for (int i = 0; i < 2000; i++) {
+    ups_key_t key = ups_make_key(&i, sizeof(i));
+    ups_record_t rec = {0};
+    REQUIRE(0 == ups_db_find(db, 0, &key, &rec, 0));
+    REQUIRE(0 == ::memcmp(rec.data, &i, sizeof(i)));
+  }
+  REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+}
+
+// Inserts (or overwrites) |count| records of the tiered storage tests
+static void
+insertTieredRecords(ups_db_t *db, int count, int seed)
+{
+  std::vector<uint8_t> blob(3000);
+  for (int i = 0; i < count; i++) {
+    ::memset(&blob[0], (i + seed) & 0xff, blob.size());
+    ups_key_t key = ups_make_key(&i, sizeof(i));
+    ups_record_t rec = ups_make_record(&blob[0], (uint32_t)blob.size());
+    REQUIRE(0 == ups_db_insert(db, 0, &key, &rec, UPS_OVERWRITE));
+  }
+}
+
+// Verifies the records of |insertTieredRecords|
+static void
+checkTieredRecords(ups_db_t *db, int count, int seed)
+{
+  for (int i = 0; i < count; i++) {
+    ups_key_t key = ups_make_key(&i, sizeof(i));
+    ups_record_t rec = {0};
+    REQUIRE(0 == ups_db_find(db, 0, &key, &rec, 0));
+    REQUIRE(rec.size == 3000u);
+    std::vector<uint8_t> expected(3000, (uint8_t)((i + seed) & 0xff));
+    REQUIRE(0 == ::memcmp(rec.data, &expected[0], expected.size()));
+  }
+}
+
+// Reports a single page as cached to the migration rounds
+struct CachedPage : public CachedPages
+{
+  CachedPage(uint64_t address_)
+    : address(address_) {
+  }
+
+  virtual bool is_cached(uint64_t address_) {
+    return address_ == address;
+  }
+
+  uint64_t address;
+};
+
+TEST_CASE("Device/tieredStorage", "")
+{
+  ups_env_t *env;
+  ups_db_t *db;
+  std::string cold = std::string(Utils::opath(".test")) + ".cold";
+  ups_parameter_t params[] = {
+    { UPS_PARAM_COLD_STORAGE_PATH, (uint64_t)cold.c_str() },
+    { UPS_PARAM_CACHE_SIZE, 64 * 1024 },
+    { 0, 0 }
+  };
+  const int kCount = 500;
+
+  REQUIRE(0 == ups_env_create(&env, Utils::opath(".test"), 0, 0644, params));
+  REQUIRE(0 == ups_env_create_db(env, &db, 1, 0, 0));
+
+  // the rounds are run explicitly, not in the background
+  LocalEnvironment *lenv = (LocalEnvironment *)env;
+  TieredDevice *dev = dynamic_cast<TieredDevice *>(lenv->device());
+  REQUIRE(dev != 0);
+  dev->set_manual_rounds(true);
+  insertTieredRecords(db, kCount, 0);
+
+  ups_parameter_t query[] = {
+    { UPS_PARAM_COLD_STORAGE_PATH, 0 },
+    { UPS_PARAM_FLAGS, 0 },
+    { 0, 0 }
+  };
+  REQUIRE(0 == ups_env_get_parameters(env, query));
+  REQUIRE(0 == ::strcmp(cold.c_str(), (const char *)query[0].value));
+  REQUIRE((query[1].value & UPS_DISABLE_MMAP) != 0);
+
+  // pages which are not accessed for a few rounds are moved
+  CachedPage hot_page(lenv->config().page_size_bytes);
+  for (int i = 0; i <= TieredDevice::kColdAge; i++)
+    dev->migrate_pages(&hot_page);
+
+  ups_env_metrics_t metrics;
+  REQUIRE(0 == ups_env_get_metrics(env, &metrics));
+  REQUIRE(metrics.tiered_cold_pages > 0);
+  REQUIRE(metrics.tiered_pages_demoted == metrics.tiered_cold_pages);
+  REQUIRE(false == dev->is_cold(0));
+  REQUIRE(false == dev->is_cold(lenv->config().page_size_bytes));
+  uint64_t demoted = metrics.tiered_pages_demoted;
+
+  // cold pages are read and written in the secondary file
+  checkTieredRecords(db, kCount, 0);
+  insertTieredRecords(db, kCount, 1);
+  checkTieredRecords(db, kCount, 1);
+
+  // pages which are read frequently are moved back; the Database is
+  // reopened to evict its pages, therefore each pass reads from the device
+  for (int i = 0; i < TieredDevice::kPromoteReads; i++) {
+    REQUIRE(0 == ups_db_close(db, 0));
+    REQUIRE(0 == ups_env_open_db(env, &db, 1, 0, 0));
+    checkTieredRecords(db, kCount, 1);
+  }
+  dev->migrate_pages(&hot_page);
+  REQUIRE(0 == ups_env_get_metrics(env, &metrics));
+  REQUIRE(metrics.tiered_pages_promoted > 0);
+  REQUIRE(metrics.tiered_cold_pages < demoted);
+  checkTieredRecords(db, kCount, 1);
+
+  // the map is persistent
+  for (int i = 0; i <= TieredDevice::kColdAge; i++)
+    dev->migrate_pages(&hot_page);
+  REQUIRE(0 == ups_env_get_metrics(env, &metrics));
+  uint64_t cold_pages = metrics.tiered_cold_pages;
+  REQUIRE(cold_pages > 0);
+  REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+
+  // the path is required to open the Environment
+  REQUIRE(UPS_INV_PARAMETER == ups_env_open(&env, Utils::opath(".test"),
+                          0, 0));
+
+  REQUIRE(0 == ups_env_open(&env, Utils::opath(".test"), 0, params));
+  REQUIRE(0 == ups_env_open_db(env, &db, 1, 0, 0));
+  REQUIRE(0 == ups_env_get_metrics(env, &metrics));
+  REQUIRE(metrics.tiered_cold_pages == cold_pages);
+  checkTieredRecords(db, kCount, 1);
+  REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+
+  ups_parameter_t inmem[] = {
+    { UPS_PARAM_COLD_STORAGE_PATH, (uint64_t)cold.c_str() },
+    { 0, 0 }
+  };
+  REQUIRE(UPS_INV_PARAMETER == ups_env_create(&env, 0, UPS_IN_MEMORY,
+                  0644, inmem));
+}
+
+TEST_CASE("Device/tieredStorageConvert", "")
+{
+  ups_env_t *env;
+  ups_db_t *db;
+  std::string cold = std::string(Utils::opath(".test")) + ".cold";
+  ups_parameter_t params[] = {
+    { UPS_PARAM_COLD_STORAGE_PATH, (uint64_t)cold.c_str() },
+    { UPS_PARAM_FAST_TIER_SIZE, 64 * 1024 },
+    { 0, 0 }
+  };
+  const int kCount = 500;
+
+  (void)os::unlink(cold.c_str());
+  (void)os::unlink((cold + ".map").c_str());
+
+  REQUIRE(0 == ups_env_create(&env, Utils::opath(".test"),
+                          UPS_ENABLE_TRANSACTIONS, 0644, 0));
+  REQUIRE(0 == ups_env_create_db(env, &db, 1, 0, 0));
+  REQUIRE(5 == ((LocalEnvironment *)env)->header()->version(3));
+  insertTieredRecords(db, kCount, 0);
+  REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+
+  // an existing Environment is converted; the pages are moved until the
+  // database file does not exceed the fast tier. Older releases can no
+  // longer open the file
+  REQUIRE(0 == ups_env_open(&env, Utils::opath(".test"),
+                          UPS_ENABLE_TRANSACTIONS, params));
+  REQUIRE(0 == ups_env_open_db(env, &db, 1, 0, 0));
+  LocalEnvironment *lenv = (LocalEnvironment *)env;
+  REQUIRE(UPS_FILE_VERSION == lenv->header()->version(3));
+  TieredDevice *dev = dynamic_cast<TieredDevice *>(lenv->device());
+  REQUIRE(dev != 0);
+  dev->set_manual_rounds(true);
+  for (int i = 0; i < 20; i++)
+    dev->migrate_pages(0);
+
+  uint32_t ps = lenv->config().page_size_bytes;
+  uint64_t pages = dev->file_size() / ps;
+  ups_env_metrics_t metrics;
+  REQUIRE(0 == ups_env_get_metrics(env, &metrics));
+  REQUIRE(metrics.tiered_cold_pages > 0);
+  uint64_t hot_size = (pages - metrics.tiered_cold_pages) * ps;
+  REQUIRE(hot_size <= 64u * 1024);
+
+  insertTieredRecords(db, kCount, 2);
+  REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+
+  REQUIRE(UPS_INV_PARAMETER == ups_env_open(&env, Utils::opath(".test"),
+                          UPS_ENABLE_TRANSACTIONS, 0));
+  REQUIRE(0 == ups_env_open(&env, Utils::opath(".test"),
+                          UPS_ENABLE_TRANSACTIONS, params));
+  REQUIRE(0 == ups_env_open_db(env, &db, 1, 0, 0));
+  checkTieredRecords(db, kCount, 2);
+  REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+}
+
+TEST_CASE("Device/fileGrowth", "")
+{
+  ups_env_t *env;
+  ups_db_t *db;
+  const uint64_t kStep = 1024 * 1024;
+  ups_parameter_t params[] = {
+    { UPS_PARAM_FILE_GROWTH_BYTES, kStep },
+    { 0, 0 }
+  };
+
+  REQUIRE(0 == ups_env_create(&env, Utils::opath(".test"), 0, 0644, params));
+  REQUIRE(0 == ups_env_create_db(env, &db, 1, 0, 0));
+
+  ups_parameter_t query[] = {
+    { UPS_PARAM_FILE_GROWTH_BYTES, 0 },
+    { 0, 0 }
+  };
+  REQUIRE(0 == ups_env_get_parameters(env, query));
+  REQUIRE(kStep == query[0].value);
+
+  // the file grows in steps; the storage is reserved with fallocate()
+  LocalEnvironment *lenv = (LocalEnvironment *)env;
+  DiskDevice *dev = (DiskDevice *)lenv->device();
+  uint32_t ps = lenv->config().page_size_bytes;
+  uint64_t address = dev->alloc(ps);
+  REQUIRE(dev->file_size() == kStep);
+  REQUIRE(dev->preallocated_end() == kStep);
+  REQUIRE(dev->needs_preallocation() == false);
+
+  // less than half of the step is left: the next step is reserved
+  // without changing the file size
+  while (address + ps <= kStep / 2)
+    address = dev->alloc(ps);
+  REQUIRE(dev->needs_preallocation() == true);
+  dev->preallocate();
+  REQUIRE(dev->needs_preallocation() == false);
+  REQUIRE(dev->file_size() == kStep);
+  uint64_t reserved = dev->preallocated_end();
+  REQUIRE(reserved > 2 * kStep);
+
+  // growing into the reserved storage only changes the file size
+  while (address < kStep)
+    address = dev->alloc(ps);
+  REQUIRE(dev->file_size() == 2 * kStep);
+  REQUIRE(dev->preallocated_end() == reserved);
+
+  // the records are stored in the preallocated file
+  std::vector<uint8_t> blob(3000);
+  for (int i = 0; i < 1000; i++) {
+    ::memset(&blob[0], i & 0xff, blob.size());
+    ups_key_t key = ups_make_key(&i, sizeof(i));
+    ups_record_t rec = ups_make_record(&blob[0], (uint32_t)blob.size());
+    REQUIRE(0 == ups_db_insert(db, 0, &key, &rec, 0));
+  }
+  uint64_t size = dev->file_size();
+  REQUIRE(0 == size % kStep);
+  REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+
+  // the unused space was released
+  File f;
+  f.open(Utils::opath(".test"), true);
+  REQUIRE(f.file_size() < size);
+  f.close();
+
+  REQUIRE(0 == ups_env_open(&env, Utils::opath(".test"), 0, params));
+  REQUIRE(0 == ups_env_open_db(env, &db, 1, 0, 0));
+  for (int i = 0; i < 1000; i++) {
+    ups_key_t key = ups_make_key(&i, sizeof(i));
+    ups_record_t rec = {0};
+    REQUIRE(0 == ups_db_find(db, 0, &key, &rec, 0));
+    REQUIRE(rec.size == 3000u);
+    REQUIRE(((uint8_t *)rec.data)[0] == (uint8_t)(i & 0xff));
+  }
+  REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+}
 
 TEST_CASE("Device-inmem/newDelete", "")
 {
@@ -75,6 +75,59 @@ struct EraseLogEntry : public LogEntry {
   ups_key_t *key;
 };
 
+// Commits |count| transactions, each with a single insert
+static void
+commitRange(ups_env_t *env, ups_db_t *db, int thread, int count,
+                bool *result)
+{
+  *result = true;
+  for (int i = 0; i < count; i++) {
+    int k = thread * 1000 + i;
+    ups_txn_t *txn;
+    ups_key_t key = ups_make_key(&k, sizeof(k));
+    ups_record_t rec = ups_make_record(&k, sizeof(k));
+    if (ups_txn_begin(&txn, env, 0, 0, 0)
+        || ups_db_insert(db, txn, &key, &rec, 0)
+        || ups_txn_commit(txn, 0))
+      *result = false;
+  }
+}
+
+struct RecoveryProgress {
+  RecoveryProgress()
+    : calls(0), replayed(0), total(0) {
+  }
+
+  int calls;
+  uint64_t replayed;
+  uint64_t total;
+};
+
+// Stores the progress of the recovery in |context|
+static void UPS_CALLCONV
+recoveryProgress(void *context, uint64_t replayed, uint64_t total)
+{
+  RecoveryProgress *progress = (RecoveryProgress *)context;
+  REQUIRE(replayed >= progress->replayed);
+  REQUIRE(replayed <= total);
+  progress->calls++;
+  progress->replayed = replayed;
+  progress->total = total;
+}
+
+// Lets the next Changeset flush of the recovery fail, after some of the
+// replayed operations were already written to the file
+static void UPS_CALLCONV
+interruptRecovery(void *context, uint64_t replayed, uint64_t total)
+{
+  bool *interrupted = (bool *)context;
+  if (!*interrupted && replayed > 0 && replayed < total) {
+    ErrorInducer::activate(true);
+    ErrorInducer::add(ErrorInducer::kChangesetFlush, 1);
+    *interrupted = true;
+  }
+}
+
 struct JournalFixture {
   ups_db_t *m_db;
   ups_env_t *m_env;
@@ -1313,6 +1366,510 @@ struct JournalFixture {
     REQUIRE(params[0].value == 44);
   }
 
+  void groupCommitTest() {
+    const int kThreads = 4;
+    const int kCommits = 50;
+
+    teardown();
+
+    ups_parameter_t params[] = {
+      {UPS_PARAM_JOURNAL_GROUP_COMMIT_WINDOW, 2000},
+      {UPS_PARAM_JOURNAL_GROUP_COMMIT_BYTES, 1024 * 1024},
+      // do not recycle segments; the file sizes are verified below
+      {UPS_PARAM_JOURNAL_SWITCH_THRESHOLD, 1000},
+      {0, 0}
+    };
+
+    REQUIRE(0 == ups_env_create(&m_env, Utils::opath(".test"),
+                UPS_ENABLE_TRANSACTIONS | UPS_ENABLE_FSYNC, 0644,
+                &params[0]));
+    REQUIRE(0 == ups_env_create_db(m_env, &m_db, 1, 0, 0));
+
+    params[0].value = 0;
+    params[1].value = 0;
+    REQUIRE(0 == ups_env_get_parameters(m_env, &params[0]));
+    REQUIRE(params[0].value == 2000);
+    REQUIRE(params[1].value == 1024 * 1024);
+
+    bool results[kThreads];
+    std::vector<Thread *> threads;
+    for (int i = 0; i < kThreads; i++)
+      threads.push_back(new Thread(boost::bind(&commitRange, m_env, m_db, i,
+                                  kCommits, &results[i])));
+    for (int i = 0; i < kThreads; i++) {
+      threads[i]->join();
+      delete threads[i];
+      REQUIRE(results[i] == true);
+    }
+
+    // the commits were synced in groups
+    ups_env_metrics_t metrics;
+    REQUIRE(0 == ups_env_get_metrics(m_env, &metrics));
+    REQUIRE(metrics.journal_group_commits > 0);
+    REQUIRE(metrics.journal_group_commits < (uint64_t)(kThreads * kCommits));
+
+    // ups_txn_commit returned, therefore the data is already in the files
+    Journal *j = ((LocalEnvironment *)m_env)->journal();
+    uint64_t size = j->state.files[0].file_size()
+                      + j->state.files[1].file_size();
+    REQUIRE(size == metrics.journal_bytes_flushed);
+
+    // recover and verify the data
+    REQUIRE(0 == ups_env_close(m_env,
+                UPS_AUTO_CLEANUP | UPS_DONT_CLEAR_LOG));
+    REQUIRE(0 == ups_env_open(&m_env, Utils::opath(".test"),
+                UPS_ENABLE_TRANSACTIONS | UPS_ENABLE_FSYNC
+                | UPS_AUTO_RECOVERY, 0));
+    REQUIRE(0 == ups_env_open_db(m_env, &m_db, 1, 0, 0));
+    for (int t = 0; t < kThreads; t++) {
+      for (int i = 0; i < kCommits; i++) {
+        int k = t * 1000 + i;
+        ups_key_t key = ups_make_key(&k, sizeof(k));
+        ups_record_t rec = {0};
+        REQUIRE(0 == ups_db_find(m_db, 0, &key, &rec, 0));
+        REQUIRE(k == *(int *)rec.data);
+      }
+    }
+  }
+
+  void segmentTest() {
+    const uint64_t kSegmentSize = 64 * 1024;
+    const int kTxns = 400;
+
+    teardown();
+
+    ups_parameter_t bad[] = {
+      {UPS_PARAM_JOURNAL_SEGMENTS, 1},
+      {0, 0}
+    };
+    REQUIRE(UPS_INV_PARAMETER == ups_env_create(&m_env, Utils::opath(".test"),
+                UPS_ENABLE_TRANSACTIONS, 0644, &bad[0]));
+    bad[0].value = JournalState::kMaxSegments + 1;
+    REQUIRE(UPS_INV_PARAMETER == ups_env_create(&m_env, Utils::opath(".test"),
+                UPS_ENABLE_TRANSACTIONS, 0644, &bad[0]));
+
+    ups_parameter_t params[] = {
+      {UPS_PARAM_JOURNAL_SEGMENTS, 4},
+      {UPS_PARAM_JOURNAL_SEGMENT_SIZE, kSegmentSize},
+      // only switch the segments when they are full
+      {UPS_PARAM_JOURNAL_SWITCH_THRESHOLD, 100000},
+      {0, 0}
+    };
+
+    REQUIRE(0 == ups_env_create(&m_env, Utils::opath(".test"),
+                UPS_ENABLE_TRANSACTIONS, 0644, &params[0]));
+    REQUIRE(0 == ups_env_create_db(m_env, &m_db, 1, 0, 0));
+
+    params[0].value = 0;
+    params[1].value = 0;
+    REQUIRE(0 == ups_env_get_parameters(m_env, &params[0]));
+    REQUIRE(params[0].value == 4);
+    REQUIRE(params[1].value == kSegmentSize);
+
+    std::vector<uint8_t> buffer(1024);
+    for (int i = 0; i < kTxns; i++) {
+      ups_txn_t *txn;
+      ups_key_t key = ups_make_key(&i, sizeof(i));
+      ups_record_t rec = ups_make_record(&buffer[0], (uint32_t)buffer.size());
+      ::memcpy(&buffer[0], &i, sizeof(i));
+      REQUIRE(0 == ups_txn_begin(&txn, m_env, 0, 0, 0));
+      REQUIRE(0 == ups_db_insert(m_db, txn, &key, &rec, 0));
+      REQUIRE(0 == ups_txn_commit(txn, 0));
+    }
+
+    // all segments were used, and the oldest ones were recycled
+    ups_env_metrics_t metrics;
+    REQUIRE(0 == ups_env_get_metrics(m_env, &metrics));
+    REQUIRE(metrics.journal_segments == 4);
+    REQUIRE(metrics.journal_segments_recycled > 0);
+    uint64_t flushed = metrics.journal_bytes_flushed;
+    REQUIRE(flushed > 4 * kSegmentSize);
+
+    // the segments do not grow beyond their size (plus the last Transaction)
+    Journal *j = ((LocalEnvironment *)m_env)->journal();
+    j->test_flush_buffers();
+    for (int i = 0; i < 4; i++) {
+      uint64_t size = j->state.files[i].file_size();
+      REQUIRE(size < kSegmentSize + 4 * 1024);
+    }
+
+    // reopen without parameters; all segments are used for recovery
+    REQUIRE(0 == ups_env_close(m_env,
+                UPS_AUTO_CLEANUP | UPS_DONT_CLEAR_LOG));
+    REQUIRE(true == os::file_exists(".test.jrn2"));
+    REQUIRE(true == os::file_exists(".test.jrn3"));
+    REQUIRE(false == os::file_exists(".test.jrn4"));
+    REQUIRE(0 == ups_env_open(&m_env, Utils::opath(".test"),
+                UPS_ENABLE_TRANSACTIONS | UPS_AUTO_RECOVERY, 0));
+    REQUIRE(0 == ups_env_open_db(m_env, &m_db, 1, 0, 0));
+
+    params[2].name = 0;
+    REQUIRE(0 == ups_env_get_parameters(m_env, &params[0]));
+    REQUIRE(params[0].value == 4);
+    REQUIRE(params[1].value == 0);
+
+    for (int i = 0; i < kTxns; i++) {
+      ups_key_t key = ups_make_key(&i, sizeof(i));
+      ups_record_t rec = {0};
+      REQUIRE(0 == ups_db_find(m_db, 0, &key, &rec, 0));
+      REQUIRE(i == *(int *)rec.data);
+    }
+  }
+
+  void partitionedRecoveryTest() {
+#ifndef WIN32
+    const int kDatabases = 3;
+    const int kKeys = 500;
+    ups_db_t *db[kDatabases];
+    ups_txn_t *txn;
+
+    // do not flush the committed Transactions to the btree
+    teardown();
+    REQUIRE(0 == ups_env_create(&m_env, Utils::opath(".test"),
+                UPS_ENABLE_TRANSACTIONS | UPS_DONT_FLUSH_TRANSACTIONS,
+                0644, 0));
+    for (int d = 0; d < kDatabases; d++)
+      REQUIRE(0 == ups_env_create_db(m_env, &db[d], d + 1, 0, 0));
+
+    for (int d = 0; d < kDatabases; d++) {
+      /* insert the keys (in reverse order) and commit them */
+      REQUIRE(0 == ups_txn_begin(&txn, m_env, 0, 0, 0));
+      for (int i = kKeys - 1; i >= 0; i--) {
+        int r = d * 10000 + i;
+        ups_key_t key = ups_make_key(&i, sizeof(i));
+        ups_record_t rec = ups_make_record(&r, sizeof(r));
+        REQUIRE(0 == ups_db_insert(db[d], txn, &key, &rec, 0));
+      }
+      REQUIRE(0 == ups_txn_commit(txn, 0));
+
+      /* erase every 4th key */
+      REQUIRE(0 == ups_txn_begin(&txn, m_env, 0, 0, 0));
+      for (int i = 0; i < kKeys; i += 4) {
+        ups_key_t key = ups_make_key(&i, sizeof(i));
+        REQUIRE(0 == ups_db_erase(db[d], txn, &key, 0));
+      }
+      REQUIRE(0 == ups_txn_commit(txn, 0));
+
+      /* insert more keys, but abort the Transaction */
+      REQUIRE(0 == ups_txn_begin(&txn, m_env, 0, 0, 0));
+      for (int i = kKeys; i < kKeys + 10; i++) {
+        ups_key_t key = ups_make_key(&i, sizeof(i));
+        ups_record_t rec = ups_make_record(&i, sizeof(i));
+        REQUIRE(0 == ups_db_insert(db[d], txn, &key, &rec, 0));
+      }
+      REQUIRE(0 == ups_txn_abort(txn, 0));
+    }
+
+    /* and one Transaction which is not committed before the "crash" */
+    int k = kKeys + 20;
+    ups_key_t key = ups_make_key(&k, sizeof(k));
+    ups_record_t rec = ups_make_record(&k, sizeof(k));
+    REQUIRE(0 == ups_txn_begin(&txn, m_env, 0, 0, 0));
+    REQUIRE(0 == ups_db_insert(db[0], txn, &key, &rec, 0));
+
+    m_lenv = (LocalEnvironment *)m_env;
+    m_lenv->journal()->test_flush_buffers();
+
+    /* backup the files */
+    REQUIRE(true == os::copy(Utils::opath(".test"),
+          Utils::opath(".test.bak")));
+    REQUIRE(true == os::copy(Utils::opath(".test.jrn0"),
+          Utils::opath(".test.bak0")));
+    REQUIRE(true == os::copy(Utils::opath(".test.jrn1"),
+          Utils::opath(".test.bak1")));
+    REQUIRE(0 == ups_txn_abort(txn, 0));
+    REQUIRE(0 == ups_env_close(m_env, UPS_AUTO_CLEANUP));
+
+    /* restore the files */
+    REQUIRE(true == os::copy(Utils::opath(".test.bak"),
+          Utils::opath(".test")));
+    REQUIRE(true == os::copy(Utils::opath(".test.bak0"),
+          Utils::opath(".test.jrn0")));
+    REQUIRE(true == os::copy(Utils::opath(".test.bak1"),
+          Utils::opath(".test.jrn1")));
+
+    RecoveryProgress progress;
+    ups_parameter_t params[] = {
+      {UPS_PARAM_RECOVERY_PROGRESS_CALLBACK, (uint64_t)&recoveryProgress},
+      {UPS_PARAM_RECOVERY_PROGRESS_CONTEXT, (uint64_t)&progress},
+      {0, 0}
+    };
+    REQUIRE(0 == ups_env_open(&m_env, Utils::opath(".test"),
+                UPS_ENABLE_TRANSACTIONS | UPS_AUTO_RECOVERY, &params[0]));
+
+    /* all inserts and erases of the committed Transactions were replayed */
+    uint64_t expected = kDatabases * (kKeys + kKeys / 4);
+    REQUIRE(progress.calls > 2);
+    REQUIRE(progress.total == expected);
+    REQUIRE(progress.replayed == expected);
+
+    verifyJournalIsEmpty();
+
+    for (int d = 0; d < kDatabases; d++) {
+      REQUIRE(0 == ups_env_open_db(m_env, &db[d], d + 1, 0, 0));
+      for (int i = 0; i < kKeys + 10; i++) {
+        ups_key_t key = ups_make_key(&i, sizeof(i));
+        ups_record_t rec = ups_make_record(0, 0);
+        if (i >= kKeys || i % 4 == 0) {
+          REQUIRE(UPS_KEY_NOT_FOUND == ups_db_find(db[d], 0, &key, &rec, 0));
+        }
+        else {
+          int r = d * 10000 + i;
+          REQUIRE(0 == ups_db_find(db[d], 0, &key, &rec, 0));
+          REQUIRE(r == *(int *)rec.data);
+        }
+      }
+    }
+
+    /* the Transaction which was not committed was not replayed */
+    REQUIRE(UPS_KEY_NOT_FOUND == ups_db_find(db[0], 0, &key, &rec, 0));
+#endif
+  }
+
+  void interruptedRecoveryTest() {
+#ifndef WIN32
+    const int kKeys = 3000;
+    ups_txn_t *txn;
+
+    // do not flush the committed Transactions to the btree
+    teardown();
+    REQUIRE(0 == ups_env_create(&m_env, Utils::opath(".test"),
+                UPS_ENABLE_TRANSACTIONS | UPS_DONT_FLUSH_TRANSACTIONS,
+                0644, 0));
+    REQUIRE(0 == ups_env_create_db(m_env, &m_db, 1, 0, 0));
+
+    REQUIRE(0 == ups_txn_begin(&txn, m_env, 0, 0, 0));
+    for (int i = 0; i < kKeys; i++) {
+      ups_key_t key = ups_make_key(&i, sizeof(i));
+      ups_record_t rec = ups_make_record(&i, sizeof(i));
+      REQUIRE(0 == ups_db_insert(m_db, txn, &key, &rec, 0));
+    }
+    REQUIRE(0 == ups_txn_commit(txn, 0));
+
+    m_lenv = (LocalEnvironment *)m_env;
+    m_lenv->journal()->test_flush_buffers();
+
+    /* backup the files */
+    REQUIRE(true == os::copy(Utils::opath(".test"),
+          Utils::opath(".test.bak")));
+    REQUIRE(true == os::copy(Utils::opath(".test.jrn0"),
+          Utils::opath(".test.bak0")));
+    REQUIRE(true == os::copy(Utils::opath(".test.jrn1"),
+          Utils::opath(".test.bak1")));
+    REQUIRE(0 == ups_env_close(m_env, UPS_AUTO_CLEANUP));
+
+    /* restore the files */
+    REQUIRE(true == os::copy(Utils::opath(".test.bak"),
+          Utils::opath(".test")));
+    REQUIRE(true == os::copy(Utils::opath(".test.bak0"),
+          Utils::opath(".test.jrn0")));
+    REQUIRE(true == os::copy(Utils::opath(".test.bak1"),
+          Utils::opath(".test.jrn1")));
+
+    /* the recovery fails after some operations were written to the file */
+    bool interrupted = false;
+    ups_parameter_t params[] = {
+      {UPS_PARAM_RECOVERY_PROGRESS_CALLBACK, (uint64_t)&interruptRecovery},
+      {UPS_PARAM_RECOVERY_PROGRESS_CONTEXT, (uint64_t)&interrupted},
+      {0, 0}
+    };
+    ups_status_t st = ups_env_open(&m_env, Utils::opath(".test"),
+                UPS_ENABLE_TRANSACTIONS | UPS_AUTO_RECOVERY, &params[0]);
+    ErrorInducer::activate(false);
+    REQUIRE(true == interrupted);
+    REQUIRE(UPS_INTERNAL_ERROR == st);
+
+    /* the second recovery replays these operations again */
+    REQUIRE(0 == ups_env_open(&m_env, Utils::opath(".test"),
+                UPS_ENABLE_TRANSACTIONS | UPS_AUTO_RECOVERY, 0));
+    verifyJournalIsEmpty();
+
+    REQUIRE(0 == ups_env_open_db(m_env, &m_db, 1, 0, 0));
+    for (int i = 0; i < kKeys; i++) {
+      ups_key_t key = ups_make_key(&i, sizeof(i));
+      ups_record_t rec = {0};
+      REQUIRE(0 == ups_db_find(m_db, 0, &key, &rec, 0));
+      REQUIRE(i == *(int *)rec.data);
+    }
+    REQUIRE(0 == ups_db_check_integrity(m_db, 0));
+#endif
+  }
+
+  void checkpointTest() {
+#ifndef WIN32
+    const int kKeys = 100;
+    ups_txn_t *txn;
+
+    // the checkpoint thread runs after the interval
+    teardown();
+    ups_parameter_t params[] = {
+      {UPS_PARAM_JOURNAL_CHECKPOINT_INTERVAL, 10},
+      {UPS_PARAM_JOURNAL_CHECKPOINT_BYTES, 1024 * 1024},
+      {0, 0}
+    };
+    REQUIRE(0 == ups_env_create(&m_env, Utils::opath(".test"),
+                UPS_ENABLE_TRANSACTIONS | UPS_DONT_FLUSH_TRANSACTIONS,
+                0644, &params[0]));
+    REQUIRE(0 == ups_env_create_db(m_env, &m_db, 1, 0, 0));
+
+    params[0].value = 0;
+    params[1].value = 0;
+    REQUIRE(0 == ups_env_get_parameters(m_env, &params[0]));
+    REQUIRE(params[0].value == 10);
+    REQUIRE(params[1].value == 1024 * 1024);
+
+    for (int i = 0; i < kKeys; i++) {
+      ups_key_t key = ups_make_key(&i, sizeof(i));
+      ups_record_t rec = ups_make_record(&i, sizeof(i));
+      REQUIRE(0 == ups_txn_begin(&txn, m_env, 0, 0, 0));
+      REQUIRE(0 == ups_db_insert(m_db, txn, &key, &rec, 0));
+      REQUIRE(0 == ups_txn_commit(txn, 0));
+    }
+
+    ups_env_metrics_t metrics;
+    for (int i = 0; i < 500; i++) {
+      REQUIRE(0 == ups_env_get_metrics(m_env, &metrics));
+      if (metrics.journal_checkpoints > 0)
+        break;
+      boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+    }
+    REQUIRE(metrics.journal_checkpoints > 0);
+    REQUIRE(0 == ups_env_close(m_env, UPS_AUTO_CLEANUP));
+
+    // without an interval, the commits wake up the checkpoint thread
+    // as soon as the journal grew by UPS_PARAM_JOURNAL_CHECKPOINT_BYTES
+    params[0].value = 0;
+    params[1].value = 1024;
+    REQUIRE(0 == ups_env_create(&m_env, Utils::opath(".test"),
+                UPS_ENABLE_TRANSACTIONS | UPS_DONT_FLUSH_TRANSACTIONS,
+                0644, &params[0]));
+    REQUIRE(0 == ups_env_create_db(m_env, &m_db, 1, 0, 0));
+
+    for (int i = 0; i < kKeys; i++) {
+      ups_key_t key = ups_make_key(&i, sizeof(i));
+      ups_record_t rec = ups_make_record(&i, sizeof(i));
+      REQUIRE(0 == ups_txn_begin(&txn, m_env, 0, 0, 0));
+      REQUIRE(0 == ups_db_insert(m_db, txn, &key, &rec, 0));
+      REQUIRE(0 == ups_txn_commit(txn, 0));
+    }
+
+    for (int i = 0; i < 500; i++) {
+      REQUIRE(0 == ups_env_get_metrics(m_env, &metrics));
+      if (metrics.journal_checkpoints > 0)
+        break;
+      boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+    }
+    REQUIRE(metrics.journal_checkpoints > 0);
+    REQUIRE(0 == ups_env_close(m_env, UPS_AUTO_CLEANUP));
+
+    // without the thread; the checkpoint is run manually
+    REQUIRE(0 == ups_env_create(&m_env, Utils::opath(".test"),
+                UPS_ENABLE_TRANSACTIONS | UPS_DONT_FLUSH_TRANSACTIONS,
+                0644, 0));
+    REQUIRE(0 == ups_env_create_db(m_env, &m_db, 1, 0, 0));
+    m_lenv = (LocalEnvironment *)m_env;
+
+    for (int i = 0; i < kKeys; i++) {
+      ups_key_t key = ups_make_key(&i, sizeof(i));
+      ups_record_t rec = ups_make_record(&i, sizeof(i));
+      REQUIRE(0 == ups_txn_begin(&txn, m_env, 0, 0, 0));
+      REQUIRE(0 == ups_db_insert(m_db, txn, &key, &rec, 0));
+      REQUIRE(0 == ups_txn_commit(txn, 0));
+    }
+
+    // this Transaction remains active during the checkpoint
+    ups_txn_t *active;
+    int k = kKeys * 10;
+    ups_key_t key = ups_make_key(&k, sizeof(k));
+    ups_record_t rec = ups_make_record(&k, sizeof(k));
+    REQUIRE(0 == ups_txn_begin(&active, m_env, 0, 0, 0));
+    REQUIRE(0 == ups_db_insert(m_db, active, &key, &rec, 0));
+
+    // the first call starts the checkpoint, a later call completes it
+    REQUIRE(false == m_lenv->checkpoint());
+    bool completed = false;
+    for (int i = 0; i < 500 && !completed; i++) {
+      completed = m_lenv->checkpoint();
+      if (!completed)
+        boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+    }
+    REQUIRE(completed == true);
+    REQUIRE(0 == ups_env_get_metrics(m_env, &metrics));
+    REQUIRE(metrics.journal_checkpoints == 1);
+
+    // the recovery starts with the active Transaction
+    Journal *j = m_lenv->journal();
+    j->test_flush_buffers();
+    Journal::Iterator it;
+    PJournalEntry entry;
+    ByteArray auxbuffer;
+    uint64_t min_lsn = 0;
+    while (true) {
+      j->test_read_entry(&it, &entry, &auxbuffer);
+      if (entry.lsn == 0)
+        break;
+      if (entry.type == Journal::kEntryTypeCheckpoint)
+        min_lsn = ((PJournalEntryCheckpoint *)auxbuffer.data())->min_lsn;
+    }
+    uint64_t begin_lsn = ((LocalTransaction *)active)->get_begin_lsn();
+    REQUIRE(begin_lsn != 0);
+    REQUIRE(min_lsn == begin_lsn);
+
+    // these Transactions are not flushed
+    for (int i = kKeys; i < kKeys + 10; i++) {
+      ups_key_t key = ups_make_key(&i, sizeof(i));
+      ups_record_t rec = ups_make_record(&i, sizeof(i));
+      REQUIRE(0 == ups_txn_begin(&txn, m_env, 0, 0, 0));
+      REQUIRE(0 == ups_db_insert(m_db, txn, &key, &rec, 0));
+      REQUIRE(0 == ups_txn_commit(txn, 0));
+    }
+    m_lenv->journal()->test_flush_buffers();
+
+    /* backup the files */
+    REQUIRE(true == os::copy(Utils::opath(".test"),
+          Utils::opath(".test.bak")));
+    REQUIRE(true == os::copy(Utils::opath(".test.jrn0"),
+          Utils::opath(".test.bak0")));
+    REQUIRE(true == os::copy(Utils::opath(".test.jrn1"),
+          Utils::opath(".test.bak1")));
+    REQUIRE(0 == ups_txn_abort(active, 0));
+    REQUIRE(0 == ups_env_close(m_env, UPS_AUTO_CLEANUP));
+
+    /* restore the files */
+    REQUIRE(true == os::copy(Utils::opath(".test.bak"),
+          Utils::opath(".test")));
+    REQUIRE(true == os::copy(Utils::opath(".test.bak0"),
+          Utils::opath(".test.jrn0")));
+    REQUIRE(true == os::copy(Utils::opath(".test.bak1"),
+          Utils::opath(".test.jrn1")));
+
+    RecoveryProgress progress;
+    ups_parameter_t recovery_params[] = {
+      {UPS_PARAM_RECOVERY_PROGRESS_CALLBACK, (uint64_t)&recoveryProgress},
+      {UPS_PARAM_RECOVERY_PROGRESS_CONTEXT, (uint64_t)&progress},
+      {0, 0}
+    };
+    REQUIRE(0 == ups_env_open(&m_env, Utils::opath(".test"),
+                UPS_ENABLE_TRANSACTIONS | UPS_AUTO_RECOVERY,
+                &recovery_params[0]));
+
+    /* only the Transactions after the checkpoint were replayed */
+    REQUIRE(progress.total == 10);
+    REQUIRE(progress.replayed == 10);
+
+    REQUIRE(0 == ups_env_open_db(m_env, &m_db, 1, 0, 0));
+    for (int i = 0; i < kKeys + 10; i++) {
+      ups_key_t key = ups_make_key(&i, sizeof(i));
+      ups_record_t rec = ups_make_record(0, 0);
+      REQUIRE(0 == ups_db_find(m_db, 0, &key, &rec, 0));
+      REQUIRE(i == *(int *)rec.data);
+    }
+
+    /* the active Transaction was not committed and was not replayed */
+    REQUIRE(UPS_KEY_NOT_FOUND == ups_db_find(m_db, 0, &key, &rec, 0));
+#endif
+  }
+
   void issue45Test() {
     ups_txn_t *txn;
     ups_key_t key = {0};
@@ -1333,6 +1890,191 @@ struct JournalFixture {
     REQUIRE(0 == ups_env_open_db(m_env, &m_db, 1, 0, 0));
   }
 
+  void pageDeltaTest() {
+#ifndef WIN32
+    const int kKeys = 2000;
+    ups_txn_t *txn;
+
+    // all changesets are stored in the first segment
+    teardown();
+    ups_parameter_t params[] = {
+      {UPS_PARAM_JOURNAL_SWITCH_THRESHOLD, 1000000},
+      {0, 0}
+    };
+    REQUIRE(0 == ups_env_create(&m_env, Utils::opath(".test"),
+                UPS_ENABLE_TRANSACTIONS, 0644, &params[0]));
+
+    /* backup the empty database file */
+    REQUIRE(true == os::copy(Utils::opath(".test"),
+          Utils::opath(".test.bak")));
+
+    REQUIRE(0 == ups_env_create_db(m_env, &m_db, 1, 0, 0));
+
+    char buffer[64] = {0};
+    for (int i = 0; i < kKeys; i++) {
+      ups_key_t key = ups_make_key(&i, sizeof(i));
+      ::memcpy(buffer, &i, sizeof(i));
+      ups_record_t rec = ups_make_record(buffer, sizeof(buffer));
+      REQUIRE(0 == ups_txn_begin(&txn, m_env, 0, 0, 0));
+      REQUIRE(0 == ups_db_insert(m_db, txn, &key, &rec, 0));
+      REQUIRE(0 == ups_txn_commit(txn, 0));
+    }
+
+    /* the changesets only store the modified parts of the pages */
+    ups_env_metrics_t metrics;
+    REQUIRE(0 == ups_env_get_metrics(m_env, &metrics));
+    uint64_t before = metrics.journal_page_bytes_before_delta;
+    uint64_t after = metrics.journal_page_bytes_after_delta * 4;
+    REQUIRE(before > 0);
+    REQUIRE(after < before);
+
+    /* backup the journal */
+    REQUIRE(true == os::copy(Utils::opath(".test.jrn0"),
+          Utils::opath(".test.bak0")));
+    REQUIRE(true == os::copy(Utils::opath(".test.jrn1"),
+          Utils::opath(".test.bak1")));
+
+    /* close the environment, then restore the files */
+    REQUIRE(0 == ups_env_close(m_env, UPS_AUTO_CLEANUP));
+    REQUIRE(true == os::copy(Utils::opath(".test.bak"),
+          Utils::opath(".test")));
+    REQUIRE(true == os::copy(Utils::opath(".test.bak0"),
+          Utils::opath(".test.jrn0")));
+    REQUIRE(true == os::copy(Utils::opath(".test.bak1"),
+          Utils::opath(".test.jrn1")));
+
+    /* all pages are rebuilt from their deltas */
+    REQUIRE(0 ==
+        ups_env_open(&m_env, Utils::opath(".test"),
+            UPS_ENABLE_TRANSACTIONS | UPS_AUTO_RECOVERY, 0));
+    REQUIRE(0 == ups_env_open_db(m_env, &m_db, 1, 0, 0));
+    REQUIRE(0 == ups_db_check_integrity(m_db, 0));
+
+    for (int i = 0; i < kKeys; i++) {
+      ups_key_t key = ups_make_key(&i, sizeof(i));
+      ups_record_t rec = {0};
+      REQUIRE(0 == ups_db_find(m_db, 0, &key, &rec, 0));
+      REQUIRE(rec.size == sizeof(buffer));
+      REQUIRE(0 == ::memcmp(rec.data, &i, sizeof(i)));
+    }
+#endif
+  }
+
+  // Reads the file at |filename| into |data|
+  void readFile(const char *filename, std::vector<uint8_t> &data) {
+    File f;
+    f.open(filename, true);
+    data.resize((size_t)f.file_size());
+    if (!data.empty())
+      f.pread(0, &data[0], data.size());
+    f.close();
+  }
+
+  // Writes a journal with a single changeset in the format of older
+  // releases (|version| is 0) to the first segment; the second segment
+  // is empty
+  void writeVersion0Journal(uint16_t version, uint32_t num_pages,
+                  std::vector<uint8_t> &pages) {
+    PJournalEntry entry;
+    entry.lsn = 1;
+    entry.type = Journal::kEntryTypeChangeset;
+    entry.version = version;
+    PJournalEntryChangeset changeset;
+    changeset.num_pages = num_pages;
+    entry.followup_size = sizeof(changeset) + pages.size();
+
+    File f;
+    f.create(Utils::opath(".test.jrn0"), 0644);
+    f.write(&entry, sizeof(entry));
+    f.write(&changeset, sizeof(changeset));
+    f.write(&pages[0], pages.size());
+    f.close();
+    f.create(Utils::opath(".test.jrn1"), 0644);
+    f.close();
+  }
+
+  void recoverVersion0ChangesetTest() {
+#ifndef WIN32
+    ups_txn_t *txn;
+
+    teardown();
+    REQUIRE(0 == ups_env_create(&m_env, Utils::opath(".test"),
+                UPS_ENABLE_TRANSACTIONS, 0644, 0));
+    REQUIRE(0 == ups_env_create_db(m_env, &m_db, 1, 0, 0));
+    uint32_t page_size = ((LocalEnvironment *)m_env)->config().page_size_bytes;
+    for (int i = 0; i < 10; i++) {
+      ups_key_t key = ups_make_key(&i, sizeof(i));
+      ups_record_t rec = ups_make_record(&i, sizeof(i));
+      REQUIRE(0 == ups_txn_begin(&txn, m_env, 0, 0, 0));
+      REQUIRE(0 == ups_db_insert(m_db, txn, &key, &rec, 0));
+      REQUIRE(0 == ups_txn_commit(txn, 0));
+    }
+    REQUIRE(0 == ups_env_close(m_env, UPS_AUTO_CLEANUP));
+
+    /* backup the database file */
+    REQUIRE(true == os::copy(Utils::opath(".test"),
+          Utils::opath(".test.bak")));
+
+    REQUIRE(0 == ups_env_open(&m_env, Utils::opath(".test"),
+                UPS_ENABLE_TRANSACTIONS, 0));
+    REQUIRE(0 == ups_env_open_db(m_env, &m_db, 1, 0, 0));
+    for (int i = 10; i < 20; i++) {
+      ups_key_t key = ups_make_key(&i, sizeof(i));
+      ups_record_t rec = ups_make_record(&i, sizeof(i));
+      REQUIRE(0 == ups_txn_begin(&txn, m_env, 0, 0, 0));
+      REQUIRE(0 == ups_db_insert(m_db, txn, &key, &rec, 0));
+      REQUIRE(0 == ups_txn_commit(txn, 0));
+    }
+    REQUIRE(0 == ups_env_close(m_env, UPS_AUTO_CLEANUP));
+
+    /* older releases logged the full images of the modified pages, and
+     * their page headers only store the address and the compressed size */
+    std::vector<uint8_t> before, after, pages;
+    readFile(Utils::opath(".test.bak"), before);
+    readFile(Utils::opath(".test"), after);
+    uint32_t num_pages = 0;
+    for (uint64_t address = 0; address < after.size(); address += page_size) {
+      if (address + page_size <= before.size()
+            && 0 == ::memcmp(&before[address], &after[address], page_size))
+        continue;
+      uint32_t compressed_size = 0;
+      pages.insert(pages.end(), (uint8_t *)&address,
+                      (uint8_t *)&address + sizeof(address));
+      pages.insert(pages.end(), (uint8_t *)&compressed_size,
+                      (uint8_t *)&compressed_size + sizeof(compressed_size));
+      pages.insert(pages.end(), &after[address], &after[address] + page_size);
+      num_pages++;
+    }
+    REQUIRE(num_pages > 0);
+    REQUIRE(PJournalEntryPageHeader::kSizeofVersion0
+                    == sizeof(uint64_t) + sizeof(uint32_t));
+
+    /* journals of a newer release are rejected */
+    writeVersion0Journal(PJournalEntry::kFormatVersion + 1, num_pages, pages);
+    REQUIRE(UPS_INV_FILE_VERSION == ups_env_open(&m_env,
+                Utils::opath(".test"),
+                UPS_ENABLE_TRANSACTIONS | UPS_AUTO_RECOVERY, 0));
+
+    /* restore the database file, then recover the old journal */
+    writeVersion0Journal(0, num_pages, pages);
+    REQUIRE(true == os::copy(Utils::opath(".test.bak"),
+          Utils::opath(".test")));
+    REQUIRE(UPS_NEED_RECOVERY == ups_env_open(&m_env, Utils::opath(".test"),
+                UPS_ENABLE_TRANSACTIONS, 0));
+    REQUIRE(0 == ups_env_open(&m_env, Utils::opath(".test"),
+                UPS_ENABLE_TRANSACTIONS | UPS_AUTO_RECOVERY, 0));
+    REQUIRE(0 == ups_env_open_db(m_env, &m_db, 1, 0, 0));
+    REQUIRE(0 == ups_db_check_integrity(m_db, 0));
+
+    for (int i = 0; i < 20; i++) {
+      ups_key_t key = ups_make_key(&i, sizeof(i));
+      ups_record_t rec = {0};
+      REQUIRE(0 == ups_db_find(m_db, 0, &key, &rec, 0));
+      REQUIRE(i == *(int *)rec.data);
+    }
+#endif
+  }
+
   void issue71Test() {
     for (int i = 0; i < 80; i++) {
       ups_key_t key = ups_make_key((void *)&i, sizeof(i));
@@ -1344,14 +2086,15 @@ struct JournalFixture {
     REQUIRE(0 == ups_env_close(m_env,
                 UPS_AUTO_CLEANUP | UPS_DONT_CLEAR_LOG));
 
-    /* verify the journal file sizes */
+    /* verify the journal file sizes; the segments are recycled as soon
+     * as their changesets were flushed */
     File f;
     f.open(".test.jrn0", 0);
-    REQUIRE(f.file_size() == 197796);
+    REQUIRE(f.file_size() == 4658);
     f.close();
 
     f.open(".test.jrn1", 0);
-    REQUIRE(f.file_size() == 1154720);
+    REQUIRE(f.file_size() == 1817);
     f.close();
 
     m_env = 0; // do not close again when tearing down
@@ -1514,12 +2257,54 @@ TEST_CASE("Journal/switchThresholdTest", "")
   f.switchThresholdTest();
 }
 
+TEST_CASE("Journal/groupCommitTest", "")
+{
+  JournalFixture f;
+  f.groupCommitTest();
+}
+
+TEST_CASE("Journal/segmentTest", "")
+{
+  JournalFixture f;
+  f.segmentTest();
+}
+
+TEST_CASE("Journal/partitionedRecoveryTest", "")
+{
+  JournalFixture f;
+  f.partitionedRecoveryTest();
+}
+
+TEST_CASE("Journal/interruptedRecoveryTest", "")
+{
+  JournalFixture f;
+  f.interruptedRecoveryTest();
+}
+
+TEST_CASE("Journal/checkpointTest", "")
+{
+  JournalFixture f;
+  f.checkpointTest();
+}
+
 TEST_CASE("Journal/issue45Test", "")
 {
   JournalFixture f;
   f.issue45Test();
 }
 
+TEST_CASE("Journal/pageDeltaTest", "")
+{
+  JournalFixture f;
+  f.pageDeltaTest();
+}
+
+TEST_CASE("Journal/recoverVersion0ChangesetTest", "")
+{
+  JournalFixture f;
+  f.recoverVersion0ChangesetTest();
+}
+
 TEST_CASE("Journal/issue71Test", "")
 {
   JournalFixture f;
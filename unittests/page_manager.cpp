@@ -15,11 +15,17 @@
  * See the file COPYING for License information.
  */
 
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
 #include "3rdparty/catch/catch.hpp"
 
 #include "utils.h"
 
 #include "1base/pickle.h"
+#include "1globals/globals.h"
+#include "1os/file.h"
 #include "2page/page.h"
 #include "2device/device.h"
 #include "3page_manager/freelist.h"
@@ -256,6 +262,422 @@ struct PageManagerFixture {
     REQUIRE(false == pm->state->cache.is_cache_full());
   }
 
+  void cacheScanResistanceTest(int policy) {
+    LocalEnvironment *lenv = (LocalEnvironment *)m_env;
+
+    EnvConfig config;
+    config.cache_size_bytes = 16 * config.page_size_bytes;
+    config.cache_policy = policy;
+    Cache cache(config);
+
+    PPageData pers;
+    memset(&pers, 0, sizeof(pers));
+    std::vector<Page *> v;
+
+    // 8 "hot" pages are loaded, evicted and loaded again
+    for (unsigned int i = 0; i < 8; i++) {
+      Page *p = new Page(lenv->device());
+      p->set_without_header(true);
+      p->assign_allocated_buffer(&pers, i + 1);
+      v.push_back(p);
+      cache.put(p);
+      cache.del(p);
+      cache.put(p);
+      REQUIRE(p == cache.get(i + 1));
+    }
+
+    // then a scan loads 20 "cold" pages
+    for (unsigned int i = 0; i < 20; i++) {
+      Page *p = new Page(lenv->device());
+      p->set_without_header(true);
+      p->assign_allocated_buffer(&pers, i + 100);
+      v.push_back(p);
+      cache.put(p);
+    }
+
+    std::vector<uint64_t> candidates;
+    std::vector<Page *> garbage;
+    cache.purge_candidates(candidates, garbage, 0);
+    REQUIRE(candidates.empty());
+    REQUIRE(garbage.size() == 12);
+
+    // 2Q only evicts cold pages; LRU evicts the hot pages first
+    int hot_pages = 0;
+    for (size_t i = 0; i < garbage.size(); i++)
+      if (garbage[i]->address() < 100)
+        hot_pages++;
+    if (policy == UPS_CACHE_POLICY_2Q)
+      REQUIRE(hot_pages == 0);
+    else
+      REQUIRE(hot_pages == 8);
+
+    for (size_t i = 0; i < v.size(); i++) {
+      cache.del(v[i]);
+      v[i]->set_data(0);
+      delete v[i];
+    }
+    REQUIRE(cache.current_elements() == 0);
+  }
+
+  void cacheShardTest() {
+    LocalEnvironment *lenv = (LocalEnvironment *)m_env;
+
+    EnvConfig config;
+    config.cache_size_bytes = 16 * config.page_size_bytes;
+    REQUIRE(1u == Cache(config).num_shards());
+
+    config.cache_size_bytes = 64 * CacheState::kMinPagesPerShard
+                                * config.page_size_bytes;
+    Cache cache(config);
+    REQUIRE((size_t)CacheState::kMaxShards == cache.num_shards());
+
+    PPageData pers;
+    memset(&pers, 0, sizeof(pers));
+    std::vector<Page *> v;
+
+    for (unsigned int i = 0; i < 100; i++) {
+      Page *p = new Page(lenv->device());
+      p->set_without_header(true);
+      p->assign_allocated_buffer(&pers, (i + 1) * config.page_size_bytes);
+      v.push_back(p);
+      cache.put(p);
+    }
+    REQUIRE(100u == cache.current_elements());
+    REQUIRE(100u == cache.allocated_elements());
+
+    for (unsigned int i = 0; i < 100; i++)
+      REQUIRE(v[i] == cache.get((i + 1) * config.page_size_bytes));
+    for (unsigned int i = 0; i < 10; i++)
+      REQUIRE((Page *)0 == cache.get((i + 1000) * config.page_size_bytes));
+
+    ups_env_metrics_t metrics;
+    memset(&metrics, 0, sizeof(metrics));
+    cache.fill_metrics(&metrics);
+    REQUIRE(100u == metrics.cache_hits);
+    REQUIRE(10u == metrics.cache_misses);
+    REQUIRE((uint32_t)CacheState::kMaxShards == metrics.cache_shards);
+
+    // the pages are distributed over the shards
+    uint64_t hits = 0;
+    int used_shards = 0;
+    for (uint32_t i = 0; i < metrics.cache_shards; i++) {
+      hits += metrics.cache_shard_hits[i];
+      if (metrics.cache_shard_hits[i] > 0)
+        used_shards++;
+    }
+    REQUIRE(100u == hits);
+    REQUIRE(used_shards > 1);
+
+    for (size_t i = 0; i < v.size(); i++) {
+      cache.del(v[i]);
+      v[i]->set_data(0);
+      delete v[i];
+    }
+    REQUIRE(0u == cache.current_elements());
+    REQUIRE(0u == cache.allocated_elements());
+  }
+
+  void setCacheSizeRuntimeTest() {
+    uint64_t size = 32 * UPS_DEFAULT_PAGE_SIZE;
+    ups_parameter_t param[] = {
+      { UPS_PARAM_CACHE_SIZE, size },
+      { 0, 0 }
+    };
+    REQUIRE(0 == ups_env_set_parameters(m_env, &param[0]));
+
+    ups_parameter_t query[] = {
+      { UPS_PARAM_CACHE_SIZE, 0 },
+      { 0, 0 }
+    };
+    REQUIRE(0 == ups_env_get_parameters(m_env, &query[0]));
+    REQUIRE(size == query[0].value);
+
+    LocalEnvironment *lenv = (LocalEnvironment *)m_env;
+    REQUIRE(size == lenv->page_manager()->state->cache.capacity());
+
+    ups_parameter_t zero[] = {
+      { UPS_PARAM_CACHE_SIZE, 0 },
+      { 0, 0 }
+    };
+    REQUIRE(UPS_INV_PARAMETER == ups_env_set_parameters(m_env, &zero[0]));
+
+    ups_parameter_t unknown[] = {
+      { UPS_PARAM_PAGE_SIZE, 1024 },
+      { 0, 0 }
+    };
+    REQUIRE(UPS_INV_PARAMETER == ups_env_set_parameters(m_env, &unknown[0]));
+    REQUIRE(UPS_INV_PARAMETER == ups_env_set_parameters(m_env, 0));
+    REQUIRE(size == lenv->page_manager()->state->cache.capacity());
+  }
+
+  void cacheShrinkTest(bool use_budget) {
+    LocalEnvironment *lenv = (LocalEnvironment *)m_env;
+
+    EnvConfig config;
+    config.cache_size_bytes = 200 * config.page_size_bytes;
+    Cache cache(config);
+
+    PPageData pers;
+    memset(&pers, 0, sizeof(pers));
+    std::vector<Page *> v;
+
+    for (unsigned int i = 0; i < 100; i++) {
+      Page *p = new Page(lenv->device());
+      p->set_without_header(true);
+      p->assign_allocated_buffer(&pers, (i + 1) * config.page_size_bytes);
+      v.push_back(p);
+      cache.put(p);
+    }
+    REQUIRE(false == cache.is_cache_full());
+
+    if (use_budget) {
+      // all caches together exceed the budget by 10 pages; this cache
+      // evicts its share
+      ups_set_cache_budget(Globals::ms_cache_usage
+                      - 10 * config.page_size_bytes);
+    }
+    else
+      cache.set_capacity(16 * config.page_size_bytes);
+    REQUIRE(true == cache.is_cache_full());
+
+    std::vector<uint64_t> candidates;
+    std::vector<Page *> garbage;
+    cache.purge_candidates(candidates, garbage, 0);
+    REQUIRE(candidates.empty());
+    if (use_budget) {
+      REQUIRE(garbage.size() > 0);
+      REQUIRE(garbage.size() <= 10);
+      ups_set_cache_budget(0);
+      REQUIRE(false == cache.is_cache_full());
+    }
+    else {
+      // the cache is trimmed incrementally
+      REQUIRE(garbage.size() == (size_t)CacheState::kMaxEvictionsPerShard);
+    }
+
+    for (size_t i = 0; i < v.size(); i++) {
+      cache.del(v[i]);
+      v[i]->set_data(0);
+      delete v[i];
+    }
+  }
+
+  // a large cache only simulates the sampled pages in its ghost caches;
+  // the estimated hit ratios match those of a simulation of all pages
+  void cacheGhostSamplingTest() {
+    LocalEnvironment *lenv = (LocalEnvironment *)m_env;
+
+    EnvConfig config;
+    const size_t capacity = 2048;
+    config.cache_size_bytes = capacity * config.page_size_bytes;
+    Cache cache(config);
+    REQUIRE(cache.state.num_shards > 1);
+    REQUIRE(1u < cache.state.sample_rate.load());
+
+    // the cached pages are hit without simulating the ghost caches
+    std::vector<PPageData> pers(capacity);
+    memset(&pers[0], 0, pers.size() * sizeof(PPageData));
+    std::vector<Page *> v;
+    for (size_t i = 0; i < capacity; i++) {
+      Page *p = new Page(lenv->device());
+      p->assign_allocated_buffer(&pers[i], (i + 1) * config.page_size_bytes);
+      p->set_type(Page::kTypeBindex);
+      v.push_back(p);
+      cache.put(p);
+    }
+
+    // the unsampled simulation
+    GhostCache full_double, full_half;
+    full_double.capacity = 2 * capacity;
+    full_half.capacity = capacity / 2;
+
+    // almost all accesses hit the cache; the sampled hits are buffered.
+    // 0.1% of the accesses are spread over 8192 pages
+    uint32_t seed = 1;
+    for (int i = 0; i < 200000; i++) {
+      seed = seed * 1103515245 + 12345;
+      uint32_t r = seed >> 8;
+      uint64_t page_id = 1 + (r / 1000) % (r % 1000 < 999 ? 2048 : 8192);
+      uint64_t address = page_id * config.page_size_bytes;
+      cache.get(address);
+      full_double.access(address);
+      full_half.access(address);
+    }
+
+    ups_env_metrics_t metrics;
+    memset(&metrics, 0, sizeof(metrics));
+    cache.fill_metrics(&metrics);
+    double expected_double = (double)full_double.hits / full_double.accesses;
+    double expected_half = (double)full_half.hits / full_half.accesses;
+    REQUIRE(expected_double > expected_half);
+    REQUIRE(std::abs(metrics.cache_hit_ratio_double - expected_double) < 0.05);
+    REQUIRE(std::abs(metrics.cache_hit_ratio_half - expected_half) < 0.05);
+
+    for (size_t i = 0; i < v.size(); i++) {
+      cache.del(v[i]);
+      v[i]->set_data(0);
+      delete v[i];
+    }
+  }
+
+  // a new capacity is distributed over the shards; large caches sample
+  // their ghost caches
+  void cacheResizeShardsTest() {
+    EnvConfig config;
+    config.cache_size_bytes = 2 * CacheState::kMinPagesPerShard
+                                * config.page_size_bytes;
+    Cache cache(config);
+    REQUIRE(2u == cache.state.num_shards);
+    REQUIRE(1u == cache.state.sample_rate.load());
+
+    size_t sizes[] = {4096, 100, 1025};
+    for (int i = 0; i < 3; i++) {
+      uint64_t capacity = sizes[i] * config.page_size_bytes;
+      cache.set_capacity(capacity);
+      REQUIRE(capacity == cache.capacity());
+
+      size_t total = 0;
+      for (size_t s = 0; s < cache.state.num_shards; s++) {
+        CacheShard &shard = cache.state.shards[s];
+        REQUIRE(shard.capacity_pages >= sizes[i] / 2);
+        REQUIRE(shard.ghost_double.capacity == 2 * (shard.capacity_pages
+                                / cache.state.sample_rate.load()));
+        total += shard.capacity_pages;
+      }
+      REQUIRE(sizes[i] == total);
+      size_t rate = sizes[i] > CacheState::kMinSampledPages
+                      ? (size_t)CacheState::kGhostSampleRate
+                      : 1u;
+      REQUIRE(rate == cache.state.sample_rate.load());
+    }
+  }
+
+  // read-only operations purge the cache as well; pages which are used
+  // by another reader are skipped
+  void readOnlyPurgeTest() {
+    LocalEnvironment *lenv = (LocalEnvironment *)m_env;
+    PageManager *pm = lenv->page_manager();
+
+    std::vector<uint8_t> buffer(UPS_DEFAULT_PAGE_SIZE);
+    for (uint32_t i = 0; i < 200; i++) {
+      ups_key_t key = ups_make_key(&i, sizeof(i));
+      ups_record_t rec = ups_make_record(&buffer[0], (uint32_t)buffer.size());
+      REQUIRE(0 == ups_db_insert(m_db, 0, &key, &rec, 0));
+    }
+    REQUIRE(0 == ups_env_flush(m_env, 0));
+
+    size_t before = pm->state->cache.current_elements();
+    pm->set_cache_size(16 * UPS_DEFAULT_PAGE_SIZE);
+    REQUIRE(true == pm->state->cache.is_cache_full());
+
+    // another reader uses all cached pages; nothing is purged
+    Context other(lenv, 0, (LocalDatabase *)m_db, true);
+    uint64_t file_size = lenv->device()->file_size();
+    for (uint64_t address = UPS_DEFAULT_PAGE_SIZE; address < file_size;
+            address += UPS_DEFAULT_PAGE_SIZE)
+      pm->fetch(&other, address, PageManager::kOnlyFromCache);
+
+    Context context(lenv, 0, (LocalDatabase *)m_db, true);
+    pm->purge_cache(&context);
+    REQUIRE(before == pm->state->cache.current_elements());
+
+    // the other reader is done; now the pages are purged
+    other.changeset.clear();
+    pm->purge_cache(&context);
+    REQUIRE(before > pm->state->cache.current_elements());
+  }
+
+  void cacheMetricsTest() {
+    LocalEnvironment *lenv = (LocalEnvironment *)m_env;
+
+    EnvConfig config;
+    config.cache_size_bytes = 16 * config.page_size_bytes;
+    Cache cache(config);
+
+    PPageData pers[8];
+    memset(&pers[0], 0, sizeof(pers));
+    std::vector<Page *> v;
+
+    for (unsigned int i = 0; i < 8; i++) {
+      Page *p = new Page(lenv->device());
+      p->assign_allocated_buffer(&pers[i], (i + 1) * config.page_size_bytes);
+      p->set_type(i < 6 ? Page::kTypeBindex : Page::kTypeBlob);
+      v.push_back(p);
+      cache.put(p);
+    }
+    for (unsigned int i = 0; i < 8; i++)
+      REQUIRE(v[i] == cache.get((i + 1) * config.page_size_bytes));
+    cache.count_fetched_page(v[7]);
+    cache.count_dirty_evictions(3);
+    cache.evict(v[0]);
+
+    // a cyclic scan over 12 pages never hits a cache with 8 pages, but
+    // always hits a cache with 32 pages (after the first round)
+    for (unsigned int round = 0; round < 5; round++)
+      for (unsigned int i = 0; i < 12; i++)
+        cache.get((i + 100) * config.page_size_bytes);
+
+    ups_env_metrics_t metrics;
+    memset(&metrics, 0, sizeof(metrics));
+    cache.fill_metrics(&metrics);
+    REQUIRE(6u == metrics.cache_hits_index);
+    REQUIRE(0u == metrics.cache_misses_index);
+    REQUIRE(2u == metrics.cache_hits_blob);
+    REQUIRE(1u == metrics.cache_misses_blob);
+    REQUIRE(0u == metrics.cache_hits_page_manager);
+    REQUIRE(1u == metrics.cache_evictions_clean);
+    REQUIRE(3u == metrics.cache_evictions_dirty);
+    REQUIRE(metrics.cache_eviction_avg_age > 0u);
+    REQUIRE(metrics.cache_hit_ratio_half < 0.2);
+    REQUIRE(metrics.cache_hit_ratio_double > 0.7);
+
+    for (size_t i = 1; i < v.size(); i++)
+      cache.del(v[i]);
+    for (size_t i = 0; i < v.size(); i++) {
+      v[i]->set_data(0);
+      delete v[i];
+    }
+
+    // the Environment reports the metrics of its cache
+    for (int i = 0; i < 100; i++) {
+      ups_key_t key = ups_make_key(&i, sizeof(i));
+      ups_record_t rec = {0};
+      REQUIRE(0 == ups_db_insert(m_db, 0, &key, &rec, 0));
+      REQUIRE(0 == ups_db_find(m_db, 0, &key, &rec, 0));
+    }
+    REQUIRE(0 == ups_env_get_metrics(m_env, &metrics));
+    REQUIRE(metrics.cache_hits_index > 0u);
+  }
+
+  void cachePolicyParameterTest() {
+    REQUIRE(0 == ups_env_close(m_env, UPS_AUTO_CLEANUP));
+
+    ups_parameter_t bad[] = {
+      { UPS_PARAM_CACHE_POLICY, 99 },
+      { 0, 0 }
+    };
+    REQUIRE(UPS_INV_PARAMETER ==
+        ups_env_create(&m_env, Utils::opath(".test"), 0, 0644, &bad[0]));
+
+    ups_parameter_t param[] = {
+      { UPS_PARAM_CACHE_POLICY, UPS_CACHE_POLICY_2Q },
+      { 0, 0 }
+    };
+    REQUIRE(0 ==
+        ups_env_create(&m_env, Utils::opath(".test"), 0, 0644, &param[0]));
+
+    ups_parameter_t query[] = {
+      { UPS_PARAM_CACHE_POLICY, 0 },
+      { 0, 0 }
+    };
+    REQUIRE(0 == ups_env_get_parameters(m_env, &query[0]));
+    REQUIRE(UPS_CACHE_POLICY_2Q == query[0].value);
+
+    LocalEnvironment *lenv = (LocalEnvironment *)m_env;
+    PageManager *pm = lenv->page_manager();
+    REQUIRE(UPS_CACHE_POLICY_2Q == pm->state->cache.state.policy);
+  }
+
   void storeStateTest() {
     LocalEnvironment *lenv = (LocalEnvironment *)m_env;
     PageManagerState *state = lenv->page_manager()->state.get();
@@ -509,6 +931,465 @@ TEST_CASE("PageManager/cacheFullTest", "")
   f.cacheFullTest();
 }
 
+TEST_CASE("PageManager/cacheScanResistanceLruTest", "")
+{
+  PageManagerFixture f;
+  f.cacheScanResistanceTest(UPS_CACHE_POLICY_LRU);
+}
+
+TEST_CASE("PageManager/cacheScanResistance2QTest", "")
+{
+  PageManagerFixture f;
+  f.cacheScanResistanceTest(UPS_CACHE_POLICY_2Q);
+}
+
+TEST_CASE("PageManager/cacheShardTest", "")
+{
+  PageManagerFixture f;
+  f.cacheShardTest();
+}
+
+TEST_CASE("PageManager/setCacheSizeRuntimeTest", "")
+{
+  PageManagerFixture f;
+  f.setCacheSizeRuntimeTest();
+}
+
+TEST_CASE("PageManager/cacheGhostSamplingTest", "")
+{
+  PageManagerFixture f;
+  f.cacheGhostSamplingTest();
+}
+
+TEST_CASE("PageManager/cacheResizeShardsTest", "")
+{
+  PageManagerFixture f;
+  f.cacheResizeShardsTest();
+}
+
+TEST_CASE("PageManager/cacheShrinkTest", "")
+{
+  PageManagerFixture f;
+  f.cacheShrinkTest(false);
+}
+
+TEST_CASE("PageManager/cacheBudgetTest", "")
+{
+  PageManagerFixture f;
+  f.cacheShrinkTest(true);
+}
+
+TEST_CASE("PageManager/readOnlyPurgeTest", "")
+{
+  PageManagerFixture f;
+  f.readOnlyPurgeTest();
+}
+
+TEST_CASE("PageManager/cacheMetricsTest", "")
+{
+  PageManagerFixture f;
+  f.cacheMetricsTest();
+}
+
+TEST_CASE("PageManager/cachePolicyParameterTest", "")
+{
+  PageManagerFixture f;
+  f.cachePolicyParameterTest();
+}
+
+// Creates a database, then scans it with a cursor after reopening the
+// Environment; returns the number of pages loaded by the read-ahead
+static uint64_t
+scanColdDatabase(uint32_t read_ahead)
+{
+  ups_env_t *env;
+  ups_db_t *db;
+  ups_cursor_t *cursor;
+  ups_parameter_t create_params[] = {
+    { UPS_PARAM_PAGE_SIZE, 1024 },
+    { UPS_PARAM_READ_AHEAD, read_ahead },
+    { 0, 0 }
+  };
+  ups_parameter_t open_params[] = {
+    { UPS_PARAM_READ_AHEAD, read_ahead },
+    { 0, 0 }
+  };
+  ups_parameter_t db_params[] = {
+    { UPS_PARAM_KEY_TYPE, UPS_TYPE_UINT32 },
+    { 0, 0 }
+  };
+  std::vector<uint32_t> buffer(25);
+
+  REQUIRE(0 == ups_env_create(&env, Utils::opath(".test"), 0, 0644,
+                          create_params));
+  REQUIRE(0 == ups_env_create_db(env, &db, 1, 0, db_params));
+  for (uint32_t i = 0; i < 10000; i++) {
+    std::fill(buffer.begin(), buffer.end(), i);
+    ups_key_t key = ups_make_key(&i, sizeof(i));
+    ups_record_t rec = ups_make_record(&buffer[0],
+                          (uint32_t)(buffer.size() * sizeof(uint32_t)));
+    REQUIRE(0 == ups_db_insert(db, 0, &key, &rec, 0));
+  }
+  REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+
+  REQUIRE(0 == ups_env_open(&env, Utils::opath(".test"), 0, open_params));
+  REQUIRE(0 == ups_env_open_db(env, &db, 1, 0, 0));
+  REQUIRE(0 == ups_cursor_create(&cursor, db, 0, 0));
+
+  ups_parameter_t query[] = {
+    { UPS_PARAM_READ_AHEAD, 0 },
+    { 0, 0 }
+  };
+  REQUIRE(0 == ups_env_get_parameters(env, query));
+  REQUIRE(read_ahead == query[0].value);
+
+  ups_key_t key = {0};
+  ups_record_t rec = {0};
+  uint32_t i = 0;
+  while (ups_cursor_move(cursor, &key, &rec, UPS_CURSOR_NEXT) == 0) {
+    REQUIRE(i == *(uint32_t *)key.data);
+    REQUIRE(rec.size == buffer.size() * sizeof(uint32_t));
+    REQUIRE(i == ((uint32_t *)rec.data)[buffer.size() - 1]);
+    i++;
+  }
+  REQUIRE(10000u == i);
+
+  ups_env_metrics_t metrics;
+  REQUIRE(0 == ups_env_get_metrics(env, &metrics));
+  REQUIRE(0 == ups_cursor_close(cursor));
+  REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+  return metrics.page_count_prefetched;
+}
+
+TEST_CASE("PageManager/readAhead", "")
+{
+  REQUIRE(scanColdDatabase(8) > 0u);
+  REQUIRE(scanColdDatabase(0) == 0u);
+}
+
+// Fills two databases with 20000 keys each, then erases the second
+// database; its pages are moved to the freelist, and the nodes of the
+// first database are spread over the whole file
+static void
+fillAndEraseDatabase(ups_env_t *env, ups_db_t *db)
+{
+  ups_db_t *db2;
+  ups_parameter_t db_params[] = {
+    { UPS_PARAM_KEY_TYPE, UPS_TYPE_UINT32 },
+    { UPS_PARAM_RECORD_SIZE, sizeof(uint32_t) },
+    { 0, 0 }
+  };
+  REQUIRE(0 == ups_env_create_db(env, &db2, 2, 0, db_params));
+
+  for (uint32_t i = 0; i < 20000; i++) {
+    ups_key_t key = ups_make_key(&i, sizeof(i));
+    ups_record_t rec = ups_make_record(&i, sizeof(i));
+    REQUIRE(0 == ups_db_insert(db, 0, &key, &rec, 0));
+    REQUIRE(0 == ups_db_insert(db2, 0, &key, &rec, 0));
+  }
+
+  REQUIRE(0 == ups_db_close(db2, 0));
+  REQUIRE(0 == ups_env_erase_db(env, 2, 0));
+}
+
+// Verifies the keys which were inserted by |fillAndEraseDatabase|
+static void
+verifyCompactedDatabase(ups_db_t *db)
+{
+  REQUIRE(0 == ups_db_check_integrity(db, 0));
+
+  ups_cursor_t *cursor;
+  REQUIRE(0 == ups_cursor_create(&cursor, db, 0, 0));
+  ups_key_t key = {0};
+  ups_record_t rec = {0};
+  uint32_t i = 0;
+  while (ups_cursor_move(cursor, &key, &rec, UPS_CURSOR_NEXT) == 0) {
+    REQUIRE(i == *(uint32_t *)key.data);
+    REQUIRE(i == *(uint32_t *)rec.data);
+    i++;
+  }
+  REQUIRE(20000u == i);
+  REQUIRE(0 == ups_cursor_close(cursor));
+
+  for (i = 0; i < 20000; i += 97) {
+    ups_key_t key = ups_make_key(&i, sizeof(i));
+    REQUIRE(0 == ups_db_find(db, 0, &key, &rec, 0));
+    REQUIRE(i == *(uint32_t *)rec.data);
+  }
+}
+
+static void
+compactDatabase(uint32_t flags)
+{
+  ups_env_t *env;
+  ups_db_t *db;
+  ups_parameter_t env_params[] = {
+    { UPS_PARAM_PAGE_SIZE, 1024 },
+    { 0, 0 }
+  };
+  ups_parameter_t db_params[] = {
+    { UPS_PARAM_KEY_TYPE, UPS_TYPE_UINT32 },
+    { UPS_PARAM_RECORD_SIZE, sizeof(uint32_t) },
+    { 0, 0 }
+  };
+
+  REQUIRE(0 == ups_env_create(&env, Utils::opath(".test"), flags, 0644,
+                          env_params));
+  REQUIRE(0 == ups_env_create_db(env, &db, 1, 0, db_params));
+  fillAndEraseDatabase(env, db);
+
+  // couple a cursor to the last leaf
+  ups_cursor_t *cursor;
+  uint32_t last = 19990;
+  ups_key_t key = ups_make_key(&last, sizeof(last));
+  ups_record_t rec = {0};
+  REQUIRE(0 == ups_cursor_create(&cursor, db, 0, 0));
+  REQUIRE(0 == ups_cursor_find(cursor, &key, &rec, 0));
+
+  LocalEnvironment *lenv = (LocalEnvironment *)env;
+  uint64_t file_size = lenv->device()->file_size();
+  REQUIRE(lenv->page_manager()->compaction_candidate() != 0);
+
+  // move a single page, then all others
+  REQUIRE(1u == lenv->compact(1));
+  uint32_t moved = 1 + lenv->compact(0xffffffff);
+  REQUIRE(moved > 1);
+  REQUIRE(0 == lenv->page_manager()->compaction_candidate());
+  REQUIRE(0u == lenv->compact(0xffffffff));
+
+  // the file is truncated immediately
+  uint64_t half_size = file_size / 2;
+#ifndef WIN32
+  REQUIRE(lenv->device()->file_size() < half_size);
+#endif
+
+  ups_env_metrics_t metrics;
+  REQUIRE(0 == ups_env_get_metrics(env, &metrics));
+  REQUIRE(moved == metrics.page_count_relocated);
+
+  // the cursor was uncoupled from its page, but keeps its position
+  REQUIRE(0 == ups_cursor_move(cursor, &key, &rec, UPS_CURSOR_NEXT));
+  REQUIRE(19991u == *(uint32_t *)key.data);
+  REQUIRE(0 == ups_cursor_close(cursor));
+
+  verifyCompactedDatabase(db);
+  REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+
+  // the file was truncated when it was closed
+  File file;
+  file.open(Utils::opath(".test"), true);
+  REQUIRE(file.file_size() < half_size);
+  file.close();
+
+  REQUIRE(0 == ups_env_open(&env, Utils::opath(".test"), flags, 0));
+  REQUIRE(0 == ups_env_open_db(env, &db, 1, 0, 0));
+  verifyCompactedDatabase(db);
+  REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+}
+
+TEST_CASE("PageManager/compaction", "")
+{
+  compactDatabase(0);
+  compactDatabase(UPS_DISABLE_MMAP);
+  compactDatabase(UPS_ENABLE_TRANSACTIONS);
+}
+
+TEST_CASE("PageManager/compactionStopsAtBlobs", "")
+{
+  ups_env_t *env;
+  ups_db_t *db, *db3;
+  ups_parameter_t env_params[] = {
+    { UPS_PARAM_PAGE_SIZE, 1024 },
+    { 0, 0 }
+  };
+  ups_parameter_t db_params[] = {
+    { UPS_PARAM_KEY_TYPE, UPS_TYPE_UINT32 },
+    { UPS_PARAM_RECORD_SIZE, sizeof(uint32_t) },
+    { 0, 0 }
+  };
+
+  REQUIRE(0 == ups_env_create(&env, Utils::opath(".test"), UPS_DISABLE_MMAP,
+                          0644, env_params));
+  REQUIRE(0 == ups_env_create_db(env, &db, 1, 0, db_params));
+  REQUIRE(0 == ups_env_create_db(env, &db3, 3, 0, 0));
+  fillAndEraseDatabase(env, db);
+
+  // the blob is stored in the last pages of the file
+  std::vector<uint8_t> blob(4000, 'x');
+  uint32_t k = 1;
+  ups_key_t key = ups_make_key(&k, sizeof(k));
+  ups_record_t rec = ups_make_record(&blob[0], (uint32_t)blob.size());
+  REQUIRE(0 == ups_db_insert(db3, 0, &key, &rec, 0));
+
+  // the blob is not moved, and the file cannot shrink; therefore the
+  // btree nodes in front of it are not moved, either
+  LocalEnvironment *lenv = (LocalEnvironment *)env;
+  uint64_t used_size = lenv->device()->used_size();
+  REQUIRE(lenv->page_manager()->compaction_candidate() == used_size - 1024);
+  REQUIRE(0u == lenv->compact(0xffffffff));
+  REQUIRE(used_size == lenv->device()->used_size());
+
+  verifyCompactedDatabase(db);
+  ups_record_t found = {0};
+  REQUIRE(0 == ups_db_find(db3, 0, &key, &found, 0));
+  REQUIRE(found.size == blob.size());
+  REQUIRE(0 == ::memcmp(found.data, &blob[0], blob.size()));
+  REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+}
+
+TEST_CASE("PageManager/compactionMapped", "")
+{
+  ups_env_t *env;
+  ups_db_t *db;
+  ups_parameter_t env_params[] = {
+    { UPS_PARAM_PAGE_SIZE, 4096 },
+    { 0, 0 }
+  };
+  ups_parameter_t db_params[] = {
+    { UPS_PARAM_KEY_TYPE, UPS_TYPE_UINT32 },
+    { UPS_PARAM_RECORD_SIZE, sizeof(uint32_t) },
+    { 0, 0 }
+  };
+
+  REQUIRE(0 == ups_env_create(&env, Utils::opath(".test"), 0, 0644,
+                          env_params));
+  REQUIRE(0 == ups_env_create_db(env, &db, 1, 0, db_params));
+  fillAndEraseDatabase(env, db);
+  REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+
+  // the reopened file is mapped; the mapped memory beyond the new end
+  // of the file is released before the file is truncated
+  REQUIRE(0 == ups_env_open(&env, Utils::opath(".test"), 0, 0));
+  REQUIRE(0 == ups_env_open_db(env, &db, 1, 0, 0));
+  LocalEnvironment *lenv = (LocalEnvironment *)env;
+  uint64_t file_size = lenv->device()->file_size();
+  REQUIRE(lenv->device()->is_mapped(file_size / 2, 4096));
+
+  REQUIRE(lenv->compact(0xffffffff) > 0u);
+#ifndef WIN32
+  REQUIRE(lenv->device()->file_size() < file_size);
+  REQUIRE(!lenv->device()->is_mapped(lenv->device()->file_size(), 4096));
+#endif
+  verifyCompactedDatabase(db);
+  REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+}
+
+TEST_CASE("PageManager/backgroundCompaction", "")
+{
+  ups_env_t *env;
+  ups_db_t *db;
+  ups_parameter_t env_params[] = {
+    { UPS_PARAM_PAGE_SIZE, 1024 },
+    { UPS_PARAM_COMPACTION_RATE, 10000 },
+    { 0, 0 }
+  };
+  ups_parameter_t db_params[] = {
+    { UPS_PARAM_KEY_TYPE, UPS_TYPE_UINT32 },
+    { UPS_PARAM_RECORD_SIZE, sizeof(uint32_t) },
+    { 0, 0 }
+  };
+
+  REQUIRE(0 == ups_env_create(&env, Utils::opath(".test"), UPS_DISABLE_MMAP,
+                          0644, env_params));
+  REQUIRE(0 == ups_env_create_db(env, &db, 1, 0, db_params));
+
+  ups_parameter_t query[] = {
+    { UPS_PARAM_COMPACTION_RATE, 0 },
+    { 0, 0 }
+  };
+  REQUIRE(0 == ups_env_get_parameters(env, query));
+  REQUIRE(10000u == query[0].value);
+
+  fillAndEraseDatabase(env, db);
+
+  // wait till the compaction thread moved the pages
+  LocalEnvironment *lenv = (LocalEnvironment *)env;
+  for (int i = 0; i < 100; i++) {
+    {
+      ScopedWriteLock lock(lenv->mutex());
+      if (lenv->page_manager()->compaction_candidate() == 0)
+        break;
+    }
+    boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+  }
+
+  ups_env_metrics_t metrics;
+  REQUIRE(0 == ups_env_get_metrics(env, &metrics));
+  REQUIRE(metrics.page_count_relocated > 0u);
+
+  verifyCompactedDatabase(db);
+  REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+
+  REQUIRE(0 == ups_env_open(&env, Utils::opath(".test"), 0, 0));
+  REQUIRE(0 == ups_env_open_db(env, &db, 1, 0, 0));
+  verifyCompactedDatabase(db);
+  REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+}
+
+// Holds the Environment's read lock for most of the time; the lock
+// periods of several threads overlap
+static void
+holdReadLock(LocalEnvironment *lenv, boost::atomic<bool> *stop)
+{
+  while (!stop->load()) {
+    ScopedReadLock lock(lenv->mutex());
+    boost::this_thread::sleep(boost::posix_time::milliseconds(2));
+  }
+}
+
+TEST_CASE("PageManager/backgroundCompactionWithReaders", "")
+{
+  ups_env_t *env;
+  ups_db_t *db;
+  ups_parameter_t env_params[] = {
+    { UPS_PARAM_PAGE_SIZE, 1024 },
+    { UPS_PARAM_COMPACTION_RATE, 10000 },
+    { 0, 0 }
+  };
+  ups_parameter_t db_params[] = {
+    { UPS_PARAM_KEY_TYPE, UPS_TYPE_UINT32 },
+    { UPS_PARAM_RECORD_SIZE, sizeof(uint32_t) },
+    { 0, 0 }
+  };
+
+  REQUIRE(0 == ups_env_create(&env, Utils::opath(".test"), UPS_DISABLE_MMAP,
+                          0644, env_params));
+  REQUIRE(0 == ups_env_create_db(env, &db, 1, 0, db_params));
+  fillAndEraseDatabase(env, db);
+
+  // the Environment is never idle, but the compaction is not starved
+  LocalEnvironment *lenv = (LocalEnvironment *)env;
+  boost::atomic<bool> stop(false);
+  std::vector<Thread *> threads;
+  for (int i = 0; i < 2; i++)
+    threads.push_back(new Thread(boost::bind(&holdReadLock, lenv, &stop)));
+
+  // the machine can be busy with other tests; wait up to 20 seconds
+  ups_env_metrics_t metrics;
+  for (int i = 0; i < 400; i++) {
+    {
+      ScopedReadLock lock(lenv->mutex());
+      if (lenv->page_manager()->compaction_candidate() == 0)
+        break;
+    }
+    boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+  }
+
+  stop = true;
+  for (size_t i = 0; i < threads.size(); i++) {
+    threads[i]->join();
+    delete threads[i];
+  }
+
+  // close the Environment before checking the results; otherwise a failure
+  // keeps the file locked for the following tests
+  int st = ups_env_get_metrics(env, &metrics);
+  verifyCompactedDatabase(db);
+  REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+  REQUIRE(0 == st);
+  REQUIRE(metrics.page_count_relocated > 0u);
+}
+
 TEST_CASE("PageManager/storeStateTest", "")
 {
   PageManagerFixture f(false, 16 * UPS_DEFAULT_PAGE_SIZE);
@@ -50,6 +50,57 @@ custom_compare_func(ups_db_t *db,
   return (::memcmp(lhs, rhs, lhs_length));
 }
 
+// Looks up |count| keys, then walks over all keys with a cursor
+static void
+findAll(ups_db_t *db, int count, bool *result)
+{
+  *result = true;
+  for (int i = 0; i < count; i++) {
+    char buffer[200] = {0};
+    ::sprintf(buffer, "%08d", i);
+    ups_key_t key = ups_make_key(buffer, sizeof(buffer));
+    ups_record_t rec = {0};
+    if (ups_db_find(db, 0, &key, &rec, 0)
+        || rec.size != sizeof(i)
+        || *(int *)rec.data != i)
+      *result = false;
+  }
+
+  ups_cursor_t *cursor;
+  if (ups_cursor_create(&cursor, db, 0, 0)) {
+    *result = false;
+    return;
+  }
+  ups_key_t key = {0};
+  ups_record_t rec = {0};
+  int i = 0;
+  while (0 == ups_cursor_move(cursor, &key, &rec, UPS_CURSOR_NEXT)) {
+    if (*(int *)rec.data != i)
+      *result = false;
+    i++;
+  }
+  if (i != count)
+    *result = false;
+  ups_cursor_close(cursor);
+}
+
+// Looks up |count| keys
+static void
+findKeys(ups_db_t *db, int count, bool *result)
+{
+  *result = true;
+  for (int i = 0; i < count; i++) {
+    char buffer[200] = {0};
+    ::sprintf(buffer, "%08d", i);
+    ups_key_t key = ups_make_key(buffer, sizeof(buffer));
+    ups_record_t rec = {0};
+    if (ups_db_find(db, 0, &key, &rec, 0)
+        || rec.size != sizeof(i)
+        || *(int *)rec.data != i)
+      *result = false;
+  }
+}
+
 struct my_key_t {
   int32_t val1;
   uint32_t val2;
@@ -1997,6 +2048,158 @@ struct UpscaledbFixture {
     REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
   }
 
+  void workerThreadsTest() {
+    ups_env_t *env;
+    ups_db_t *db;
+    ups_parameter_t pin[] = {
+        {UPS_PARAM_WORKER_THREADS, 4},
+        {UPS_PARAM_CACHE_SIZE, 64 * 1024},
+        {0, 0}
+    };
+    ups_parameter_t pout[] = {
+        {UPS_PARAM_WORKER_THREADS, 0},
+        {0, 0}
+    };
+
+    // at least one worker thread is required
+    REQUIRE(UPS_INV_PARAMETER == ups_env_create(&env, Utils::opath("test.db"),
+                            0, 0, &pout[0]));
+
+    REQUIRE(0 == ups_env_create(&env, Utils::opath("test.db"),
+                            0, 0, &pin[0]));
+    REQUIRE(0 == ups_env_get_parameters(env, &pout[0]));
+    REQUIRE(4u == pout[0].value);
+    REQUIRE(0 == ups_env_create_db(env, &db, 1, 0, 0));
+
+    // fill the cache; the dirty pages are flushed by multiple threads
+    std::vector<uint8_t> buffer(1024);
+    for (int i = 0; i < 2000; i++) {
+      ups_key_t key = ups_make_key(&i, sizeof(i));
+      ups_record_t rec = ups_make_record(&buffer[0], (uint32_t)buffer.size());
+      REQUIRE(0 == ups_db_insert(db, 0, &key, &rec, 0));
+    }
+
+    ups_env_metrics_t metrics;
+    REQUIRE(0 == ups_env_get_metrics(env, &metrics));
+    REQUIRE(4u == metrics.worker_threads);
+    REQUIRE(metrics.worker_max_queue_depth > 0u);
+    REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+
+    // reopen with the default settings and verify the data
+    REQUIRE(0 == ups_env_open(&env, Utils::opath("test.db"), 0, 0));
+    REQUIRE(0 == ups_env_get_parameters(env, &pout[0]));
+    REQUIRE(1u == pout[0].value);
+    REQUIRE(0 == ups_env_open_db(env, &db, 1, 0, 0));
+    for (int i = 0; i < 2000; i++) {
+      ups_key_t key = ups_make_key(&i, sizeof(i));
+      ups_record_t rec = {0};
+      REQUIRE(0 == ups_db_find(db, 0, &key, &rec, 0));
+      REQUIRE(rec.size == (uint32_t)buffer.size());
+    }
+    REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+  }
+
+  void concurrentFindTest() {
+    const int kThreads = 4;
+    const int kKeys = 2000;
+    ups_env_t *env;
+    ups_db_t *db;
+    ups_parameter_t params[] = {
+        {UPS_PARAM_CACHE_SIZE, 64 * 1024},
+        {0, 0}
+    };
+
+    // a small cache, therefore the readers also purge the cache
+    REQUIRE(0 == ups_env_create(&env, Utils::opath("test.db"),
+                            0, 0, &params[0]));
+    REQUIRE(0 == ups_env_create_db(env, &db, 1, 0, 0));
+
+    // the keys are stored as extended keys
+    for (int i = 0; i < kKeys; i++) {
+      char buffer[200] = {0};
+      ::sprintf(buffer, "%08d", i);
+      ups_key_t key = ups_make_key(buffer, sizeof(buffer));
+      ups_record_t rec = ups_make_record(&i, sizeof(i));
+      REQUIRE(0 == ups_db_insert(db, 0, &key, &rec, 0));
+    }
+
+    bool results[kThreads];
+    std::vector<Thread *> threads;
+    for (int i = 0; i < kThreads; i++)
+      threads.push_back(new Thread(boost::bind(&findAll, db, kKeys,
+                                  &results[i])));
+    for (int i = 0; i < kThreads; i++) {
+      threads[i]->join();
+      delete threads[i];
+      REQUIRE(results[i] == true);
+    }
+
+    REQUIRE(0 == ups_db_check_integrity(db, 0));
+    REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+  }
+
+  // Without Transactions, a writer only locks its own Database; the
+  // readers of other Databases are not blocked
+  void concurrentFindOtherDatabaseTest() {
+    const int kThreads = 4;
+    const int kKeys = 2000;
+    ups_env_t *env;
+    ups_db_t *db1, *db2;
+    ups_parameter_t params[] = {
+        {UPS_PARAM_CACHE_SIZE, 64 * 1024},
+        {0, 0}
+    };
+
+    REQUIRE(0 == ups_env_create(&env, Utils::opath("test.db"),
+                            0, 0, &params[0]));
+    REQUIRE(0 == ups_env_create_db(env, &db1, 1, 0, 0));
+    REQUIRE(0 == ups_env_create_db(env, &db2, 2, 0, 0));
+
+    for (int i = 0; i < kKeys; i++) {
+      char buffer[200] = {0};
+      ::sprintf(buffer, "%08d", i);
+      ups_key_t key = ups_make_key(buffer, sizeof(buffer));
+      ups_record_t rec = ups_make_record(&i, sizeof(i));
+      REQUIRE(0 == ups_db_insert(db1, 0, &key, &rec, 0));
+    }
+
+    bool results[kThreads];
+
+    // a lookup in |db1| completes while |db2| is locked by a writer
+    {
+      ScopedDatabaseWriteLock lock((Database *)db2);
+      Thread thread(boost::bind(&findKeys, db1, kKeys, &results[0]));
+      REQUIRE(true == thread.timed_join(boost::posix_time::seconds(30)));
+      REQUIRE(true == results[0]);
+    }
+
+    // the readers of |db1| run while the main thread writes to |db2|
+    std::vector<Thread *> threads;
+    for (int i = 0; i < kThreads; i++)
+      threads.push_back(new Thread(boost::bind(&findKeys, db1, kKeys,
+                                  &results[i])));
+
+    for (int i = 0; i < kKeys; i++) {
+      char buffer[200] = {0};
+      ::sprintf(buffer, "%08d", i);
+      ups_key_t key = ups_make_key(buffer, sizeof(buffer));
+      ups_record_t rec = ups_make_record(&i, sizeof(i));
+      REQUIRE(0 == ups_db_insert(db2, 0, &key, &rec, 0));
+    }
+
+    for (int i = 0; i < kThreads; i++) {
+      threads[i]->join();
+      delete threads[i];
+      REQUIRE(results[i] == true);
+    }
+
+    findKeys(db2, kKeys, &results[0]);
+    REQUIRE(true == results[0]);
+    REQUIRE(0 == ups_db_check_integrity(db1, 0));
+    REQUIRE(0 == ups_db_check_integrity(db2, 0));
+    REQUIRE(0 == ups_env_close(env, UPS_AUTO_CLEANUP));
+  }
+
   // Open an existing environment and use the ErrorInducer for a failure in
   // mmap. Make sure that the fallback to read() works
   void issue55Test() {
@@ -2710,6 +2913,24 @@ TEST_CASE("Upscaledb/posixFadviseTest", "")
   f.posixFadviseTest();
 }
 
+TEST_CASE("Upscaledb/workerThreadsTest", "")
+{
+  UpscaledbFixture f;
+  f.workerThreadsTest();
+}
+
+TEST_CASE("Upscaledb/concurrentFindTest", "")
+{
+  UpscaledbFixture f;
+  f.concurrentFindTest();
+}
+
+TEST_CASE("Upscaledb/concurrentFindOtherDatabaseTest", "")
+{
+  UpscaledbFixture f;
+  f.concurrentFindOtherDatabaseTest();
+}
+
 TEST_CASE("Upscaledb/issue55Test", "")
 {
   UpscaledbFixture f;